@@ -37,8 +37,13 @@
 #include <signal.h>
 #include <termio.h>
 #include <limits.h>
+#include <errno.h>
+#include <sys/eventfd.h>
 #include "timeline_trace_file.hpp"
 #include "global_managers.hpp"
+#include "thread_name.hpp"
+#include "thread_priority.hpp"
+#include "timer.hpp"
 
 namespace Granite
 {
@@ -266,7 +271,8 @@ bool LinuxInputManager::add_device(int fd, DeviceType type, const char *devnode,
 	}
 
 	dev->fd = fd;
-	event.data.ptr = dev.get();
+	dev->id = next_device_id++;
+	event.data.u64 = dev->id;
 	event.events = EPOLLIN;
 
 	if (type == DeviceType::Joystick)
@@ -275,6 +281,8 @@ bool LinuxInputManager::add_device(int fd, DeviceType type, const char *devnode,
 		setup_joypad_remapper(fd, dev->joystate.index);
 	}
 
+	// The input thread looks up devices by ID as soon as the FD is signalled.
+	std::lock_guard<std::mutex> holder{device_lock};
 	if (epoll_ctl(queue_fd, EPOLL_CTL_ADD, fd, &event) < 0)
 	{
 		LOGE("Failed to add FD to epoll.\n");
@@ -285,6 +293,14 @@ bool LinuxInputManager::add_device(int fd, DeviceType type, const char *devnode,
 	return true;
 }
 
+LinuxInputManager::Device *LinuxInputManager::find_device(uint32_t id) const
+{
+	for (auto &dev : devices)
+		if (dev->id == id)
+			return dev.get();
+	return nullptr;
+}
+
 bool LinuxInputManager::hotplug_available()
 {
 	struct pollfd fds = {};
@@ -373,23 +389,33 @@ bool LinuxInputManager::poll()
 	while (hotplug_available())
 		handle_hotplug();
 
+	if (input_thread.joinable())
+	{
+		drain_event_ring();
+		return true;
+	}
+
 	int ret;
 	epoll_event events[32];
 	while ((ret = epoll_wait(queue_fd, events, 32, 0)) > 0)
 	{
+		int64_t arrival_time = Util::get_current_time_nsecs();
 		for (int i = 0; i < ret; i++)
 		{
 			if (events[i].events & EPOLLIN)
 			{
 				struct input_event input_events[32];
-				auto &device = *static_cast<Device *>(events[i].data.ptr);
+				auto *device = find_device(uint32_t(events[i].data.u64));
+				if (!device)
+					continue;
 
 				ssize_t len;
-				while ((len = read(device.fd, input_events, 32)) > 0)
+				while ((len = read(device->fd, input_events, sizeof(input_events))) > 0)
 				{
 					len /= sizeof(input_events[0]);
 					for (ssize_t j = 0; j < len; j++)
-						(this->*device.callback)(device, input_events[j]);
+						(this->*device->callback)(*device, input_events[j]);
+					last_event_arrival_time = arrival_time;
 				}
 			}
 		}
@@ -398,8 +424,128 @@ bool LinuxInputManager::poll()
 	return true;
 }
 
+void LinuxInputManager::drain_event_ring()
+{
+	QueuedEvent queued[64];
+	Device *device = nullptr;
+	size_t count;
+
+	// Only this thread modifies devices, so lookups do not need the lock.
+	while ((count = std::min<size_t>(event_ring.read_avail(), 64)) != 0)
+	{
+		event_ring.read_and_move(queued, count);
+		for (size_t i = 0; i < count; i++)
+		{
+			auto &q = queued[i];
+			if (!device || device->id != q.device_id)
+				device = find_device(q.device_id);
+
+			// Events from a device which was unplugged after they were queued are dropped.
+			if (device)
+			{
+				(this->*device->callback)(*device, q.event);
+				last_event_arrival_time = q.arrival_time;
+			}
+		}
+	}
+}
+
+void LinuxInputManager::input_thread_main()
+{
+	Util::set_current_thread_name("input-thread");
+	Util::set_current_thread_priority(Util::ThreadPriority::High);
+
+	epoll_event events[32];
+	input_event input_events[32];
+	QueuedEvent queued[32];
+
+	while (input_thread_running.load(std::memory_order_acquire))
+	{
+		int ret = epoll_wait(queue_fd, events, 32, -1);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			LOGE("epoll_wait failed in input thread.\n");
+			break;
+		}
+
+		// One timestamp per wakeup, this is as close to arrival as user space can observe.
+		int64_t arrival_time = Util::get_current_time_nsecs();
+
+		std::lock_guard<std::mutex> holder{device_lock};
+		for (int i = 0; i < ret; i++)
+		{
+			// ID 0 is the wake FD, the loop condition picks up shutdown requests.
+			auto id = uint32_t(events[i].data.u64);
+			if (id == 0 || (events[i].events & EPOLLIN) == 0)
+				continue;
+
+			auto *device = find_device(id);
+			if (!device)
+				continue;
+
+			ssize_t len;
+			while ((len = read(device->fd, input_events, sizeof(input_events))) > 0)
+			{
+				size_t count = size_t(len) / sizeof(input_events[0]);
+				for (size_t j = 0; j < count; j++)
+					queued[j] = { id, input_events[j], arrival_time };
+
+				// Never block on the consumer. If the main thread stalls for thousands of events, drop the newest ones.
+				size_t to_write = std::min<size_t>(count, event_ring.write_avail());
+				event_ring.write_and_move(queued, to_write);
+				if (to_write < count)
+					dropped_events.fetch_add(count - to_write, std::memory_order_relaxed);
+			}
+		}
+	}
+}
+
+bool LinuxInputManager::start_input_thread()
+{
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wake_fd < 0)
+		return false;
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.u64 = 0;
+	if (epoll_ctl(queue_fd, EPOLL_CTL_ADD, wake_fd, &event) < 0)
+	{
+		close(wake_fd);
+		wake_fd = -1;
+		return false;
+	}
+
+	event_ring.reset(QueuedEventCount);
+	input_thread_running.store(true, std::memory_order_release);
+	input_thread = std::thread(&LinuxInputManager::input_thread_main, this);
+	return true;
+}
+
+void LinuxInputManager::stop_input_thread()
+{
+	if (input_thread.joinable())
+	{
+		input_thread_running.store(false, std::memory_order_release);
+		uint64_t value = 1;
+		if (write(wake_fd, &value, sizeof(value)) < 0)
+			LOGE("Failed to wake up input thread.\n");
+		input_thread.join();
+	}
+
+	if (wake_fd >= 0)
+	{
+		close(wake_fd);
+		wake_fd = -1;
+	}
+}
+
 void LinuxInputManager::remove_device(const char *devnode)
 {
+	// Closing the FD removes it from the epoll set. Holding the lock ensures the input thread is not reading from it.
+	std::lock_guard<std::mutex> holder{device_lock};
 	auto itr = Util::unstable_remove_if(begin(devices), end(devices), [=](const std::unique_ptr<Device> &dev) {
 		return dev->devnode == devnode;
 	});
@@ -669,6 +815,9 @@ bool LinuxInputManager::init(LinuxInputManagerFlags flags_, InputTracker *tracke
 		return false;
 	}
 
+	if ((flags & LINUX_INPUT_MANAGER_INPUT_THREAD_BIT) && !start_input_thread())
+		LOGW("Failed to start input thread, falling back to polling.\n");
+
 	if ((flags & LINUX_INPUT_MANAGER_KEYBOARD_BIT) &&
 	    !enqueue_open_devices(DeviceType::Keyboard, &LinuxInputManager::input_handle_keyboard))
 	{
@@ -702,6 +851,8 @@ bool LinuxInputManager::init(LinuxInputManagerFlags flags_, InputTracker *tracke
 
 LinuxInputManager::~LinuxInputManager()
 {
+	stop_input_thread();
+
 	for (auto &init : deferred_init)
 		if (init.task)
 			init.task->wait();
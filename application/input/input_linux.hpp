@@ -27,8 +27,12 @@
 #include <functional>
 #include <vector>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include "input.hpp"
 #include "thread_group.hpp"
+#include "message_queue.hpp"
 
 namespace Granite
 {
@@ -37,7 +41,12 @@ enum LinuxInputManagerFlagBits
 	LINUX_INPUT_MANAGER_KEYBOARD_BIT = 1 << 0,
 	LINUX_INPUT_MANAGER_MOUSE_BIT = 1 << 1,
 	LINUX_INPUT_MANAGER_TOUCHPAD_BIT = 1 << 2,
-	LINUX_INPUT_MANAGER_JOYPAD_BIT = 1 << 3
+	LINUX_INPUT_MANAGER_JOYPAD_BIT = 1 << 3,
+	// Reads devices on a dedicated thread which blocks on the epoll set.
+	// Events are timestamped on arrival and handed to poll() through a lock-free queue,
+	// so poll() never enters the kernel for device reads and can be called again
+	// right before submission to late-latch input.
+	LINUX_INPUT_MANAGER_INPUT_THREAD_BIT = 1 << 4
 };
 using LinuxInputManagerFlags = uint32_t;
 
@@ -49,6 +58,18 @@ public:
 	~LinuxInputManager();
 	bool poll();
 
+	// Arrival time (Util::get_current_time_nsecs()) of the most recently dispatched event.
+	// Only meaningful with LINUX_INPUT_MANAGER_INPUT_THREAD_BIT, otherwise it is the time of the last poll() which saw input.
+	int64_t get_last_event_arrival_time() const
+	{
+		return last_event_arrival_time;
+	}
+
+	uint64_t get_dropped_event_count() const
+	{
+		return dropped_events.load(std::memory_order_relaxed);
+	}
+
 	LinuxInputManager(LinuxInputManager &&) = delete;
 	void operator=(const LinuxInputManager &) = delete;
 
@@ -58,6 +79,8 @@ private:
 	struct udev *udev = nullptr;
 	struct udev_monitor *udev_monitor = nullptr;
 	int queue_fd = -1;
+	int wake_fd = -1;
+	int64_t last_event_arrival_time = 0;
 
 	enum class DeviceType
 	{
@@ -90,8 +113,30 @@ private:
 		std::string devnode;
 		JoypadState joystate;
 		InputTracker *tracker = nullptr;
+		uint32_t id = 0;
 	};
 	std::vector<std::unique_ptr<Device>> devices;
+	uint32_t next_device_id = 1;
+	Device *find_device(uint32_t id) const;
+
+	// Input thread state. devices and device FDs are only modified with device_lock held
+	// when the input thread is running, the thread holds it while reading.
+	struct QueuedEvent
+	{
+		uint32_t device_id;
+		input_event event;
+		int64_t arrival_time;
+	};
+	enum { QueuedEventCount = 4096 };
+	Util::LockFreeRingBuffer<QueuedEvent> event_ring;
+	std::thread input_thread;
+	std::mutex device_lock;
+	std::atomic_bool input_thread_running{false};
+	std::atomic_uint64_t dropped_events{0};
+	bool start_input_thread();
+	void stop_input_thread();
+	void input_thread_main();
+	void drain_event_ring();
 
 	bool enqueue_open_devices(DeviceType type, InputCallback callback);
 	bool add_device(int fd, DeviceType type, const char *devnode, InputCallback callback);
@@ -180,9 +180,10 @@ public:
 		png_readback = std::move(base_path);
 	}
 
-	void enable_video_encode(std::string path)
+	void enable_video_encode(std::string path, bool yuv420)
 	{
 		video_encode_path = std::move(path);
+		video_encode_yuv420 = yuv420;
 #ifndef HAVE_GRANITE_FFMPEG
 		LOGE("HAVE_GRANITE_FFMPEG is not defined. Video encode not supported.\n");
 #endif
@@ -311,6 +312,8 @@ public:
 			VideoEncoder::Options enc_opts = {};
 			enc_opts.width = width;
 			enc_opts.height = height;
+			if (video_encode_yuv420)
+				enc_opts.subsampling = ChromaSubsampling::Chroma420;
 
 			double frame_rate = std::round(1.0 / time_step);
 			enc_opts.frame_timebase.num = 1;
@@ -458,6 +461,7 @@ private:
 	double time_step = 0.01;
 	std::string png_readback;
 	std::string video_encode_path;
+	bool video_encode_yuv420 = false;
 	enum { SwapchainImages = 4 };
 
 	std::vector<ImageHandle> swapchain_images;
@@ -502,7 +506,7 @@ static void print_help()
 {
 	LOGI("[--png-path <path>] [--stat <output.json>]\n"
 	     "[--fs-assets <path>] [--fs-cache <path>] [--fs-builtin <path>]\n"
-	     "[--video-encode-path <path>]\n"
+	     "[--video-encode-path <path>] [--video-encode-yuv420]\n"
 	     "[--png-reference-path <path>] [--frames <frames>] [--width <width>] [--height <height>] [--time-step <step>].\n");
 }
 
@@ -526,6 +530,7 @@ int application_main_headless(Application *(*create_application)(int, char **),
 		unsigned width = 1280;
 		unsigned height = 720;
 		double time_step = 0.01;
+		bool video_encode_yuv420 = false;
 	} args;
 
 	CLICallbacks cbs;
@@ -536,6 +541,7 @@ int application_main_headless(Application *(*create_application)(int, char **),
 	cbs.add("--png-path", [&](CLIParser &parser) { args.png_path = parser.next_string(); });
 	cbs.add("--png-reference-path", [&](CLIParser &parser) { args.png_reference_path = parser.next_string(); });
 	cbs.add("--video-encode-path", [&](CLIParser &parser) { args.video_encode_path = parser.next_string(); });
+	cbs.add("--video-encode-yuv420", [&](CLIParser &) { args.video_encode_yuv420 = true; });
 	cbs.add("--fs-assets", [&](CLIParser &parser) { args.assets = parser.next_string(); });
 	cbs.add("--fs-builtin", [&](CLIParser &parser) { args.builtin = parser.next_string(); });
 	cbs.add("--fs-cache", [&](CLIParser &parser) { args.cache = parser.next_string(); });
@@ -576,7 +582,7 @@ int application_main_headless(Application *(*create_application)(int, char **),
 		if (!args.png_path.empty())
 			p->enable_png_readback(args.png_path);
 		if (!args.video_encode_path.empty())
-			p->enable_video_encode(args.video_encode_path);
+			p->enable_video_encode(args.video_encode_path, args.video_encode_yuv420);
 		p->set_max_frames(args.max_frames);
 		p->set_time_step(args.time_step);
 		p->init_headless(app.get());
@@ -461,7 +461,7 @@ SceneViewerApplication::SceneViewerApplication(const std::string &path, const st
 		auto *update = entity->allocate_component<PerFrameUpdateComponent>();
 		// Must come before clusterer since we're modifying volumetric light textures,
 		// which will affect clustering, since it writes new descriptors.
-		update->dependency_order = -1;
+		update->set_dependency_order(*entity, -1);
 		update->refresh = volumetric_diffuse.get();
 
 		volumetric_diffuse->set_fallback_render_context(&fallback_depth_context);
@@ -23,6 +23,11 @@ vec4 FsrEasuBF(vec2 p) { return textureGather(uTex, p, 2); }
 #include "ffx_fsr1.h"
 #include "../../inc/srgb.h"
 
+#pragma spec_define TARGET_SRGB
+#ifndef TARGET_SRGB
+#define TARGET_SRGB 0
+#endif
+
 layout(location = 0) out vec4 FragColor;
 layout(location = 0) in vec2 vUV;
 
@@ -43,9 +48,8 @@ void main()
 	FsrEasuF(color, uvec2(vUV), param0, param1, param2, param3);
 #endif
 
-#if TARGET_SRGB
-	color = decode_srgb(color);
-#endif
+	if (TARGET_SRGB != 0)
+		color = decode_srgb(color);
 
 	FragColor = vec4(color, 1.0);
 }
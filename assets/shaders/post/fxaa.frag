@@ -4,6 +4,11 @@ precision highp int;
 
 #include "../inc/srgb.h"
 
+#pragma spec_define FXAA_TARGET_SRGB
+#ifndef FXAA_TARGET_SRGB
+#define FXAA_TARGET_SRGB 0
+#endif
+
 const float FXAA_REDUCE_MIN = 1.0 / 128.0;
 const float FXAA_REDUCE_MUL = 1.0 / 8.0;
 const float FXAA_SPAN_MAX = 8.0;
@@ -57,11 +62,10 @@ void main()
     else
         color = rgbB;
 
-#if FXAA_TARGET_SRGB
     // We're writing to an sRGB target, so need to decode UNORM to sRGB
     // (only to have it be converted back again to UNORM) ...
-    FragColor = decode_srgb(color);
-#else
-    FragColor = color;
-#endif
+    if (FXAA_TARGET_SRGB != 0)
+        FragColor = decode_srgb(color);
+    else
+        FragColor = color;
 }
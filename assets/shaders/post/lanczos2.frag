@@ -2,6 +2,11 @@
 
 #include "../inc/srgb.h"
 
+#pragma spec_define TARGET_SRGB
+#ifndef TARGET_SRGB
+#define TARGET_SRGB 0
+#endif
+
 layout(location = 0) out vec4 FragColor;
 layout(location = 0) in vec2 vUV;
 layout(set = 0, binding = 0) uniform sampler2D uTex;
@@ -68,9 +73,8 @@ void main()
 
     color /= total_w;
 
-#if TARGET_SRGB
-    color = decode_srgb(color);
-#endif
+    if (TARGET_SRGB != 0)
+        color = decode_srgb(color);
 
     FragColor = vec4(color, 1.0);
 }
\ No newline at end of file
@@ -6,6 +6,11 @@ precision highp int;
 #include "smaa_common.h"
 #include "../inc/srgb.h"
 
+#pragma spec_define SMAA_TARGET_SRGB
+#ifndef SMAA_TARGET_SRGB
+#define SMAA_TARGET_SRGB 0
+#endif
+
 layout(set = 0, binding = 0) uniform sampler2D ColorTex;
 layout(set = 0, binding = 1) uniform sampler2D BlendTex;
 
@@ -16,7 +21,6 @@ layout(location = 0) out vec4 Color;
 void main()
 {
     Color = SMAANeighborhoodBlendingPS(vTex, vOffset, ColorTex, BlendTex);
-#if SMAA_TARGET_SRGB
-    Color.rgb = decode_srgb(Color.rgb);
-#endif
+    if (SMAA_TARGET_SRGB != 0)
+        Color.rgb = decode_srgb(Color.rgb);
 }
@@ -27,6 +27,9 @@
 #include "string_helpers.hpp"
 
 #include "spirv-tools/libspirv.hpp"
+#include "spirv-tools/optimizer.hpp"
+#include <algorithm>
+#include <stdlib.h>
 
 namespace Granite
 {
@@ -72,9 +75,123 @@ static Stage convert_stage(const std::string &stage)
 		return Stage::Unknown;
 }
 
+struct GLSLSourceCache::PreprocessedSource
+{
+	struct Section
+	{
+		Stage stage;
+		std::string source;
+	};
+	std::vector<Section> sections;
+	std::vector<std::string> pragmas;
+	std::string source_path;
+	std::vector<std::string> dependencies;
+	GLSLCompiler::Optimization optimization;
+	bool overrides_optimization;
+};
+
+GLSLSourceCache &GLSLSourceCache::get_default()
+{
+	static GLSLSourceCache cache;
+	return cache;
+}
+
+bool GLSLSourceCache::load_text_file(FilesystemInterface &iface, const std::string &path, std::string &text)
+{
+	{
+		std::lock_guard<std::mutex> holder{lock};
+		auto itr = files.find(path);
+		if (itr != files.end() && itr->second.iface == &iface)
+		{
+			stats.file_hits++;
+			text = itr->second.text;
+			return true;
+		}
+		stats.file_misses++;
+	}
+
+	// Missing files are not cached. A file can be created later in a directory which is not watched,
+	// e.g. an include directory which was only probed, and we would never learn about it.
+	if (!iface.load_text_file(path, text))
+		return false;
+
+	std::lock_guard<std::mutex> holder{lock};
+	files[path] = { &iface, text };
+	return true;
+}
+
+void GLSLSourceCache::invalidate(const std::string &path)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	files.erase(path);
+
+	for (auto itr = preprocessed.begin(); itr != preprocessed.end(); )
+	{
+		auto &deps = itr->second->dependencies;
+		if (itr->second->source_path == path || std::find(deps.begin(), deps.end(), path) != deps.end())
+			itr = preprocessed.erase(itr);
+		else
+			++itr;
+	}
+}
+
+void GLSLSourceCache::clear()
+{
+	std::lock_guard<std::mutex> holder{lock};
+	files.clear();
+	preprocessed.clear();
+}
+
+GLSLSourceCache::Statistics GLSLSourceCache::get_statistics() const
+{
+	std::lock_guard<std::mutex> holder{lock};
+	return stats;
+}
+
+void GLSLSourceCache::reset_statistics()
+{
+	std::lock_guard<std::mutex> holder{lock};
+	stats = {};
+}
+
+std::shared_ptr<const GLSLSourceCache::PreprocessedSource> GLSLSourceCache::find_preprocessed(Util::Hash key)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	auto itr = preprocessed.find(key);
+	if (itr != preprocessed.end())
+	{
+		stats.preprocess_hits++;
+		return itr->second;
+	}
+	else
+	{
+		stats.preprocess_misses++;
+		return {};
+	}
+}
+
+void GLSLSourceCache::insert_preprocessed(Util::Hash key, std::shared_ptr<const PreprocessedSource> source_)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	preprocessed[key] = std::move(source_);
+}
+
+void GLSLCompiler::set_source_cache(GLSLSourceCache *cache)
+{
+	source_cache = cache;
+}
+
+bool GLSLCompiler::load_text_file(const std::string &path, std::string &text)
+{
+	if (source_cache)
+		return source_cache->load_text_file(iface, path, text);
+	else
+		return iface.load_text_file(path, text);
+}
+
 bool GLSLCompiler::set_source_from_file(const std::string &path, Stage forced_stage)
 {
-	if (!iface.load_text_file(path, source))
+	if (!load_text_file(path, source))
 	{
 		LOGE("Failed to load shader: %s\n", path.c_str());
 		return false;
@@ -92,7 +209,7 @@ bool GLSLCompiler::set_source_from_file(const std::string &path, Stage forced_st
 
 bool GLSLCompiler::set_source_from_file_multistage(const std::string &path)
 {
-	if (iface.load_text_file(path, source))
+	if (load_text_file(path, source))
 	{
 		LOGE("Failed to load shader: %s\n", path.c_str());
 		return false;
@@ -112,7 +229,7 @@ bool GLSLCompiler::find_include_path(const std::string &source_path_, const std:
                                      std::string &included_path, std::string &included_source)
 {
 	auto relpath = Path::relpath(source_path_, include_path);
-	if (iface.load_text_file(relpath, included_source))
+	if (load_text_file(relpath, included_source))
 	{
 		included_path = relpath;
 		return true;
@@ -123,7 +240,7 @@ bool GLSLCompiler::find_include_path(const std::string &source_path_, const std:
 		for (auto &include_dir : *include_directories)
 		{
 			auto path = Path::join(include_dir, include_path);
-			if (iface.load_text_file(path, included_source))
+			if (load_text_file(path, included_source))
 			{
 				included_path = path;
 				return true;
@@ -171,12 +288,14 @@ bool GLSLCompiler::parse_variants(const std::string &source_, const std::string
 		else if (line.find("#pragma optimize off") == 0)
 		{
 			optimization = Optimization::ForceOff;
+			optimization_pragma = true;
 			preprocessed_source += "// #pragma optimize off";
 			preprocessed_source += '\n';
 		}
 		else if (line.find("#pragma optimize on") == 0)
 		{
 			optimization = Optimization::ForceOn;
+			optimization_pragma = true;
 			preprocessed_source += "// #pragma optimize on";
 			preprocessed_source += '\n';
 		}
@@ -229,8 +348,29 @@ bool GLSLCompiler::preprocess()
 	preprocessed_source.clear();
 	pragmas.clear();
 	preprocessed_sections.clear();
+	dependencies.clear();
+	spec_defines.clear();
 	preprocessing_active_stage = Stage::Unknown;
 
+	Util::Hash key = 0;
+	if (source_cache)
+	{
+		key = get_preprocess_key();
+		auto cached = source_cache->find_preprocessed(key);
+		if (cached)
+		{
+			for (auto &section : cached->sections)
+				preprocessed_sections.push_back({ section.stage, section.source });
+			pragmas = cached->pragmas;
+			dependencies.insert(cached->dependencies.begin(), cached->dependencies.end());
+			if (cached->overrides_optimization)
+				optimization = cached->optimization;
+			parse_spec_defines();
+			return true;
+		}
+	}
+
+	optimization_pragma = false;
 	bool ret = parse_variants(source, source_path);
 
 	if (ret && !preprocessed_source.empty())
@@ -239,9 +379,88 @@ bool GLSLCompiler::preprocess()
 		preprocessed_source = {};
 	}
 
+	if (ret)
+		parse_spec_defines();
+
+	if (ret && source_cache)
+	{
+		auto result = std::make_shared<GLSLSourceCache::PreprocessedSource>();
+		for (auto &section : preprocessed_sections)
+			result->sections.push_back({ section.stage, section.source });
+		result->pragmas = pragmas;
+		result->source_path = source_path;
+		result->dependencies.insert(result->dependencies.end(), dependencies.begin(), dependencies.end());
+		result->optimization = optimization;
+		result->overrides_optimization = optimization_pragma;
+		source_cache->insert_preprocessed(key, std::move(result));
+	}
+
 	return ret;
 }
 
+void GLSLCompiler::parse_spec_defines()
+{
+	spec_defines.clear();
+	for (auto &pragma : pragmas)
+	{
+		if (pragma.find("spec_define ") != 0)
+			continue;
+
+		auto name = pragma.substr(12);
+		auto first = name.find_first_not_of(" \t");
+		auto last = name.find_last_not_of(" \t\r");
+		if (first == std::string::npos)
+			continue;
+		name = name.substr(first, last - first + 1);
+
+		if (find_spec_define(name) < 0)
+			spec_defines.push_back(std::move(name));
+	}
+}
+
+int GLSLCompiler::find_spec_define(const std::string &name) const
+{
+	auto itr = std::find(spec_defines.begin(), spec_defines.end(), name);
+	return itr != spec_defines.end() ? int(itr - spec_defines.begin()) : -1;
+}
+
+void GLSLCompiler::split_spec_defines(const std::vector<std::pair<std::string, int>> *defines,
+                                      std::vector<std::pair<std::string, int>> &regular_defines,
+                                      std::vector<std::pair<std::string, int>> &spec_define_values) const
+{
+	regular_defines.clear();
+	spec_define_values.clear();
+	if (!defines)
+		return;
+
+	for (auto &define : *defines)
+	{
+		if (find_spec_define(define.first) >= 0)
+			spec_define_values.push_back(define);
+		else
+			regular_defines.push_back(define);
+	}
+}
+
+Util::Hash GLSLCompiler::get_preprocess_key() const
+{
+	// Includes resolve relative to the source path and include directories,
+	// so both are part of the key along with the source itself.
+	Util::Hasher h;
+	h.pointer(&iface);
+	h.string(source_path);
+	h.string(source);
+	if (include_directories)
+	{
+		h.u32(uint32_t(include_directories->size()));
+		for (auto &dir : *include_directories)
+			h.string(dir);
+	}
+	else
+		h.u32(0);
+	return h.get();
+}
+
 Util::Hash GLSLCompiler::get_source_hash() const
 {
 	Util::Hasher h;
@@ -254,7 +473,66 @@ Util::Hash GLSLCompiler::get_source_hash() const
 	return h.get();
 }
 
+// Declares spec defines as specialization constants right after #version.
+// A #line directive afterwards keeps line numbers in error messages intact.
+static bool inject_spec_define_constants(std::string &glsl, const std::vector<std::string> &names)
+{
+	unsigned next_line = 1;
+	size_t offset = 0;
+
+	while (offset < glsl.size())
+	{
+		size_t end_of_line = glsl.find('\n', offset);
+		if (end_of_line == std::string::npos)
+			end_of_line = glsl.size();
+
+		auto first_non_space = glsl.find_first_not_of(" \t", offset);
+		if (first_non_space < end_of_line && glsl.compare(first_non_space, 6, "#line ") == 0)
+		{
+			next_line = unsigned(strtoul(glsl.c_str() + first_non_space + 6, nullptr, 0));
+		}
+		else if (first_non_space < end_of_line && glsl.compare(first_non_space, 8, "#version") == 0)
+		{
+			std::string decl;
+			for (size_t i = 0; i < names.size(); i++)
+			{
+				decl += Util::join("layout(constant_id = ", GLSLCompiler::SpecDefineConstantIDBase + i,
+				                   ") const int ", names[i], " = 0; ");
+			}
+			// Shaders fall back to "#define X 0" when X is not defined, so make each
+			// name visible to the preprocessor as well, expanding to the constant.
+			for (auto &name : names)
+				decl += Util::join("\n#define ", name, " ", name);
+			decl += Util::join("\n#line ", next_line + 1, "\n");
+
+			if (end_of_line == glsl.size())
+				glsl += '\n';
+			glsl.insert(end_of_line + 1, decl);
+			return true;
+		}
+		else
+			next_line++;
+
+		offset = end_of_line + 1;
+	}
+
+	return false;
+}
+
 std::vector<uint32_t> GLSLCompiler::compile(std::string &error_message, const std::vector<std::pair<std::string, int>> *defines) const
+{
+	return compile_internal(error_message, defines, false);
+}
+
+std::vector<uint32_t> GLSLCompiler::compile_specializable(std::string &error_message,
+                                                          const std::vector<std::pair<std::string, int>> *defines) const
+{
+	return compile_internal(error_message, defines, true);
+}
+
+std::vector<uint32_t> GLSLCompiler::compile_internal(std::string &error_message,
+                                                     const std::vector<std::pair<std::string, int>> *defines,
+                                                     bool specializable) const
 {
 	shaderc::Compiler compiler;
 	shaderc::CompileOptions options;
@@ -266,7 +544,22 @@ std::vector<uint32_t> GLSLCompiler::compile(std::string &error_message, const st
 
 	if (defines)
 		for (auto &define : *defines)
-			options.AddMacroDefinition(define.first, std::to_string(define.second));
+			if (!specializable || find_spec_define(define.first) < 0)
+				options.AddMacroDefinition(define.first, std::to_string(define.second));
+
+	if (!specializable)
+	{
+		// Spec defines are used in expressions, so they always need a value.
+		for (auto &name : spec_defines)
+		{
+			if (!defines || std::find_if(defines->begin(), defines->end(), [&](const std::pair<std::string, int> &define) {
+				    return define.first == name;
+			    }) == defines->end())
+			{
+				options.AddMacroDefinition(name, "0");
+			}
+		}
+	}
 
 #if GRANITE_COMPILER_OPTIMIZE
 	if (optimization != Optimization::ForceOff)
@@ -322,7 +615,8 @@ std::vector<uint32_t> GLSLCompiler::compile(std::string &error_message, const st
 		return {};
 	}
 
-	shaderc::SpvCompilationResult result;
+	const std::string *glsl;
+	std::string combined_source;
 
 	if (preprocessed_sections.size() == 1)
 	{
@@ -331,11 +625,10 @@ std::vector<uint32_t> GLSLCompiler::compile(std::string &error_message, const st
 			error_message = "No preprocessed sections available.";
 			return {};
 		}
-		result = compiler.CompileGlslToSpv(preprocessed_sections.front().source, kind, source_path.c_str(), options);
+		glsl = &preprocessed_sections.front().source;
 	}
 	else
 	{
-		std::string combined_source;
 		for (auto &section : preprocessed_sections)
 			if (section.stage == Stage::Unknown || section.stage == stage)
 				combined_source += section.source;
@@ -344,9 +637,23 @@ std::vector<uint32_t> GLSLCompiler::compile(std::string &error_message, const st
 			error_message = "No preprocessed sections available.";
 			return {};
 		}
-		result = compiler.CompileGlslToSpv(combined_source, kind, source_path.c_str(), options);
+		glsl = &combined_source;
 	}
 
+	if (specializable && !spec_defines.empty())
+	{
+		if (glsl != &combined_source)
+			combined_source = *glsl;
+		if (!inject_spec_define_constants(combined_source, spec_defines))
+		{
+			error_message = "Cannot declare spec defines without a #version directive.";
+			return {};
+		}
+		glsl = &combined_source;
+	}
+
+	shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(*glsl, kind, source_path.c_str(), options);
+
 	error_message.clear();
 	if (result.GetCompilationStatus() != shaderc_compilation_status_success)
 	{
@@ -372,4 +679,114 @@ std::vector<uint32_t> GLSLCompiler::compile(std::string &error_message, const st
 
 	return compiled_spirv;
 }
+
+namespace SPIRV
+{
+enum : uint32_t
+{
+	MagicNumber = 0x07230203,
+	OpConstant = 43,
+	OpSpecConstant = 50,
+	OpDecorate = 71,
+	DecorationSpecId = 1
+};
+}
+
+// Turns the specialization constants declared for spec defines into regular constants.
+// Any other specialization constant is left alone so it can still be specialized at pipeline creation.
+static bool freeze_spec_defines(const std::vector<uint32_t> &spirv,
+                                const std::unordered_map<uint32_t, uint32_t> &spec_id_values,
+                                std::vector<uint32_t> &frozen)
+{
+	if (spirv.size() < 5 || spirv[0] != SPIRV::MagicNumber)
+		return false;
+
+	std::unordered_map<uint32_t, uint32_t> id_values;
+	frozen.clear();
+	frozen.reserve(spirv.size());
+	frozen.insert(frozen.end(), spirv.begin(), spirv.begin() + 5);
+
+	size_t offset = 5;
+	while (offset < spirv.size())
+	{
+		uint32_t op = spirv[offset] & 0xffff;
+		uint32_t count = spirv[offset] >> 16;
+		if (count == 0 || offset + count > spirv.size())
+			return false;
+
+		if (op == SPIRV::OpDecorate && count == 4 && spirv[offset + 2] == SPIRV::DecorationSpecId)
+		{
+			auto itr = spec_id_values.find(spirv[offset + 3]);
+			if (itr != spec_id_values.end())
+			{
+				id_values[spirv[offset + 1]] = itr->second;
+				offset += count;
+				continue;
+			}
+		}
+
+		size_t start = frozen.size();
+		frozen.insert(frozen.end(), spirv.begin() + offset, spirv.begin() + offset + count);
+
+		if (op == SPIRV::OpSpecConstant && count == 4)
+		{
+			auto itr = id_values.find(spirv[offset + 2]);
+			if (itr != id_values.end())
+			{
+				frozen[start] = (count << 16) | SPIRV::OpConstant;
+				frozen[start + 3] = itr->second;
+			}
+		}
+
+		offset += count;
+	}
+
+	return true;
+}
+
+bool GLSLCompiler::specialize(const std::vector<uint32_t> &spirv,
+                              const std::vector<std::pair<std::string, int>> &spec_define_values,
+                              std::vector<uint32_t> &specialized_spirv, std::string &error_message) const
+{
+	std::unordered_map<uint32_t, uint32_t> spec_id_values;
+	for (auto &define : spec_define_values)
+	{
+		int index = find_spec_define(define.first);
+		if (index >= 0)
+			spec_id_values[SpecDefineConstantIDBase + index] = uint32_t(define.second);
+	}
+
+	for (size_t i = 0; i < spec_defines.size(); i++)
+		spec_id_values.emplace(uint32_t(SpecDefineConstantIDBase + i), 0u);
+
+	std::vector<uint32_t> frozen;
+	if (!freeze_spec_defines(spirv, spec_id_values, frozen))
+	{
+		error_message = "Invalid SPIR-V module.";
+		return false;
+	}
+
+	spvtools::Optimizer optimizer(target == Target::Vulkan11 ? SPV_ENV_VULKAN_1_1 : SPV_ENV_VULKAN_1_0);
+	optimizer.SetMessageConsumer([&error_message](spv_message_level_t, const char *, const spv_position_t&, const char *message) {
+		error_message = message;
+	});
+
+	// Fold away everything which depended on the spec defines, including resources only used in dead branches.
+	optimizer.RegisterPass(spvtools::CreateFoldSpecConstantOpAndCompositePass());
+	optimizer.RegisterPass(spvtools::CreateUnifyConstantPass());
+	optimizer.RegisterPass(spvtools::CreateDeadBranchElimPass());
+	optimizer.RegisterPass(spvtools::CreateAggressiveDCEPass());
+	optimizer.RegisterPass(spvtools::CreateDeadVariableEliminationPass());
+	optimizer.RegisterPass(spvtools::CreateEliminateDeadConstantPass());
+	optimizer.RegisterPass(spvtools::CreateCompactIdsPass());
+
+	specialized_spirv.clear();
+	if (!optimizer.Run(frozen.data(), frozen.size(), &specialized_spirv))
+	{
+		error_message += "\nFailed to specialize SPIR-V.\n";
+		return false;
+	}
+
+	return true;
+}
 }
@@ -25,6 +25,9 @@
 #include <string>
 #include <vector>
 #include <unordered_set>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
 #include <stdint.h>
 #include "small_vector.hpp"
 #include "global_managers.hpp"
@@ -49,6 +52,8 @@ enum class Target
 	Vulkan11
 };
 
+class GLSLSourceCache;
+
 class GLSLCompiler
 {
 public:
@@ -72,6 +77,9 @@ public:
 
 	void set_include_directories(const std::vector<std::string> *include_directories);
 
+	// Optional. When set, file loads and preprocessing results are shared through the cache.
+	void set_source_cache(GLSLSourceCache *cache);
+
 	bool set_source_from_file(const std::string &path, Stage stage = Stage::Unknown);
 	bool set_source_from_file_multistage(const std::string &path);
 	bool preprocess();
@@ -79,6 +87,31 @@ public:
 
 	std::vector<uint32_t> compile(std::string &error_message, const std::vector<std::pair<std::string, int>> *defines = nullptr) const;
 
+	// Defines declared with "#pragma spec_define NAME" must only be used in expressions, never in #if.
+	// They can be compiled once as specialization constants, and each variant is folded from that module.
+	// Shaders should follow the pragma with an "#ifndef NAME / #define NAME 0 / #endif" fallback
+	// so they still compile when nothing defines NAME.
+	const std::vector<std::string> &get_spec_defines() const
+	{
+		return spec_defines;
+	}
+
+	void split_spec_defines(const std::vector<std::pair<std::string, int>> *defines,
+	                        std::vector<std::pair<std::string, int>> &regular_defines,
+	                        std::vector<std::pair<std::string, int>> &spec_define_values) const;
+
+	// Compiles with spec defines declared as specialization constants. Spec defines in defines are ignored.
+	std::vector<uint32_t> compile_specializable(std::string &error_message,
+	                                            const std::vector<std::pair<std::string, int>> *defines = nullptr) const;
+
+	// Freezes spec defines in a module from compile_specializable() and removes dead code.
+	// Spec defines which are not given a value resolve to 0, like in compile().
+	bool specialize(const std::vector<uint32_t> &spirv,
+	                const std::vector<std::pair<std::string, int>> &spec_define_values,
+	                std::vector<uint32_t> &specialized_spirv, std::string &error_message) const;
+
+	enum { SpecDefineConstantIDBase = 1024 };
+
 	const std::unordered_set<std::string> &get_dependencies() const
 	{
 		return dependencies;
@@ -125,15 +158,72 @@ private:
 
 	std::vector<std::pair<size_t, size_t>> preprocessed_lines;
 	std::vector<std::string> pragmas;
+	std::vector<std::string> spec_defines;
 
 	Target target = Target::Vulkan10;
 
 	bool parse_variants(const std::string &source, const std::string &path);
+	void parse_spec_defines();
+	int find_spec_define(const std::string &name) const;
+	std::vector<uint32_t> compile_internal(std::string &error_message,
+	                                       const std::vector<std::pair<std::string, int>> *defines,
+	                                       bool specializable) const;
 
 	Optimization optimization = Optimization::Default;
+	bool optimization_pragma = false;
 	bool strip = false;
 
 	bool find_include_path(const std::string &source_path, const std::string &include_path,
 	                       std::string &included_path, std::string &included_source);
+
+	GLSLSourceCache *source_cache = nullptr;
+	bool load_text_file(const std::string &path, std::string &text);
+	Util::Hash get_preprocess_key() const;
+};
+
+// Thread-safe cache of shader source files and preprocessed shaders.
+// Large headers are included by almost every shader, so avoid hitting the filesystem for every include.
+// Preprocessing does not depend on variant defines (they are resolved in compile()),
+// so a preprocessed result is shared by every variant of a source.
+class GLSLSourceCache
+{
+public:
+	// Process-wide instance used by the shader manager.
+	static GLSLSourceCache &get_default();
+
+	bool load_text_file(FilesystemInterface &iface, const std::string &path, std::string &text);
+
+	// Drops the file, and any preprocessed shader which depends on it.
+	void invalidate(const std::string &path);
+	void clear();
+
+	struct Statistics
+	{
+		uint64_t file_hits = 0;
+		uint64_t file_misses = 0;
+		uint64_t preprocess_hits = 0;
+		uint64_t preprocess_misses = 0;
+	};
+	Statistics get_statistics() const;
+	void reset_statistics();
+
+	struct PreprocessedSource;
+
+private:
+	friend class GLSLCompiler;
+
+	struct FileEntry
+	{
+		FilesystemInterface *iface;
+		std::string text;
+	};
+
+	mutable std::mutex lock;
+	std::unordered_map<std::string, FileEntry> files;
+	std::unordered_map<Util::Hash, std::shared_ptr<const PreprocessedSource>> preprocessed;
+	Statistics stats;
+
+	std::shared_ptr<const PreprocessedSource> find_preprocessed(Util::Hash key);
+	void insert_preprocessed(Util::Hash key, std::shared_ptr<const PreprocessedSource> source);
 };
 }
@@ -31,6 +31,17 @@ Entity *EntityPool::create_entity()
 	auto *entity = entity_pool.allocate(this, hasher.get());
 	entity->pool_offset = entities.size();
 	entities.push_back(entity);
+
+	if (free_slots.empty())
+	{
+		entity->slot = slot_count++;
+	}
+	else
+	{
+		entity->slot = free_slots.back();
+		free_slots.pop_back();
+	}
+
 	return entity;
 }
 
@@ -39,6 +50,7 @@ void EntityPool::free_component(Entity &entity, ComponentType id, ComponentNode
 	auto *c = component_types.find(id);
 	assert(c);
 	c->free_component(component->get());
+	c->version = ++change_version;
 	component_nodes.free(component);
 
 	auto *component_groups = component_to_groups.find(id);
@@ -53,6 +65,42 @@ void EntityPool::free_component(Entity &entity, ComponentType id, ComponentNode
 	}
 }
 
+void EntityPool::mark_component_changed(Entity &entity, ComponentType id)
+{
+	auto *c = component_types.find(id);
+	if (c)
+		mark_changed(entity, c);
+}
+
+void EntityPool::mark_entities(Entity *const *to_mark, size_t count, ComponentAllocatorBase *allocator,
+                               uint64_t version)
+{
+	allocator->changes.reserve_slots(slot_count);
+	for (size_t i = 0; i < count; i++)
+		allocator->changes.mark(to_mark[i]->slot, version);
+}
+
+void ComponentChangeTracker::reserve_slots(uint32_t slot_count)
+{
+	if (slot_count <= slot_versions.size())
+		return;
+
+	// Grow geometrically in whole chunks. Versions start out as 0, which is older than any change.
+	size_t new_size = std::max<size_t>(slot_versions.size() * 2, ChunkSize);
+	while (new_size < slot_count)
+		new_size *= 2;
+
+	std::vector<std::atomic<uint64_t>> new_slot_versions(new_size);
+	std::vector<std::atomic<uint64_t>> new_chunk_versions(new_size / ChunkSize);
+	for (size_t i = 0; i < slot_versions.size(); i++)
+		new_slot_versions[i].store(slot_versions[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+	for (size_t i = 0; i < chunk_versions.size(); i++)
+		new_chunk_versions[i].store(chunk_versions[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+	slot_versions.swap(new_slot_versions);
+	chunk_versions.swap(new_chunk_versions);
+}
+
 void EntityPool::delete_entity(Entity *entity)
 {
 	{
@@ -73,9 +121,82 @@ void EntityPool::delete_entity(Entity *entity)
 	entities[offset] = entities.back();
 	entities[offset]->pool_offset = offset;
 	entities.pop_back();
+	free_slots.push_back(entity->slot);
 	entity_pool.free(entity);
 }
 
+void EntityPool::gather_groups_for_component(ComponentType id, std::vector<EntityGroupBase *> &affected)
+{
+	auto *component_groups = component_to_groups.find(id);
+	if (!component_groups)
+		return;
+
+	for (auto &group : *component_groups)
+	{
+		auto *g = groups.find(group.get_hash());
+		if (g && std::find(affected.begin(), affected.end(), g) == affected.end())
+			affected.push_back(g);
+	}
+}
+
+void EntityPool::delete_entities(Entity *const *to_delete, size_t count)
+{
+	if (!count)
+		return;
+
+	// Remove from groups first while slots are still valid.
+	// Typically all entities in a batch share a handful of component types.
+	std::vector<ComponentType> seen_types;
+	std::vector<EntityGroupBase *> affected;
+	for (size_t i = 0; i < count; i++)
+	{
+		for (auto &component : to_delete[i]->components)
+		{
+			ComponentType id = component.get_hash();
+			if (std::find(seen_types.begin(), seen_types.end(), id) == seen_types.end())
+			{
+				seen_types.push_back(id);
+				gather_groups_for_component(id, affected);
+			}
+		}
+	}
+
+	for (auto *group : affected)
+		group->remove_entities(to_delete, count);
+
+	uint64_t version = ++change_version;
+	ComponentAllocatorBase *allocator = nullptr;
+	for (size_t i = 0; i < count; i++)
+	{
+		auto *entity = to_delete[i];
+		auto &list = entity->components.inner_list();
+		auto itr = list.begin();
+		while (itr != list.end())
+		{
+			auto *component = itr.get();
+			itr = list.erase(itr);
+
+			if (!allocator || allocator->get_hash() != component->get_hash())
+			{
+				allocator = component_types.find(component->get_hash());
+				assert(allocator);
+				allocator->version = version;
+			}
+
+			allocator->free_component(component->get());
+			component_nodes.free(component);
+		}
+
+		auto offset = entity->pool_offset;
+		assert(offset < entities.size());
+		entities[offset] = entities.back();
+		entities[offset]->pool_offset = offset;
+		entities.pop_back();
+		free_slots.push_back(entity->slot);
+		entity_pool.free(entity);
+	}
+}
+
 EntityPool::~EntityPool()
 {
 	{
@@ -26,6 +26,7 @@
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <atomic>
 #include "object_pool.hpp"
 #include "intrusive.hpp"
 #include "intrusive_hash_map.hpp"
@@ -117,9 +118,71 @@ public:
 	virtual ~EntityGroupBase() = default;
 	virtual void add_entity(Entity &entity) = 0;
 	virtual void remove_entity(const Entity &entity) = 0;
+
+	// Bulk paths. add_entities() assumes every entity matches the group.
+	virtual bool matches(const Entity &entity) const = 0;
+	virtual void add_entities(Entity *const *entities, size_t count) = 0;
+	virtual void remove_entities(Entity *const *entities, size_t count) = 0;
 	virtual void reset() = 0;
 };
 
+// Change versions for one component type, indexed by entity slot.
+// Slots are grouped in chunks of ChunkSize, and each chunk records the last version any of its slots was marked with,
+// so a reader skips untouched chunks without looking at individual slots.
+// Marking is two stores and never looks at groups. mark() may be called concurrently from multiple threads,
+// as long as slots have been reserved up front and concurrent markers use the same version.
+class ComponentChangeTracker
+{
+public:
+	enum { ChunkSize = 64 };
+
+	void mark(uint32_t slot, uint64_t version)
+	{
+		assert(slot < slot_versions.size());
+		// Avoid dirtying cache lines which already hold the version, which is common for chunks.
+		if (slot_versions[slot].load(std::memory_order_relaxed) < version)
+			slot_versions[slot].store(version, std::memory_order_relaxed);
+		auto &chunk = chunk_versions[slot / ChunkSize];
+		if (chunk.load(std::memory_order_relaxed) < version)
+			chunk.store(version, std::memory_order_relaxed);
+	}
+
+	uint64_t get_slot_version(uint32_t slot) const
+	{
+		return slot_versions[slot].load(std::memory_order_relaxed);
+	}
+
+	uint64_t get_chunk_version(size_t chunk) const
+	{
+		return chunk_versions[chunk].load(std::memory_order_relaxed);
+	}
+
+	size_t get_num_chunks() const
+	{
+		return chunk_versions.size();
+	}
+
+	// Not thread-safe. Must be called before slots are marked.
+	void reserve_slots(uint32_t slot_count);
+
+private:
+	std::vector<std::atomic<uint64_t>> slot_versions;
+	std::vector<std::atomic<uint64_t>> chunk_versions;
+};
+
+class ComponentAllocatorBase : public Util::IntrusiveHashMapEnabled<ComponentAllocatorBase>
+{
+public:
+	virtual ~ComponentAllocatorBase() = default;
+	virtual void free_component(ComponentBase *component) = 0;
+
+	// Last change version of any component of this type, including allocation and free.
+	uint64_t version = 0;
+
+	// Per entity changes, including allocation.
+	ComponentChangeTracker changes;
+};
+
 class EntityPool;
 
 struct EntityDeleter
@@ -175,6 +238,9 @@ public:
 	template <typename T>
 	void free_component();
 
+	template <typename T>
+	void mark_changed();
+
 	ComponentHashMap &get_components()
 	{
 		return components;
@@ -190,6 +256,13 @@ public:
 		return hash;
 	}
 
+	// Dense index which is stable for the lifetime of the entity.
+	// Slots of deleted entities are recycled.
+	uint32_t get_slot() const
+	{
+		return slot;
+	}
+
 	bool mark_for_destruction()
 	{
 		bool ret = !marked;
@@ -201,6 +274,7 @@ private:
 	EntityPool *pool;
 	Util::Hash hash;
 	size_t pool_offset = 0;
+	uint32_t slot = 0;
 	ComponentHashMap components;
 	bool marked = false;
 };
@@ -209,11 +283,20 @@ template <typename... Ts>
 class EntityGroup : public EntityGroupBase
 {
 public:
+	// Changes are tracked per component type and entity slot, see ComponentChangeTracker.
+	// The group only needs to know which trackers to look at, and when it was created.
+	template <typename... Allocators>
+	explicit EntityGroup(uint64_t creation_version_, const Allocators *... allocators_)
+		: allocators{ allocators_... }, creation_version(creation_version_)
+	{
+		static_assert(sizeof...(Allocators) == sizeof...(Ts), "Need one allocator per component type.");
+	}
+
 	void add_entity(Entity &entity) override final
 	{
 		if (has_all_components<Ts...>(entity))
 		{
-			entity_to_index[entity.get_hash()].get() = entities.size();
+			set_index(entity.get_slot(), entities.size());
 			groups.push_back(std::make_tuple(entity.get_component<Ts>()...));
 			entities.push_back(&entity);
 		}
@@ -222,18 +305,80 @@ public:
 	void remove_entity(const Entity &entity) override final
 	{
 		size_t offset;
-		if (entity_to_index.find_and_consume_pod(entity.get_hash(), offset))
+		if (find_index(entity.get_slot(), offset))
 		{
 			entities[offset] = entities.back();
 			groups[offset] = groups.back();
-			entity_to_index[entities[offset]->get_hash()].get() = offset;
+			set_index(entities[offset]->get_slot(), offset);
 
-			entity_to_index.erase(entity.get_hash());
+			clear_index(entity.get_slot());
 			entities.pop_back();
 			groups.pop_back();
 		}
 	}
 
+	bool matches(const Entity &entity) const override final
+	{
+		return has_all_components<Ts...>(entity);
+	}
+
+	void add_entities(Entity *const *new_entities, size_t count) override final
+	{
+		if (!count)
+			return;
+
+		size_t base = entities.size();
+		groups.reserve(base + count);
+		entities.reserve(base + count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			auto &entity = *new_entities[i];
+			set_index(entity.get_slot(), entities.size());
+			groups.push_back(std::make_tuple(entity.get_component<Ts>()...));
+			entities.push_back(&entity);
+		}
+	}
+
+	void remove_entities(Entity *const *to_remove, size_t count) override final
+	{
+		// Swap removal is cheaper when only a few members go away.
+		if (count * 16 < entities.size())
+		{
+			for (size_t i = 0; i < count; i++)
+				remove_entity(*to_remove[i]);
+			return;
+		}
+
+		size_t first_hole = entities.size();
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t offset;
+			if (find_index(to_remove[i]->get_slot(), offset))
+			{
+				clear_index(to_remove[i]->get_slot());
+				entities[offset] = nullptr;
+				first_hole = std::min(first_hole, offset);
+			}
+		}
+
+		// Compact in one pass, which also preserves the order of surviving members.
+		size_t write_offset = first_hole;
+		for (size_t i = first_hole; i < entities.size(); i++)
+		{
+			if (!entities[i])
+				continue;
+
+			entities[write_offset] = entities[i];
+			groups[write_offset] = groups[i];
+			set_index(entities[write_offset]->get_slot(), write_offset);
+			write_offset++;
+		}
+
+		entities.resize(write_offset);
+		groups.resize(write_offset);
+	}
+
 	const ComponentGroupVector<Ts...> &get_groups() const
 	{
 		return groups;
@@ -244,17 +389,180 @@ public:
 		return entities;
 	}
 
+	// Highest change version of any component type in the group, including members which have since been removed.
+	uint64_t get_version() const
+	{
+		uint64_t version = creation_version;
+		for (auto *allocator : allocators)
+			version = std::max(version, allocator->version);
+		return version;
+	}
+
+	// Number of slot chunks which for_each_changed_range() can iterate over.
+	// Members of the group can only live in chunks which are tracked by all component types.
+	size_t get_num_change_chunks() const
+	{
+		size_t num_chunks = allocators[0]->changes.get_num_chunks();
+		for (auto *allocator : allocators)
+			num_chunks = std::min(num_chunks, allocator->changes.get_num_chunks());
+		return num_chunks;
+	}
+
+	// Calls func(std::tuple<Ts *...> &, Entity &) for every member which was added or
+	// had one of its components marked as changed after the given version.
+	// Members are visited in entity slot order, not in group order.
+	template <typename Func>
+	void for_each_changed(uint64_t since_version, const Func &func) const
+	{
+		for_each_changed_range(since_version, 0, get_num_change_chunks(), func);
+	}
+
+	// Same as for_each_changed(), restricted to slot chunks [begin_chunk, end_chunk).
+	// Disjoint ranges can be iterated concurrently.
+	template <typename Func>
+	void for_each_changed_range(uint64_t since_version, size_t begin_chunk, size_t end_chunk, const Func &func) const
+	{
+		// Everything is new to an observer which last looked before the group existed.
+		bool all_changed = since_version < creation_version;
+		constexpr size_t num_types = sizeof...(Ts);
+		end_chunk = std::min(end_chunk, get_num_change_chunks());
+
+		// Changed members are scattered, so visiting them is bound by cache misses.
+		// Gather a batch of changed slots first so their memory can be fetched in parallel.
+		uint32_t batch[2 * ComponentChangeTracker::ChunkSize];
+		size_t batch_count = 0;
+
+		for (size_t chunk = begin_chunk; chunk < end_chunk; chunk++)
+		{
+			// Only look at slots of component types which changed in this chunk.
+			const ComponentChangeTracker *dirty[num_types] = {};
+			size_t num_dirty = 0;
+			for (auto *allocator : allocators)
+				if (allocator->changes.get_chunk_version(chunk) > since_version)
+					dirty[num_dirty++] = &allocator->changes;
+
+			if (!all_changed && !num_dirty)
+				continue;
+
+			uint32_t begin = uint32_t(chunk * ComponentChangeTracker::ChunkSize);
+			uint32_t end = begin + ComponentChangeTracker::ChunkSize;
+			for (uint32_t slot = begin; slot < end; slot++)
+			{
+				bool changed = all_changed;
+				for (size_t i = 0; i < num_dirty && !changed; i++)
+					changed = dirty[i]->get_slot_version(slot) > since_version;
+
+				if (changed)
+				{
+					prefetch_index(slot);
+					batch[batch_count++] = slot;
+				}
+			}
+
+			if (batch_count >= ComponentChangeTracker::ChunkSize)
+			{
+				dispatch_batch(batch, batch_count, func);
+				batch_count = 0;
+			}
+		}
+
+		dispatch_batch(batch, batch_count, func);
+	}
+
+	void get_changed_groups(uint64_t since_version, ComponentGroupVector<Ts...> &changed) const
+	{
+		for_each_changed(since_version, [&](const std::tuple<Ts *...> &t, const Entity &) {
+			changed.push_back(t);
+		});
+	}
+
 	void reset() override final
 	{
 		groups.clear();
 		entities.clear();
-		entity_to_index.clear();
+		index_pages.clear();
 	}
 
 private:
 	ComponentGroupVector<Ts...> groups;
 	std::vector<Entity *> entities;
-	Util::IntrusiveHashMap<Util::IntrusivePODWrapper<size_t>> entity_to_index;
+	const ComponentAllocatorBase *allocators[sizeof...(Ts)];
+	uint64_t creation_version;
+
+	// Sparse mapping from entity slot to index in the group, biased by one so 0 means not present.
+	// Pages are only allocated for slot ranges which contain members.
+	enum { IndexPageSize = 4096 };
+	std::vector<std::vector<uint32_t>> index_pages;
+
+	bool find_index(uint32_t slot, size_t &index) const
+	{
+		uint32_t page = slot / IndexPageSize;
+		if (page >= index_pages.size() || index_pages[page].empty())
+			return false;
+
+		uint32_t biased = index_pages[page][slot % IndexPageSize];
+		index = size_t(biased) - 1;
+		return biased != 0;
+	}
+
+	void set_index(uint32_t slot, size_t index)
+	{
+		uint32_t page = slot / IndexPageSize;
+		if (page >= index_pages.size())
+			index_pages.resize(page + 1);
+		if (index_pages[page].empty())
+			index_pages[page].resize(IndexPageSize);
+		index_pages[page][slot % IndexPageSize] = uint32_t(index + 1);
+	}
+
+	void clear_index(uint32_t slot)
+	{
+		index_pages[slot / IndexPageSize][slot % IndexPageSize] = 0;
+	}
+
+	static inline void prefetch(const void *ptr)
+	{
+#ifdef __GNUC__
+		__builtin_prefetch(ptr);
+#else
+		(void)ptr;
+#endif
+	}
+
+	void prefetch_index(uint32_t slot) const
+	{
+		uint32_t page = slot / IndexPageSize;
+		if (page < index_pages.size() && !index_pages[page].empty())
+			prefetch(&index_pages[page][slot % IndexPageSize]);
+	}
+
+	// Takes a batch of changed slots. Resolving slots to members and then touching the members are
+	// pipelined, so each step only waits for memory which was requested by the previous one.
+	template <typename Func>
+	void dispatch_batch(uint32_t *batch, size_t count, const Func &func) const
+	{
+		size_t member_count = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t index;
+			if (find_index(batch[i], index))
+			{
+				prefetch(&groups[index]);
+				prefetch(&entities[index]);
+				batch[member_count++] = uint32_t(index);
+			}
+		}
+
+		for (size_t i = 0; i < member_count; i++)
+		{
+			auto &t = groups[batch[i]];
+			int prefetch_components[] = { (prefetch(std::get<Ts *>(t)), 0)... };
+			(void)prefetch_components;
+		}
+
+		for (size_t i = 0; i < member_count; i++)
+			func(groups[batch[i]], *entities[batch[i]]);
+	}
 
 	template <typename... Us>
 	struct HasAllComponents;
@@ -279,19 +587,12 @@ private:
 	};
 
 	template <typename... Us>
-	bool has_all_components(const Entity &entity)
+	static bool has_all_components(const Entity &entity)
 	{
 		return HasAllComponents<Us...>::has_component(entity);
 	}
 };
 
-class ComponentAllocatorBase : public Util::IntrusiveHashMapEnabled<ComponentAllocatorBase>
-{
-public:
-	virtual ~ComponentAllocatorBase() = default;
-	virtual void free_component(ComponentBase *component) = 0;
-};
-
 template <typename T>
 struct ComponentAllocator : public ComponentAllocatorBase
 {
@@ -324,7 +625,7 @@ public:
 		{
 			register_group<Ts...>(group_id);
 
-			t = new EntityGroup<Ts...>();
+			t = new EntityGroup<Ts...>(++change_version, get_component_allocator<Ts>()...);
 			t->set_hash(group_id);
 			groups.insert_yield(t);
 
@@ -354,15 +655,7 @@ public:
 	T *allocate_component(Entity &entity, Ts&&... ts)
 	{
 		constexpr ComponentType id = ComponentIDMapping::get_id<T>();
-		auto *t = component_types.find(id);
-		if (!t)
-		{
-			t = new ComponentAllocator<T>();
-			t->set_hash(id);
-			component_types.insert_yield(t);
-		}
-
-		auto *allocator = static_cast<ComponentAllocator<T> *>(t);
+		auto *allocator = get_component_allocator<T>();
 		auto *existing = entity.components.find(id);
 
 		if (existing)
@@ -371,7 +664,9 @@ public:
 			// In-place modify. Destroy old data, and in-place construct.
 			// Do not need to fiddle with data structures internally.
 			comp->~T();
-			return new (comp) T(std::forward<Ts>(ts)...);
+			comp = new (comp) T(std::forward<Ts>(ts)...);
+			mark_changed(entity, allocator);
+			return comp;
 		}
 		else
 		{
@@ -380,6 +675,7 @@ public:
 			node->set_hash(id);
 			entity.components.insert_replace(node);
 
+			mark_changed(entity, allocator);
 			auto *component_groups = component_to_groups.find(id);
 			if (component_groups)
 				for (auto &group : *component_groups)
@@ -389,7 +685,59 @@ public:
 		}
 	}
 
+	// Change tracking. Versions increase monotonically with every change.
+	// A system remembers get_change_version() after it has run, and on the next run
+	// only visits group members changed since then through EntityGroup::for_each_changed().
+	uint64_t get_change_version() const
+	{
+		return change_version;
+	}
+
+	// O(1), independent of how many groups T is part of.
+	template <typename T>
+	void mark_changed(Entity &entity)
+	{
+		mark_changed(entity, get_component_allocator<T>());
+	}
+
+	// For marking many components of type T, possibly from worker threads.
+	// Reserves one version for the whole batch and makes sure every live entity slot can be marked.
+	// Changes are then made with get_change_tracker<T>().mark(entity.get_slot(), version).
+	// The pool must not be modified until the batch is done.
+	template <typename T>
+	uint64_t begin_component_changes()
+	{
+		auto *allocator = get_component_allocator<T>();
+		allocator->changes.reserve_slots(slot_count);
+		allocator->version = ++change_version;
+		return allocator->version;
+	}
+
+	template <typename T>
+	ComponentChangeTracker &get_change_tracker()
+	{
+		return get_component_allocator<T>()->changes;
+	}
+
+	// Cheap check whether any component of type T changed at all.
+	template <typename T>
+	uint64_t get_component_version()
+	{
+		auto *t = component_types.find(ComponentIDMapping::get_id<T>());
+		return t ? t->version : 0;
+	}
+
+	void mark_component_changed(Entity &entity, ComponentType id);
 	void free_component(Entity &entity, ComponentType id, ComponentNode *component);
+
+	// Creates count entities which all have default constructed components Ts...
+	// Pools and group storage are sized up front, and group membership is resolved once for the whole batch
+	// rather than per component allocation. Component pointers are optionally written to components.
+	template <typename... Ts>
+	void create_entities(Entity **new_entities, size_t count, std::tuple<Ts *...> *components = nullptr);
+
+	// Deletes a list of unique entities. Affected groups are compacted in one pass.
+	void delete_entities(Entity *const *to_delete, size_t count);
 	void reset_groups();
 	void reset_groups_for_component_type(ComponentType id);
 
@@ -400,7 +748,10 @@ private:
 	Util::ObjectPool<ComponentNode> component_nodes;
 	ComponentGroupHashMap component_to_groups;
 	std::vector<Entity *> entities;
+	std::vector<uint32_t> free_slots;
+	uint32_t slot_count = 0;
 	uint64_t cookie = 0;
+	uint64_t change_version = 0;
 
 	template <typename... Us>
 	struct GroupRegisters;
@@ -433,8 +784,88 @@ private:
 	}
 
 	void free_groups();
+
+	template <typename T>
+	ComponentAllocator<T> *get_component_allocator()
+	{
+		constexpr ComponentType id = ComponentIDMapping::get_id<T>();
+		auto *t = component_types.find(id);
+		if (!t)
+		{
+			t = new ComponentAllocator<T>();
+			t->set_hash(id);
+			component_types.insert_yield(t);
+		}
+
+		return static_cast<ComponentAllocator<T> *>(t);
+	}
+
+	template <typename T>
+	T *allocate_new_component(Entity &entity, ComponentAllocator<T> *allocator)
+	{
+		auto *comp = allocator->pool.allocate();
+		auto *node = component_nodes.allocate(comp);
+		node->set_hash(ComponentIDMapping::get_id<T>());
+		entity.components.insert_replace(node);
+		return comp;
+	}
+
+	void mark_entities(Entity *const *to_mark, size_t count, ComponentAllocatorBase *allocator, uint64_t version);
+
+	void mark_changed(Entity &entity, ComponentAllocatorBase *allocator)
+	{
+		allocator->version = ++change_version;
+		allocator->changes.reserve_slots(entity.slot + 1);
+		allocator->changes.mark(entity.slot, change_version);
+	}
+
+	void gather_groups_for_component(ComponentType id, std::vector<EntityGroupBase *> &affected);
 };
 
+template <typename... Ts>
+void EntityPool::create_entities(Entity **new_entities, size_t count, std::tuple<Ts *...> *components)
+{
+	static_assert(sizeof...(Ts) > 0, "Need at least one component type.");
+	if (!count)
+		return;
+
+	uint64_t version = ++change_version;
+	auto allocators = std::make_tuple(get_component_allocator<Ts>()...);
+	int prepare_allocators[] = {
+		(std::get<ComponentAllocator<Ts> *>(allocators)->pool.reserve(count),
+		 std::get<ComponentAllocator<Ts> *>(allocators)->version = version, 0)...
+	};
+	(void)prepare_allocators;
+
+	entity_pool.reserve(count);
+	component_nodes.reserve(count * sizeof...(Ts));
+	entities.reserve(entities.size() + count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		auto *entity = create_entity();
+		auto tup = std::make_tuple(allocate_new_component<Ts>(*entity, std::get<ComponentAllocator<Ts> *>(allocators))...);
+		if (components)
+			components[i] = tup;
+		new_entities[i] = entity;
+	}
+
+	int mark_allocators[] = {
+		(mark_entities(new_entities, count, std::get<ComponentAllocator<Ts> *>(allocators), version), 0)...
+	};
+	(void)mark_allocators;
+
+	// Every entity in the batch has the same component set, so the first one decides membership for all.
+	std::vector<EntityGroupBase *> affected;
+	const ComponentType ids[] = { ComponentIDMapping::get_id<Ts>()... };
+	for (auto id : ids)
+		gather_groups_for_component(id, affected);
+
+	for (auto *group : affected)
+		if (group->matches(*new_entities[0]))
+			group->add_entities(new_entities, count);
+}
+
 template <typename T, typename... Ts>
 T *Entity::allocate_component(Ts&&... ts)
 {
@@ -453,4 +884,10 @@ void Entity::free_component()
 	}
 }
 
+template <typename T>
+void Entity::mark_changed()
+{
+	pool->mark_changed<T>(*this);
+}
+
 }
\ No newline at end of file
@@ -159,6 +159,19 @@ static void test_decompose()
 	assert_equal_epsilon(original, reconstructed);
 }
 
+static void test_trs_inverse()
+{
+	// Reference for SIMD::inverse_affine(). TRS inverse is the reverse composition of inverted components.
+	vec3 scaling(4.0f, -3.0f, 0.5f);
+	quat rotate = angleAxis(1.2f, normalize(vec3(0.3f, -0.7f, 0.2f)));
+	vec3 trans(-5.0f, 8.0f, 2.5f);
+
+	mat4 original = translate(trans) * mat4_cast(rotate) * scale(scaling);
+	mat4 expected = scale(1.0f / scaling) * mat4_cast(conjugate(rotate)) * translate(-trans);
+	assert_equal_epsilon(inverse(original), expected);
+	assert_equal_epsilon(original * expected, mat4(1.0f));
+}
+
 int main()
 {
 	test_mat2();
@@ -166,4 +179,5 @@ int main()
 	test_mat4();
 	test_quat();
 	test_decompose();
+	test_trs_inverse();
 }
\ No newline at end of file
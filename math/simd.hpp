@@ -144,7 +144,41 @@ static inline void mul(vec4 &c, const mat4 &a, const vec4 &b)
 
 static inline void mul(mat4 &c, const mat4 &a, const mat4 &b)
 {
-#if defined(__SSE__)
+#if defined(__AVX512F__)
+	// All four columns in one register, broadcasting within each 128-bit lane.
+	__m512 a0 = _mm512_broadcast_f32x4(_mm_loadu_ps(a[0].data));
+	__m512 a1 = _mm512_broadcast_f32x4(_mm_loadu_ps(a[1].data));
+	__m512 a2 = _mm512_broadcast_f32x4(_mm_loadu_ps(a[2].data));
+	__m512 a3 = _mm512_broadcast_f32x4(_mm_loadu_ps(a[3].data));
+	__m512 b0123 = _mm512_loadu_ps(b[0].data);
+
+	__m512 col = _mm512_mul_ps(a0, _mm512_permute_ps(b0123, _MM_SHUFFLE(0, 0, 0, 0)));
+	col = _mm512_add_ps(col, _mm512_mul_ps(a1, _mm512_permute_ps(b0123, _MM_SHUFFLE(1, 1, 1, 1))));
+	col = _mm512_add_ps(col, _mm512_mul_ps(a2, _mm512_permute_ps(b0123, _MM_SHUFFLE(2, 2, 2, 2))));
+	col = _mm512_add_ps(col, _mm512_mul_ps(a3, _mm512_permute_ps(b0123, _MM_SHUFFLE(3, 3, 3, 3))));
+	_mm512_storeu_ps(c[0].data, col);
+#elif defined(__AVX__)
+	// Two columns per register. Separate mul and add (no FMA) keeps results identical to the scalar path.
+	__m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a[0].data));
+	__m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a[1].data));
+	__m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a[2].data));
+	__m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a[3].data));
+	__m256 b01 = _mm256_loadu_ps(b[0].data);
+	__m256 b23 = _mm256_loadu_ps(b[2].data);
+
+	__m256 col01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, _MM_SHUFFLE(0, 0, 0, 0)));
+	col01 = _mm256_add_ps(col01, _mm256_mul_ps(a1, _mm256_permute_ps(b01, _MM_SHUFFLE(1, 1, 1, 1))));
+	col01 = _mm256_add_ps(col01, _mm256_mul_ps(a2, _mm256_permute_ps(b01, _MM_SHUFFLE(2, 2, 2, 2))));
+	col01 = _mm256_add_ps(col01, _mm256_mul_ps(a3, _mm256_permute_ps(b01, _MM_SHUFFLE(3, 3, 3, 3))));
+
+	__m256 col23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, _MM_SHUFFLE(0, 0, 0, 0)));
+	col23 = _mm256_add_ps(col23, _mm256_mul_ps(a1, _mm256_permute_ps(b23, _MM_SHUFFLE(1, 1, 1, 1))));
+	col23 = _mm256_add_ps(col23, _mm256_mul_ps(a2, _mm256_permute_ps(b23, _MM_SHUFFLE(2, 2, 2, 2))));
+	col23 = _mm256_add_ps(col23, _mm256_mul_ps(a3, _mm256_permute_ps(b23, _MM_SHUFFLE(3, 3, 3, 3))));
+
+	_mm256_storeu_ps(c[0].data, col01);
+	_mm256_storeu_ps(c[2].data, col23);
+#elif defined(__SSE__)
 	__m128 a0 = _mm_loadu_ps(a[0].data);
 	__m128 a1 = _mm_loadu_ps(a[1].data);
 	__m128 a2 = _mm_loadu_ps(a[2].data);
@@ -237,6 +271,55 @@ static inline void mul(mat4 &c, const mat4 &a, const mat4 &b)
 #endif
 }
 
+// Inverse of a matrix where the last row is (0, 0, 0, 1), i.e. any TRS transform.
+// Much cheaper than a general inverse(), since the 3x3 part can be inverted with cross products.
+static inline void inverse_affine(mat4 &output, const mat4 &m)
+{
+#if defined(__SSE__)
+	__m128 c0 = _mm_loadu_ps(m[0].data);
+	__m128 c1 = _mm_loadu_ps(m[1].data);
+	__m128 c2 = _mm_loadu_ps(m[2].data);
+	__m128 t = _mm_loadu_ps(m[3].data);
+
+#define YZX(v) _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1))
+#define ZXY(v) _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2))
+#define CROSS(a, b) _mm_sub_ps(_mm_mul_ps(YZX(a), ZXY(b)), _mm_mul_ps(ZXY(a), YZX(b)))
+	// Rows of the inverse are the cross products of the columns scaled by 1 / det.
+	// W ends up as 0 in all of them.
+	__m128 r0 = CROSS(c1, c2);
+	__m128 r1 = CROSS(c2, c0);
+	__m128 r2 = CROSS(c0, c1);
+#undef CROSS
+#undef ZXY
+#undef YZX
+
+	__m128 det = _mm_mul_ps(c0, r0);
+	det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(2, 3, 0, 1)));
+	det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(1, 0, 3, 2)));
+	__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	r0 = _mm_mul_ps(r0, inv_det);
+	r1 = _mm_mul_ps(r1, inv_det);
+	r2 = _mm_mul_ps(r2, inv_det);
+	__m128 r3 = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+	__m128 trans = _mm_mul_ps(r0, _mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 0, 0, 0)));
+	trans = _mm_add_ps(trans, _mm_mul_ps(r1, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1))));
+	trans = _mm_add_ps(trans, _mm_mul_ps(r2, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 2, 2, 2))));
+	trans = _mm_sub_ps(_mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f), trans);
+
+	_mm_storeu_ps(output[0].data, r0);
+	_mm_storeu_ps(output[1].data, r1);
+	_mm_storeu_ps(output[2].data, r2);
+	_mm_storeu_ps(output[3].data, trans);
+#else
+	mat3 inv = inverse(mat3(m));
+	output = mat4(inv);
+	output[3] = vec4(-(inv * m[3].xyz()), 1.0f);
+#endif
+}
+
 static inline void transform_aabb(AABB &output, const AABB &aabb, const mat4 &m)
 {
 #if defined(__SSE__)
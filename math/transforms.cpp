@@ -26,6 +26,11 @@
 #include "muglm/matrix_helper.hpp"
 #include <assert.h>
 
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define GRANITE_BATCH_TRANSFORM_X86
+#include <immintrin.h>
+#endif
+
 namespace Granite
 {
 bool compute_plane_reflection(mat4 &projection, mat4 &view, vec3 camera_pos, vec3 center, vec3 normal, vec3 look_up,
@@ -106,6 +111,308 @@ void compute_model_transform(mat4 &world, vec3 s, quat rot, vec3 trans, const ma
 	SIMD::mul(world, parent, model);
 }
 
+static void compute_model_transforms_generic(mat4 *const *world, const mat4 *const *parents,
+                                             const vec3 *s, const quat *rot, const vec3 *trans, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		compute_model_transform(*world[i], s[i], rot[i], trans[i], *parents[i]);
+}
+
+#ifdef GRANITE_BATCH_TRANSFORM_X86
+#define GRANITE_TARGET_AVX2 __attribute__((target("avx2")))
+#define GRANITE_TARGET_AVX512 __attribute__((target("avx512f")))
+
+// The kernels work on 8 (AVX2) or 16 (AVX-512) transforms at a time.
+// Rotations are loaded as-is and transposed within each 128-bit lane, which gives SoA registers where the
+// elements are interleaved between lanes. The rotation matrices are built in SoA form, and the same
+// transpose brings them back to one column per 128-bit lane, in the original element order.
+// The parent multiply is then done in AoS form, one transform per 128-bit lane.
+// Since the model matrix has (0, 0, 0, 1) as its last row, only the translation column needs parent[3].
+
+GRANITE_TARGET_AVX2 static inline void transpose_lanes(__m256 &a, __m256 &b, __m256 &c, __m256 &d)
+{
+	__m256 t0 = _mm256_unpacklo_ps(a, b);
+	__m256 t1 = _mm256_unpackhi_ps(a, b);
+	__m256 t2 = _mm256_unpacklo_ps(c, d);
+	__m256 t3 = _mm256_unpackhi_ps(c, d);
+	a = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	b = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	c = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	d = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+GRANITE_TARGET_AVX2 static inline __m256 load_columns(const mat4 &a, const mat4 &b, unsigned col)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(a[col].data)), _mm_loadu_ps(b[col].data), 1);
+}
+
+GRANITE_TARGET_AVX2 static void compute_model_transforms_avx2(mat4 *const *world, const mat4 *const *parents,
+                                                              const vec3 *s, const quat *rot, const vec3 *trans,
+                                                              size_t count)
+{
+	// Lane order after transpose_lanes is 0, 2, 4, 6, 1, 3, 5, 7. Index vec3 components to match.
+	const __m256i vec3_index = _mm256_setr_epi32(0, 6, 12, 18, 3, 9, 15, 21);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const float *q = rot[i].as_vec4().data;
+		__m256 x = _mm256_loadu_ps(q + 0);
+		__m256 y = _mm256_loadu_ps(q + 8);
+		__m256 z = _mm256_loadu_ps(q + 16);
+		__m256 w = _mm256_loadu_ps(q + 24);
+		transpose_lanes(x, y, z, w);
+
+		__m256 sx = _mm256_i32gather_ps(s[i].data + 0, vec3_index, 4);
+		__m256 sy = _mm256_i32gather_ps(s[i].data + 1, vec3_index, 4);
+		__m256 sz = _mm256_i32gather_ps(s[i].data + 2, vec3_index, 4);
+		__m256 tx = _mm256_i32gather_ps(trans[i].data + 0, vec3_index, 4);
+		__m256 ty = _mm256_i32gather_ps(trans[i].data + 1, vec3_index, 4);
+		__m256 tz = _mm256_i32gather_ps(trans[i].data + 2, vec3_index, 4);
+
+		__m256 x2 = _mm256_add_ps(x, x);
+		__m256 y2 = _mm256_add_ps(y, y);
+		__m256 z2 = _mm256_add_ps(z, z);
+		__m256 xx = _mm256_mul_ps(x, x2);
+		__m256 yy = _mm256_mul_ps(y, y2);
+		__m256 zz = _mm256_mul_ps(z, z2);
+		__m256 xy = _mm256_mul_ps(x, y2);
+		__m256 xz = _mm256_mul_ps(x, z2);
+		__m256 yz = _mm256_mul_ps(y, z2);
+		__m256 wx = _mm256_mul_ps(w, x2);
+		__m256 wy = _mm256_mul_ps(w, y2);
+		__m256 wz = _mm256_mul_ps(w, z2);
+
+		__m256 m[4][4];
+		m[0][0] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx);
+		m[0][1] = _mm256_mul_ps(_mm256_add_ps(xy, wz), sx);
+		m[0][2] = _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx);
+		m[0][3] = zero;
+		m[1][0] = _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy);
+		m[1][1] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy);
+		m[1][2] = _mm256_mul_ps(_mm256_add_ps(yz, wx), sy);
+		m[1][3] = zero;
+		m[2][0] = _mm256_mul_ps(_mm256_add_ps(xz, wy), sz);
+		m[2][1] = _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz);
+		m[2][2] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz);
+		m[2][3] = zero;
+		m[3][0] = tx;
+		m[3][1] = ty;
+		m[3][2] = tz;
+		m[3][3] = one;
+
+		// m[c][k] is now column c of transforms i + 2k and i + 2k + 1.
+		for (auto &col : m)
+			transpose_lanes(col[0], col[1], col[2], col[3]);
+
+		for (unsigned k = 0; k < 4; k++)
+		{
+			size_t a = i + 2 * k;
+			size_t b = a + 1;
+			__m256 p0 = load_columns(*parents[a], *parents[b], 0);
+			__m256 p1 = load_columns(*parents[a], *parents[b], 1);
+			__m256 p2 = load_columns(*parents[a], *parents[b], 2);
+
+			for (unsigned c = 0; c < 4; c++)
+			{
+				__m256 v = m[c][k];
+				__m256 r = _mm256_mul_ps(p0, _mm256_permute_ps(v, _MM_SHUFFLE(0, 0, 0, 0)));
+				r = _mm256_add_ps(r, _mm256_mul_ps(p1, _mm256_permute_ps(v, _MM_SHUFFLE(1, 1, 1, 1))));
+				r = _mm256_add_ps(r, _mm256_mul_ps(p2, _mm256_permute_ps(v, _MM_SHUFFLE(2, 2, 2, 2))));
+				if (c == 3)
+					r = _mm256_add_ps(r, load_columns(*parents[a], *parents[b], 3));
+
+				_mm_storeu_ps((*world[a])[c].data, _mm256_castps256_ps128(r));
+				_mm_storeu_ps((*world[b])[c].data, _mm256_extractf128_ps(r, 1));
+			}
+		}
+	}
+
+	compute_model_transforms_generic(world + i, parents + i, s + i, rot + i, trans + i, count - i);
+}
+
+// The unmasked forms of most AVX-512 permutes, gathers and extracts pass _mm512_undefined_ps() through,
+// which GCC 12 reports as maybe-uninitialized. The masked forms with every lane enabled compile to the same
+// instructions, so use them with an explicit zero passthrough instead.
+static constexpr __mmask16 AllLanes = 0xffff;
+
+GRANITE_TARGET_AVX512 static inline void transpose_lanes(__m512 &a, __m512 &b, __m512 &c, __m512 &d)
+{
+	const __m512 zero = _mm512_setzero_ps();
+	__m512 t0 = _mm512_mask_unpacklo_ps(zero, AllLanes, a, b);
+	__m512 t1 = _mm512_mask_unpackhi_ps(zero, AllLanes, a, b);
+	__m512 t2 = _mm512_mask_unpacklo_ps(zero, AllLanes, c, d);
+	__m512 t3 = _mm512_mask_unpackhi_ps(zero, AllLanes, c, d);
+	a = _mm512_mask_shuffle_ps(zero, AllLanes, t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	b = _mm512_mask_shuffle_ps(zero, AllLanes, t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	c = _mm512_mask_shuffle_ps(zero, AllLanes, t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	d = _mm512_mask_shuffle_ps(zero, AllLanes, t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+GRANITE_TARGET_AVX512 static inline __m512 load_columns(const mat4 *const *p, unsigned col)
+{
+	__m512 v = _mm512_mask_broadcast_f32x4(_mm512_setzero_ps(), AllLanes, _mm_loadu_ps((*p[0])[col].data));
+	v = _mm512_insertf32x4(v, _mm_loadu_ps((*p[1])[col].data), 1);
+	v = _mm512_insertf32x4(v, _mm_loadu_ps((*p[2])[col].data), 2);
+	v = _mm512_insertf32x4(v, _mm_loadu_ps((*p[3])[col].data), 3);
+	return v;
+}
+
+GRANITE_TARGET_AVX512 static void compute_model_transforms_avx512(mat4 *const *world, const mat4 *const *parents,
+                                                                  const vec3 *s, const quat *rot, const vec3 *trans,
+                                                                  size_t count)
+{
+	// Lane order after transpose_lanes is 0, 4, 8, 12, 1, 5, 9, 13, etc. Index vec3 components to match.
+	const __m512i vec3_index = _mm512_setr_epi32(0, 12, 24, 36, 3, 15, 27, 39, 6, 18, 30, 42, 9, 21, 33, 45);
+	const __m512 one = _mm512_set1_ps(1.0f);
+	const __m512 zero = _mm512_setzero_ps();
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const float *q = rot[i].as_vec4().data;
+		__m512 x = _mm512_loadu_ps(q + 0);
+		__m512 y = _mm512_loadu_ps(q + 16);
+		__m512 z = _mm512_loadu_ps(q + 32);
+		__m512 w = _mm512_loadu_ps(q + 48);
+		transpose_lanes(x, y, z, w);
+
+		__m512 sx = _mm512_mask_i32gather_ps(zero, AllLanes, vec3_index, s[i].data + 0, 4);
+		__m512 sy = _mm512_mask_i32gather_ps(zero, AllLanes, vec3_index, s[i].data + 1, 4);
+		__m512 sz = _mm512_mask_i32gather_ps(zero, AllLanes, vec3_index, s[i].data + 2, 4);
+		__m512 tx = _mm512_mask_i32gather_ps(zero, AllLanes, vec3_index, trans[i].data + 0, 4);
+		__m512 ty = _mm512_mask_i32gather_ps(zero, AllLanes, vec3_index, trans[i].data + 1, 4);
+		__m512 tz = _mm512_mask_i32gather_ps(zero, AllLanes, vec3_index, trans[i].data + 2, 4);
+
+		__m512 x2 = _mm512_add_ps(x, x);
+		__m512 y2 = _mm512_add_ps(y, y);
+		__m512 z2 = _mm512_add_ps(z, z);
+		__m512 xx = _mm512_mul_ps(x, x2);
+		__m512 yy = _mm512_mul_ps(y, y2);
+		__m512 zz = _mm512_mul_ps(z, z2);
+		__m512 xy = _mm512_mul_ps(x, y2);
+		__m512 xz = _mm512_mul_ps(x, z2);
+		__m512 yz = _mm512_mul_ps(y, z2);
+		__m512 wx = _mm512_mul_ps(w, x2);
+		__m512 wy = _mm512_mul_ps(w, y2);
+		__m512 wz = _mm512_mul_ps(w, z2);
+
+		__m512 m[4][4];
+		m[0][0] = _mm512_mul_ps(_mm512_sub_ps(one, _mm512_add_ps(yy, zz)), sx);
+		m[0][1] = _mm512_mul_ps(_mm512_add_ps(xy, wz), sx);
+		m[0][2] = _mm512_mul_ps(_mm512_sub_ps(xz, wy), sx);
+		m[0][3] = zero;
+		m[1][0] = _mm512_mul_ps(_mm512_sub_ps(xy, wz), sy);
+		m[1][1] = _mm512_mul_ps(_mm512_sub_ps(one, _mm512_add_ps(xx, zz)), sy);
+		m[1][2] = _mm512_mul_ps(_mm512_add_ps(yz, wx), sy);
+		m[1][3] = zero;
+		m[2][0] = _mm512_mul_ps(_mm512_add_ps(xz, wy), sz);
+		m[2][1] = _mm512_mul_ps(_mm512_sub_ps(yz, wx), sz);
+		m[2][2] = _mm512_mul_ps(_mm512_sub_ps(one, _mm512_add_ps(xx, yy)), sz);
+		m[2][3] = zero;
+		m[3][0] = tx;
+		m[3][1] = ty;
+		m[3][2] = tz;
+		m[3][3] = one;
+
+		// m[c][k] is now column c of transforms i + 4k to i + 4k + 3.
+		for (auto &col : m)
+			transpose_lanes(col[0], col[1], col[2], col[3]);
+
+		for (unsigned k = 0; k < 4; k++)
+		{
+			size_t a = i + 4 * k;
+			__m512 p0 = load_columns(parents + a, 0);
+			__m512 p1 = load_columns(parents + a, 1);
+			__m512 p2 = load_columns(parents + a, 2);
+
+			for (unsigned c = 0; c < 4; c++)
+			{
+				__m512 v = m[c][k];
+				__m512 r = _mm512_mul_ps(p0, _mm512_mask_permute_ps(zero, AllLanes, v, _MM_SHUFFLE(0, 0, 0, 0)));
+				r = _mm512_add_ps(r, _mm512_mul_ps(p1, _mm512_mask_permute_ps(zero, AllLanes, v, _MM_SHUFFLE(1, 1, 1, 1))));
+				r = _mm512_add_ps(r, _mm512_mul_ps(p2, _mm512_mask_permute_ps(zero, AllLanes, v, _MM_SHUFFLE(2, 2, 2, 2))));
+				if (c == 3)
+					r = _mm512_add_ps(r, load_columns(parents + a, 3));
+
+				_mm_storeu_ps((*world[a + 0])[c].data, _mm512_mask_extractf32x4_ps(_mm_setzero_ps(), 0xf, r, 0));
+				_mm_storeu_ps((*world[a + 1])[c].data, _mm512_mask_extractf32x4_ps(_mm_setzero_ps(), 0xf, r, 1));
+				_mm_storeu_ps((*world[a + 2])[c].data, _mm512_mask_extractf32x4_ps(_mm_setzero_ps(), 0xf, r, 2));
+				_mm_storeu_ps((*world[a + 3])[c].data, _mm512_mask_extractf32x4_ps(_mm_setzero_ps(), 0xf, r, 3));
+			}
+		}
+	}
+
+	// Any AVX-512 CPU also has AVX2.
+	compute_model_transforms_avx2(world + i, parents + i, s + i, rot + i, trans + i, count - i);
+}
+#endif
+
+static bool batch_transform_path_supported(BatchTransformPath path)
+{
+	switch (path)
+	{
+	case BatchTransformPath::Generic:
+		return true;
+#ifdef GRANITE_BATCH_TRANSFORM_X86
+	case BatchTransformPath::AVX2:
+		return __builtin_cpu_supports("avx2");
+	case BatchTransformPath::AVX512:
+		return __builtin_cpu_supports("avx512f");
+#endif
+	default:
+		return false;
+	}
+}
+
+static BatchTransformPath select_batch_transform_path()
+{
+	if (batch_transform_path_supported(BatchTransformPath::AVX512))
+		return BatchTransformPath::AVX512;
+	else if (batch_transform_path_supported(BatchTransformPath::AVX2))
+		return BatchTransformPath::AVX2;
+	else
+		return BatchTransformPath::Generic;
+}
+
+static BatchTransformPath batch_transform_path = select_batch_transform_path();
+
+bool set_batch_transform_path(BatchTransformPath path)
+{
+	if (!batch_transform_path_supported(path))
+		return false;
+	batch_transform_path = path;
+	return true;
+}
+
+BatchTransformPath get_batch_transform_path()
+{
+	return batch_transform_path;
+}
+
+void compute_model_transforms(mat4 *const *world, const mat4 *const *parents,
+                              const vec3 *s, const quat *rot, const vec3 *trans, size_t count)
+{
+	switch (batch_transform_path)
+	{
+#ifdef GRANITE_BATCH_TRANSFORM_X86
+	case BatchTransformPath::AVX512:
+		compute_model_transforms_avx512(world, parents, s, rot, trans, count);
+		break;
+
+	case BatchTransformPath::AVX2:
+		compute_model_transforms_avx2(world, parents, s, rot, trans, count);
+		break;
+#endif
+
+	default:
+		compute_model_transforms_generic(world, parents, s, rot, trans, count);
+		break;
+	}
+}
+
 void compute_normal_transform(mat4 &normal, const mat4 &world)
 {
 	normal = mat4(transpose(inverse(mat3(world))));
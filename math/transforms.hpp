@@ -36,6 +36,23 @@ bool compute_plane_refraction(mat4 &projection, mat4 &view, vec3 camera_pos, vec
                               float radius_up, float radius_other, float &z_near, float z_far);
 
 void compute_model_transform(mat4 &world, vec3 scale, quat rotation, vec3 translation, const mat4 &parent);
+// Batched variant of compute_model_transform. Inputs are packed arrays, while the outputs and parents
+// are pointers since they normally live in scene nodes. Outputs must not alias any parent in the same batch.
+// Several transforms are processed per iteration with AVX2 or AVX-512 when the CPU supports it.
+void compute_model_transforms(mat4 *const *world, const mat4 *const *parents,
+                              const vec3 *scale, const quat *rotation, const vec3 *translation, size_t count);
+
+enum class BatchTransformPath
+{
+	Generic,
+	AVX2,
+	AVX512
+};
+
+// The path is selected from CPU features on startup. Overriding it is mostly useful for testing.
+// Returns false if the CPU cannot run the requested path.
+bool set_batch_transform_path(BatchTransformPath path);
+BatchTransformPath get_batch_transform_path();
 
 void compute_normal_transform(mat4 &normal, const mat4 &world);
 
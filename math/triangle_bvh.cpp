@@ -0,0 +1,873 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "triangle_bvh.hpp"
+#include "simd_headers.hpp"
+#include <algorithm>
+#include <thread>
+#include <float.h>
+#include <math.h>
+
+namespace Granite
+{
+namespace
+{
+struct BuildTriangle
+{
+	vec3 lo;
+	vec3 hi;
+	vec3 centroid;
+};
+
+struct Bin
+{
+	vec3 lo;
+	vec3 hi;
+	uint32_t count;
+};
+
+enum
+{
+	MaxBins = 64,
+	// Past this depth, splits fall back to median to bound the traversal stack.
+	MedianSplitDepth = 48,
+	MaxStackDepth = 128,
+	// Don't bother spawning threads for small subtrees.
+	ParallelThreshold = 16 * 1024
+};
+
+static inline void reset_bounds(vec3 &lo, vec3 &hi)
+{
+	lo = vec3(FLT_MAX);
+	hi = vec3(-FLT_MAX);
+}
+
+static inline float half_surface_area(const vec3 &lo, const vec3 &hi)
+{
+	vec3 d = max(hi - lo, vec3(0.0f));
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+struct Builder
+{
+	const BuildTriangle *tris;
+	uint32_t *order;
+	unsigned max_leaf_triangles;
+	unsigned num_bins;
+	unsigned spawn_depth;
+
+	unsigned bin_index(float c, float lo, float scale) const
+	{
+		auto b = unsigned((c - lo) * scale);
+		return std::min(b, num_bins - 1);
+	}
+
+	uint32_t split(uint32_t begin, uint32_t end, const vec3 &centroid_lo, const vec3 &centroid_hi, unsigned depth) const
+	{
+		float best_cost = FLT_MAX;
+		int best_axis = -1;
+		unsigned best_split = 0;
+		int widest_axis = 0;
+		vec3 extent = centroid_hi - centroid_lo;
+
+		for (int axis = 0; axis < 3; axis++)
+			if (extent[axis] > extent[widest_axis])
+				widest_axis = axis;
+
+		if (depth < MedianSplitDepth)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (extent[axis] <= 0.0f)
+					continue;
+
+				Bin bins[MaxBins];
+				for (unsigned i = 0; i < num_bins; i++)
+				{
+					reset_bounds(bins[i].lo, bins[i].hi);
+					bins[i].count = 0;
+				}
+
+				float lo = centroid_lo[axis];
+				float scale = float(num_bins) / extent[axis];
+				for (uint32_t i = begin; i < end; i++)
+				{
+					auto &tri = tris[order[i]];
+					auto &bin = bins[bin_index(tri.centroid[axis], lo, scale)];
+					bin.lo = min(bin.lo, tri.lo);
+					bin.hi = max(bin.hi, tri.hi);
+					bin.count++;
+				}
+
+				// Sweep from the right to get the cost of the right side for every split plane.
+				float right_area[MaxBins];
+				uint32_t right_count[MaxBins];
+				vec3 acc_lo, acc_hi;
+				reset_bounds(acc_lo, acc_hi);
+				uint32_t acc_count = 0;
+				for (unsigned i = num_bins - 1; i > 0; i--)
+				{
+					acc_lo = min(acc_lo, bins[i].lo);
+					acc_hi = max(acc_hi, bins[i].hi);
+					acc_count += bins[i].count;
+					right_area[i] = half_surface_area(acc_lo, acc_hi);
+					right_count[i] = acc_count;
+				}
+
+				reset_bounds(acc_lo, acc_hi);
+				acc_count = 0;
+				for (unsigned i = 1; i < num_bins; i++)
+				{
+					acc_lo = min(acc_lo, bins[i - 1].lo);
+					acc_hi = max(acc_hi, bins[i - 1].hi);
+					acc_count += bins[i - 1].count;
+					if (acc_count == 0 || right_count[i] == 0)
+						continue;
+
+					float cost = half_surface_area(acc_lo, acc_hi) * float(acc_count) +
+					             right_area[i] * float(right_count[i]);
+					if (cost < best_cost)
+					{
+						best_cost = cost;
+						best_axis = axis;
+						best_split = i;
+					}
+				}
+			}
+		}
+
+		if (best_axis >= 0)
+		{
+			float lo = centroid_lo[best_axis];
+			float scale = float(num_bins) / extent[best_axis];
+			auto *mid = std::partition(order + begin, order + end, [&](uint32_t index) {
+				return bin_index(tris[index].centroid[best_axis], lo, scale) < best_split;
+			});
+
+			auto mid_index = uint32_t(mid - order);
+			if (mid_index != begin && mid_index != end)
+				return mid_index;
+		}
+
+		// No usable SAH split, e.g. all centroids are equal or we're too deep. Split at the median.
+		uint32_t mid = begin + (end - begin) / 2;
+		std::nth_element(order + begin, order + mid, order + end, [&](uint32_t a, uint32_t b) {
+			float ca = tris[a].centroid[widest_axis];
+			float cb = tris[b].centroid[widest_axis];
+			return ca < cb || (ca == cb && a < b);
+		});
+		return mid;
+	}
+
+	void build(std::vector<TriangleBVH::Node> &nodes, uint32_t node_index,
+	           uint32_t begin, uint32_t end, unsigned depth) const
+	{
+		vec3 lo, hi, centroid_lo, centroid_hi;
+		reset_bounds(lo, hi);
+		reset_bounds(centroid_lo, centroid_hi);
+		for (uint32_t i = begin; i < end; i++)
+		{
+			auto &tri = tris[order[i]];
+			lo = min(lo, tri.lo);
+			hi = max(hi, tri.hi);
+			centroid_lo = min(centroid_lo, tri.centroid);
+			centroid_hi = max(centroid_hi, tri.centroid);
+		}
+
+		nodes[node_index].lo = lo;
+		nodes[node_index].hi = hi;
+
+		uint32_t count = end - begin;
+		if (count <= max_leaf_triangles)
+		{
+			nodes[node_index].offset = begin;
+			nodes[node_index].count = count;
+			return;
+		}
+
+		uint32_t mid = split(begin, end, centroid_lo, centroid_hi, depth);
+
+		auto left = uint32_t(nodes.size());
+		nodes.resize(nodes.size() + 2);
+		nodes[node_index].offset = left;
+		nodes[node_index].count = 0;
+
+		if (depth < spawn_depth && count >= ParallelThreshold)
+		{
+			// Right subtree is built into a separate array and spliced in afterwards.
+			std::vector<TriangleBVH::Node> right_nodes(1);
+			std::thread worker([&]() {
+				build(right_nodes, 0, mid, end, depth + 1);
+			});
+			build(nodes, left, begin, mid, depth + 1);
+			worker.join();
+
+			auto base = uint32_t(nodes.size()) - 1;
+			auto remap = [base](TriangleBVH::Node node) {
+				if (node.count == 0)
+					node.offset += base;
+				return node;
+			};
+
+			nodes[left + 1] = remap(right_nodes.front());
+			nodes.reserve(nodes.size() + right_nodes.size() - 1);
+			for (size_t i = 1; i < right_nodes.size(); i++)
+				nodes.push_back(remap(right_nodes[i]));
+		}
+		else
+		{
+			build(nodes, left, begin, mid, depth + 1);
+			build(nodes, left + 1, mid, end, depth + 1);
+		}
+	}
+};
+
+static inline vec3 safe_inverse(const vec3 &dir)
+{
+	// Avoids 0 * inf = NaN in the slab test when the origin lies on a slab plane.
+	vec3 result;
+	for (int i = 0; i < 3; i++)
+	{
+		float d = dir[i];
+		if (fabsf(d) < 1e-30f)
+			d = d < 0.0f ? -1e-30f : 1e-30f;
+		result[i] = 1.0f / d;
+	}
+	return result;
+}
+
+static inline bool intersect_box(const TriangleBVH::Node &node, const vec3 &origin, const vec3 &inv_dir,
+                                 float limit, float &t_near)
+{
+	vec3 t0 = (node.lo - origin) * inv_dir;
+	vec3 t1 = (node.hi - origin) * inv_dir;
+	vec3 t_min = min(t0, t1);
+	vec3 t_max = max(t0, t1);
+	float tn = std::max(std::max(t_min.x, t_min.y), std::max(t_min.z, 0.0f));
+	float tf = std::min(std::min(t_max.x, t_max.y), std::min(t_max.z, limit));
+	t_near = tn;
+	return tn <= tf;
+}
+
+static inline bool intersect_triangle(const TriangleBVH::Triangle &tri, const vec3 &origin, const vec3 &dir,
+                                      float limit, float &t, float &u, float &v)
+{
+	vec3 e1 = tri.e1.xyz();
+	vec3 e2 = tri.e2.xyz();
+	vec3 p = cross(dir, e2);
+	float det = dot(e1, p);
+	if (fabsf(det) < 1e-20f)
+		return false;
+
+	float inv_det = 1.0f / det;
+	vec3 s = origin - tri.v0.xyz();
+	u = dot(s, p) * inv_det;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+
+	vec3 q = cross(s, e1);
+	v = dot(dir, q) * inv_det;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	t = dot(e2, q) * inv_det;
+	return t >= 0.0f && t < limit;
+}
+
+static inline float box_distance_sq(const TriangleBVH::Node &node, const vec3 &p)
+{
+	vec3 d = max(max(node.lo - p, p - node.hi), vec3(0.0f));
+	return dot(d, d);
+}
+
+// Real-Time Collision Detection, 5.1.5.
+static vec3 closest_point_triangle(const vec3 &p, const vec3 &a, const vec3 &b, const vec3 &c)
+{
+	vec3 ab = b - a;
+	vec3 ac = c - a;
+	vec3 ap = p - a;
+	float d1 = dot(ab, ap);
+	float d2 = dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+		return a;
+
+	vec3 bp = p - b;
+	float d3 = dot(ab, bp);
+	float d4 = dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+		return b;
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		return a + ab * (d1 / (d1 - d3));
+
+	vec3 cp = p - c;
+	float d5 = dot(ab, cp);
+	float d6 = dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+		return c;
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		return a + ac * (d2 / (d2 - d6));
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+	float denom = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Separating axis test, 3 box normals, triangle normal and the 9 edge cross products.
+static bool triangle_box_overlap(const vec3 &center, const vec3 &extent,
+                                 const vec3 &a, const vec3 &b, const vec3 &c)
+{
+	vec3 v[3] = { a - center, b - center, c - center };
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float lo = std::min(std::min(v[0][axis], v[1][axis]), v[2][axis]);
+		float hi = std::max(std::max(v[0][axis], v[1][axis]), v[2][axis]);
+		if (lo > extent[axis] || hi < -extent[axis])
+			return false;
+	}
+
+	vec3 edges[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+	vec3 n = cross(edges[0], edges[1]);
+	if (fabsf(dot(n, v[0])) > dot(extent, abs(n)))
+		return false;
+
+	for (auto &edge : edges)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			vec3 unit(0.0f);
+			unit[axis] = 1.0f;
+			vec3 sep = cross(unit, edge);
+			float p0 = dot(v[0], sep);
+			float p1 = dot(v[1], sep);
+			float p2 = dot(v[2], sep);
+			float r = dot(extent, abs(sep));
+			if (std::min(std::min(p0, p1), p2) > r || std::max(std::max(p0, p1), p2) < -r)
+				return false;
+		}
+	}
+
+	return true;
+}
+}
+
+void TriangleBVH::build(const vec4 *positions, const uint32_t *indices_, size_t num_triangles)
+{
+	build(positions, indices_, num_triangles, {});
+}
+
+void TriangleBVH::build(const vec4 *positions, const uint32_t *indices_, size_t num_triangles,
+                        const BuildOptions &options)
+{
+	nodes.clear();
+	triangles.clear();
+	triangle_ids.clear();
+	indices.assign(indices_, indices_ + num_triangles * 3);
+
+	if (!num_triangles)
+		return;
+
+	std::vector<BuildTriangle> tris(num_triangles);
+	for (size_t i = 0; i < num_triangles; i++)
+	{
+		vec3 a = positions[indices[3 * i + 0]].xyz();
+		vec3 b = positions[indices[3 * i + 1]].xyz();
+		vec3 c = positions[indices[3 * i + 2]].xyz();
+		auto &tri = tris[i];
+		tri.lo = min(min(a, b), c);
+		tri.hi = max(max(a, b), c);
+		tri.centroid = 0.5f * (tri.lo + tri.hi);
+	}
+
+	triangle_ids.resize(num_triangles);
+	for (size_t i = 0; i < num_triangles; i++)
+		triangle_ids[i] = uint32_t(i);
+
+	unsigned num_threads = options.num_threads;
+	if (num_threads == 0)
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+	Builder builder = {};
+	builder.tris = tris.data();
+	builder.order = triangle_ids.data();
+	builder.max_leaf_triangles = std::max(1u, options.max_leaf_triangles);
+	builder.num_bins = std::max(2u, std::min<unsigned>(options.num_bins, MaxBins));
+	while ((1u << builder.spawn_depth) < num_threads)
+		builder.spawn_depth++;
+
+	nodes.reserve(2 * num_triangles);
+	nodes.resize(1);
+	builder.build(nodes, 0, 0, uint32_t(num_triangles), 0);
+	nodes.shrink_to_fit();
+
+	triangles.resize(num_triangles);
+	update_triangles(positions);
+}
+
+void TriangleBVH::update_triangles(const vec4 *positions)
+{
+	size_t count = triangle_ids.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t id = triangle_ids[i];
+		vec3 a = positions[indices[3 * id + 0]].xyz();
+		vec3 b = positions[indices[3 * id + 1]].xyz();
+		vec3 c = positions[indices[3 * id + 2]].xyz();
+		auto &tri = triangles[i];
+		tri.v0 = vec4(a, 0.0f);
+		tri.e1 = vec4(b - a, 0.0f);
+		tri.e2 = vec4(c - a, 0.0f);
+	}
+}
+
+void TriangleBVH::refit(const vec4 *positions)
+{
+	update_triangles(positions);
+
+	// Children are always allocated after their parent, so a reverse sweep visits children first.
+	for (size_t i = nodes.size(); i; i--)
+	{
+		auto &node = nodes[i - 1];
+		if (node.count)
+		{
+			vec3 lo, hi;
+			reset_bounds(lo, hi);
+			for (uint32_t j = node.offset; j < node.offset + node.count; j++)
+			{
+				uint32_t id = triangle_ids[j];
+				for (unsigned k = 0; k < 3; k++)
+				{
+					vec3 p = positions[indices[3 * id + k]].xyz();
+					lo = min(lo, p);
+					hi = max(hi, p);
+				}
+			}
+			node.lo = lo;
+			node.hi = hi;
+		}
+		else
+		{
+			auto &left = nodes[node.offset];
+			auto &right = nodes[node.offset + 1];
+			node.lo = min(left.lo, right.lo);
+			node.hi = max(left.hi, right.hi);
+		}
+	}
+}
+
+bool TriangleBVH::raycast_single(const Ray &ray, Hit &hit, bool any_hit) const
+{
+	hit.t = ray.tmax;
+	hit.u = 0.0f;
+	hit.v = 0.0f;
+	hit.triangle = InvalidTriangle;
+
+	float t_near;
+	vec3 inv_dir = safe_inverse(ray.direction);
+	if (nodes.empty() || !intersect_box(nodes.front(), ray.origin, inv_dir, hit.t, t_near))
+		return false;
+
+	struct StackEntry
+	{
+		uint32_t node;
+		float t_near;
+	};
+	StackEntry stack[MaxStackDepth];
+	unsigned stack_size = 0;
+	uint32_t node_index = 0;
+
+	for (;;)
+	{
+		auto &node = nodes[node_index];
+		if (node.count)
+		{
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+			{
+				float t, u, v;
+				if (intersect_triangle(triangles[i], ray.origin, ray.direction, hit.t, t, u, v))
+				{
+					hit.t = t;
+					hit.u = u;
+					hit.v = v;
+					hit.triangle = triangle_ids[i];
+					if (any_hit)
+						return true;
+				}
+			}
+		}
+		else
+		{
+			float t_left, t_right;
+			bool hit_left = intersect_box(nodes[node.offset], ray.origin, inv_dir, hit.t, t_left);
+			bool hit_right = intersect_box(nodes[node.offset + 1], ray.origin, inv_dir, hit.t, t_right);
+
+			if (hit_left && hit_right)
+			{
+				uint32_t near_node = node.offset;
+				uint32_t far_node = node.offset + 1;
+				if (t_right < t_left)
+				{
+					std::swap(near_node, far_node);
+					std::swap(t_left, t_right);
+				}
+
+				stack[stack_size++] = { far_node, t_right };
+				node_index = near_node;
+				continue;
+			}
+			else if (hit_left || hit_right)
+			{
+				node_index = hit_left ? node.offset : node.offset + 1;
+				continue;
+			}
+		}
+
+		// Pop until we find a node which can still contain a closer hit.
+		for (;;)
+		{
+			if (!stack_size)
+				return hit.triangle != InvalidTriangle;
+
+			auto &entry = stack[--stack_size];
+			if (entry.t_near <= hit.t)
+			{
+				node_index = entry.node;
+				break;
+			}
+		}
+	}
+}
+
+bool TriangleBVH::raycast(const Ray &ray, Hit &hit) const
+{
+	return raycast_single(ray, hit, false);
+}
+
+bool TriangleBVH::raycast_any(const Ray &ray) const
+{
+	Hit hit;
+	return raycast_single(ray, hit, true);
+}
+
+#if defined(__SSE3__)
+namespace
+{
+struct RayPacket
+{
+	__m128 ox, oy, oz;
+	__m128 dx, dy, dz;
+	__m128 ix, iy, iz;
+	__m128 t, u, v;
+	__m128i id;
+};
+
+static inline __m128 intersect_box_packet(const TriangleBVH::Node &node, const RayPacket &p, __m128 &t_near)
+{
+	__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.lo.x), p.ox), p.ix);
+	__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.hi.x), p.ox), p.ix);
+	__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.lo.y), p.oy), p.iy);
+	__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.hi.y), p.oy), p.iy);
+	__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.lo.z), p.oz), p.iz);
+	__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.hi.z), p.oz), p.iz);
+
+	__m128 tn = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+	                       _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+	__m128 tf = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+	                       _mm_min_ps(_mm_max_ps(t0z, t1z), p.t));
+	t_near = tn;
+	return _mm_cmple_ps(tn, tf);
+}
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline void intersect_triangle_packet(const TriangleBVH::Triangle &tri, uint32_t id, RayPacket &p)
+{
+	__m128 e1x = _mm_set1_ps(tri.e1.x), e1y = _mm_set1_ps(tri.e1.y), e1z = _mm_set1_ps(tri.e1.z);
+	__m128 e2x = _mm_set1_ps(tri.e2.x), e2y = _mm_set1_ps(tri.e2.y), e2z = _mm_set1_ps(tri.e2.z);
+
+	// p = cross(dir, e2)
+	__m128 px = _mm_sub_ps(_mm_mul_ps(p.dy, e2z), _mm_mul_ps(p.dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(p.dz, e2x), _mm_mul_ps(p.dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(p.dx, e2y), _mm_mul_ps(p.dy, e2x));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+	__m128 mask = _mm_cmpge_ps(abs_det, _mm_set1_ps(1e-20f));
+	__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	__m128 sx = _mm_sub_ps(p.ox, _mm_set1_ps(tri.v0.x));
+	__m128 sy = _mm_sub_ps(p.oy, _mm_set1_ps(tri.v0.y));
+	__m128 sz = _mm_sub_ps(p.oz, _mm_set1_ps(tri.v0.z));
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv_det);
+
+	// q = cross(s, e1)
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p.dx, qx), _mm_mul_ps(p.dy, qy)), _mm_mul_ps(p.dz, qz)), inv_det);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(u, one));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(t, zero));
+	mask = _mm_and_ps(mask, _mm_cmplt_ps(t, p.t));
+
+	if (_mm_movemask_ps(mask) == 0)
+		return;
+
+	p.t = select(mask, t, p.t);
+	p.u = select(mask, u, p.u);
+	p.v = select(mask, v, p.v);
+	__m128i imask = _mm_castps_si128(mask);
+	p.id = _mm_or_si128(_mm_and_si128(imask, _mm_set1_epi32(int(id))), _mm_andnot_si128(imask, p.id));
+}
+}
+
+void TriangleBVH::raycast_packet(const Ray *rays, Hit *hits, unsigned count) const
+{
+	alignas(16) float o[3][4], d[3][4], inv[3][4], t[4];
+	for (unsigned i = 0; i < 4; i++)
+	{
+		// Unused lanes get a negative range so they never hit anything.
+		const Ray &ray = rays[i < count ? i : 0];
+		vec3 inv_dir = safe_inverse(ray.direction);
+		for (int c = 0; c < 3; c++)
+		{
+			o[c][i] = ray.origin[c];
+			d[c][i] = ray.direction[c];
+			inv[c][i] = inv_dir[c];
+		}
+		t[i] = i < count ? ray.tmax : -1.0f;
+	}
+
+	RayPacket p;
+	p.ox = _mm_load_ps(o[0]);
+	p.oy = _mm_load_ps(o[1]);
+	p.oz = _mm_load_ps(o[2]);
+	p.dx = _mm_load_ps(d[0]);
+	p.dy = _mm_load_ps(d[1]);
+	p.dz = _mm_load_ps(d[2]);
+	p.ix = _mm_load_ps(inv[0]);
+	p.iy = _mm_load_ps(inv[1]);
+	p.iz = _mm_load_ps(inv[2]);
+	p.t = _mm_load_ps(t);
+	p.u = _mm_setzero_ps();
+	p.v = _mm_setzero_ps();
+	p.id = _mm_set1_epi32(-1);
+
+	static const uint8_t popcount4[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+	uint32_t stack[MaxStackDepth];
+	unsigned stack_size = 0;
+
+	__m128 t_near;
+	if (!nodes.empty() && _mm_movemask_ps(intersect_box_packet(nodes.front(), p, t_near)) != 0)
+		stack[stack_size++] = 0;
+
+	while (stack_size)
+	{
+		uint32_t node_index = stack[--stack_size];
+		for (;;)
+		{
+			auto &node = nodes[node_index];
+			if (node.count)
+			{
+				for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+					intersect_triangle_packet(triangles[i], triangle_ids[i], p);
+				break;
+			}
+
+			__m128 t_left, t_right;
+			__m128 mask_left = intersect_box_packet(nodes[node.offset], p, t_left);
+			__m128 mask_right = intersect_box_packet(nodes[node.offset + 1], p, t_right);
+			int bits_left = _mm_movemask_ps(mask_left);
+			int bits_right = _mm_movemask_ps(mask_right);
+
+			if (bits_left && bits_right)
+			{
+				// Visit the child which is closer for the majority of active rays first.
+				int both = bits_left & bits_right;
+				int right_closer = both & _mm_movemask_ps(_mm_cmplt_ps(t_right, t_left));
+				bool right_first = 2 * popcount4[right_closer] > popcount4[both];
+				stack[stack_size++] = right_first ? node.offset : node.offset + 1;
+				node_index = right_first ? node.offset + 1 : node.offset;
+			}
+			else if (bits_left || bits_right)
+				node_index = bits_left ? node.offset : node.offset + 1;
+			else
+				break;
+		}
+	}
+
+	alignas(16) float out_t[4], out_u[4], out_v[4];
+	alignas(16) uint32_t out_id[4];
+	_mm_store_ps(out_t, p.t);
+	_mm_store_ps(out_u, p.u);
+	_mm_store_ps(out_v, p.v);
+	_mm_store_si128(reinterpret_cast<__m128i *>(out_id), p.id);
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		hits[i].t = out_t[i];
+		hits[i].u = out_u[i];
+		hits[i].v = out_v[i];
+		hits[i].triangle = out_id[i];
+	}
+}
+#else
+void TriangleBVH::raycast_packet(const Ray *rays, Hit *hits, unsigned count) const
+{
+	for (unsigned i = 0; i < count; i++)
+		raycast_single(rays[i], hits[i], false);
+}
+#endif
+
+void TriangleBVH::raycast(const Ray *rays, Hit *hits, size_t count) const
+{
+	for (size_t i = 0; i < count; i += 4)
+		raycast_packet(rays + i, hits + i, unsigned(std::min<size_t>(count - i, 4)));
+}
+
+void TriangleBVH::query_sphere(vec3 center, float radius, std::vector<uint32_t> &result) const
+{
+	if (nodes.empty())
+		return;
+
+	float radius_sq = radius * radius;
+	uint32_t stack[MaxStackDepth];
+	unsigned stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size)
+	{
+		auto &node = nodes[stack[--stack_size]];
+		if (box_distance_sq(node, center) > radius_sq)
+			continue;
+
+		if (node.count)
+		{
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+			{
+				auto &tri = triangles[i];
+				vec3 a = tri.v0.xyz();
+				vec3 p = closest_point_triangle(center, a, a + tri.e1.xyz(), a + tri.e2.xyz());
+				vec3 delta = p - center;
+				if (dot(delta, delta) <= radius_sq)
+					result.push_back(triangle_ids[i]);
+			}
+		}
+		else
+		{
+			stack[stack_size++] = node.offset + 1;
+			stack[stack_size++] = node.offset;
+		}
+	}
+}
+
+void TriangleBVH::query_aabb(const AABB &aabb, std::vector<uint32_t> &result) const
+{
+	if (nodes.empty())
+		return;
+
+	vec3 lo = aabb.get_minimum();
+	vec3 hi = aabb.get_maximum();
+	vec3 center = 0.5f * (lo + hi);
+	vec3 extent = 0.5f * (hi - lo);
+
+	uint32_t stack[MaxStackDepth];
+	unsigned stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size)
+	{
+		auto &node = nodes[stack[--stack_size]];
+		if (any(greaterThan(node.lo, hi)) || any(lessThan(node.hi, lo)))
+			continue;
+
+		if (node.count)
+		{
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+			{
+				auto &tri = triangles[i];
+				vec3 a = tri.v0.xyz();
+				if (triangle_box_overlap(center, extent, a, a + tri.e1.xyz(), a + tri.e2.xyz()))
+					result.push_back(triangle_ids[i]);
+			}
+		}
+		else
+		{
+			stack[stack_size++] = node.offset + 1;
+			stack[stack_size++] = node.offset;
+		}
+	}
+}
+
+AABB TriangleBVH::get_bounds() const
+{
+	if (nodes.empty())
+		return AABB(vec3(0.0f), vec3(0.0f));
+	else
+		return AABB(nodes.front().lo, nodes.front().hi);
+}
+
+unsigned TriangleBVH::get_depth() const
+{
+	if (nodes.empty())
+		return 0;
+
+	struct Entry
+	{
+		uint32_t node;
+		unsigned depth;
+	};
+	std::vector<Entry> stack = {{ 0, 1 }};
+	unsigned max_depth = 0;
+
+	while (!stack.empty())
+	{
+		auto entry = stack.back();
+		stack.pop_back();
+		max_depth = std::max(max_depth, entry.depth);
+		auto &node = nodes[entry.node];
+		if (!node.count)
+		{
+			stack.push_back({ node.offset, entry.depth + 1 });
+			stack.push_back({ node.offset + 1, entry.depth + 1 });
+		}
+	}
+
+	return max_depth;
+}
+}
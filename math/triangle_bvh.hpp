@@ -0,0 +1,129 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "math.hpp"
+#include "aabb.hpp"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Granite
+{
+// Triangle-level acceleration structure for collision meshes.
+// Positions and indices match SceneFormats::CollisionMesh layout, so
+// build(mesh.positions.data(), mesh.indices.data(), mesh.indices.size() / 3) works directly.
+// Built with binned SAH, optionally across multiple threads.
+// All queries are const and can be called concurrently.
+class TriangleBVH
+{
+public:
+	struct BuildOptions
+	{
+		unsigned max_leaf_triangles = 4;
+		unsigned num_bins = 16;
+		// 0 = use hardware concurrency, 1 = build serially.
+		// The resulting tree topology does not depend on the thread count.
+		unsigned num_threads = 0;
+	};
+
+	struct Ray
+	{
+		vec3 origin;
+		vec3 direction;
+		float tmax;
+	};
+
+	struct Hit
+	{
+		float t;
+		// Barycentrics, position = v0 * (1 - u - v) + v1 * u + v2 * v.
+		float u, v;
+		// Primitive index in the index buffer passed to build(), or InvalidTriangle.
+		uint32_t triangle;
+	};
+	enum : uint32_t { InvalidTriangle = UINT32_MAX };
+
+	void build(const vec4 *positions, const uint32_t *indices, size_t num_triangles);
+	void build(const vec4 *positions, const uint32_t *indices, size_t num_triangles, const BuildOptions &options);
+
+	// Updates node bounds for new vertex positions, keeping the existing topology.
+	// Much cheaper than a rebuild, but tree quality degrades if triangles move far relative to each other.
+	// For rigidly moving instances, transform the query into object space instead.
+	void refit(const vec4 *positions);
+
+	// Closest hit. Returns false if nothing was hit within [0, ray.tmax].
+	bool raycast(const Ray &ray, Hit &hit) const;
+	// Any hit, for occlusion queries.
+	bool raycast_any(const Ray &ray) const;
+	// Ray streams are traced in packets of 4, which pays off for coherent rays,
+	// e.g. from a camera or a light probe.
+	void raycast(const Ray *rays, Hit *hits, size_t count) const;
+
+	// Appends all triangles which intersect the volume.
+	void query_sphere(vec3 center, float radius, std::vector<uint32_t> &triangles) const;
+	void query_aabb(const AABB &aabb, std::vector<uint32_t> &triangles) const;
+
+	AABB get_bounds() const;
+	size_t get_node_count() const
+	{
+		return nodes.size();
+	}
+
+	size_t get_triangle_count() const
+	{
+		return triangle_ids.size();
+	}
+
+	unsigned get_depth() const;
+
+	struct Node
+	{
+		vec3 lo;
+		// Leaf: first triangle, internal: left child, right child is offset + 1.
+		uint32_t offset;
+		vec3 hi;
+		// 0 for internal nodes.
+		uint32_t count;
+	};
+
+	// Precomputed for Möller-Trumbore. Stored in leaf order.
+	struct Triangle
+	{
+		vec4 v0;
+		vec4 e1;
+		vec4 e2;
+	};
+
+private:
+	std::vector<Node> nodes;
+	std::vector<Triangle> triangles;
+	std::vector<uint32_t> triangle_ids;
+	std::vector<uint32_t> indices;
+
+	void update_triangles(const vec4 *positions);
+	bool raycast_single(const Ray &ray, Hit &hit, bool any_hit) const;
+	void raycast_packet(const Ray *rays, Hit *hits, unsigned count) const;
+};
+}
@@ -0,0 +1,99 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "atlas_packer.hpp"
+#include "muglm/muglm_impl.hpp"
+#include <algorithm>
+
+namespace Granite
+{
+AtlasPacker::AtlasPacker(uvec2 layer_size_, unsigned max_layers_, unsigned padding_)
+	: layer_size(layer_size_), max_layers(max_layers_), padding(padding_)
+{
+}
+
+bool AtlasPacker::pack(const uvec2 *sizes, size_t count, AtlasRect *rects)
+{
+	shelves.clear();
+	layer_heights.clear();
+	num_layers = 0;
+
+	order.resize(count);
+	for (size_t i = 0; i < count; i++)
+		order[i] = i;
+
+	// Ties are broken by width, then by index to keep placement deterministic.
+	std::sort(order.begin(), order.end(), [sizes](size_t a, size_t b) {
+		if (sizes[a].y != sizes[b].y)
+			return sizes[a].y > sizes[b].y;
+		if (sizes[a].x != sizes[b].x)
+			return sizes[a].x > sizes[b].x;
+		return a < b;
+	});
+
+	for (size_t index : order)
+	{
+		uvec2 cell = sizes[index] + uvec2(2 * padding);
+		if (cell.x > layer_size.x || cell.y > layer_size.y)
+			return false;
+
+		// First fit among existing shelves.
+		Shelf *shelf = nullptr;
+		for (auto &s : shelves)
+		{
+			if (s.height >= cell.y && s.x + cell.x <= layer_size.x)
+			{
+				shelf = &s;
+				break;
+			}
+		}
+
+		// Open a new shelf in the first layer with vertical space left, or in a new layer.
+		if (!shelf)
+		{
+			unsigned layer = 0;
+			while (layer < num_layers && layer_heights[layer] + cell.y > layer_size.y)
+				layer++;
+
+			if (layer == num_layers)
+			{
+				if (num_layers == max_layers)
+					return false;
+				layer_heights.push_back(0);
+				num_layers++;
+			}
+
+			shelves.push_back({ layer, layer_heights[layer], cell.y, 0 });
+			layer_heights[layer] += cell.y;
+			shelf = &shelves.back();
+		}
+
+		auto &rect = rects[index];
+		rect.offset = uvec2(shelf->x, shelf->y) + uvec2(padding);
+		rect.size = sizes[index];
+		rect.layer = shelf->layer;
+		shelf->x += cell.x;
+	}
+
+	return true;
+}
+}
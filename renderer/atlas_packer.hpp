@@ -0,0 +1,82 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "math.hpp"
+#include <stddef.h>
+#include <vector>
+
+namespace Granite
+{
+struct AtlasRect
+{
+	uvec2 offset;
+	uvec2 size;
+	unsigned layer;
+};
+
+// Packs rectangles into a stack of equally sized layers, e.g. a 2D array texture.
+// Uses shelf packing with the rectangles sorted by decreasing height.
+// The result only depends on the input sizes, so the same sprite set always packs the same way.
+class AtlasPacker
+{
+public:
+	// padding is a gutter around every rect which the caller can fill with clamped edge texels.
+	AtlasPacker(uvec2 layer_size, unsigned max_layers, unsigned padding = 0);
+
+	// Returns false if the rects do not fit in max_layers.
+	bool pack(const uvec2 *sizes, size_t count, AtlasRect *rects);
+
+	unsigned get_num_layers() const
+	{
+		return num_layers;
+	}
+
+	uvec2 get_layer_size() const
+	{
+		return layer_size;
+	}
+
+	unsigned get_padding() const
+	{
+		return padding;
+	}
+
+private:
+	uvec2 layer_size;
+	unsigned max_layers;
+	unsigned padding;
+	unsigned num_layers = 0;
+
+	struct Shelf
+	{
+		unsigned layer;
+		unsigned y;
+		unsigned height;
+		unsigned x;
+	};
+	std::vector<Shelf> shelves;
+	std::vector<unsigned> layer_heights;
+	std::vector<size_t> order;
+};
+}
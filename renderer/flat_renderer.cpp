@@ -25,7 +25,9 @@
 #include "device.hpp"
 #include "event.hpp"
 #include "sprite.hpp"
+#include <algorithm>
 #include <float.h>
+#include <string.h>
 
 using namespace Vulkan;
 using namespace Util;
@@ -119,22 +121,14 @@ void FlatRenderer::flush(Vulkan::CommandBuffer &cmd, const vec3 &camera_pos, con
 	queue.dispatch(Queue::Transparent, cmd, &state);
 }
 
-void FlatRenderer::render_quad(const ImageView *view, unsigned layer, Vulkan::StockSampler sampler,
-                               const vec3 &offset, const vec2 &size, const vec2 &tex_offset, const vec2 &tex_size, const vec4 &color,
-                               DrawPipeline pipeline)
+void FlatRenderer::push_quads(const ImageView *view, Vulkan::StockSampler sampler, DrawPipeline pipeline,
+                              const ivec4 &clip, float z, SpriteInstanceInfo *instance_data)
 {
-	if (color.w <= 0.0f)
-		return;
 	auto type = pipeline == DrawPipeline::AlphaBlend ? Queue::Transparent : Queue::Opaque;
 	bool layered = view && view->get_create_info().view_type == VK_IMAGE_VIEW_TYPE_2D_ARRAY;
 
 	SpriteRenderInfo sprite;
-	build_scissor(sprite.clip_quad, offset.xy(), offset.xy() + size);
-
-	auto *quads = queue.allocate_one<QuadData>();
-	auto *instance_data = queue.allocate_one<SpriteInstanceInfo>();
-	instance_data->quads = quads;
-	instance_data->count = 1;
+	sprite.clip_quad = clip;
 
 	Hasher h;
 	h.string("quad");
@@ -155,7 +149,7 @@ void FlatRenderer::render_quad(const ImageView *view, unsigned layer, Vulkan::St
 	}
 
 	auto instance_key = h.get();
-	auto sorting_key = RenderInfo::get_sprite_sort_key(type, pipe_hash, h.get(), offset.z);
+	auto sorting_key = RenderInfo::get_sprite_sort_key(type, pipe_hash, h.get(), z);
 
 	auto *sprite_data = queue.push<SpriteRenderInfo>(type, instance_key, sorting_key, RenderFunctions::sprite_render, instance_data);
 
@@ -183,6 +177,24 @@ void FlatRenderer::render_quad(const ImageView *view, unsigned layer, Vulkan::St
 		}
 		*sprite_data = sprite;
 	}
+}
+
+void FlatRenderer::render_quad(const ImageView *view, unsigned layer, Vulkan::StockSampler sampler,
+                               const vec3 &offset, const vec2 &size, const vec2 &tex_offset, const vec2 &tex_size, const vec4 &color,
+                               DrawPipeline pipeline)
+{
+	if (color.w <= 0.0f)
+		return;
+
+	ivec4 clip;
+	build_scissor(clip, offset.xy(), offset.xy() + size);
+
+	auto *quads = queue.allocate_one<QuadData>();
+	auto *instance_data = queue.allocate_one<SpriteInstanceInfo>();
+	instance_data->quads = quads;
+	instance_data->count = 1;
+
+	push_quads(view, sampler, pipeline, clip, offset.z, instance_data);
 
 	quads->layer = offset.z;
 	quads->array_layer = float(layer);
@@ -201,6 +213,88 @@ void FlatRenderer::render_quad(const ImageView *view, unsigned layer, Vulkan::St
 	quads->rotation[3] = 1.0f;
 }
 
+void FlatRenderer::push_sprite_batch(const SpriteBatchInfo &info, const QuadData *quads, unsigned count)
+{
+	if (!count)
+		return;
+
+	// One scissor for the whole batch. The shader rotates the [-1, 1] quad around its center.
+	vec2 minimum(FLT_MAX);
+	vec2 maximum(-FLT_MAX);
+	if (info.bounds_size.x != 0.0f || info.bounds_size.y != 0.0f)
+	{
+		minimum = info.bounds_offset;
+		maximum = info.bounds_offset + info.bounds_size;
+	}
+	else
+	{
+		for (unsigned i = 0; i < count; i++)
+		{
+			auto &quad = quads[i];
+			vec2 extent = 0.5f * vec2(muglm::abs(quad.rotation[0]) + muglm::abs(quad.rotation[2]),
+			                          muglm::abs(quad.rotation[1]) + muglm::abs(quad.rotation[3]));
+			vec2 scale(quad.pos_scale_x, quad.pos_scale_y);
+			vec2 a = vec2(quad.pos_off_x, quad.pos_off_y) + (0.5f - extent) * scale;
+			vec2 b = vec2(quad.pos_off_x, quad.pos_off_y) + (0.5f + extent) * scale;
+			minimum = min(minimum, min(a, b));
+			maximum = max(maximum, max(a, b));
+		}
+	}
+
+	ivec4 clip;
+	build_scissor(clip, minimum, maximum);
+
+	auto *data = queue.allocate_many<QuadData>(count);
+
+	if (info.pipeline != DrawPipeline::AlphaBlend)
+	{
+		// Depth testing resolves overlap, so a single instanced draw covers everything.
+		memcpy(data, quads, count * sizeof(QuadData));
+		float z = FLT_MAX;
+		for (unsigned i = 0; i < count; i++)
+			z = std::min(z, quads[i].layer);
+
+		auto *instance_data = queue.allocate_one<SpriteInstanceInfo>();
+		instance_data->quads = data;
+		instance_data->count = count;
+		push_quads(info.view, info.sampler, info.pipeline, clip, z, instance_data);
+		return;
+	}
+
+	// Blending needs back-to-front order, also against everything else in the transparent queue.
+	// Sort the batch by layer and push each run of equal layers as its own entry.
+	batch_order.resize(count);
+	for (unsigned i = 0; i < count; i++)
+		batch_order[i] = i;
+
+	bool sorted = true;
+	for (unsigned i = 1; i < count && sorted; i++)
+		sorted = quads[i - 1].layer >= quads[i].layer;
+
+	if (!sorted)
+	{
+		std::stable_sort(batch_order.begin(), batch_order.end(), [quads](unsigned a, unsigned b) {
+			return quads[a].layer > quads[b].layer;
+		});
+	}
+
+	for (unsigned i = 0; i < count; i++)
+		data[i] = quads[batch_order[i]];
+
+	for (unsigned begin = 0; begin < count; )
+	{
+		unsigned end = begin + 1;
+		while (end < count && data[end].layer == data[begin].layer)
+			end++;
+
+		auto *instance_data = queue.allocate_one<SpriteInstanceInfo>();
+		instance_data->quads = data + begin;
+		instance_data->count = end - begin;
+		push_quads(info.view, info.sampler, info.pipeline, clip, data[begin].layer, instance_data);
+		begin = end;
+	}
+}
+
 void FlatRenderer::render_textured_quad(const ImageView &view,
                                         const vec3 &offset, const vec2 &size, const vec2 &tex_offset,
                                         const vec2 &tex_size, DrawPipeline pipeline, const vec4 &color, Vulkan::StockSampler sampler,
@@ -69,6 +69,22 @@ struct LineStripInfo
 	ivec4 clip = ivec4(0, 0, 0x4000, 0x4000);
 };
 
+struct QuadData;
+struct SpriteInstanceInfo;
+
+struct SpriteBatchInfo
+{
+	// Plain 2D or 2D array view, e.g. from SpriteAtlas. nullptr renders untextured quads.
+	const Vulkan::ImageView *view = nullptr;
+	Vulkan::StockSampler sampler = Vulkan::StockSampler::LinearClamp;
+	DrawPipeline pipeline = DrawPipeline::AlphaBlend;
+
+	// If bounds_size is non-zero, all quads are known to lie inside this rect (in pixels),
+	// and it is used for scissoring instead of computing bounds per quad.
+	vec2 bounds_offset = vec2(0.0f);
+	vec2 bounds_size = vec2(0.0f);
+};
+
 class FlatRenderer : public EventHandler
 {
 public:
@@ -78,6 +94,10 @@ public:
 	void push_sprite(const SpriteInfo &info);
 	void push_sprites(const SpriteList &visible);
 
+	// Submits many quads sharing one texture and pipeline with a single queue entry per depth layer,
+	// rather than one per quad. The quads are copied, and transparent batches are sorted back-to-front.
+	void push_sprite_batch(const SpriteBatchInfo &info, const QuadData *quads, unsigned count);
+
 	void render_quad(const vec3 &offset, const vec2 &size, const vec4 &color);
 
 	void render_textured_quad(const Vulkan::ImageView &view, const vec3 &offset, const vec2 &size,
@@ -120,6 +140,10 @@ private:
 	                 const vec3 &offset, const vec2 &size, const vec2 &tex_offset, const vec2 &tex_size, const vec4 &color,
 	                 DrawPipeline pipeline);
 
+	void push_quads(const Vulkan::ImageView *view, Vulkan::StockSampler sampler, DrawPipeline pipeline,
+	                const ivec4 &clip, float z, SpriteInstanceInfo *instance_data);
+
 	void build_scissor(ivec4 &clip, const vec2 &minimum, const vec2 &maximum) const;
+	std::vector<unsigned> batch_order;
 };
 }
\ No newline at end of file
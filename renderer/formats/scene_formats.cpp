@@ -22,6 +22,11 @@
 
 #define NOMINMAX
 #include "scene_formats.hpp"
+#include "thread_group.hpp"
+#include "task_composer.hpp"
+#include "parallel_for.hpp"
+#include "global_managers.hpp"
+#include <algorithm>
 #include <string.h>
 #include <unordered_map>
 #include <unordered_set>
@@ -42,44 +47,243 @@ static vec3 compute_normal(const vec3 &a, const vec3 &b, const vec3 &c)
 	return n;
 }
 
-struct IndexRemapping
+namespace
 {
-	std::vector<unsigned> index_remap;
-	std::vector<unsigned> unique_attrib_to_source_index;
+struct VertexStreams
+{
+	explicit VertexStreams(const Mesh &mesh)
+		: positions(mesh.positions.data()), position_stride(mesh.position_stride)
+	{
+		if (!mesh.attributes.empty())
+		{
+			attributes = mesh.attributes.data();
+			attribute_stride = mesh.attribute_stride;
+		}
+	}
+
+	const uint8_t *positions;
+	size_t position_stride;
+	const uint8_t *attributes = nullptr;
+	size_t attribute_stride = 0;
+
+	// Hash full 32-bit words where possible. Strides are almost always a multiple of 4,
+	// so this is far cheaper than feeding the hasher a byte at a time.
+	static void hash_bytes(Hasher &h, const uint8_t *data, size_t size)
+	{
+		size_t words = size / sizeof(uint32_t);
+		for (size_t i = 0; i < words; i++)
+		{
+			uint32_t word;
+			memcpy(&word, data + i * sizeof(uint32_t), sizeof(word));
+			h.u32(word);
+		}
+
+		for (size_t i = words * sizeof(uint32_t); i < size; i++)
+			h.u32(data[i]);
+	}
+
+	uint64_t hash(size_t index) const
+	{
+		Hasher h;
+		hash_bytes(h, positions + index * position_stride, position_stride);
+		if (attributes)
+			hash_bytes(h, attributes + index * attribute_stride, attribute_stride);
+
+		// The last word is only XOR-ed into the low bits, so mix before the top bits are used for partitioning.
+		uint64_t v = h.get();
+		v ^= v >> 33;
+		v *= 0xff51afd7ed558ccdull;
+		v ^= v >> 33;
+		return v;
+	}
+
+	bool equal(size_t a, size_t b) const
+	{
+		if (memcmp(positions + a * position_stride, positions + b * position_stride, position_stride) != 0)
+			return false;
+		if (attributes && memcmp(attributes + a * attribute_stride, attributes + b * attribute_stride, attribute_stride) != 0)
+			return false;
+		return true;
+	}
 };
 
-// Find duplicate indices.
-static IndexRemapping build_index_remap_list(const Mesh &mesh)
+// Open addressing table of vertex indices keyed by hash.
+// Vertices with equal hashes are always compared byte-for-byte, so hash collisions cannot merge distinct vertices.
+class VertexTable
 {
-	unsigned attribute_count = unsigned(mesh.positions.size() / mesh.position_stride);
-	std::unordered_map<Hash, unsigned> attribute_remapper;
-	IndexRemapping remapped;
-	remapped.index_remap.reserve(attribute_count);
+public:
+	explicit VertexTable(size_t count)
+	{
+		size_t size = 16;
+		while (size < count * 2)
+			size *= 2;
+		mask = size - 1;
+		slots.resize(size, UINT32_MAX);
+	}
 
-	unsigned unique_count = 0;
-	for (unsigned i = 0; i < attribute_count; i++)
+	// Returns the first inserted vertex which is identical to index, or index itself if it is unique.
+	uint32_t find_or_insert(const VertexStreams &streams, const uint64_t *hashes, uint32_t index)
 	{
-		Hasher h;
-		h.data(mesh.positions.data() + i * mesh.position_stride, mesh.position_stride);
-		if (!mesh.attributes.empty())
-			h.data(mesh.attributes.data() + i * mesh.attribute_stride, mesh.attribute_stride);
+		uint64_t h = hashes[index];
+		for (size_t slot = h & mask;; slot = (slot + 1) & mask)
+		{
+			uint32_t candidate = slots[slot];
+			if (candidate == UINT32_MAX)
+			{
+				slots[slot] = index;
+				return index;
+			}
+			else if (hashes[candidate] == h && streams.equal(candidate, index))
+				return candidate;
+		}
+	}
 
-		auto hash = h.get();
-		auto itr = attribute_remapper.find(hash);
-		if (itr != end(attribute_remapper))
+private:
+	std::vector<uint32_t> slots;
+	size_t mask;
+};
+}
+
+static constexpr size_t ParallelDeduplicationThreshold = 64 * 1024;
+static constexpr unsigned NumDeduplicationPartitions = 256;
+
+static void build_vertex_remap_serial(VertexRemap &remap, const VertexStreams &streams, size_t count)
+{
+	std::vector<uint64_t> hashes(count);
+	for (size_t i = 0; i < count; i++)
+		hashes[i] = streams.hash(i);
+
+	VertexTable table(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t first = table.find_or_insert(streams, hashes.data(), uint32_t(i));
+		if (first == i)
 		{
-			remapped.index_remap.push_back(itr->second);
+			remap.index_remap[i] = uint32_t(remap.unique_attrib_to_source_index.size());
+			remap.unique_attrib_to_source_index.push_back(uint32_t(i));
 		}
 		else
+			remap.index_remap[i] = remap.index_remap[first];
+	}
+}
+
+// Identical vertices have identical hashes, so vertices are bucketed into partitions by hash,
+// and each partition is deduplicated independently. Partitions are filled in source order,
+// which means the first occurrence of every vertex is found exactly like the serial path.
+// Unique IDs are then assigned in source order with a scan, so the result does not depend on thread count.
+static void build_vertex_remap_parallel(VertexRemap &remap, const VertexStreams &streams, size_t count,
+                                        ThreadGroup &group)
+{
+	constexpr unsigned Partitions = NumDeduplicationPartitions;
+	unsigned num_chunks = std::max(1u, std::min(4u * group.get_num_threads(), 64u));
+
+	std::vector<uint64_t> hashes(count);
+	std::vector<uint32_t> first(count);
+	std::vector<uint32_t> sorted(count);
+	std::vector<uint32_t> chunk_offsets(num_chunks * Partitions);
+	uint32_t partition_offsets[Partitions + 1];
+	uint32_t unique_count = 0;
+
+	const auto partition_of = [](uint64_t h) { return unsigned(h >> 56); };
+
+	TaskComposer composer(group);
+
+	parallel_for(composer, "vertex-dedup-hash", count, num_chunks, nullptr, [&](const ParallelChunk &chunk) {
+		uint32_t *counts = chunk_offsets.data() + chunk.index * Partitions;
+		for (size_t i = chunk.begin; i < chunk.end; i++)
 		{
-			attribute_remapper[hash] = unique_count;
-			remapped.index_remap.push_back(unique_count);
-			remapped.unique_attrib_to_source_index.push_back(i);
-			unique_count++;
+			hashes[i] = streams.hash(i);
+			counts[partition_of(hashes[i])]++;
 		}
-	}
+	});
 
-	return remapped;
+	composer.begin_pipeline_stage().enqueue_task([&]() {
+		uint32_t offset = 0;
+		for (unsigned p = 0; p < Partitions; p++)
+		{
+			partition_offsets[p] = offset;
+			for (unsigned c = 0; c < num_chunks; c++)
+			{
+				uint32_t partition_count = chunk_offsets[c * Partitions + p];
+				chunk_offsets[c * Partitions + p] = offset;
+				offset += partition_count;
+			}
+		}
+		partition_offsets[Partitions] = offset;
+	});
+
+	parallel_for(composer, "vertex-dedup-scatter", count, num_chunks, nullptr, [&](const ParallelChunk &chunk) {
+		uint32_t *offsets = chunk_offsets.data() + chunk.index * Partitions;
+		for (size_t i = chunk.begin; i < chunk.end; i++)
+			sorted[offsets[partition_of(hashes[i])]++] = uint32_t(i);
+	});
+
+	parallel_for(composer, "vertex-dedup-partition", Partitions, Partitions, nullptr, [&](const ParallelChunk &chunk) {
+		for (size_t p = chunk.begin; p < chunk.end; p++)
+		{
+			uint32_t begin = partition_offsets[p];
+			uint32_t end = partition_offsets[p + 1];
+			if (begin == end)
+				continue;
+
+			VertexTable table(end - begin);
+			for (uint32_t i = begin; i < end; i++)
+				first[sorted[i]] = table.find_or_insert(streams, hashes.data(), sorted[i]);
+		}
+	});
+
+	parallel_scan(composer, "vertex-dedup-assign", count, num_chunks, nullptr, uint32_t(0),
+	              [&](const ParallelChunk &chunk) {
+		              uint32_t unique = 0;
+		              for (size_t i = chunk.begin; i < chunk.end; i++)
+			              if (first[i] == i)
+				              unique++;
+		              return unique;
+	              },
+	              [](uint32_t a, uint32_t b) { return a + b; },
+	              [&](const ParallelChunk &chunk, uint32_t prefix) {
+		              // sorted is no longer needed, so reuse it for the unique -> source mapping.
+		              for (size_t i = chunk.begin; i < chunk.end; i++)
+		              {
+			              if (first[i] == i)
+			              {
+				              remap.index_remap[i] = prefix;
+				              sorted[prefix] = uint32_t(i);
+				              prefix++;
+			              }
+		              }
+
+		              if (chunk.index + 1 == chunk.count)
+			              unique_count = prefix;
+	              });
+
+	// The first occurrence always has a lower index, and every unique vertex got its ID in the previous stage.
+	parallel_for(composer, "vertex-dedup-resolve", count, num_chunks, nullptr, [&](const ParallelChunk &chunk) {
+		for (size_t i = chunk.begin; i < chunk.end; i++)
+			if (first[i] != i)
+				remap.index_remap[i] = remap.index_remap[first[i]];
+	});
+
+	composer.get_outgoing_task()->wait();
+
+	sorted.resize(unique_count);
+	sorted.shrink_to_fit();
+	remap.unique_attrib_to_source_index = std::move(sorted);
+}
+
+VertexRemap mesh_build_vertex_remap(const Mesh &mesh, ThreadGroup *group)
+{
+	size_t count = mesh.positions.size() / mesh.position_stride;
+	VertexStreams streams(mesh);
+	VertexRemap remap;
+	remap.index_remap.resize(count);
+
+	if (group && group->get_num_threads() > 0 && count >= ParallelDeduplicationThreshold)
+		build_vertex_remap_parallel(remap, streams, count, *group);
+	else
+		build_vertex_remap_serial(remap, streams, count);
+
+	return remap;
 }
 
 static std::vector<uint32_t> build_canonical_index_buffer(const Mesh &mesh, const std::vector<unsigned> &index_remap)
@@ -225,7 +429,7 @@ static bool mesh_unroll_vertices(Mesh &mesh)
 
 void mesh_deduplicate_vertices(Mesh &mesh)
 {
-	auto index_remap = build_index_remap_list(mesh);
+	auto index_remap = mesh_build_vertex_remap(mesh, GRANITE_THREAD_GROUP());
 	auto index_buffer = build_canonical_index_buffer(mesh, index_remap.index_remap);
 	rebuild_new_attributes_remap_src(mesh.positions, mesh.position_stride,
 	                                 mesh.attributes, mesh.attribute_stride,
@@ -249,7 +453,7 @@ Mesh mesh_optimize_index_buffer(const Mesh &mesh, bool stripify)
 	optimized.attribute_stride = mesh.attribute_stride;
 
 	// Remove redundant indices and rewrite index and attribute buffers.
-	auto index_remap = build_index_remap_list(mesh);
+	auto index_remap = mesh_build_vertex_remap(mesh, GRANITE_THREAD_GROUP());
 	auto index_buffer = build_canonical_index_buffer(mesh, index_remap.index_remap);
 	rebuild_new_attributes_remap_src(optimized.positions, optimized.position_stride,
 	                                 optimized.attributes, optimized.attribute_stride,
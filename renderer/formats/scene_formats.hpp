@@ -33,6 +33,8 @@
 
 namespace Granite
 {
+class ThreadGroup;
+
 namespace SceneFormats
 {
 struct NodeTransform
@@ -255,6 +257,19 @@ bool mesh_renormalize_tangents(Mesh &mesh);
 bool mesh_flip_tangents_w(Mesh &mesh);
 bool extract_collision_mesh(CollisionMesh &collision_mesh, const Mesh &mesh);
 
+struct VertexRemap
+{
+	// For every source vertex, the unique vertex it maps to.
+	std::vector<uint32_t> index_remap;
+	// For every unique vertex, the first source vertex with identical data.
+	std::vector<uint32_t> unique_attrib_to_source_index;
+};
+
+// Finds vertices with bit-identical position and attribute data.
+// Unique vertices are numbered in order of first occurrence, and the result is identical
+// regardless of whether a thread group is used. Large meshes are processed in parallel if group is non-null.
+VertexRemap mesh_build_vertex_remap(const Mesh &mesh, ThreadGroup *group = nullptr);
+
 void mesh_deduplicate_vertices(Mesh &mesh);
 Mesh mesh_optimize_index_buffer(const Mesh &mesh, bool stripify);
 std::unordered_set<uint32_t> build_used_nodes_in_scene(const SceneNodes &scene, const std::vector<Node> &nodes);
@@ -0,0 +1,346 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "material_table.hpp"
+#include "command_buffer.hpp"
+#include "device.hpp"
+#include "resource_manager.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <string.h>
+
+using namespace Vulkan;
+
+namespace Granite
+{
+uint32_t MaterialTable::acquire_material(const Material &material)
+{
+	return acquire_material(material.get_hash(), material.get_info(), material.textures);
+}
+
+uint32_t MaterialTable::acquire_material(Util::Hash hash, const MaterialInfo &info, const ImageAssetID *textures)
+{
+	auto itr = material_lookup.find(hash);
+	if (itr != material_lookup.end())
+	{
+		material_slots[itr->second].refcount++;
+		return itr->second;
+	}
+
+	uint32_t index;
+	if (!free_material_slots.empty())
+	{
+		index = free_material_slots.back();
+		free_material_slots.pop_back();
+	}
+	else
+	{
+		index = uint32_t(material_slots.size());
+		material_slots.emplace_back();
+		parameters.emplace_back();
+	}
+
+	auto &params = parameters[index];
+	params.base_color = info.uniform_base_color;
+	params.emissive = vec4(info.uniform_emissive_color, info.normal_scale);
+	params.metallic = info.uniform_metallic;
+	params.roughness = info.uniform_roughness;
+	for (unsigned i = 0; i < Util::ecast(TextureKind::Count); i++)
+		params.textures[i] = textures[i] ? acquire_texture(textures[i]) : uint32_t(InvalidIndex);
+	params.padding = 0;
+
+	material_slots[index] = { hash, 1, ++version };
+	material_lookup[hash] = index;
+	return index;
+}
+
+void MaterialTable::release_material(uint32_t index)
+{
+	assert(index < material_slots.size());
+	auto &slot = material_slots[index];
+	assert(slot.refcount);
+
+	if (--slot.refcount == 0)
+	{
+		for (auto &tex : parameters[index].textures)
+			if (tex != InvalidIndex)
+				release_texture(tex);
+		material_lookup.erase(slot.hash);
+		free_material_slots.push_back(index);
+	}
+}
+
+uint32_t MaterialTable::acquire_texture(ImageAssetID id)
+{
+	auto itr = texture_lookup.find(id.id);
+	if (itr != texture_lookup.end())
+	{
+		texture_slots[itr->second].refcount++;
+		return itr->second;
+	}
+
+	uint32_t slot;
+	if (!free_texture_slots.empty())
+	{
+		slot = free_texture_slots.back();
+		free_texture_slots.pop_back();
+	}
+	else
+	{
+		slot = uint32_t(texture_slots.size());
+		texture_slots.emplace_back();
+	}
+
+	texture_slots[slot] = { id, 1 };
+	texture_lookup[id.id] = slot;
+	return slot;
+}
+
+void MaterialTable::release_texture(uint32_t slot)
+{
+	assert(slot < texture_slots.size());
+	auto &tex = texture_slots[slot];
+	assert(tex.refcount);
+
+	if (--tex.refcount == 0)
+	{
+		texture_lookup.erase(tex.id.id);
+		tex.id = {};
+		free_texture_slots.push_back(slot);
+	}
+}
+
+uint32_t MaterialTable::get_num_material_slots() const
+{
+	return uint32_t(material_slots.size());
+}
+
+const BindlessMaterialParameters *MaterialTable::get_parameters() const
+{
+	return parameters.data();
+}
+
+uint32_t MaterialTable::get_num_live_materials() const
+{
+	return uint32_t(material_lookup.size());
+}
+
+uint32_t MaterialTable::get_num_texture_slots() const
+{
+	return uint32_t(texture_slots.size());
+}
+
+ImageAssetID MaterialTable::get_texture(uint32_t slot) const
+{
+	return texture_slots[slot].id;
+}
+
+uint64_t MaterialTable::get_version() const
+{
+	return version;
+}
+
+void MaterialTable::get_dirty_material_ranges(uint64_t since_version, std::vector<Range> &ranges) const
+{
+	ranges.clear();
+	if (since_version >= version)
+		return;
+
+	for (uint32_t i = 0, n = uint32_t(material_slots.size()); i < n; i++)
+	{
+		auto &slot = material_slots[i];
+		if (!slot.refcount || slot.version <= since_version)
+			continue;
+
+		if (!ranges.empty() && ranges.back().offset + ranges.back().count == i)
+			ranges.back().count++;
+		else
+			ranges.push_back({ i, 1 });
+	}
+}
+
+void DescriptorArrayShadow::compute_updates(const uint64_t *cookies, uint32_t count, std::vector<uint32_t> &updates)
+{
+	updates.clear();
+	if (written.size() < count)
+		written.resize(count);
+
+	// Unused elements keep whatever they had, nothing should be indexing them.
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (cookies[i] && cookies[i] != written[i])
+		{
+			updates.push_back(i);
+			written[i] = cookies[i];
+		}
+	}
+}
+
+void DescriptorArrayShadow::reset()
+{
+	written.clear();
+}
+
+BindlessMaterialTable::BindlessMaterialTable(Device &device_)
+	: device(device_)
+{
+	frame_sets.resize(device.get_num_frame_contexts());
+}
+
+void BindlessMaterialTable::flush(CommandBuffer &cmd, const ResourceManager &manager)
+{
+	frame_stats = {};
+	flush_parameters(cmd);
+	flush_descriptors(manager);
+}
+
+void BindlessMaterialTable::flush_parameters(CommandBuffer &cmd)
+{
+	uint32_t num_slots = table.get_num_material_slots();
+	if (!num_slots)
+		return;
+
+	VkDeviceSize required_size = num_slots * sizeof(BindlessMaterialParameters);
+	if (!parameter_buffer || parameter_buffer->get_create_info().size < required_size)
+	{
+		uint32_t capacity = 64;
+		while (capacity < num_slots)
+			capacity *= 2;
+
+		BufferCreateInfo info = {};
+		info.size = capacity * sizeof(BindlessMaterialParameters);
+		info.domain = BufferDomain::Device;
+		info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		parameter_buffer = device.create_buffer(info);
+		device.set_name(*parameter_buffer, "material-parameters");
+
+		// A new buffer needs everything.
+		uploaded_version = 0;
+	}
+
+	table.get_dirty_material_ranges(uploaded_version, dirty_ranges);
+	uploaded_version = table.get_version();
+	if (dirty_ranges.empty())
+		return;
+
+	uint32_t num_dirty = 0;
+	for (auto &range : dirty_ranges)
+		num_dirty += range.count;
+
+	BufferCreateInfo info = {};
+	info.size = num_dirty * sizeof(BindlessMaterialParameters);
+	info.domain = BufferDomain::Host;
+	info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	auto staging = device.create_buffer(info);
+
+	auto *mapped = static_cast<BindlessMaterialParameters *>(device.map_host_buffer(*staging, MEMORY_ACCESS_WRITE_BIT));
+	std::vector<VkBufferCopy> copies;
+	copies.reserve(dirty_ranges.size());
+
+	uint32_t staging_offset = 0;
+	for (auto &range : dirty_ranges)
+	{
+		memcpy(mapped + staging_offset, table.get_parameters() + range.offset,
+		       range.count * sizeof(BindlessMaterialParameters));
+		copies.push_back({ staging_offset * sizeof(BindlessMaterialParameters),
+		                   range.offset * sizeof(BindlessMaterialParameters),
+		                   range.count * sizeof(BindlessMaterialParameters) });
+		staging_offset += range.count;
+	}
+	device.unmap_host_buffer(*staging, MEMORY_ACCESS_WRITE_BIT);
+
+	// Earlier frames may still be reading the buffer.
+	cmd.barrier(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, 0,
+	            VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+	cmd.copy_buffer(*parameter_buffer, *staging, copies.data(), copies.size());
+	cmd.barrier(VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+	            VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+
+	frame_stats.uploaded_materials = num_dirty;
+}
+
+void BindlessMaterialTable::flush_descriptors(const ResourceManager &manager)
+{
+	uint32_t num_textures = table.get_num_texture_slots();
+	if (!num_textures)
+		return;
+
+	unsigned frame_index = device.get_current_frame_context();
+	if (frame_index >= frame_sets.size())
+		frame_sets.resize(frame_index + 1);
+	auto &set = frame_sets[frame_index];
+
+	if (num_textures > VULKAN_NUM_BINDINGS_BINDLESS_VARYING)
+	{
+		LOGE("Exceeding maximum number of bindless material textures (%u > %u).\n",
+		     num_textures, VULKAN_NUM_BINDINGS_BINDLESS_VARYING);
+		num_textures = VULKAN_NUM_BINDINGS_BINDLESS_VARYING;
+	}
+
+	// Each frame context owns its set, so it is never written while the GPU might be reading it.
+	if (!set.pool || set.capacity < num_textures)
+	{
+		uint32_t capacity = std::max<uint32_t>(64, set.capacity);
+		while (capacity < num_textures)
+			capacity *= 2;
+		capacity = std::min<uint32_t>(capacity, VULKAN_NUM_BINDINGS_BINDLESS_VARYING);
+
+		set.pool = device.create_bindless_descriptor_pool(BindlessResourceType::ImageFP, 1, capacity);
+		if (!set.pool || !set.pool->allocate_descriptors(capacity))
+		{
+			LOGE("Failed to allocate bindless material descriptors.\n");
+			set.pool.reset();
+			set.capacity = 0;
+			return;
+		}
+		set.capacity = capacity;
+		set.shadow.reset();
+	}
+
+	cookies.resize(num_textures);
+	for (uint32_t i = 0; i < num_textures; i++)
+	{
+		auto id = table.get_texture(i);
+		auto *view = id ? manager.get_image_view(id) : nullptr;
+		cookies[i] = view ? view->get_cookie() : 0;
+	}
+
+	// Picks up both newly assigned slots and views which changed due to streaming.
+	set.shadow.compute_updates(cookies.data(), num_textures, descriptor_updates);
+	for (auto index : descriptor_updates)
+		set.pool->set_texture(index, *manager.get_image_view(table.get_texture(index)));
+
+	frame_stats.written_descriptors = descriptor_updates.size();
+}
+
+void BindlessMaterialTable::bind(CommandBuffer &cmd, unsigned parameter_set, unsigned parameter_binding,
+                                 unsigned texture_set) const
+{
+	if (parameter_buffer)
+		cmd.set_storage_buffer(parameter_set, parameter_binding, *parameter_buffer);
+
+	unsigned frame_index = device.get_current_frame_context();
+	if (frame_index < frame_sets.size() && frame_sets[frame_index].pool)
+		cmd.set_bindless(texture_set, frame_sets[frame_index].pool->get_descriptor_set());
+}
+}
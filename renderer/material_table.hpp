@@ -0,0 +1,172 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "material.hpp"
+#include "buffer.hpp"
+#include "descriptor_set.hpp"
+#include "hash.hpp"
+#include <unordered_map>
+#include <vector>
+
+namespace Vulkan
+{
+class CommandBuffer;
+class ResourceManager;
+}
+
+namespace Granite
+{
+// std430 layout of one entry in the material parameter buffer.
+struct BindlessMaterialParameters
+{
+	vec4 base_color;
+	vec4 emissive; // xyz: emissive color, w: normal scale.
+	float metallic;
+	float roughness;
+	uint32_t textures[Util::ecast(TextureKind::Count)]; // Indices into the bindless texture array.
+	uint32_t padding;
+};
+static_assert(sizeof(BindlessMaterialParameters) == 64, "Unexpected size of BindlessMaterialParameters.");
+
+// Scene-wide table of material parameters and the textures they reference.
+// Identical materials share a slot, and every modification bumps a version,
+// so a consumer only needs to upload what changed since the version it last saw.
+class MaterialTable
+{
+public:
+	enum { InvalidIndex = 0xffffffffu };
+
+	struct Range
+	{
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	// Reference counted. Returns the index to place in per-instance data.
+	uint32_t acquire_material(const Material &material);
+	uint32_t acquire_material(Util::Hash hash, const MaterialInfo &info, const ImageAssetID *textures);
+	void release_material(uint32_t index);
+
+	uint32_t get_num_material_slots() const;
+	const BindlessMaterialParameters *get_parameters() const;
+	uint32_t get_num_live_materials() const;
+
+	uint32_t get_num_texture_slots() const;
+	// Invalid if the slot is currently unused.
+	ImageAssetID get_texture(uint32_t slot) const;
+
+	uint64_t get_version() const;
+	// Coalesced ranges of live material slots modified after since_version.
+	void get_dirty_material_ranges(uint64_t since_version, std::vector<Range> &ranges) const;
+
+private:
+	struct MaterialSlot
+	{
+		Util::Hash hash;
+		uint32_t refcount;
+		uint64_t version;
+	};
+	std::vector<BindlessMaterialParameters> parameters;
+	std::vector<MaterialSlot> material_slots;
+	std::vector<uint32_t> free_material_slots;
+	std::unordered_map<Util::Hash, uint32_t> material_lookup;
+
+	struct TextureSlot
+	{
+		ImageAssetID id;
+		uint32_t refcount;
+	};
+	std::vector<TextureSlot> texture_slots;
+	std::vector<uint32_t> free_texture_slots;
+	std::unordered_map<uint32_t, uint32_t> texture_lookup;
+
+	uint64_t version = 0;
+
+	uint32_t acquire_texture(ImageAssetID id);
+	void release_texture(uint32_t slot);
+};
+
+// Mirrors what one copy of a descriptor array contains,
+// so only descriptors whose contents changed need to be written.
+class DescriptorArrayShadow
+{
+public:
+	// cookies[i] identifies what element i should contain, 0 if the element is unused.
+	void compute_updates(const uint64_t *cookies, uint32_t count, std::vector<uint32_t> &updates);
+	void reset();
+
+private:
+	std::vector<uint64_t> written;
+};
+
+// GPU side of the MaterialTable: a persistent parameter buffer which receives delta uploads,
+// and one persistent bindless texture set per frame context which receives delta descriptor writes.
+class BindlessMaterialTable
+{
+public:
+	explicit BindlessMaterialTable(Vulkan::Device &device);
+
+	MaterialTable &get_table()
+	{
+		return table;
+	}
+
+	// Must be called outside a render pass, before anything which binds the table this frame.
+	void flush(Vulkan::CommandBuffer &cmd, const Vulkan::ResourceManager &manager);
+	void bind(Vulkan::CommandBuffer &cmd, unsigned parameter_set, unsigned parameter_binding, unsigned texture_set) const;
+
+	struct Statistics
+	{
+		uint64_t uploaded_materials = 0;
+		uint64_t written_descriptors = 0;
+	};
+	const Statistics &get_frame_statistics() const
+	{
+		return frame_stats;
+	}
+
+private:
+	Vulkan::Device &device;
+	MaterialTable table;
+
+	Vulkan::BufferHandle parameter_buffer;
+	uint64_t uploaded_version = 0;
+
+	struct FrameSet
+	{
+		Vulkan::BindlessDescriptorPoolHandle pool;
+		uint32_t capacity = 0;
+		DescriptorArrayShadow shadow;
+	};
+	std::vector<FrameSet> frame_sets;
+	std::vector<MaterialTable::Range> dirty_ranges;
+	std::vector<uint64_t> cookies;
+	std::vector<uint32_t> descriptor_updates;
+	Statistics frame_stats;
+
+	void flush_parameters(Vulkan::CommandBuffer &cmd);
+	void flush_descriptors(const Vulkan::ResourceManager &manager);
+};
+}
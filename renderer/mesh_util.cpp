@@ -22,6 +22,7 @@
 
 #include "mesh_util.hpp"
 #include "device.hpp"
+#include "upload_manager.hpp"
 #include "material_util.hpp"
 #include "render_context.hpp"
 #include "shader_suite.hpp"
@@ -60,26 +61,29 @@ ImportedSkinnedMesh::ImportedSkinnedMesh(const Mesh &mesh_, const MaterialInfo &
 
 void ImportedSkinnedMesh::on_device_created(const DeviceCreatedEvent &created)
 {
-	auto &device = created.get_device();
+	// Scenes can have thousands of meshes, batch the uploads rather than submitting a copy per buffer.
+	// The meshes may be drawn right away, so the frame budget must not defer them.
+	auto &uploader = created.get_device().get_upload_manager();
+	auto mode = UploadManager::UploadMode::Required;
 
 	BufferCreateInfo buffer_info = {};
 	buffer_info.domain = BufferDomain::Device;
 	buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
 
 	buffer_info.size = mesh.positions.size();
-	vbo_position = device.create_buffer(buffer_info, mesh.positions.data());
+	vbo_position = uploader.create_buffer(buffer_info, mesh.positions.data(), nullptr, mode);
 
 	if (!mesh.attributes.empty())
 	{
 		buffer_info.size = mesh.attributes.size();
-		vbo_attributes = device.create_buffer(buffer_info, mesh.attributes.data());
+		vbo_attributes = uploader.create_buffer(buffer_info, mesh.attributes.data(), nullptr, mode);
 	}
 
 	if (!mesh.indices.empty())
 	{
 		buffer_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
 		buffer_info.size = mesh.indices.size();
-		ibo = device.create_buffer(buffer_info, mesh.indices.data());
+		ibo = uploader.create_buffer(buffer_info, mesh.indices.data(), nullptr, mode);
 	}
 
 	bake();
@@ -115,26 +119,27 @@ ImportedMesh::ImportedMesh(const Mesh &mesh_, const MaterialInfo &info)
 
 void ImportedMesh::on_device_created(const DeviceCreatedEvent &created)
 {
-	auto &device = created.get_device();
+	auto &uploader = created.get_device().get_upload_manager();
+	auto mode = UploadManager::UploadMode::Required;
 
 	BufferCreateInfo buffer_info = {};
 	buffer_info.domain = BufferDomain::Device;
 	buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
 
 	buffer_info.size = mesh.positions.size();
-	vbo_position = device.create_buffer(buffer_info, mesh.positions.data());
+	vbo_position = uploader.create_buffer(buffer_info, mesh.positions.data(), nullptr, mode);
 
 	if (!mesh.attributes.empty())
 	{
 		buffer_info.size = mesh.attributes.size();
-		vbo_attributes = device.create_buffer(buffer_info, mesh.attributes.data());
+		vbo_attributes = uploader.create_buffer(buffer_info, mesh.attributes.data(), nullptr, mode);
 	}
 
 	if (!mesh.indices.empty())
 	{
 		buffer_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
 		buffer_info.size = mesh.indices.size();
-		ibo = device.create_buffer(buffer_info, mesh.indices.data());
+		ibo = uploader.create_buffer(buffer_info, mesh.indices.data(), nullptr, mode);
 	}
 
 	bake();
@@ -26,6 +26,7 @@
 #include "math.hpp"
 #include "hash.hpp"
 #include <vector>
+#include <algorithm>
 
 namespace Granite
 {
@@ -117,6 +118,20 @@ public:
 		return &timestamp;
 	}
 
+	// Entity slots of spatials which follow this node, so they can be marked as changed
+	// when the transform is updated. Slots of deleted entities are not removed. If a slot is recycled,
+	// the new entity sees a spurious change, which the timestamp check in Scene rejects.
+	inline void add_spatial_slot(uint32_t slot)
+	{
+		if (std::find(spatial_slots.begin(), spatial_slots.end(), slot) == spatial_slots.end())
+			spatial_slots.push_back(slot);
+	}
+
+	inline const std::vector<uint32_t> &get_spatial_slots() const
+	{
+		return spatial_slots;
+	}
+
 	unsigned get_dirty_transform_depth() const;
 
 	inline bool test_and_set_pending_update_no_atomic()
@@ -134,6 +149,7 @@ public:
 
 private:
 	std::vector<Util::IntrusivePtr<Node>> children;
+	std::vector<uint32_t> spatial_slots;
 	Skinning *skinning = nullptr;
 	Node *parent = nullptr;
 	uint32_t timestamp = 0;
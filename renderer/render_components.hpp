@@ -146,6 +146,22 @@ struct PerFrameUpdateTransformComponent : ComponentBase
 {
 	GRANITE_COMPONENT_TYPE_DECL(PerFrameUpdateTransformComponent)
 	PerFrameRefreshableTransform *refresh = nullptr;
+
+	// Scene only re-sorts updates when the component changes,
+	// so the order is set through the owning entity, which marks the component as changed.
+	inline void set_dependency_order(Entity &owner, int order)
+	{
+		assert(owner.get_component<PerFrameUpdateTransformComponent>() == this);
+		dependency_order = order;
+		owner.mark_changed<PerFrameUpdateTransformComponent>();
+	}
+
+	inline int get_dependency_order() const
+	{
+		return dependency_order;
+	}
+
+private:
 	int dependency_order = 0;
 };
 
@@ -153,6 +169,22 @@ struct PerFrameUpdateComponent : ComponentBase
 {
 	GRANITE_COMPONENT_TYPE_DECL(PerFrameUpdateComponent)
 	PerFrameRefreshable *refresh = nullptr;
+
+	// Scene only re-sorts updates when the component changes,
+	// so the order is set through the owning entity, which marks the component as changed.
+	inline void set_dependency_order(Entity &owner, int order)
+	{
+		assert(owner.get_component<PerFrameUpdateComponent>() == this);
+		dependency_order = order;
+		owner.mark_changed<PerFrameUpdateComponent>();
+	}
+
+	inline int get_dependency_order() const
+	{
+		return dependency_order;
+	}
+
+private:
 	int dependency_order = 0;
 };
 
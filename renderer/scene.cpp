@@ -30,7 +30,7 @@
 namespace Granite
 {
 Scene::Scene()
-	: spatials(pool.get_component_group<BoundedComponent, RenderInfoComponent, CachedSpatialTransformTimestampComponent>()),
+	: spatials(*pool.get_component_group_holder<BoundedComponent, RenderInfoComponent, CachedSpatialTransformTimestampComponent>()),
 	  opaque(pool.get_component_group<RenderInfoComponent, RenderableComponent, CachedSpatialTransformTimestampComponent, OpaqueComponent>()),
 	  transparent(pool.get_component_group<RenderInfoComponent, RenderableComponent, CachedSpatialTransformTimestampComponent, TransparentComponent>()),
 	  positional_lights(pool.get_component_group<RenderInfoComponent, RenderableComponent, CachedSpatialTransformTimestampComponent, PositionalLightComponent>()),
@@ -49,7 +49,8 @@ Scene::Scene()
 	  per_frame_update_transforms(pool.get_component_group<PerFrameUpdateTransformComponent, RenderInfoComponent>()),
 	  environments(pool.get_component_group<EnvironmentComponent>()),
 	  render_pass_sinks(pool.get_component_group<RenderPassSinkComponent, RenderableComponent, CullPlaneComponent>()),
-	  render_pass_creators(pool.get_component_group<RenderPassComponent>())
+	  render_pass_creators(pool.get_component_group<RenderPassComponent>()),
+	  spatial_transform_changes(pool.get_change_tracker<CachedSpatialTransformTimestampComponent>())
 {
 	pending_hierarchy_level_mask.store(0, std::memory_order_relaxed);
 }
@@ -148,33 +149,43 @@ void Scene::bind_render_graph_resources(RenderGraph &graph)
 
 void Scene::refresh_per_frame(const RenderContext &context, TaskComposer &composer)
 {
-	per_frame_update_transforms_sorted = per_frame_update_transforms;
-	per_frame_updates_sorted = per_frame_updates;
+	// Only re-sort when a per frame update component was added, removed or marked as changed.
+	uint64_t version = std::max(pool.get_component_group_holder<PerFrameUpdateComponent>()->get_version(),
+	                            pool.get_component_group_holder<PerFrameUpdateTransformComponent,
+	                                                            RenderInfoComponent>()->get_version());
 
-	stable_sort(per_frame_update_transforms_sorted.begin(), per_frame_update_transforms_sorted.end(),
-	            [](auto &a, auto &b) -> bool {
-		            int order_a = get_component<PerFrameUpdateTransformComponent>(a)->dependency_order;
-		            int order_b = get_component<PerFrameUpdateTransformComponent>(b)->dependency_order;
-		            return order_a < order_b;
-	            });
-
-	stable_sort(per_frame_updates_sorted.begin(), per_frame_updates_sorted.end(),
-	            [](auto &a, auto &b) -> bool {
-		            int order_a = get_component<PerFrameUpdateComponent>(a)->dependency_order;
-		            int order_b = get_component<PerFrameUpdateComponent>(b)->dependency_order;
-		            return order_a < order_b;
-	            });
+	if (version != per_frame_updates_sorted_version)
+	{
+		per_frame_update_transforms_sorted = per_frame_update_transforms;
+		per_frame_updates_sorted = per_frame_updates;
+
+		stable_sort(per_frame_update_transforms_sorted.begin(), per_frame_update_transforms_sorted.end(),
+		            [](auto &a, auto &b) -> bool {
+			            int order_a = get_component<PerFrameUpdateTransformComponent>(a)->get_dependency_order();
+			            int order_b = get_component<PerFrameUpdateTransformComponent>(b)->get_dependency_order();
+			            return order_a < order_b;
+		            });
+
+		stable_sort(per_frame_updates_sorted.begin(), per_frame_updates_sorted.end(),
+		            [](auto &a, auto &b) -> bool {
+			            int order_a = get_component<PerFrameUpdateComponent>(a)->get_dependency_order();
+			            int order_b = get_component<PerFrameUpdateComponent>(b)->get_dependency_order();
+			            return order_a < order_b;
+		            });
+
+		per_frame_updates_sorted_version = version;
+	}
 
 	int dep = std::numeric_limits<int>::min();
 
 	for (auto &update : per_frame_update_transforms_sorted)
 	{
 		auto *comp = get_component<PerFrameUpdateTransformComponent>(update);
-		assert(comp->dependency_order != std::numeric_limits<int>::min());
-		if (comp->dependency_order != dep)
+		assert(comp->get_dependency_order() != std::numeric_limits<int>::min());
+		if (comp->get_dependency_order() != dep)
 		{
 			composer.begin_pipeline_stage();
-			dep = comp->dependency_order;
+			dep = comp->get_dependency_order();
 		}
 
 		auto *refresh = comp->refresh;
@@ -188,11 +199,11 @@ void Scene::refresh_per_frame(const RenderContext &context, TaskComposer &compos
 	for (auto &update : per_frame_updates_sorted)
 	{
 		auto *comp = get_component<PerFrameUpdateComponent>(update);
-		assert(comp->dependency_order != std::numeric_limits<int>::min());
-		if (comp->dependency_order != dep)
+		assert(comp->get_dependency_order() != std::numeric_limits<int>::min());
+		if (comp->get_dependency_order() != dep)
 		{
 			composer.begin_pipeline_stage();
-			dep = comp->dependency_order;
+			dep = comp->get_dependency_order();
 		}
 
 		auto *refresh = comp->refresh;
@@ -257,19 +268,15 @@ void Scene::gather_visible_motion_vector_renderables(const Frustum &frustum, Vis
 	                           });
 }
 
-void Scene::gather_visible_opaque_renderables_subset(const Frustum &frustum, VisibilityList &list,
-                                                     unsigned index, unsigned num_indices) const
+void Scene::gather_visible_opaque_renderables_range(const Frustum &frustum, VisibilityList &list,
+                                                    size_t start_index, size_t end_index) const
 {
-	size_t start_index = (index * opaque.size()) / num_indices;
-	size_t end_index = ((index + 1) * opaque.size()) / num_indices;
 	gather_visible_renderables(frustum, list, opaque, start_index, end_index, filter_true);
 }
 
-void Scene::gather_visible_motion_vector_renderables_subset(const Frustum &frustum, VisibilityList &list,
-                                                            unsigned index, unsigned num_indices) const
+void Scene::gather_visible_motion_vector_renderables_range(const Frustum &frustum, VisibilityList &list,
+                                                           size_t start_index, size_t end_index) const
 {
-	size_t start_index = (index * opaque.size()) / num_indices;
-	size_t end_index = ((index + 1) * opaque.size()) / num_indices;
 	gather_visible_renderables(frustum, list, opaque, start_index, end_index,
 	                           [](const RenderInfoComponent *info, RenderableFlags flags) {
 		                           return (flags & RENDERABLE_IMPLICIT_MOTION_BIT) == 0 &&
@@ -287,19 +294,15 @@ void Scene::gather_visible_static_shadow_renderables(const Frustum &frustum, Vis
 	gather_visible_renderables(frustum, list, static_shadowing, 0, static_shadowing.size(), filter_true);
 }
 
-void Scene::gather_visible_transparent_renderables_subset(const Frustum &frustum, VisibilityList &list,
-                                                          unsigned index, unsigned num_indices) const
+void Scene::gather_visible_transparent_renderables_range(const Frustum &frustum, VisibilityList &list,
+                                                         size_t start_index, size_t end_index) const
 {
-	size_t start_index = (index * transparent.size()) / num_indices;
-	size_t end_index = ((index + 1) * transparent.size()) / num_indices;
 	gather_visible_renderables(frustum, list, transparent, start_index, end_index, filter_true);
 }
 
-void Scene::gather_visible_static_shadow_renderables_subset(const Frustum &frustum, VisibilityList &list,
-                                                            unsigned index, unsigned num_indices) const
+void Scene::gather_visible_static_shadow_renderables_range(const Frustum &frustum, VisibilityList &list,
+                                                           size_t start_index, size_t end_index) const
 {
-	size_t start_index = (index * static_shadowing.size()) / num_indices;
-	size_t end_index = ((index + 1) * static_shadowing.size()) / num_indices;
 	gather_visible_renderables(frustum, list, static_shadowing, start_index, end_index, filter_true);
 }
 
@@ -310,14 +313,12 @@ void Scene::gather_visible_dynamic_shadow_renderables(const Frustum &frustum, Vi
 		list.push_back({ get_component<RenderableComponent>(object)->renderable.get(), nullptr });
 }
 
-void Scene::gather_visible_dynamic_shadow_renderables_subset(const Frustum &frustum, VisibilityList &list,
-                                                             unsigned index, unsigned num_indices) const
+void Scene::gather_visible_dynamic_shadow_renderables_range(const Frustum &frustum, VisibilityList &list,
+                                                            size_t start_index, size_t end_index) const
 {
-	size_t start_index = (index * dynamic_shadowing.size()) / num_indices;
-	size_t end_index = ((index + 1) * dynamic_shadowing.size()) / num_indices;
 	gather_visible_renderables(frustum, list, dynamic_shadowing, start_index, end_index, filter_true);
 
-	if (index == 0)
+	if (start_index == 0)
 		for (auto &object : render_pass_shadowing)
 			list.push_back({ get_component<RenderableComponent>(object)->renderable.get(), nullptr });
 }
@@ -464,19 +465,15 @@ void Scene::gather_visible_volumetric_fog_regions(const Frustum &frustum, Volume
 	}
 }
 
-void Scene::gather_visible_positional_lights_subset(const Frustum &frustum, VisibilityList &list,
-                                                    unsigned index, unsigned num_indices) const
+void Scene::gather_visible_positional_lights_range(const Frustum &frustum, VisibilityList &list,
+                                                   size_t start_index, size_t end_index) const
 {
-	size_t start_index = (index * positional_lights.size()) / num_indices;
-	size_t end_index = ((index + 1) * positional_lights.size()) / num_indices;
 	gather_positional_lights(frustum, list, positional_lights, start_index, end_index);
 }
 
-void Scene::gather_visible_positional_lights_subset(const Frustum &frustum, PositionalLightList &list,
-                                                    unsigned index, unsigned num_indices) const
+void Scene::gather_visible_positional_lights_range(const Frustum &frustum, PositionalLightList &list,
+                                                   size_t start_index, size_t end_index) const
 {
-	size_t start_index = (index * positional_lights.size()) / num_indices;
-	size_t end_index = ((index + 1) * positional_lights.size()) / num_indices;
 	gather_positional_lights(frustum, list, positional_lights, start_index, end_index);
 }
 
@@ -558,21 +555,14 @@ static const mat4 identity_transform(1.0f);
 
 size_t Scene::get_cached_transforms_count() const
 {
-	return spatials.size();
-}
-
-void Scene::update_cached_transforms_subset(unsigned index, unsigned num_indices)
-{
-	size_t begin_index = (spatials.size() * index) / num_indices;
-	size_t end_index = (spatials.size() * (index + 1)) / num_indices;
-	update_cached_transforms_range(begin_index, end_index);
+	return spatials.get_num_change_chunks();
 }
 
 void Scene::update_all_transforms()
 {
 	update_transform_tree();
 	update_transform_listener_components();
-	update_cached_transforms_range(0, spatials.size());
+	update_cached_transforms_range(0, get_cached_transforms_count());
 }
 
 static void perform_update_skinning(Node * const *updates, size_t count)
@@ -586,6 +576,12 @@ static void perform_update_skinning(Node * const *updates, size_t count)
 
 void Scene::update_transform_tree(TaskComposer *composer)
 {
+	// The cached transform update also revisits spatials which changed in the previous tree update,
+	// so requires_motion_vectors is cleared once they stop moving.
+	spatial_changes_since = prev_transform_update_version;
+	prev_transform_update_version = pool.get_change_version();
+	spatial_transform_version = pool.begin_component_changes<CachedSpatialTransformTimestampComponent>();
+
 	if (composer)
 	{
 		auto &group = composer->begin_pipeline_stage();
@@ -716,7 +712,8 @@ void Scene::update_transform_listener_components()
 			// We only expect this to run once since diffuse volumes really
 			// cannot freely move around the scene due to the semi-baked nature of it.
 			auto texture_to_world = transform->get_world_transform() * translate(vec3(-0.5f));
-			auto world_to_texture = inverse(texture_to_world);
+			mat4 world_to_texture;
+			SIMD::inverse_affine(world_to_texture, texture_to_world);
 
 			world_to_texture = transpose(world_to_texture);
 			texture_to_world = transpose(texture_to_world);
@@ -743,7 +740,8 @@ void Scene::update_transform_listener_components()
 		{
 			// This is a somewhat expensive operation, so timestamp it.
 			auto texture_to_world = transform->get_world_transform() * translate(vec3(-0.5f));
-			auto world_to_texture = inverse(texture_to_world);
+			mat4 world_to_texture;
+			SIMD::inverse_affine(world_to_texture, texture_to_world);
 
 			world_to_texture = transpose(world_to_texture);
 
@@ -765,7 +763,8 @@ void Scene::update_transform_listener_components()
 		{
 			// This is a somewhat expensive operation, so timestamp it.
 			auto texture_to_world = transform->get_world_transform();
-			auto world_to_texture = inverse(texture_to_world);
+			mat4 world_to_texture;
+			SIMD::inverse_affine(world_to_texture, texture_to_world);
 
 			world_to_texture = transpose(world_to_texture);
 			texture_to_world = transpose(texture_to_world);
@@ -782,10 +781,9 @@ void Scene::update_transform_listener_components()
 
 void Scene::update_cached_transforms_range(size_t begin_range, size_t end_range)
 {
-	for (size_t i = begin_range; i < end_range; i++)
-	{
-		auto &s = spatials[i];
-
+	spatials.for_each_changed_range(spatial_changes_since, begin_range, end_range,
+	                                [](const std::tuple<BoundedComponent *, RenderInfoComponent *,
+	                                                    CachedSpatialTransformTimestampComponent *> &s, const Entity &) {
 		BoundedComponent *aabb;
 		RenderInfoComponent *cached_transform;
 		CachedSpatialTransformTimestampComponent *timestamp;
@@ -820,7 +818,7 @@ void Scene::update_cached_transforms_range(size_t begin_range, size_t end_range)
 
 		// The first update won't have valid prev transforms.
 		cached_transform->requires_motion_vectors = modified_timestamp && new_timestamp >= 2;
-	}
+	});
 }
 
 void Scene::push_pending_node_update(Node *node)
@@ -876,43 +874,64 @@ void Scene::distribute_per_level_updates(TaskGroup *group)
 	}
 }
 
-static void update_transform_tree_node(Node &node, const mat4 &transform)
+static void perform_updates(Node * const *updates, size_t count, ComponentChangeTracker &changes, uint64_t version)
 {
-	node.prev_cached_transform = node.cached_transform;
-	compute_model_transform(node.cached_transform.world_transform,
-	                        node.transform.scale, node.transform.rotation, node.transform.translation,
-	                        transform);
+	// Gather the node transforms in blocks so the batched transform kernel can fill its vector lanes.
+	constexpr size_t BlockSize = 64;
+	vec3 scales[BlockSize];
+	vec3 translations[BlockSize];
+	quat rotations[BlockSize];
+	const mat4 *parents[BlockSize];
+	mat4 *worlds[BlockSize];
 
-	//compute_normal_transform(node.cached_transform.normal_transform, node.cached_transform.world_transform);
-	node.update_timestamp();
-	node.clear_pending_update_no_atomic();
-}
-
-static void perform_updates(Node * const *updates, size_t count)
-{
-	for (size_t i = 0; i < count; i++)
+	for (size_t base = 0; base < count; base += BlockSize)
 	{
-		auto *update = updates[i];
-		auto *parent = update->get_parent();
-		auto &transform = parent ? parent->cached_transform.world_transform : identity_transform;
-		update_transform_tree_node(*update, transform);
+		size_t block_count = std::min(count - base, BlockSize);
+
+		for (size_t i = 0; i < block_count; i++)
+		{
+			auto &node = *updates[base + i];
+			auto *parent = node.get_parent();
+			node.prev_cached_transform = node.cached_transform;
+			scales[i] = node.transform.scale;
+			translations[i] = node.transform.translation;
+			rotations[i] = node.transform.rotation;
+			parents[i] = parent ? &parent->cached_transform.world_transform : &identity_transform;
+			worlds[i] = &node.cached_transform.world_transform;
+		}
+
+		compute_model_transforms(worlds, parents, scales, rotations, translations, block_count);
+
+		for (size_t i = 0; i < block_count; i++)
+		{
+			auto &node = *updates[base + i];
+			//compute_normal_transform(node.cached_transform.normal_transform, node.cached_transform.world_transform);
+			node.update_timestamp();
+			node.clear_pending_update_no_atomic();
+
+			for (auto slot : node.get_spatial_slots())
+				changes.mark(slot, version);
+		}
 	}
 }
 
 void Scene::perform_per_level_updates(unsigned level, TaskGroup *group)
 {
+	auto &changes = spatial_transform_changes;
+	uint64_t version = spatial_transform_version;
+
 	if (group)
 	{
-		pending_node_update_per_level[level].for_each_ranged([group](Node *const *updates, size_t count) {
-			group->enqueue_task([=]() {
-				perform_updates(updates, count);
+		pending_node_update_per_level[level].for_each_ranged([group, &changes, version](Node *const *updates, size_t count) {
+			group->enqueue_task([=, &changes]() {
+				perform_updates(updates, count, changes, version);
 			});
 		});
 	}
 	else
 	{
-		pending_node_update_per_level[level].for_each_ranged([](Node *const *updates, size_t count) {
-			perform_updates(updates, count);
+		pending_node_update_per_level[level].for_each_ranged([&changes, version](Node *const *updates, size_t count) {
+			perform_updates(updates, count, changes, version);
 		});
 	}
 }
@@ -1002,6 +1021,7 @@ Entity *Scene::create_volumetric_diffuse_light(uvec3 resolution, Node *node)
 	{
 		transform->scene_node = node;
 		timestamp->current_timestamp = node->get_timestamp_pointer();
+		node->add_spatial_slot(entity->get_slot());
 	}
 	timestamp->cookie = transform_cookies.fetch_add(std::memory_order_relaxed);
 
@@ -1024,6 +1044,7 @@ Entity *Scene::create_volumetric_fog_region(Node *node)
 	{
 		transform->scene_node = node;
 		timestamp->current_timestamp = node->get_timestamp_pointer();
+		node->add_spatial_slot(entity->get_slot());
 	}
 	timestamp->cookie = transform_cookies.fetch_add(std::memory_order_relaxed);
 
@@ -1046,6 +1067,7 @@ Entity *Scene::create_volumetric_decal(Node *node)
 	{
 		transform->scene_node = node;
 		timestamp->current_timestamp = node->get_timestamp_pointer();
+		node->add_spatial_slot(entity->get_slot());
 	}
 	timestamp->cookie = transform_cookies.fetch_add(std::memory_order_relaxed);
 
@@ -1097,6 +1119,7 @@ Entity *Scene::create_light(const SceneFormats::LightInfo &light, Node *node)
 		{
 			transform->scene_node = node;
 			timestamp->current_timestamp = node->get_timestamp_pointer();
+			node->add_spatial_slot(entity->get_slot());
 		}
 
 		auto *bounded = entity->allocate_component<BoundedComponent>();
@@ -1122,6 +1145,7 @@ Entity *Scene::create_renderable(AbstractRenderableHandle renderable, Node *node
 		{
 			transform->scene_node = node;
 			timestamp->current_timestamp = node->get_timestamp_pointer();
+			node->add_spatial_slot(entity->get_slot());
 		}
 		auto *bounded = entity->allocate_component<BoundedComponent>();
 		bounded->aabb = renderable->get_static_aabb();
@@ -1154,13 +1178,15 @@ Entity *Scene::create_renderable(AbstractRenderableHandle renderable, Node *node
 
 void Scene::destroy_entities(Util::IntrusiveList<Entity> &entity_list)
 {
+	std::vector<Entity *> to_free;
 	auto itr = entity_list.begin();
 	while (itr != entity_list.end())
 	{
-		auto *to_free = itr.get();
+		to_free.push_back(itr.get());
 		itr = entity_list.erase(itr);
-		to_free->get_pool()->delete_entity(to_free);
 	}
+
+	pool.delete_entities(to_free.data(), to_free.size());
 }
 
 void Scene::remove_entities_with_component(ComponentType id)
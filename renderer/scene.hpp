@@ -56,7 +56,10 @@ public:
 	void update_transform_tree();
 	void update_transform_tree(TaskComposer &composer);
 	void update_transform_listener_components();
-	void update_cached_transforms_subset(unsigned index, unsigned num_indices);
+
+	// Only spatials whose transform changed since the previous transform tree update are visited.
+	// Ranges are in units of ECS change tracking chunks, not spatials.
+	void update_cached_transforms_range(size_t start_index, size_t end_index);
 	size_t get_cached_transforms_count() const;
 
 	void gather_visible_opaque_renderables(const Frustum &frustum, VisibilityList &list) const;
@@ -71,20 +74,22 @@ public:
 	void gather_visible_volumetric_decals(const Frustum &frustum, VolumetricDecalList &list) const;
 	void gather_visible_volumetric_fog_regions(const Frustum &frustum, VolumetricFogRegionList &list) const;
 
-	void gather_visible_opaque_renderables_subset(const Frustum &frustum, VisibilityList &list,
-	                                              unsigned index, unsigned num_indices) const;
-	void gather_visible_motion_vector_renderables_subset(const Frustum &frustum, VisibilityList &list,
-	                                                     unsigned index, unsigned num_indices) const;
-	void gather_visible_transparent_renderables_subset(const Frustum &frustum, VisibilityList &list,
-	                                                   unsigned index, unsigned num_indices) const;
-	void gather_visible_static_shadow_renderables_subset(const Frustum &frustum, VisibilityList &list,
-	                                                     unsigned index, unsigned num_indices) const;
-	void gather_visible_dynamic_shadow_renderables_subset(const Frustum &frustum, VisibilityList &list,
-	                                                      unsigned index, unsigned num_indices) const;
-	void gather_visible_positional_lights_subset(const Frustum &frustum, VisibilityList &list,
-	                                             unsigned index, unsigned num_indices) const;
-	void gather_visible_positional_lights_subset(const Frustum &frustum, PositionalLightList &list,
-	                                             unsigned index, unsigned num_indices) const;
+	// Ranges index into the objects counted by the corresponding get_*_count().
+	void gather_visible_opaque_renderables_range(const Frustum &frustum, VisibilityList &list,
+	                                             size_t start_index, size_t end_index) const;
+	void gather_visible_motion_vector_renderables_range(const Frustum &frustum, VisibilityList &list,
+	                                                    size_t start_index, size_t end_index) const;
+	void gather_visible_transparent_renderables_range(const Frustum &frustum, VisibilityList &list,
+	                                                  size_t start_index, size_t end_index) const;
+	void gather_visible_static_shadow_renderables_range(const Frustum &frustum, VisibilityList &list,
+	                                                    size_t start_index, size_t end_index) const;
+	// The range starting at 0 also gathers render pass shadow casters.
+	void gather_visible_dynamic_shadow_renderables_range(const Frustum &frustum, VisibilityList &list,
+	                                                     size_t start_index, size_t end_index) const;
+	void gather_visible_positional_lights_range(const Frustum &frustum, VisibilityList &list,
+	                                            size_t start_index, size_t end_index) const;
+	void gather_visible_positional_lights_range(const Frustum &frustum, PositionalLightList &list,
+	                                            size_t start_index, size_t end_index) const;
 
 	size_t get_opaque_renderables_count() const;
 	size_t get_motion_vector_renderables_count() const;
@@ -130,6 +135,16 @@ public:
 	Entity *create_volumetric_fog_region(Node *node);
 	Entity *create_volumetric_decal(Node *node);
 	Entity *create_entity();
+
+	// Bulk spawn of entities sharing a component set, e.g. particles or props on level load.
+	template <typename... Ts>
+	void create_entities(Entity **new_entities, size_t count, std::tuple<Ts *...> *components = nullptr)
+	{
+		pool.create_entities<Ts...>(new_entities, count, components);
+		for (size_t i = 0; i < count; i++)
+			entities.insert_front(new_entities[i]);
+	}
+
 	void destroy_entity(Entity *entity);
 	void queue_destroy_entity(Entity *entity);
 	void destroy_queued_entities();
@@ -151,7 +166,7 @@ private:
 	NodeHandle root_node;
 
 	// Sets up the default useful component groups up front.
-	const ComponentGroupVector<
+	EntityGroup<
 			BoundedComponent,
 			RenderInfoComponent,
 			CachedSpatialTransformTimestampComponent> &spatials;
@@ -221,6 +236,7 @@ private:
 	ComponentGroupVector<PerFrameUpdateComponent> per_frame_updates_sorted;
 	ComponentGroupVector<PerFrameUpdateTransformComponent,
 			RenderInfoComponent> per_frame_update_transforms_sorted;
+	uint64_t per_frame_updates_sorted_version = 0;
 
 	const ComponentGroupVector<EnvironmentComponent> &environments;
 	const ComponentGroupVector<RenderPassSinkComponent,
@@ -231,8 +247,6 @@ private:
 	Util::IntrusiveList<Entity> queued_entities;
 	void destroy_entities(Util::IntrusiveList<Entity> &entity_list);
 
-	void update_cached_transforms_range(size_t start_index, size_t end_index);
-
 	// New transform update system:
 	enum { MaxNodeHierarchyLevels = 32 };
 	void push_pending_node_update(Node *node);
@@ -244,6 +258,12 @@ private:
 	Util::AtomicAppendBuffer<Node *, 8> pending_node_update_per_level[MaxNodeHierarchyLevels];
 	std::atomic_uint32_t pending_hierarchy_level_mask;
 
+	// Nodes mark the spatials which follow them when their transform is updated.
+	ComponentChangeTracker &spatial_transform_changes;
+	uint64_t spatial_transform_version = 0;
+	uint64_t spatial_changes_since = 0;
+	uint64_t prev_transform_update_version = 0;
+
 	void update_transform_tree(TaskComposer *composer);
 };
 }
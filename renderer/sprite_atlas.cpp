@@ -0,0 +1,113 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sprite_atlas.hpp"
+#include "muglm/muglm_impl.hpp"
+#include "device.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <string.h>
+
+namespace Granite
+{
+unsigned SpriteAtlas::add_image(unsigned width, unsigned height, const void *rgba8)
+{
+	PendingImage img;
+	img.size = uvec2(width, height);
+	img.texels.resize(width * height);
+	if (!img.texels.empty())
+		memcpy(img.texels.data(), rgba8, img.texels.size() * sizeof(uint32_t));
+	pending.push_back(std::move(img));
+	return unsigned(pending.size() - 1);
+}
+
+bool SpriteAtlas::bake(Vulkan::Device &device, unsigned layer_size, unsigned max_layers,
+                       unsigned padding, VkFormat format)
+{
+	std::vector<uvec2> sizes;
+	sizes.reserve(pending.size());
+	for (auto &img : pending)
+		sizes.push_back(img.size);
+
+	std::vector<AtlasRect> rects(pending.size());
+	AtlasPacker packer(uvec2(layer_size), max_layers, padding);
+	if (!packer.pack(sizes.data(), sizes.size(), rects.data()))
+	{
+		LOGE("Sprites do not fit in %u layers of %u x %u.\n", max_layers, layer_size, layer_size);
+		return false;
+	}
+
+	unsigned num_layers = std::max(packer.get_num_layers(), 1u);
+	std::vector<uint32_t> texels(size_t(layer_size) * layer_size * num_layers);
+
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		auto &img = pending[i];
+		auto &rect = rects[i];
+		if (!img.size.x || !img.size.y)
+			continue;
+
+		uint32_t *layer = texels.data() + size_t(rect.layer) * layer_size * layer_size;
+		int x0 = int(rect.offset.x) - int(padding);
+		int y0 = int(rect.offset.y) - int(padding);
+		int w = int(img.size.x);
+		int h = int(img.size.y);
+
+		// Source coordinates are clamped, which fills the gutter with edge texels.
+		for (int y = -int(padding); y < h + int(padding); y++)
+		{
+			const uint32_t *src = img.texels.data() + size_t(clamp(y, 0, h - 1)) * w;
+			uint32_t *dst = layer + size_t(y0 + y + int(padding)) * layer_size + x0;
+
+			for (int x = 0; x < int(padding); x++)
+				dst[x] = src[0];
+			memcpy(dst + padding, src, w * sizeof(uint32_t));
+			for (int x = 0; x < int(padding); x++)
+				dst[padding + w + x] = src[w - 1];
+		}
+	}
+
+	auto info = Vulkan::ImageCreateInfo::immutable_2d_image(layer_size, layer_size, format);
+	info.layers = num_layers;
+	info.misc |= Vulkan::IMAGE_MISC_FORCE_ARRAY_BIT;
+
+	std::vector<Vulkan::ImageInitialData> initial(num_layers);
+	for (unsigned i = 0; i < num_layers; i++)
+		initial[i] = { texels.data() + size_t(i) * layer_size * layer_size, 0, 0 };
+
+	image = device.create_image(info, initial.data());
+	if (!image)
+		return false;
+	device.set_name(*image, "sprite-atlas");
+
+	entries.resize(rects.size());
+	for (size_t i = 0; i < rects.size(); i++)
+	{
+		entries[i].tex_offset = vec2(rects[i].offset);
+		entries[i].tex_size = vec2(rects[i].size);
+		entries[i].layer = rects[i].layer;
+	}
+
+	pending.clear();
+	return true;
+}
+}
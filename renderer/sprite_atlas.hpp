@@ -0,0 +1,82 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "atlas_packer.hpp"
+#include "image.hpp"
+#include <stdint.h>
+#include <vector>
+
+namespace Vulkan
+{
+class Device;
+}
+
+namespace Granite
+{
+// Collects RGBA8 sprite images on the CPU and bakes them into a single 2D array texture,
+// so sprites which used to need one draw per texture can go into one FlatRenderer batch.
+class SpriteAtlas
+{
+public:
+	struct Entry
+	{
+		// In texels, as expected by QuadData::tex_off_x/tex_scale_x.
+		vec2 tex_offset;
+		vec2 tex_size;
+		unsigned layer;
+	};
+
+	// Pixels are tightly packed RGBA8 and are copied. Returns the entry index.
+	unsigned add_image(unsigned width, unsigned height, const void *rgba8);
+
+	// Padding texels replicate the sprite edge so linear filtering does not bleed between sprites.
+	bool bake(Vulkan::Device &device, unsigned layer_size = 2048, unsigned max_layers = 64,
+	          unsigned padding = 1, VkFormat format = VK_FORMAT_R8G8B8A8_SRGB);
+
+	const Entry &get_entry(unsigned index) const
+	{
+		return entries[index];
+	}
+
+	const Vulkan::ImageView &get_view() const
+	{
+		return image->get_view();
+	}
+
+	const Vulkan::ImageHandle &get_image() const
+	{
+		return image;
+	}
+
+private:
+	struct PendingImage
+	{
+		uvec2 size;
+		std::vector<uint32_t> texels;
+	};
+	std::vector<PendingImage> pending;
+	std::vector<Entry> entries;
+	Vulkan::ImageHandle image;
+};
+}
@@ -22,6 +22,7 @@
 
 #include "threaded_scene.hpp"
 #include "render_context.hpp"
+#include "parallel_for.hpp"
 #include <algorithm>
 
 namespace Granite
@@ -31,123 +32,115 @@ namespace Threaded
 void scene_gather_opaque_renderables(const Scene &scene, TaskComposer &composer, const Frustum &frustum,
                                      VisibilityList *lists, unsigned num_tasks)
 {
-	auto &group = composer.begin_pipeline_stage();
-	group.set_desc("gather-opaque-renderables");
-	for (unsigned i = 0; i < num_tasks; i++)
-	{
-		group.enqueue_task([&frustum, lists, &scene, i, num_tasks]() {
-			scene.gather_visible_opaque_renderables_subset(frustum, lists[i], i, num_tasks);
-		});
-	}
+	static ParallelCostEstimator estimator;
+	parallel_for(composer, "gather-opaque-renderables", scene.get_opaque_renderables_count(), num_tasks, &estimator,
+	             [&frustum, lists, &scene](const ParallelChunk &chunk) {
+		             scene.gather_visible_opaque_renderables_range(frustum, lists[chunk.index], chunk.begin, chunk.end);
+	             });
 }
 
 void scene_gather_motion_vector_renderables(const Scene &scene, TaskComposer &composer, const Frustum &frustum,
                                             VisibilityList *lists, unsigned num_tasks)
 {
-	auto &group = composer.begin_pipeline_stage();
-	group.set_desc("gather-motion-vector-renderables");
-	for (unsigned i = 0; i < num_tasks; i++)
-	{
-		group.enqueue_task([&frustum, lists, &scene, i, num_tasks]() {
-			scene.gather_visible_motion_vector_renderables_subset(frustum, lists[i], i, num_tasks);
-		});
-	}
+	static ParallelCostEstimator estimator;
+	parallel_for(composer, "gather-motion-vector-renderables", scene.get_motion_vector_renderables_count(),
+	             num_tasks, &estimator,
+	             [&frustum, lists, &scene](const ParallelChunk &chunk) {
+		             scene.gather_visible_motion_vector_renderables_range(frustum, lists[chunk.index],
+		                                                                  chunk.begin, chunk.end);
+	             });
 }
 
 void scene_gather_transparent_renderables(const Scene &scene, TaskComposer &composer, const Frustum &frustum,
                                           VisibilityList *lists, unsigned num_tasks)
 {
-	auto &group = composer.begin_pipeline_stage();
-	group.set_desc("gather-transparent-renderables");
-	for (unsigned i = 0; i < num_tasks; i++)
-	{
-		group.enqueue_task([&frustum, lists, &scene, i, num_tasks]() {
-			scene.gather_visible_transparent_renderables_subset(frustum, lists[i], i, num_tasks);
-		});
-	}
+	static ParallelCostEstimator estimator;
+	parallel_for(composer, "gather-transparent-renderables", scene.get_transparent_renderables_count(),
+	             num_tasks, &estimator,
+	             [&frustum, lists, &scene](const ParallelChunk &chunk) {
+		             scene.gather_visible_transparent_renderables_range(frustum, lists[chunk.index],
+		                                                                chunk.begin, chunk.end);
+	             });
+}
+
+static void hash_visible_transforms(const VisibilityList &list, Util::Hash *transform_hashes,
+                                    const ParallelChunk &chunk, unsigned num_tasks)
+{
+	// Slots which did not get a chunk this time around must not keep stale hashes.
+	if (chunk.index == 0)
+		for (unsigned i = chunk.count; i < num_tasks; i++)
+			transform_hashes[i] = 0;
+
+	// This way of combining hashes is order independent and serves as a good way of hashing the overall scene.
+	Util::Hash hash = 0;
+	for (auto &v : list)
+		hash ^= v.transform_hash;
+	transform_hashes[chunk.index] = hash;
 }
 
 void scene_gather_static_shadow_renderables(const Scene &scene, TaskComposer &composer, const Frustum &frustum,
                                             VisibilityList *lists, Util::Hash *transform_hashes, unsigned num_tasks)
 {
-	auto &group = composer.begin_pipeline_stage();
-	group.set_desc("gather-static-shadow-renderables");
-	for (unsigned i = 0; i < num_tasks; i++)
-	{
-		group.enqueue_task([&frustum, lists, &scene, i, num_tasks, transform_hashes]() {
-			if (transform_hashes)
-				transform_hashes[i] = 0;
-
-			scene.gather_visible_static_shadow_renderables_subset(frustum, lists[i], i, num_tasks);
-
-			// This way of combining hashes is order independent and serves as a good way of hashing the overall scene.
-			if (transform_hashes)
-				for (auto &v : lists[i])
-					transform_hashes[i] ^= v.transform_hash;
-		});
-	}
+	static ParallelCostEstimator estimator;
+	parallel_for(composer, "gather-static-shadow-renderables", scene.get_static_shadow_renderables_count(),
+	             num_tasks, &estimator,
+	             [&frustum, lists, &scene, num_tasks, transform_hashes](const ParallelChunk &chunk) {
+		             scene.gather_visible_static_shadow_renderables_range(frustum, lists[chunk.index],
+		                                                                  chunk.begin, chunk.end);
+		             if (transform_hashes)
+			             hash_visible_transforms(lists[chunk.index], transform_hashes, chunk, num_tasks);
+	             });
 }
 
 void scene_gather_dynamic_shadow_renderables(const Scene &scene, TaskComposer &composer, const Frustum &frustum,
                                              VisibilityList *lists, Util::Hash *transform_hashes, unsigned num_tasks)
 {
-	auto &group = composer.begin_pipeline_stage();
-	group.set_desc("gather-dynamic-shadow-renderables");
-	for (unsigned i = 0; i < num_tasks; i++)
-	{
-		group.enqueue_task([&frustum, lists, &scene, i, num_tasks, transform_hashes]() {
-			if (transform_hashes)
-				transform_hashes[i] = 0;
-
-			scene.gather_visible_dynamic_shadow_renderables_subset(frustum, lists[i], i, num_tasks);
-
-			// This way of combining hashes is order independent and serves as a good way of hashing the overall scene.
-			if (transform_hashes)
-				for (auto &v : lists[i])
-					transform_hashes[i] ^= v.transform_hash;
-		});
-	}
+	static ParallelCostEstimator estimator;
+	parallel_for(composer, "gather-dynamic-shadow-renderables", scene.get_dynamic_shadow_renderables_count(),
+	             num_tasks, &estimator,
+	             [&frustum, lists, &scene, num_tasks, transform_hashes](const ParallelChunk &chunk) {
+		             scene.gather_visible_dynamic_shadow_renderables_range(frustum, lists[chunk.index],
+		                                                                   chunk.begin, chunk.end);
+		             if (transform_hashes)
+			             hash_visible_transforms(lists[chunk.index], transform_hashes, chunk, num_tasks);
+	             });
 }
 
 void scene_gather_positional_light_renderables(const Scene &scene, TaskComposer &composer, const Frustum &frustum,
                                                VisibilityList *lists, unsigned num_tasks)
 {
-	auto &group = composer.begin_pipeline_stage();
-	group.set_desc("gather-positional-light-renderables");
-	for (unsigned i = 0; i < num_tasks; i++)
-	{
-		group.enqueue_task([&frustum, lists, &scene, i, num_tasks]() {
-			scene.gather_visible_positional_lights_subset(frustum, lists[i], i, num_tasks);
-		});
-	}
+	static ParallelCostEstimator estimator;
+	parallel_for(composer, "gather-positional-light-renderables", scene.get_positional_lights_count(),
+	             num_tasks, &estimator,
+	             [&frustum, lists, &scene](const ParallelChunk &chunk) {
+		             scene.gather_visible_positional_lights_range(frustum, lists[chunk.index],
+		                                                          chunk.begin, chunk.end);
+	             });
 }
 
 void scene_gather_positional_light_renderables_sorted(const Scene &scene, TaskComposer &composer,
                                                       const RenderContext &context,
                                                       PositionalLightList *lists, unsigned num_tasks)
 {
-	{
-		auto &group = composer.begin_pipeline_stage();
-		group.set_desc("gather-positional-light-renderables");
-		for (unsigned i = 0; i < num_tasks; i++)
-		{
-			group.enqueue_task([&context, lists, &scene, i, num_tasks]() {
-				scene.gather_visible_positional_lights_subset(context.get_visibility_frustum(),
-				                                              lists[i], i, num_tasks);
-			});
-		}
-	}
+	static ParallelCostEstimator estimator;
+	unsigned num_chunks = parallel_for(composer, "gather-positional-light-renderables",
+	                                   scene.get_positional_lights_count(), num_tasks, &estimator,
+	                                   [&context, lists, &scene](const ParallelChunk &chunk) {
+		                                   scene.gather_visible_positional_lights_range(
+				                                   context.get_visibility_frustum(), lists[chunk.index],
+				                                   chunk.begin, chunk.end);
+	                                   });
 
 	{
 		auto &group = composer.begin_pipeline_stage();
 		group.set_desc("gather-positional-light-renderables-sort");
-		group.enqueue_task([&context, num_tasks, lists]() {
+		group.enqueue_task([&context, num_chunks, lists]() {
 			size_t expected_size = 0;
-			for (unsigned i = 0; i < num_tasks; i++)
+			for (unsigned i = 0; i < num_chunks; i++)
 				expected_size += lists[i].size();
 			lists[0].reserve(expected_size);
 
-			for (unsigned i = 1; i < num_tasks; i++)
+			for (unsigned i = 1; i < num_chunks; i++)
 				lists[0].insert(lists[0].end(), lists[i].begin(), lists[i].end());
 			auto &lights = lists[0];
 
@@ -169,29 +162,28 @@ void compose_parallel_push_renderables(TaskComposer &composer, const RenderConte
                                        RenderQueue *queues, VisibilityList *visibility, unsigned count,
                                        PushType type)
 {
-	{
-		auto &group = composer.begin_pipeline_stage();
-		group.set_desc("parallel-push-renderables");
-		for (unsigned i = 0; i < count; i++)
-		{
-			group.enqueue_task([i, &context, visibility, queues, type]() {
-				switch (type)
-				{
-				default:
-					queues[i].push_renderables(context, visibility[i].data(), visibility[i].size());
-					break;
-
-				case PushType::Depth:
-					queues[i].push_depth_renderables(context, visibility[i].data(), visibility[i].size());
-					break;
-
-				case PushType::MotionVector:
-					queues[i].push_motion_vector_renderables(context, visibility[i].data(), visibility[i].size());
-					break;
-				}
-			});
-		}
-	}
+	// One chunk per visibility list, since they are already balanced by the gather stage.
+	parallel_for(composer, "parallel-push-renderables", count, count, nullptr,
+	             [&context, visibility, queues, type](const ParallelChunk &chunk) {
+		             for (size_t i = chunk.begin; i < chunk.end; i++)
+		             {
+			             switch (type)
+			             {
+			             default:
+				             queues[i].push_renderables(context, visibility[i].data(), visibility[i].size());
+				             break;
+
+			             case PushType::Depth:
+				             queues[i].push_depth_renderables(context, visibility[i].data(), visibility[i].size());
+				             break;
+
+			             case PushType::MotionVector:
+				             queues[i].push_motion_vector_renderables(context, visibility[i].data(),
+				                                                      visibility[i].size());
+				             break;
+			             }
+		             }
+	             });
 
 	{
 		auto &group = composer.begin_pipeline_stage();
@@ -206,14 +198,12 @@ void compose_parallel_push_renderables(TaskComposer &composer, const RenderConte
 
 void scene_update_cached_transforms(Scene &scene, TaskComposer &composer, unsigned num_tasks)
 {
-	auto &group = composer.begin_pipeline_stage();
-	group.set_desc("parallel-update-cached-transforms");
-	for (unsigned i = 0; i < num_tasks; i++)
-	{
-		group.enqueue_task([&scene, num_tasks, i]() {
-			scene.update_cached_transforms_subset(i, num_tasks);
-		});
-	}
+	static ParallelCostEstimator estimator;
+	parallel_for(composer, "parallel-update-cached-transforms", scene.get_cached_transforms_count(),
+	             num_tasks, &estimator,
+	             [&scene](const ParallelChunk &chunk) {
+		             scene.update_cached_transforms_range(chunk.begin, chunk.end);
+	             });
 
 	auto &listener_group = composer.begin_pipeline_stage();
 	listener_group.set_desc("parallel-update-transform-listeners");
@@ -0,0 +1,260 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "tilemap.hpp"
+#include "flat_renderer.hpp"
+#include "enum_cast.hpp"
+#include "muglm/muglm_impl.hpp"
+#include <algorithm>
+#include <assert.h>
+
+namespace Granite
+{
+TileMap::TileMap(uvec2 tile_size_, unsigned chunk_tiles_)
+	: tile_size(tile_size_), chunk_tiles(std::max(chunk_tiles_, 1u))
+{
+}
+
+void TileMap::set_tile_pipelines(std::vector<DrawPipeline> pipelines)
+{
+	tile_pipelines = std::move(pipelines);
+	for (auto &layer : layers)
+		for (auto &chunk : layer.chunks)
+			chunk.dirty = true;
+}
+
+unsigned TileMap::add_layer(uvec2 size, std::vector<int> tile_indices, float z, ivec2 offset, float opacity)
+{
+	assert(tile_indices.size() == size_t(size.x) * size.y);
+
+	Layer layer;
+	layer.tiles = std::move(tile_indices);
+	layer.size = size;
+	layer.num_chunks = (size + uvec2(chunk_tiles - 1)) / uvec2(chunk_tiles);
+	layer.chunks.resize(size_t(layer.num_chunks.x) * layer.num_chunks.y);
+	layer.offset = offset;
+	layer.z = z;
+	layer.opacity = opacity;
+	layer.visible = true;
+	layers.push_back(std::move(layer));
+	return unsigned(layers.size() - 1);
+}
+
+void TileMap::set_layer_visible(unsigned layer, bool visible)
+{
+	layers[layer].visible = visible;
+}
+
+void TileMap::set_tile(unsigned layer_index, uvec2 coord, int tile)
+{
+	auto &layer = layers[layer_index];
+	assert(coord.x < layer.size.x && coord.y < layer.size.y);
+
+	auto &slot = layer.tiles[coord.y * layer.size.x + coord.x];
+	if (slot == tile)
+		return;
+	slot = tile;
+
+	uvec2 chunk_coord = coord / uvec2(chunk_tiles);
+	layer.chunks[chunk_coord.y * layer.num_chunks.x + chunk_coord.x].dirty = true;
+}
+
+int TileMap::get_tile(unsigned layer_index, uvec2 coord) const
+{
+	auto &layer = layers[layer_index];
+	assert(coord.x < layer.size.x && coord.y < layer.size.y);
+	return layer.tiles[coord.y * layer.size.x + coord.x];
+}
+
+void TileMap::set_max_resident_chunks(unsigned count)
+{
+	max_resident_chunks = count;
+}
+
+void TileMap::build_chunk(Layer &layer, uvec2 chunk_coord, Chunk &chunk)
+{
+	for (auto &s : scratch)
+		s.clear();
+
+	uvec2 begin = chunk_coord * uvec2(chunk_tiles);
+	uvec2 end = min(begin + uvec2(chunk_tiles), layer.size);
+	auto alpha = uint8_t(clamp(layer.opacity, 0.0f, 1.0f) * 255.0f + 0.5f);
+
+	for (unsigned y = begin.y; y < end.y; y++)
+	{
+		const int *row = layer.tiles.data() + size_t(y) * layer.size.x;
+		for (unsigned x = begin.x; x < end.x; x++)
+		{
+			int tile = row[x];
+			if (tile < 0)
+				continue;
+
+			auto pipeline = unsigned(tile) < tile_pipelines.size() ? tile_pipelines[tile] : DrawPipeline::Opaque;
+			if (alpha != 0xff)
+				pipeline = DrawPipeline::AlphaBlend;
+
+			QuadData quad;
+			quad.pos_off_x = float(layer.offset.x + int(x * tile_size.x));
+			quad.pos_off_y = float(layer.offset.y + int(y * tile_size.y));
+			quad.pos_scale_x = float(tile_size.x);
+			quad.pos_scale_y = float(tile_size.y);
+			quad.tex_off_x = 0.0f;
+			quad.tex_off_y = 0.0f;
+			quad.tex_scale_x = float(tile_size.x);
+			quad.tex_scale_y = float(tile_size.y);
+			quad.rotation[0] = 1.0f;
+			quad.rotation[1] = 0.0f;
+			quad.rotation[2] = 0.0f;
+			quad.rotation[3] = 1.0f;
+			quad.color[0] = 0xff;
+			quad.color[1] = 0xff;
+			quad.color[2] = 0xff;
+			quad.color[3] = alpha;
+			quad.layer = layer.z;
+			quad.array_layer = float(tile);
+			quad.blend_factor = 0.0f;
+			scratch[Util::ecast(pipeline)].push_back(quad);
+		}
+	}
+
+	chunk.quads.clear();
+	for (unsigned i = 0; i < 3; i++)
+	{
+		chunk.counts[i] = unsigned(scratch[i].size());
+		chunk.quads.insert(chunk.quads.end(), scratch[i].begin(), scratch[i].end());
+	}
+	chunk.dirty = false;
+}
+
+void TileMap::evict_chunks()
+{
+	if (resident.size() <= max_resident_chunks)
+		return;
+
+	// Oldest first, but never drop what was just handed out.
+	std::sort(resident.begin(), resident.end(), [this](const ChunkRef &a, const ChunkRef &b) {
+		return layers[a.layer].chunks[a.chunk].last_visible_frame <
+		       layers[b.layer].chunks[b.chunk].last_visible_frame;
+	});
+
+	size_t to_evict = resident.size() - max_resident_chunks;
+	size_t evicted = 0;
+	while (evicted < to_evict)
+	{
+		auto &chunk = layers[resident[evicted].layer].chunks[resident[evicted].chunk];
+		if (chunk.last_visible_frame == frame)
+			break;
+
+		std::vector<QuadData>().swap(chunk.quads);
+		chunk.resident = false;
+		chunk.dirty = true;
+		evicted++;
+	}
+
+	resident.erase(resident.begin(), resident.begin() + evicted);
+	stats.evicted_chunks = unsigned(evicted);
+}
+
+void TileMap::get_visible_batches(const vec2 &view_offset, const vec2 &view_size, std::vector<ChunkBatch> &batches)
+{
+	batches.clear();
+	stats = {};
+	frame++;
+
+	static const DrawPipeline pipelines[3] = { DrawPipeline::Opaque, DrawPipeline::AlphaTest, DrawPipeline::AlphaBlend };
+	vec2 chunk_size = vec2(tile_size * uvec2(chunk_tiles));
+
+	for (unsigned layer_index = 0; layer_index < unsigned(layers.size()); layer_index++)
+	{
+		auto &layer = layers[layer_index];
+		if (!layer.visible || layer.chunks.empty())
+			continue;
+
+		// Only the chunk range overlapping the view is visited.
+		vec2 lo = floor((view_offset - vec2(layer.offset)) / chunk_size);
+		vec2 hi = ceil((view_offset + view_size - vec2(layer.offset)) / chunk_size) - 1.0f;
+		lo = max(lo, vec2(0.0f));
+		hi = min(hi, vec2(layer.num_chunks) - 1.0f);
+		if (hi.x < lo.x || hi.y < lo.y)
+			continue;
+
+		uvec2 begin = uvec2(lo);
+		uvec2 end = uvec2(hi) + uvec2(1u);
+
+		for (unsigned y = begin.y; y < end.y; y++)
+		{
+			for (unsigned x = begin.x; x < end.x; x++)
+			{
+				unsigned chunk_index = y * layer.num_chunks.x + x;
+				auto &chunk = layer.chunks[chunk_index];
+				stats.visible_chunks++;
+
+				if (chunk.dirty)
+				{
+					build_chunk(layer, uvec2(x, y), chunk);
+					stats.rebuilt_chunks++;
+				}
+
+				if (!chunk.resident)
+				{
+					chunk.resident = true;
+					resident.push_back({ layer_index, chunk_index });
+				}
+				chunk.last_visible_frame = frame;
+
+				vec2 offset = vec2(layer.offset) + vec2(float(x), float(y)) * chunk_size;
+				const QuadData *quads = chunk.quads.data();
+				for (unsigned i = 0; i < 3; i++)
+				{
+					if (chunk.counts[i])
+					{
+						batches.push_back({ quads, chunk.counts[i], pipelines[i], offset, chunk_size });
+						stats.visible_quads += chunk.counts[i];
+					}
+					quads += chunk.counts[i];
+				}
+			}
+		}
+	}
+
+	evict_chunks();
+	stats.resident_chunks = unsigned(resident.size());
+}
+
+void TileMap::render(FlatRenderer &flat, const Vulkan::ImageView &tiles,
+                     const vec2 &view_offset, const vec2 &view_size,
+                     Vulkan::StockSampler sampler)
+{
+	get_visible_batches(view_offset, view_size, batch_scratch);
+
+	SpriteBatchInfo info;
+	info.view = &tiles;
+	info.sampler = sampler;
+	for (auto &batch : batch_scratch)
+	{
+		info.pipeline = batch.pipeline;
+		info.bounds_offset = batch.offset;
+		info.bounds_size = batch.size;
+		flat.push_sprite_batch(info, batch.quads, batch.count);
+	}
+}
+}
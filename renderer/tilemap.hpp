@@ -0,0 +1,134 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "sprite.hpp"
+#include "math.hpp"
+#include <vector>
+
+namespace Granite
+{
+class FlatRenderer;
+
+// Renders tile layers in square chunks of tiles. Each chunk keeps its quads prebuilt, so a frame
+// only copies the visible chunks into the render queue. Culling is done per chunk against the view,
+// chunks are built the first time they are seen and only rebuilt after one of their tiles changed.
+// Chunks which have not been visible for a while are evicted once too many are resident.
+// Tile indices refer to layers of a 2D array texture, like the tilemap built by TMXParser.
+class TileMap
+{
+public:
+	enum { NoTile = -1 };
+
+	explicit TileMap(uvec2 tile_size, unsigned chunk_tiles = 32);
+
+	// Pipeline per tile index, e.g. from TMXParser::Tile::pipeline. Tiles outside the list are opaque.
+	void set_tile_pipelines(std::vector<DrawPipeline> pipelines);
+
+	// z is the sprite layer, smaller values are in front. offset is in pixels.
+	unsigned add_layer(uvec2 size, std::vector<int> tile_indices, float z,
+	                   ivec2 offset = ivec2(0), float opacity = 1.0f);
+
+	void set_layer_visible(unsigned layer, bool visible);
+	void set_tile(unsigned layer, uvec2 coord, int tile);
+	int get_tile(unsigned layer, uvec2 coord) const;
+
+	void set_max_resident_chunks(unsigned count);
+
+	struct ChunkBatch
+	{
+		const QuadData *quads;
+		unsigned count;
+		DrawPipeline pipeline;
+		// Pixel rect covered by the chunk.
+		vec2 offset;
+		vec2 size;
+	};
+
+	// Culls against a view rect in pixels and returns one batch per visible chunk and pipeline.
+	// The quads stay valid until the next call.
+	void get_visible_batches(const vec2 &view_offset, const vec2 &view_size, std::vector<ChunkBatch> &batches);
+
+	void render(FlatRenderer &flat, const Vulkan::ImageView &tiles,
+	            const vec2 &view_offset, const vec2 &view_size,
+	            Vulkan::StockSampler sampler = Vulkan::StockSampler::NearestClamp);
+
+	struct Stats
+	{
+		unsigned visible_chunks = 0;
+		unsigned rebuilt_chunks = 0;
+		unsigned evicted_chunks = 0;
+		unsigned resident_chunks = 0;
+		unsigned visible_quads = 0;
+	};
+
+	// Counters for the last get_visible_batches() or render().
+	const Stats &get_stats() const
+	{
+		return stats;
+	}
+
+private:
+	struct Chunk
+	{
+		std::vector<QuadData> quads;
+		// Quads are ordered opaque, alpha test, then alpha blend.
+		unsigned counts[3] = {};
+		uint64_t last_visible_frame = 0;
+		bool dirty = true;
+		bool resident = false;
+	};
+
+	struct Layer
+	{
+		std::vector<int> tiles;
+		std::vector<Chunk> chunks;
+		uvec2 size;
+		uvec2 num_chunks;
+		ivec2 offset;
+		float z;
+		float opacity;
+		bool visible;
+	};
+
+	struct ChunkRef
+	{
+		unsigned layer;
+		unsigned chunk;
+	};
+
+	uvec2 tile_size;
+	unsigned chunk_tiles;
+	unsigned max_resident_chunks = 1024;
+	uint64_t frame = 0;
+	std::vector<Layer> layers;
+	std::vector<DrawPipeline> tile_pipelines;
+	std::vector<ChunkRef> resident;
+	std::vector<QuadData> scratch[3];
+	std::vector<ChunkBatch> batch_scratch;
+	Stats stats;
+
+	void build_chunk(Layer &layer, uvec2 chunk_coord, Chunk &chunk);
+	void evict_chunks();
+};
+}
@@ -170,8 +170,21 @@ struct CompressorState : std::enable_shared_from_this<CompressorState>
 	double total_error[4] = {};
 	std::mutex lock;
 	TaskSignal *signal = nullptr;
+	TaskGroupHandle completion;
+	bool *failed = nullptr;
+
+	void fail();
 };
 
+void CompressorState::fail()
+{
+	if (failed)
+		*failed = true;
+	if (signal)
+		signal->signal_increment();
+	completion.reset();
+}
+
 void CompressorState::setup()
 {
 	output->set_swizzle(args.output_mapping);
@@ -945,16 +958,26 @@ void CompressorState::enqueue_compression(ThreadGroup &group)
 	});
 	group.add_dependency(*write_task, *compression_task);
 	write_task->set_fence_counter_signal(signal);
+
+	if (completion)
+	{
+		group.add_dependency(*completion, *write_task);
+		completion.reset();
+	}
 }
 
 bool compress_texture(ThreadGroup &group, const CompressorArguments &args,
                       const std::shared_ptr<Vulkan::MemoryMappedTexture> &input,
-                      TaskGroupHandle &dep, TaskSignal *signal)
+                      TaskGroupHandle &dep, TaskSignal *signal,
+                      TaskGroupHandle completion, bool *failed)
 {
 	auto output = std::make_shared<CompressorState>();
 	output->input = input;
 	output->signal = signal;
 	output->args = args;
+	output->failed = failed;
+	// Dropping the last reference flushes it, so early-outs below run it right away.
+	output->completion = std::move(completion);
 
 	switch (input->get_layout().get_format())
 	{
@@ -965,6 +988,8 @@ bool compress_texture(ThreadGroup &group, const CompressorArguments &args,
 
 	default:
 		LOGE("Unsupported input format for compression: %u\n", unsigned(input->get_layout().get_format()));
+		if (failed)
+			*failed = true;
 		return false;
 	}
 
@@ -990,14 +1015,14 @@ bool compress_texture(ThreadGroup &group, const CompressorArguments &args,
 			break;
 		default:
 			LOGE("Unsupported image type.\n");
+			output->fail();
 			return;
 		}
 
 		if (!output->output->map_write(*GRANITE_FILESYSTEM(), output->args.output))
 		{
 			LOGE("Failed to map output texture for writing.\n");
-			if (output->signal)
-				output->signal->signal_increment();
+			output->fail();
 			return;
 		}
 
@@ -58,7 +58,12 @@ struct CompressorArguments
 };
 
 VkFormat string_to_format(const std::string &s);
+// If completion is provided, it runs after the output has been written and unmapped.
+// The compressor takes ownership of it and ensures it is flushed on every path, including failure.
+// Failures which happen after this returns are only reported through failed,
+// which if provided is set to true before completion runs.
 bool compress_texture(ThreadGroup &group, const CompressorArguments &args,
                       const std::shared_ptr<Vulkan::MemoryMappedTexture> &input,
-                      TaskGroupHandle &dep, TaskSignal *signal);
+                      TaskGroupHandle &dep, TaskSignal *signal,
+                      TaskGroupHandle completion = {}, bool *failed = nullptr);
 }
\ No newline at end of file
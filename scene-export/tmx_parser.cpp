@@ -25,9 +25,12 @@
 #include "path_utils.hpp"
 #include "filesystem.hpp"
 #include "rapidjson_wrapper.hpp"
+#include "rapidjson/memorystream.h"
 #include "texture_files.hpp"
 #include "texture_utils.hpp"
+#include <algorithm>
 #include <stdexcept>
+#include <string.h>
 
 using namespace rapidjson;
 using namespace Granite;
@@ -90,20 +93,103 @@ static std::vector<TMXParser::Property> parse_properties(const Value &properties
 	return props;
 }
 
+namespace
+{
+// Forwards SAX events into a Document, except for tile layer "data" arrays.
+// Those are decoded straight into tile indices and replaced by their index in tile_data,
+// since a DOM needs a full Value per tile, which dominates load time and memory on large maps.
+struct TileDataFilter
+{
+	TileDataFilter(Document &doc_, std::vector<std::vector<int>> &tile_data_)
+		: doc(doc_), tile_data(tile_data_)
+	{
+	}
+
+	Document &doc;
+	std::vector<std::vector<int>> &tile_data;
+	bool data_key = false;
+	bool in_data = false;
+
+	bool Null() { data_key = false; return !in_data && doc.Null(); }
+	bool Bool(bool b) { data_key = false; return !in_data && doc.Bool(b); }
+	bool Int(int i) { data_key = false; return !in_data && doc.Int(i); }
+	bool Int64(int64_t i) { data_key = false; return !in_data && doc.Int64(i); }
+	bool Uint64(uint64_t u) { data_key = false; return !in_data && doc.Uint64(u); }
+	bool Double(double d) { data_key = false; return !in_data && doc.Double(d); }
+	bool RawNumber(const char *str, SizeType len, bool copy) { data_key = false; return !in_data && doc.RawNumber(str, len, copy); }
+	bool String(const char *str, SizeType len, bool copy) { data_key = false; return !in_data && doc.String(str, len, copy); }
+	bool StartObject() { data_key = false; return !in_data && doc.StartObject(); }
+	bool EndObject(SizeType count) { return !in_data && doc.EndObject(count); }
+	bool EndArray(SizeType count)
+	{
+		if (in_data)
+		{
+			in_data = false;
+			return doc.Uint(unsigned(tile_data.size() - 1));
+		}
+		return doc.EndArray(count);
+	}
+
+	bool Uint(unsigned u)
+	{
+		data_key = false;
+		if (in_data)
+		{
+			tile_data.back().push_back(int(u) - 1);
+			return true;
+		}
+		return doc.Uint(u);
+	}
+
+	bool Key(const char *str, SizeType len, bool copy)
+	{
+		data_key = len == 4 && memcmp(str, "data", 4) == 0;
+		return doc.Key(str, len, copy);
+	}
+
+	bool StartArray()
+	{
+		if (in_data)
+			return false;
+
+		if (data_key)
+		{
+			data_key = false;
+			in_data = true;
+			tile_data.emplace_back();
+			return true;
+		}
+
+		return doc.StartArray();
+	}
+};
+}
+
 TMXParser::TMXParser(const std::string &path)
 {
-	std::string str;
-	if (!GRANITE_FILESYSTEM()->read_file_to_string(path, str))
+	auto file = GRANITE_FILESYSTEM()->open_readonly_mapping(path);
+	if (!file)
 		throw std::runtime_error("Failed to read JSON file.\n");
 
-	parse(path, str);
+	parse(path, file->data<char>(), file->get_size());
 }
 
-void TMXParser::parse(const std::string &base_path, const std::string &json)
+void TMXParser::parse(const std::string &base_path, const char *json, size_t size)
 {
 	Document doc;
-	doc.Parse(json);
-	if (doc.HasParseError())
+	std::vector<std::vector<int>> tile_data;
+	MemoryStream stream(json, size);
+	Reader reader;
+	bool parse_ok = true;
+
+	auto generator = [&](Document &d) -> bool {
+		TileDataFilter filter(d, tile_data);
+		parse_ok = bool(reader.Parse(stream, filter));
+		return parse_ok;
+	};
+	doc.Populate(generator);
+
+	if (!parse_ok)
 		throw std::runtime_error("Failed to parse JSON.");
 
 	map_size.x = doc["width"].GetUint();
@@ -138,10 +224,17 @@ void TMXParser::parse(const std::string &base_path, const std::string &json)
 		out_layer.visible = layer["visible"].GetBool();
 		out_layer.opacity = layer["opacity"].GetFloat();
 		out_layer.id = layer["id"].GetUint();
-
-		out_layer.tile_indices.reserve(layer["data"].GetArray().Size());
-		for (auto tile_itr = layer["data"].Begin(); tile_itr != layer["data"].End(); ++tile_itr)
-			out_layer.tile_indices.push_back(int(tile_itr->GetUint()) - 1);
+		out_layer.offset = ivec2(0);
+		if (layer.HasMember("offsetx"))
+			out_layer.offset.x = int(layer["offsetx"].GetDouble());
+		if (layer.HasMember("offsety"))
+			out_layer.offset.y = int(layer["offsety"].GetDouble());
+
+		if (!layer["data"].IsUint() || layer["data"].GetUint() >= tile_data.size())
+			throw std::runtime_error("Tile layer data must be an uncompressed JSON array.");
+		out_layer.tile_indices = std::move(tile_data[layer["data"].GetUint()]);
+		if (out_layer.tile_indices.size() != size_t(out_layer.size.x) * out_layer.size.y)
+			throw std::runtime_error("Tile layer data does not match layer size.");
 
 		if (layer.HasMember("properties"))
 			out_layer.properties = parse_properties(layer["properties"]);
@@ -276,31 +369,48 @@ void TMXParser::parse(const std::string &base_path, const std::string &json)
 
 	tilemap = SceneFormats::fixup_alpha_edges(tilemap.get_layout(), 0);
 
-	const auto find_tileset = [&](unsigned index) -> const Tileset * {
-		for (auto &tileset : tilesets)
-			if (index >= tileset.first_gid && index < tileset.first_gid + tileset.num_tiles)
-				return &tileset;
+	// Fixup tilemap indices through a table, large maps have far more tiles than there are gids.
+	unsigned max_gid = 0;
+	for (auto &tileset : tilesets)
+		max_gid = std::max(max_gid, tileset.first_gid + tileset.num_tiles);
 
-		return nullptr;
-	};
+	std::vector<int> gid_to_tile(max_gid, NoTile);
+	for (auto &tileset : tilesets)
+		for (unsigned i = 0; i < tileset.num_tiles; i++)
+			gid_to_tile[tileset.first_gid + i] = int(tileset.first_gid + i) + tileset.gid_offset;
 
-	// Fixup tilemap indices.
 	for (auto &layer : layers)
 	{
 		for (auto &index : layer.tile_indices)
 		{
 			if (index < 0)
 				continue;
-
-			auto *tileset = find_tileset(index);
-			if (tileset)
-				index += tileset->gid_offset;
-			else
-				index = NoTile;
+			index = unsigned(index) < max_gid ? gid_to_tile[index] : int(NoTile);
 		}
 	}
 }
 
+void TMXParser::build_tile_map(TileMap &map, float base_z) const
+{
+	std::vector<DrawPipeline> pipelines;
+	pipelines.reserve(tiles.size());
+	for (auto &tile : tiles)
+		pipelines.push_back(tile.pipeline);
+	map.set_tile_pipelines(std::move(pipelines));
+
+	// Later layers are drawn on top, i.e. get smaller z.
+	float z = base_z + float(layers.size());
+	for (auto &layer : layers)
+	{
+		z -= 1.0f;
+		if (layer.tile_indices.empty())
+			continue;
+
+		unsigned index = map.add_layer(layer.size, layer.tile_indices, z, layer.offset, layer.opacity);
+		map.set_layer_visible(index, layer.visible);
+	}
+}
+
 void TMXParser::copy_tile(const Vulkan::TextureFormatLayout &dst_layout, unsigned layer,
                           const Vulkan::TextureFormatLayout &src_layout, unsigned base_x, unsigned base_y)
 {
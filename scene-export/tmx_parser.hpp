@@ -27,6 +27,7 @@
 #include <stdexcept>
 #include "memory_mapped_texture.hpp"
 #include "abstract_renderable.hpp"
+#include "tilemap.hpp"
 #include "math.hpp"
 
 class TMXParser
@@ -120,6 +121,10 @@ public:
 	muglm::uvec2 get_tile_size() const;
 	muglm::uvec2 get_map_tiles() const;
 
+	// Adds all tile layers, with z counting down from base_z + number of layers.
+	// The tile indices are layers of get_tilemap_image_layout().
+	void build_tile_map(Granite::TileMap &map, float base_z = 0.0f) const;
+
 private:
 	Vulkan::MemoryMappedTexture tilemap;
 	std::vector<Tile> tiles;
@@ -128,7 +133,7 @@ private:
 	muglm::uvec2 map_size;
 	muglm::uvec2 tile_size;
 
-	void parse(const std::string &base_path, const std::string &json);
+	void parse(const std::string &base_path, const char *json, size_t size);
 	void copy_tile(const Vulkan::TextureFormatLayout &dst_layout, unsigned layer,
 	               const Vulkan::TextureFormatLayout &src_layout, unsigned x, unsigned y);
 };
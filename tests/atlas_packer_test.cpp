@@ -0,0 +1,140 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "atlas_packer.hpp"
+#include "muglm/muglm_impl.hpp"
+#include "logging.hpp"
+#include <stdlib.h>
+#include <random>
+#include <vector>
+
+using namespace Granite;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void validate(const AtlasPacker &packer, const std::vector<uvec2> &sizes, const std::vector<AtlasRect> &rects)
+{
+	uvec2 layer_size = packer.get_layer_size();
+	unsigned padding = packer.get_padding();
+
+	for (size_t i = 0; i < rects.size(); i++)
+	{
+		auto &r = rects[i];
+		check(all(equal(r.size, sizes[i])), "Rect size does not match input.");
+		check(r.layer < packer.get_num_layers(), "Rect layer out of range.");
+		check(r.offset.x >= padding && r.offset.y >= padding, "Rect gutter below zero.");
+		check(r.offset.x + r.size.x + padding <= layer_size.x &&
+		      r.offset.y + r.size.y + padding <= layer_size.y, "Rect gutter out of bounds.");
+	}
+
+	// Padded cells must not overlap, otherwise gutters of neighbours would be overwritten.
+	for (size_t i = 0; i < rects.size(); i++)
+	{
+		for (size_t j = i + 1; j < rects.size(); j++)
+		{
+			auto &a = rects[i];
+			auto &b = rects[j];
+			if (a.layer != b.layer)
+				continue;
+
+			uvec2 a_lo = a.offset - uvec2(padding), a_hi = a.offset + a.size + uvec2(padding);
+			uvec2 b_lo = b.offset - uvec2(padding), b_hi = b.offset + b.size + uvec2(padding);
+			bool disjoint = a_hi.x <= b_lo.x || b_hi.x <= a_lo.x || a_hi.y <= b_lo.y || b_hi.y <= a_lo.y;
+			check(disjoint, "Rects overlap.");
+		}
+	}
+}
+
+static std::vector<uvec2> random_sizes(std::mt19937 &rnd, unsigned count, unsigned lo, unsigned hi)
+{
+	std::uniform_int_distribution<unsigned> dist(lo, hi);
+	std::vector<uvec2> sizes(count);
+	for (auto &s : sizes)
+		s = uvec2(dist(rnd), dist(rnd));
+	return sizes;
+}
+
+int main()
+{
+	std::mt19937 rnd(1234);
+
+	{
+		AtlasPacker packer(uvec2(256), 4);
+		check(packer.pack(nullptr, 0, nullptr), "Empty input failed.");
+		check(packer.get_num_layers() == 0, "Empty input allocated layers.");
+	}
+
+	{
+		// Exact fit of 16 64x64 tiles in one layer.
+		std::vector<uvec2> sizes(16, uvec2(64));
+		std::vector<AtlasRect> rects(sizes.size());
+		AtlasPacker packer(uvec2(256), 1);
+		check(packer.pack(sizes.data(), sizes.size(), rects.data()), "Exact fit failed.");
+		validate(packer, sizes, rects);
+
+		sizes.push_back(uvec2(1));
+		rects.resize(sizes.size());
+		check(!packer.pack(sizes.data(), sizes.size(), rects.data()), "Overfull single layer succeeded.");
+	}
+
+	{
+		AtlasPacker packer(uvec2(128), 8, 1);
+		uvec2 size(127);
+		AtlasRect rect;
+		check(!packer.pack(&size, 1, &rect), "Rect larger than layer with gutter succeeded.");
+	}
+
+	for (unsigned padding = 0; padding < 3; padding++)
+	{
+		auto sizes = random_sizes(rnd, 600, 1, 90);
+		std::vector<AtlasRect> rects(sizes.size());
+		AtlasPacker packer(uvec2(512), 16, padding);
+		check(packer.pack(sizes.data(), sizes.size(), rects.data()), "Random pack failed.");
+		check(packer.get_num_layers() > 1, "Expected random set to spill into more layers.");
+		validate(packer, sizes, rects);
+
+		uint64_t area = 0;
+		for (auto &s : sizes)
+			area += uint64_t(s.x + 2 * padding) * (s.y + 2 * padding);
+		double occupancy = double(area) / (double(packer.get_num_layers()) * 512.0 * 512.0);
+		LOGI("Padding %u: %u layers, %.1f %% occupancy.\n", padding, packer.get_num_layers(), 100.0 * occupancy);
+
+		// Packing again, also with a fresh packer, must give the same placement.
+		std::vector<AtlasRect> again(sizes.size());
+		AtlasPacker other(uvec2(512), 16, padding);
+		check(other.pack(sizes.data(), sizes.size(), again.data()), "Repack failed.");
+		for (size_t i = 0; i < rects.size(); i++)
+		{
+			check(all(equal(rects[i].offset, again[i].offset)) && rects[i].layer == again[i].layer,
+			      "Packing is not deterministic.");
+		}
+	}
+
+	LOGI("All atlas packer tests passed.\n");
+}
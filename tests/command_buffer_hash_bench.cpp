@@ -0,0 +1,179 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "global_managers_init.hpp"
+#include "filesystem.hpp"
+#include "device.hpp"
+#include "context.hpp"
+#include "shader_manager.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <vector>
+
+using namespace Granite;
+using namespace Vulkan;
+
+static constexpr unsigned NumDraws = 100000;
+static constexpr unsigned NumTextures = 64;
+static constexpr unsigned Iterations = 10;
+
+enum ChurnBits
+{
+	CHURN_TEXTURE_BIT = 1 << 0,
+	CHURN_UNIFORM_BIT = 1 << 1,
+	CHURN_STATIC_STATE_BIT = 1 << 2,
+	CHURN_VERTEX_BIT = 1 << 3,
+	CHURN_PROGRAM_BIT = 1 << 4
+};
+
+struct Resources
+{
+	Program *programs[2];
+	BufferHandle vbo;
+	BufferHandle ubo;
+	std::vector<ImageHandle> textures;
+	ImageHandle rt;
+};
+
+static double run_scenario(Device &device, const Resources &res, uint32_t churn)
+{
+	RenderPassInfo rp;
+	rp.num_color_attachments = 1;
+	rp.color_attachments[0] = &res.rt->get_view();
+	rp.store_attachments = 1;
+
+	auto start_time = Util::get_current_time_nsecs();
+
+	auto cmd = device.request_command_buffer();
+	cmd->begin_render_pass(rp);
+	cmd->set_program(res.programs[0]);
+	cmd->set_quad_state();
+	cmd->set_vertex_attrib(0, 0, VK_FORMAT_R32G32_SFLOAT, 0);
+	cmd->set_texture(0, 0, res.textures[0]->get_view(), StockSampler::LinearClamp);
+	cmd->set_uniform_buffer(0, 1, *res.ubo, 0, 256);
+
+	for (unsigned i = 0; i < NumDraws; i++)
+	{
+		if (churn & CHURN_PROGRAM_BIT)
+			cmd->set_program(res.programs[(i >> 4) & 1]);
+		if (churn & CHURN_STATIC_STATE_BIT)
+			cmd->set_blend_enable((i >> 2) & 1);
+		if (churn & CHURN_VERTEX_BIT)
+			cmd->set_vertex_binding(0, *res.vbo, 0, (i & 1) ? 8 : 16);
+		else
+			cmd->set_vertex_binding(0, *res.vbo, 0, 8);
+		if (churn & CHURN_TEXTURE_BIT)
+			cmd->set_texture(0, 0, res.textures[i % NumTextures]->get_view(), StockSampler::LinearClamp);
+		if (churn & CHURN_UNIFORM_BIT)
+			cmd->set_uniform_buffer(0, 1, *res.ubo, 256 * (i & 15), 256);
+		cmd->draw(4);
+	}
+
+	cmd->end_render_pass();
+	device.submit(cmd);
+	device.next_frame_context();
+
+	return double(Util::get_current_time_nsecs() - start_time);
+}
+
+static int main_inner()
+{
+	// Only CPU overhead is interesting here, so keep the GPU side of each frame trivial.
+	if (!Context::init_loader(nullptr))
+		return EXIT_FAILURE;
+
+	Context ctx;
+	Context::SystemHandles handles;
+	handles.filesystem = GRANITE_FILESYSTEM();
+	handles.thread_group = GRANITE_THREAD_GROUP();
+	ctx.set_system_handles(handles);
+	if (!ctx.init_instance_and_device(nullptr, 0, nullptr, 0))
+		return EXIT_FAILURE;
+
+	Device device;
+	device.set_context(ctx);
+
+	Resources res;
+	auto *shader = device.get_shader_manager().register_graphics("builtin://shaders/quad.vert",
+	                                                             "builtin://shaders/blit.frag");
+	if (!shader)
+		return EXIT_FAILURE;
+	res.programs[0] = shader->register_variant({})->get_program();
+	res.programs[1] = shader->register_variant({{ "BLIT_VARIANT", 1 }})->get_program();
+	if (!res.programs[0] || !res.programs[1])
+		return EXIT_FAILURE;
+
+	BufferCreateInfo buffer_info = {};
+	buffer_info.domain = BufferDomain::Device;
+	buffer_info.size = 64 * 1024;
+	buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	res.vbo = device.create_buffer(buffer_info);
+	buffer_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	res.ubo = device.create_buffer(buffer_info);
+
+	auto tex_info = ImageCreateInfo::immutable_2d_image(4, 4, VK_FORMAT_R8G8B8A8_UNORM);
+	for (unsigned i = 0; i < NumTextures; i++)
+		res.textures.push_back(device.create_image(tex_info));
+	res.rt = device.create_image(ImageCreateInfo::render_target(256, 256, VK_FORMAT_R8G8B8A8_UNORM));
+
+	static const struct
+	{
+		const char *tag;
+		uint32_t churn;
+	} scenarios[] = {
+		{ "No churn", 0 },
+		{ "Texture", CHURN_TEXTURE_BIT },
+		{ "Uniform offset", CHURN_UNIFORM_BIT },
+		{ "Texture + uniform", CHURN_TEXTURE_BIT | CHURN_UNIFORM_BIT },
+		{ "Static state", CHURN_STATIC_STATE_BIT },
+		{ "Vertex stride", CHURN_VERTEX_BIT },
+		{ "Program", CHURN_PROGRAM_BIT },
+		{ "Everything", CHURN_TEXTURE_BIT | CHURN_UNIFORM_BIT | CHURN_STATIC_STATE_BIT |
+		                CHURN_VERTEX_BIT | CHURN_PROGRAM_BIT },
+	};
+
+	for (auto &scenario : scenarios)
+	{
+		// Warm up pipeline and descriptor set caches so only steady state is measured.
+		run_scenario(device, res, scenario.churn);
+
+		double total_time = 0.0;
+		for (unsigned i = 0; i < Iterations; i++)
+			total_time += run_scenario(device, res, scenario.churn);
+
+		double nsecs = total_time / Iterations;
+		LOGI("%-20s %8.3f ms, %6.1f ns/draw, %7.3f M draws/s.\n",
+		     scenario.tag, 1e-6 * nsecs, nsecs / NumDraws, 1e3 * NumDraws / nsecs);
+	}
+
+	device.wait_idle();
+	return EXIT_SUCCESS;
+}
+
+int main()
+{
+	Global::init(Global::MANAGER_FEATURE_DEFAULT_BITS, 1);
+	int ret = main_inner();
+	Global::deinit();
+	return ret;
+}
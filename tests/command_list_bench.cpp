@@ -0,0 +1,217 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "global_managers_init.hpp"
+#include "filesystem.hpp"
+#include "device.hpp"
+#include "context.hpp"
+#include "command_list.hpp"
+#include "shader_manager.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace Granite;
+using namespace Vulkan;
+
+static constexpr unsigned NumDraws = 50000;
+static constexpr unsigned NumTextures = 16;
+static constexpr unsigned Iterations = 20;
+
+struct Resources
+{
+	Program *program;
+	BufferHandle vbo;
+	BufferHandle ubo;
+	std::vector<ImageHandle> textures;
+};
+
+// Draws are sorted by texture, so most binds are redundant like in a real sorted render queue.
+template <typename Cmd>
+static void record_draws(Cmd &cmd, const Resources &res, unsigned begin, unsigned end)
+{
+	for (unsigned i = begin; i < end; i++)
+	{
+		cmd.set_program(res.program);
+		cmd.set_quad_state();
+		cmd.set_vertex_attrib(0, 0, VK_FORMAT_R32G32_SFLOAT, 0);
+		cmd.set_vertex_binding(0, *res.vbo, 0, 2 * sizeof(float));
+		cmd.set_texture(0, 0, res.textures[(i / 8) % NumTextures]->get_view(), StockSampler::LinearClamp);
+		cmd.set_uniform_buffer(0, 1, *res.ubo, 0, 256);
+
+		float offset[4] = { float(i), 0.0f, 0.0f, 0.0f };
+		cmd.push_constants(offset, 0, sizeof(offset));
+		cmd.draw(4);
+	}
+}
+
+static RenderPassInfo get_render_pass(const Image &rt)
+{
+	RenderPassInfo rp;
+	rp.num_color_attachments = 1;
+	rp.color_attachments[0] = &rt.get_view();
+	rp.store_attachments = 1;
+	return rp;
+}
+
+static double run_direct(Device &device, const Resources &res, const Image &rt)
+{
+	auto start_time = Util::get_current_time_nsecs();
+	auto cmd = device.request_command_buffer();
+	cmd->begin_render_pass(get_render_pass(rt));
+	record_draws(*cmd, res, 0, NumDraws);
+	cmd->end_render_pass();
+	device.submit(cmd);
+	device.next_frame_context();
+	return double(Util::get_current_time_nsecs() - start_time);
+}
+
+static double run_record(std::vector<CommandList> &lists, const Resources &res)
+{
+	auto start_time = Util::get_current_time_nsecs();
+
+	unsigned num_lists = unsigned(lists.size());
+	std::vector<std::thread> threads;
+	threads.reserve(num_lists);
+	for (unsigned i = 0; i < num_lists; i++)
+	{
+		threads.emplace_back([&, i]() {
+			auto &list = lists[i];
+			list.reset();
+			record_draws(list, res, i * NumDraws / num_lists, (i + 1) * NumDraws / num_lists);
+		});
+	}
+
+	for (auto &thread : threads)
+		thread.join();
+
+	return double(Util::get_current_time_nsecs() - start_time);
+}
+
+static double run_replay(Device &device, const std::vector<CommandList> &lists, const Image &rt,
+                         CommandListReplayStats &stats)
+{
+	auto start_time = Util::get_current_time_nsecs();
+	auto cmd = device.request_command_buffer();
+	cmd->begin_render_pass(get_render_pass(rt));
+	for (auto &list : lists)
+		list.replay(*cmd, &stats);
+	cmd->end_render_pass();
+	device.submit(cmd);
+	device.next_frame_context();
+	return double(Util::get_current_time_nsecs() - start_time);
+}
+
+static int main_inner()
+{
+	// Only CPU cost is interesting here, so keep the GPU side of each frame trivial.
+	if (!Context::init_loader(nullptr))
+		return EXIT_FAILURE;
+
+	Context ctx;
+	Context::SystemHandles handles;
+	handles.filesystem = GRANITE_FILESYSTEM();
+	handles.thread_group = GRANITE_THREAD_GROUP();
+	ctx.set_system_handles(handles);
+	if (!ctx.init_instance_and_device(nullptr, 0, nullptr, 0))
+		return EXIT_FAILURE;
+
+	Device device;
+	device.set_context(ctx);
+
+	Resources res;
+	auto *shader = device.get_shader_manager().register_graphics("builtin://shaders/quad.vert",
+	                                                             "builtin://shaders/blit.frag");
+	if (!shader)
+		return EXIT_FAILURE;
+	res.program = shader->register_variant({})->get_program();
+	if (!res.program)
+		return EXIT_FAILURE;
+
+	BufferCreateInfo buffer_info = {};
+	buffer_info.domain = BufferDomain::Device;
+	buffer_info.size = 64 * 1024;
+	buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	res.vbo = device.create_buffer(buffer_info);
+	buffer_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	res.ubo = device.create_buffer(buffer_info);
+
+	auto tex_info = ImageCreateInfo::immutable_2d_image(4, 4, VK_FORMAT_R8G8B8A8_UNORM);
+	for (unsigned i = 0; i < NumTextures; i++)
+		res.textures.push_back(device.create_image(tex_info));
+
+	auto rt = device.create_image(ImageCreateInfo::render_target(256, 256, VK_FORMAT_R8G8B8A8_UNORM));
+
+	// Warm up pipeline and descriptor caches so we only measure steady state.
+	run_direct(device, res, *rt);
+
+	double direct_time = 0.0;
+	for (unsigned i = 0; i < Iterations; i++)
+		direct_time += run_direct(device, res, *rt);
+
+	const auto report = [](const char *tag, double total_nsecs) {
+		double nsecs = total_nsecs / Iterations;
+		LOGI("%-28s %8.3f ms, %6.1f ns/draw, %7.3f M draws/s.\n",
+		     tag, 1e-6 * nsecs, nsecs / NumDraws, 1e3 * NumDraws / nsecs);
+	};
+
+	report("Direct CommandBuffer:", direct_time);
+
+	unsigned max_lists = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned num_lists = 1; num_lists <= max_lists; num_lists *= 2)
+	{
+		std::vector<CommandList> lists(num_lists);
+		double record_time = 0.0;
+		double replay_time = 0.0;
+		CommandListReplayStats stats;
+
+		for (unsigned i = 0; i < Iterations; i++)
+		{
+			record_time += run_record(lists, res);
+			replay_time += run_replay(device, lists, *rt, stats);
+		}
+
+		char tag[64];
+		snprintf(tag, sizeof(tag), "Record (%2u lists):", num_lists);
+		report(tag, record_time);
+		snprintf(tag, sizeof(tag), "Replay (%2u lists):", num_lists);
+		report(tag, replay_time);
+		snprintf(tag, sizeof(tag), "Record + replay (%2u lists):", num_lists);
+		report(tag, record_time + replay_time);
+		LOGI("  %u commands per frame, %.1f %% eliminated as redundant.\n",
+		     stats.commands / Iterations, 100.0 * double(stats.redundant) / double(std::max(stats.commands, 1u)));
+	}
+
+	device.wait_idle();
+	return EXIT_SUCCESS;
+}
+
+int main()
+{
+	Global::init(Global::MANAGER_FEATURE_DEFAULT_BITS, 1);
+	int ret = main_inner();
+	Global::deinit();
+	return ret;
+}
@@ -0,0 +1,182 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "coroutine_task.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stdlib.h>
+
+using namespace Granite;
+
+static constexpr unsigned NumAssets = 256;
+static constexpr unsigned NumForegroundThreads = 4;
+static constexpr unsigned NumBackgroundThreads = 16;
+
+// Stand-ins for reading a file and decoding it.
+static void simulate_io()
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(2));
+}
+
+static uint32_t simulate_decode(unsigned seed)
+{
+	uint32_t v = seed;
+	for (unsigned i = 0; i < 200000; i++)
+		v = v * 1664525u + 1013904223u;
+	return v;
+}
+
+static double run_blocking(ThreadGroup &group)
+{
+	std::atomic_uint checksum;
+	checksum.store(0);
+
+	auto start_time = Util::get_current_time_nsecs();
+	auto task = group.create_task();
+	for (unsigned i = 0; i < NumAssets; i++)
+	{
+		task->enqueue_task([i, &checksum]() {
+			simulate_io();
+			checksum.fetch_add(simulate_decode(i), std::memory_order_relaxed);
+		});
+	}
+	task->wait();
+	return 1e-9 * double(Util::get_current_time_nsecs() - start_time);
+}
+
+static double run_suspending(ThreadGroup &group)
+{
+	std::atomic_uint checksum;
+	checksum.store(0);
+
+	auto start_time = Util::get_current_time_nsecs();
+	auto task = group.create_task();
+	for (unsigned i = 0; i < NumAssets; i++)
+	{
+		group.enqueue_coroutine_task(*task, [i, &checksum](CoroutineContext &ctx) {
+			ctx.await_background(simulate_io);
+			checksum.fetch_add(simulate_decode(i), std::memory_order_relaxed);
+		});
+	}
+	task->wait();
+	return 1e-9 * double(Util::get_current_time_nsecs() - start_time);
+}
+
+static void test_await(ThreadGroup &group)
+{
+	TaskSignal signal;
+	std::atomic_uint order;
+	order.store(0);
+
+	auto producer = group.create_task([&]() {
+		simulate_io();
+		order.fetch_add(1);
+	});
+
+	auto consumer = group.create_task();
+	group.enqueue_coroutine_task(*consumer, [&](CoroutineContext &ctx) {
+		ctx.await(*producer);
+		if (order.load() != 1)
+		{
+			LOGE("Coroutine resumed before awaited group completed.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		ctx.await(signal, 1);
+		order.fetch_add(1);
+	});
+	consumer->flush();
+
+	// Make sure the coroutine is suspended waiting for the signal before we signal it.
+	while (order.load() != 1)
+		std::this_thread::yield();
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	signal.signal_increment();
+
+	consumer->wait();
+	if (order.load() != 2)
+	{
+		LOGE("Coroutine did not complete.\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+// Plain tasks which block on a group of coroutines. Workers help out while waiting,
+// and may also own suspended coroutines which only they can resume, neither may deadlock.
+static void test_nested_wait(ThreadGroup &group)
+{
+	constexpr unsigned NumOuterTasks = 16;
+	std::atomic_uint completed;
+	completed.store(0);
+
+	auto outer = group.create_task();
+	for (unsigned i = 0; i < NumOuterTasks; i++)
+	{
+		outer->enqueue_task([&group, &completed]() {
+			auto inner = group.create_task();
+			group.enqueue_coroutine_task(*inner, [&completed](CoroutineContext &ctx) {
+				ctx.await_background(simulate_io);
+				completed.fetch_add(1, std::memory_order_relaxed);
+			});
+			inner->wait();
+		});
+	}
+	outer->flush();
+
+	auto start_time = Util::get_current_time_nsecs();
+	while (!outer->poll())
+	{
+		if (Util::get_current_time_nsecs() - start_time > 10ll * 1000 * 1000 * 1000)
+		{
+			LOGE("Nested wait on coroutines deadlocked.\n");
+			exit(EXIT_FAILURE);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	outer->wait();
+	if (completed.load() != NumOuterTasks)
+	{
+		LOGE("Not all nested coroutines completed.\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+int main()
+{
+	ThreadGroup group;
+	group.start(NumForegroundThreads, NumBackgroundThreads, {});
+
+	test_await(group);
+	for (unsigned i = 0; i < 16; i++)
+		test_nested_wait(group);
+
+	double blocking_time = run_blocking(group);
+	double suspending_time = run_suspending(group);
+
+	LOGI("Blocking: %.1f assets/s.\n", NumAssets / blocking_time);
+	LOGI("Suspending: %.1f assets/s.\n", NumAssets / suspending_time);
+}
@@ -0,0 +1,177 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "ecs.hpp"
+#include "logging.hpp"
+#include <stdlib.h>
+#include <random>
+#include <unordered_set>
+
+using namespace Granite;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+struct AComponent : ComponentBase
+{
+	GRANITE_COMPONENT_TYPE_DECL(AComponent)
+	int v = 0;
+};
+
+struct BComponent : ComponentBase
+{
+	GRANITE_COMPONENT_TYPE_DECL(BComponent)
+	int v = 0;
+};
+
+struct CComponent : ComponentBase
+{
+	GRANITE_COMPONENT_TYPE_DECL(CComponent)
+	int v = 0;
+};
+
+template <typename First, typename Group>
+static void validate_group(const Group &group, const std::unordered_set<Entity *> &alive)
+{
+	auto &entities = group.get_entities();
+	auto &groups = group.get_groups();
+	check(entities.size() == groups.size(), "Group vectors out of sync.");
+	std::unordered_set<Entity *> seen;
+	for (size_t i = 0; i < entities.size(); i++)
+	{
+		check(alive.count(entities[i]) != 0, "Dead entity in group.");
+		check(seen.insert(entities[i]).second, "Entity in group twice.");
+		check(std::get<0>(groups[i]) == entities[i]->template get_component<First>(), "Group tuple does not match entity.");
+	}
+}
+
+static size_t count_with(const std::unordered_set<Entity *> &alive, bool need_b, bool need_c)
+{
+	size_t count = 0;
+	for (auto *e : alive)
+		if (e->has_component<AComponent>() && (!need_b || e->has_component<BComponent>()) &&
+		    (!need_c || e->has_component<CComponent>()))
+			count++;
+	return count;
+}
+
+int main()
+{
+	EntityPool pool;
+	auto *group_a = pool.get_component_group_holder<AComponent>();
+	auto *group_ab = pool.get_component_group_holder<AComponent, BComponent>();
+	auto *group_abc = pool.get_component_group_holder<AComponent, BComponent, CComponent>();
+	std::unordered_set<Entity *> alive;
+
+	auto validate = [&]() {
+		validate_group<AComponent>(*group_a, alive);
+		validate_group<AComponent>(*group_ab, alive);
+		validate_group<AComponent>(*group_abc, alive);
+		check(group_a->get_entities().size() == count_with(alive, false, false), "Group A size mismatch.");
+		check(group_ab->get_entities().size() == count_with(alive, true, false), "Group AB size mismatch.");
+		check(group_abc->get_entities().size() == count_with(alive, true, true), "Group ABC size mismatch.");
+	};
+
+	// Some individually created entities first.
+	for (int i = 0; i < 100; i++)
+	{
+		auto *e = pool.create_entity();
+		e->allocate_component<AComponent>();
+		if (i & 1)
+			e->allocate_component<BComponent>();
+		alive.insert(e);
+	}
+
+	uint64_t version = pool.get_change_version();
+	std::vector<Entity *> batch(5000);
+	std::vector<std::tuple<AComponent *, BComponent *>> components(batch.size());
+	pool.create_entities<AComponent, BComponent>(batch.data(), batch.size(), components.data());
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		check(batch[i]->get_component<AComponent>() == std::get<0>(components[i]), "Component A pointer mismatch.");
+		check(batch[i]->get_component<BComponent>() == std::get<1>(components[i]), "Component B pointer mismatch.");
+		std::get<0>(components[i])->v = int(i);
+		alive.insert(batch[i]);
+	}
+	validate();
+
+	size_t changed = 0;
+	group_ab->for_each_changed(version, [&](const std::tuple<AComponent *, BComponent *> &, const Entity &) {
+		changed++;
+	});
+	check(changed == batch.size(), "Bulk created entities not visible as changed.");
+
+	// Entities in a batch behave like any other.
+	batch[10]->allocate_component<CComponent>();
+	batch[11]->free_component<BComponent>();
+	validate();
+
+	// Groups registered after the fact pick up bulk created entities.
+	auto *group_b = pool.get_component_group_holder<BComponent>();
+	check(group_b->get_entities().size() == 50 + batch.size() - 1, "Late group size mismatch.");
+
+	// Delete a large random subset, which takes the compaction path.
+	std::mt19937 rnd(3);
+	std::vector<Entity *> to_delete;
+	for (auto *e : alive)
+		if (rnd() & 1)
+			to_delete.push_back(e);
+	for (auto *e : to_delete)
+		alive.erase(e);
+	pool.delete_entities(to_delete.data(), to_delete.size());
+	validate();
+	validate_group<BComponent>(*group_b, alive);
+
+	// Delete a few, which takes the swap removal path.
+	to_delete.clear();
+	for (auto *e : alive)
+	{
+		to_delete.push_back(e);
+		if (to_delete.size() == 5)
+			break;
+	}
+	for (auto *e : to_delete)
+		alive.erase(e);
+	pool.delete_entities(to_delete.data(), to_delete.size());
+	validate();
+
+	// Recycled slots must not alias stale group entries.
+	pool.create_entities<AComponent, BComponent, CComponent>(batch.data(), 3000);
+	for (size_t i = 0; i < 3000; i++)
+		alive.insert(batch[i]);
+	validate();
+
+	to_delete.assign(alive.begin(), alive.end());
+	pool.delete_entities(to_delete.data(), to_delete.size());
+	alive.clear();
+	validate();
+	check(group_a->get_entities().empty() && group_b->get_entities().empty(), "Groups not empty after deleting everything.");
+
+	LOGI("All ECS bulk tests passed.\n");
+}
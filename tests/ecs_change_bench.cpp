@@ -0,0 +1,179 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "ecs.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <stdlib.h>
+#include <random>
+#include <vector>
+
+using namespace Granite;
+
+static constexpr unsigned NumEntities = 1000000;
+static constexpr unsigned NumFrames = 20;
+
+// Mimics how Scene tracks transform changes through timestamps on scene nodes.
+struct NodeState
+{
+	uint32_t timestamp = 0;
+	float position[3] = {};
+};
+
+struct TransformComponent : ComponentBase
+{
+	GRANITE_COMPONENT_TYPE_DECL(TransformComponent)
+	explicit TransformComponent(const NodeState *node_)
+		: node(node_)
+	{
+	}
+	const NodeState *node;
+	uint32_t last_timestamp = 0;
+};
+
+struct BoundsComponent : ComponentBase
+{
+	GRANITE_COMPONENT_TYPE_DECL(BoundsComponent)
+	float world_bounds[6] = {};
+};
+
+static void update_bounds(TransformComponent *transform, BoundsComponent *bounds)
+{
+	for (unsigned c = 0; c < 3; c++)
+	{
+		bounds->world_bounds[c] = transform->node->position[c] - 1.0f;
+		bounds->world_bounds[c + 3] = transform->node->position[c] + 1.0f;
+	}
+	transform->last_timestamp = transform->node->timestamp;
+}
+
+struct Result
+{
+	double mark_ms;
+	double scan_ms;
+	double changed_ms;
+	size_t updates_per_frame;
+};
+
+static Result run_frames(EntityPool &pool, EntityGroup<TransformComponent, BoundsComponent> &group,
+                         std::vector<NodeState> &nodes, const std::vector<Entity *> &entities,
+                         unsigned changes_per_frame, uint32_t &frame)
+{
+	std::mt19937 rnd(frame);
+	int64_t mark_time = 0;
+	int64_t scan_time = 0;
+	int64_t changed_time = 0;
+	size_t scan_updates = 0;
+	size_t changed_updates = 0;
+	uint64_t last_version = pool.get_change_version();
+	std::vector<unsigned> indices(changes_per_frame);
+
+	for (unsigned i = 0; i < NumFrames; i++)
+	{
+		frame++;
+
+		for (auto &index : indices)
+		{
+			index = rnd() % NumEntities;
+			nodes[index].timestamp = frame;
+			nodes[index].position[0] += 1.0f;
+		}
+
+		// Only time the ECS side of marking.
+		auto start = Util::get_current_time_nsecs();
+		for (auto index : indices)
+			entities[index]->mark_changed<TransformComponent>();
+		mark_time += Util::get_current_time_nsecs() - start;
+
+		// Baseline: iterate everything and compare timestamps, like Scene::update_cached_transforms_range.
+		// Leave last_timestamp alone so the change tracked path below sees the same work.
+		start = Util::get_current_time_nsecs();
+		for (auto &tup : group.get_groups())
+		{
+			auto *transform = get_component<TransformComponent>(tup);
+			if (transform->node->timestamp != transform->last_timestamp)
+			{
+				auto *bounds = get_component<BoundsComponent>(tup);
+				for (unsigned c = 0; c < 3; c++)
+				{
+					bounds->world_bounds[c] = transform->node->position[c] - 1.0f;
+					bounds->world_bounds[c + 3] = transform->node->position[c] + 1.0f;
+				}
+				scan_updates++;
+			}
+		}
+		scan_time += Util::get_current_time_nsecs() - start;
+
+		// Change tracked: only visit members changed since last frame.
+		start = Util::get_current_time_nsecs();
+		group.for_each_changed(last_version, [&](const std::tuple<TransformComponent *, BoundsComponent *> &tup, const Entity &) {
+			update_bounds(get_component<TransformComponent>(tup), get_component<BoundsComponent>(tup));
+			changed_updates++;
+		});
+		last_version = pool.get_change_version();
+		changed_time += Util::get_current_time_nsecs() - start;
+	}
+
+	if (scan_updates != changed_updates)
+	{
+		LOGE("Mismatch in number of updates, %zu != %zu.\n", scan_updates, changed_updates);
+		exit(EXIT_FAILURE);
+	}
+
+	Result result = {};
+	result.mark_ms = 1e-6 * double(mark_time) / NumFrames;
+	result.scan_ms = 1e-6 * double(scan_time) / NumFrames;
+	result.changed_ms = 1e-6 * double(changed_time) / NumFrames;
+	result.updates_per_frame = scan_updates / NumFrames;
+	return result;
+}
+
+int main()
+{
+	EntityPool pool;
+	std::vector<NodeState> nodes(NumEntities);
+	std::vector<Entity *> entities(NumEntities);
+
+	auto start = Util::get_current_time_nsecs();
+	for (unsigned i = 0; i < NumEntities; i++)
+	{
+		entities[i] = pool.create_entity();
+		entities[i]->allocate_component<TransformComponent>(&nodes[i]);
+		entities[i]->allocate_component<BoundsComponent>();
+	}
+	auto *group = pool.get_component_group_holder<TransformComponent, BoundsComponent>();
+	LOGI("Created %u entities in %.2f ms.\n", NumEntities, 1e-6 * double(Util::get_current_time_nsecs() - start));
+
+	// Bring every member up to date once.
+	for (auto &tup : group->get_groups())
+		update_bounds(get_component<TransformComponent>(tup), get_component<BoundsComponent>(tup));
+
+	uint32_t frame = 0;
+	LOGI("%8s %10s %12s %12s %12s\n", "changed", "updates", "mark (ms)", "scan (ms)", "tracked (ms)");
+	for (unsigned divider : { 1000u, 100u, 10u })
+	{
+		auto result = run_frames(pool, *group, nodes, entities, NumEntities / divider, frame);
+		LOGI("%7.1f%% %10zu %12.3f %12.3f %12.3f\n", 100.0 / divider, result.updates_per_frame,
+		     result.mark_ms, result.scan_ms, result.changed_ms);
+	}
+}
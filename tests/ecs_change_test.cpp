@@ -0,0 +1,187 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "ecs.hpp"
+#include "logging.hpp"
+#include <stdlib.h>
+#include <random>
+#include <set>
+
+using namespace Granite;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+struct PositionComponent : ComponentBase
+{
+	GRANITE_COMPONENT_TYPE_DECL(PositionComponent)
+	explicit PositionComponent(int v_)
+		: v(v_)
+	{
+	}
+	int v;
+};
+
+struct VelocityComponent : ComponentBase
+{
+	GRANITE_COMPONENT_TYPE_DECL(VelocityComponent)
+	explicit VelocityComponent(int v_)
+		: v(v_)
+	{
+	}
+	int v;
+};
+
+struct TagComponent : ComponentBase
+{
+	GRANITE_COMPONENT_TYPE_DECL(TagComponent)
+};
+
+using Group = EntityGroup<PositionComponent, VelocityComponent>;
+
+static std::set<int> collect_changed(const Group &group, uint64_t since)
+{
+	std::set<int> result;
+	group.for_each_changed(since, [&](const std::tuple<PositionComponent *, VelocityComponent *> &t, const Entity &) {
+		check(result.insert(get_component<PositionComponent>(t)->v).second, "Member visited twice.");
+	});
+	return result;
+}
+
+int main()
+{
+	EntityPool pool;
+	auto *group = pool.get_component_group_holder<PositionComponent, VelocityComponent>();
+	auto *tag_group = pool.get_component_group_holder<TagComponent>();
+
+	// Spread over many chunks.
+	std::vector<Entity *> entities;
+	for (int i = 0; i < 1000; i++)
+	{
+		auto *entity = pool.create_entity();
+		entity->allocate_component<PositionComponent>(i);
+		entity->allocate_component<VelocityComponent>(0);
+		entities.push_back(entity);
+	}
+
+	uint64_t version = pool.get_change_version();
+	check(collect_changed(*group, 0).size() == 1000, "Added members must count as changed.");
+	check(collect_changed(*group, version).empty(), "Nothing changed yet.");
+
+	// Changing a component which is part of the group.
+	entities[3]->mark_changed<PositionComponent>();
+	entities[700]->mark_changed<VelocityComponent>();
+	entities[3]->mark_changed<PositionComponent>();
+	auto changed = collect_changed(*group, version);
+	check(changed == std::set<int>({ 3, 700 }), "Unexpected changed set.");
+	check(pool.get_component_version<PositionComponent>() > version, "Component version not bumped.");
+	check(group->get_version() > version, "Group version not bumped.");
+
+	// Changes to unrelated component types do not affect the group.
+	uint64_t position_version = pool.get_component_version<PositionComponent>();
+	version = pool.get_change_version();
+	entities[5]->allocate_component<TagComponent>();
+	entities[5]->mark_changed<TagComponent>();
+	check(collect_changed(*group, version).empty(), "Unrelated change leaked into group.");
+	check(tag_group->get_entities().size() == 1, "Tag group not populated.");
+	check(pool.get_component_version<PositionComponent>() == position_version, "Unrelated component version bumped.");
+
+	// Re-allocating a component in place counts as a change.
+	version = pool.get_change_version();
+	entities[10]->allocate_component<PositionComponent>(10);
+	check(collect_changed(*group, version) == std::set<int>({ 10 }), "In-place allocation not tracked.");
+
+	// Removing members swaps the last member into the hole, which must keep its version.
+	version = pool.get_change_version();
+	entities.back()->mark_changed<PositionComponent>();
+	pool.delete_entity(entities[1]);
+	entities[1] = nullptr;
+	entities[2]->free_component<VelocityComponent>();
+	check(group->get_entities().size() == 998, "Members not removed.");
+	check(collect_changed(*group, version) == std::set<int>({ 999 }), "Moved member lost its version.");
+
+	// Adding back a component re-adds the entity to the group as changed.
+	version = pool.get_change_version();
+	entities[2]->allocate_component<VelocityComponent>(1);
+	check(collect_changed(*group, version) == std::set<int>({ 2 }), "Re-added member not tracked.");
+
+	// Randomized check against a reference.
+	std::mt19937 rnd(1);
+	for (unsigned iter = 0; iter < 50; iter++)
+	{
+		version = pool.get_change_version();
+		std::set<int> expected;
+		for (unsigned i = 0; i < 20; i++)
+		{
+			int index = int(rnd() % entities.size());
+			if (!entities[index])
+				continue;
+			entities[index]->mark_changed<VelocityComponent>();
+			expected.insert(index);
+		}
+		check(collect_changed(*group, version) == expected, "Randomized change set mismatch.");
+	}
+
+	// Groups created after the fact see current members as changed at creation.
+	version = pool.get_change_version();
+	auto *late_group = pool.get_component_group_holder<VelocityComponent>();
+	size_t late_count = 0;
+	late_group->for_each_changed(version - 1, [&](const std::tuple<VelocityComponent *> &, const Entity &) {
+		late_count++;
+	});
+	check(late_count == late_group->get_entities().size(), "Late group members not visible.");
+
+	// Batched marking through the tracker, and iterating in chunk ranges.
+	version = pool.get_change_version();
+	uint64_t batch_version = pool.begin_component_changes<PositionComponent>();
+	check(batch_version > version, "Batch version not bumped.");
+	auto &tracker = pool.get_change_tracker<PositionComponent>();
+	std::set<int> expected = { 0, 63, 64, 500, 998 };
+	for (int index : expected)
+		tracker.mark(entities[index]->get_slot(), batch_version);
+
+	std::set<int> ranged;
+	size_t num_chunks = group->get_num_change_chunks();
+	for (size_t chunk = 0; chunk < num_chunks; chunk += 3)
+	{
+		group->for_each_changed_range(version, chunk, chunk + 3,
+		                              [&](const std::tuple<PositionComponent *, VelocityComponent *> &t, const Entity &) {
+			                              check(ranged.insert(get_component<PositionComponent>(t)->v).second,
+			                                    "Member visited twice in ranges.");
+		                              });
+	}
+	check(ranged == expected, "Ranged iteration mismatch.");
+	check(collect_changed(*group, version) == expected, "Batched marks not tracked.");
+
+	ComponentGroupVector<PositionComponent, VelocityComponent> changed_groups;
+	group->get_changed_groups(0, changed_groups);
+	check(changed_groups.size() == group->get_groups().size(), "get_changed_groups mismatch.");
+
+	LOGI("All ECS change tracking tests passed.\n");
+}
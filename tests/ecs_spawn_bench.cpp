@@ -0,0 +1,114 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "ecs.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <vector>
+
+using namespace Granite;
+
+// Spawning a burst of particles or props on level load.
+static constexpr unsigned NumEntities = 100000;
+static constexpr unsigned Iterations = 10;
+
+struct TransformComponent : ComponentBase
+{
+	GRANITE_COMPONENT_TYPE_DECL(TransformComponent)
+	float position[3] = {};
+};
+
+struct VelocityComponent : ComponentBase
+{
+	GRANITE_COMPONENT_TYPE_DECL(VelocityComponent)
+	float velocity[3] = {};
+};
+
+struct RenderableComponent : ComponentBase
+{
+	GRANITE_COMPONENT_TYPE_DECL(RenderableComponent)
+	const void *mesh = nullptr;
+};
+
+struct LightComponent : ComponentBase
+{
+	GRANITE_COMPONENT_TYPE_DECL(LightComponent)
+	float color[3] = {};
+};
+
+// Roughly the number of groups a Scene registers, several of which share component types.
+static void register_groups(EntityPool &pool)
+{
+	pool.get_component_group_holder<TransformComponent>();
+	pool.get_component_group_holder<TransformComponent, VelocityComponent>();
+	pool.get_component_group_holder<TransformComponent, RenderableComponent>();
+	pool.get_component_group_holder<TransformComponent, VelocityComponent, RenderableComponent>();
+	pool.get_component_group_holder<TransformComponent, LightComponent>();
+	pool.get_component_group_holder<RenderableComponent, LightComponent>();
+}
+
+int main()
+{
+	EntityPool pool;
+	register_groups(pool);
+	std::vector<Entity *> entities(NumEntities);
+
+	int64_t single_create = 0, single_destroy = 0;
+	int64_t bulk_create = 0, bulk_destroy = 0;
+
+	for (unsigned iter = 0; iter < Iterations; iter++)
+	{
+		auto start = Util::get_current_time_nsecs();
+		for (auto &entity : entities)
+		{
+			entity = pool.create_entity();
+			entity->allocate_component<TransformComponent>();
+			entity->allocate_component<VelocityComponent>();
+			entity->allocate_component<RenderableComponent>();
+		}
+		auto end = Util::get_current_time_nsecs();
+		single_create += end - start;
+
+		start = end;
+		for (auto *entity : entities)
+			pool.delete_entity(entity);
+		end = Util::get_current_time_nsecs();
+		single_destroy += end - start;
+
+		start = end;
+		pool.create_entities<TransformComponent, VelocityComponent, RenderableComponent>(entities.data(), entities.size());
+		end = Util::get_current_time_nsecs();
+		bulk_create += end - start;
+
+		start = end;
+		pool.delete_entities(entities.data(), entities.size());
+		end = Util::get_current_time_nsecs();
+		bulk_destroy += end - start;
+	}
+
+	LOGI("%u entities, 3 components, 6 groups.\n", NumEntities);
+	LOGI("%-10s create: %8.3f ms, destroy: %8.3f ms.\n", "Single",
+	     1e-6 * double(single_create) / Iterations, 1e-6 * double(single_destroy) / Iterations);
+	LOGI("%-10s create: %8.3f ms, destroy: %8.3f ms.\n", "Bulk",
+	     1e-6 * double(bulk_create) / Iterations, 1e-6 * double(bulk_destroy) / Iterations);
+}
@@ -0,0 +1,197 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "frame_pacer.hpp"
+#include "logging.hpp"
+#include <stdlib.h>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace Vulkan;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static constexpr int64_t Refresh60 = 16666667;
+static constexpr int64_t Millisecond = 1000000;
+
+struct FrameCost
+{
+	int64_t cpu;
+	int64_t gpu;
+};
+
+struct Trace
+{
+	std::vector<int64_t> starts;
+	std::vector<int64_t> presents;
+
+	double average_latency(size_t first) const
+	{
+		double total = 0.0;
+		for (size_t i = first; i < presents.size(); i++)
+			total += double(presents[i] - starts[i]);
+		return total / double(presents.size() - first);
+	}
+
+	unsigned count_repeats(size_t first, int64_t interval) const
+	{
+		// A repeated vblank shows up as a present interval longer than expected.
+		unsigned count = 0;
+		for (size_t i = first; i < presents.size(); i++)
+			if (presents[i] - presents[i - 1] > interval + interval / 2)
+				count++;
+		return count;
+	}
+};
+
+// Simulates a FIFO swapchain with a serial CPU -> GPU pipeline.
+// Without a pacer, this is WSI's default present wait latency of 1 frame.
+// With a pacer, WSI waits for the previous present before starting a frame, and reports its completion time.
+static Trace simulate(FramePacer *pacer, unsigned num_frames, int64_t refresh,
+                      const std::function<FrameCost (unsigned)> &cost, int64_t wakeup_jitter = 0)
+{
+	Trace trace;
+	std::mt19937 rnd(42);
+	std::uniform_int_distribution<int64_t> jitter(0, std::max<int64_t>(wakeup_jitter, 0));
+
+	int64_t t = 0;
+	int64_t gpu_done = 0;
+	int64_t last_present = 0;
+
+	for (unsigned i = 0; i < num_frames; i++)
+	{
+		if (pacer)
+		{
+			if (i >= 1)
+			{
+				t = std::max(t, trace.presents[i - 1]) + jitter(rnd);
+				pacer->present_complete(t);
+			}
+			t = pacer->compute_frame_start_time(t);
+			pacer->begin_frame(t);
+		}
+		else if (i >= 2)
+			t = std::max(t, trace.presents[i - 2]);
+
+		auto c = cost(i);
+		trace.starts.push_back(t);
+		t += c.cpu;
+		if (pacer)
+			pacer->end_frame(t);
+
+		gpu_done = std::max(gpu_done, t) + c.gpu;
+		int64_t present = (gpu_done + refresh - 1) / refresh * refresh;
+		present = std::max(present, last_present + refresh);
+		trace.presents.push_back(present);
+		last_present = present;
+	}
+
+	return trace;
+}
+
+static void test_latency_reduction()
+{
+	auto cost = [](unsigned) -> FrameCost { return { 3 * Millisecond, 5 * Millisecond }; };
+
+	FramePacer pacer;
+	auto paced = simulate(&pacer, 600, Refresh60, cost, 200000);
+	auto unpaced = simulate(nullptr, 600, Refresh60, cost);
+
+	auto &stats = pacer.get_statistics();
+	check(std::abs(stats.refresh_interval - Refresh60) < Refresh60 / 50, "refresh interval is estimated");
+	check(stats.target_interval == stats.refresh_interval, "target interval follows refresh");
+
+	double paced_latency = paced.average_latency(300);
+	double unpaced_latency = unpaced.average_latency(300);
+	LOGI("Latency: paced %.3f ms, unpaced %.3f ms.\n", 1e-6 * paced_latency, 1e-6 * unpaced_latency);
+	check(paced_latency < double(Refresh60), "paced latency is below one refresh");
+	check(paced_latency < 0.5 * unpaced_latency, "pacing reduces latency");
+	check(paced.count_repeats(300, Refresh60) <= 2, "steady state rarely misses");
+	check(unpaced.count_repeats(300, Refresh60) == 0, "unpaced never misses");
+	check(stats.frame_start_delay > 0, "frame start is deferred");
+}
+
+static void test_target_frame_rate()
+{
+	FramePacer pacer;
+	pacer.set_target_frame_rate(30.0);
+	auto trace = simulate(&pacer, 400, Refresh60, [](unsigned) -> FrameCost {
+		return { 4 * Millisecond, 4 * Millisecond };
+	});
+
+	auto &stats = pacer.get_statistics();
+	check(std::abs(stats.target_interval - 2 * Refresh60) < Refresh60 / 25, "target interval is two refreshes");
+
+	unsigned on_cadence = 0;
+	for (size_t i = 200; i < trace.presents.size(); i++)
+		if (trace.presents[i] - trace.presents[i - 1] == 2 * Refresh60)
+			on_cadence++;
+	check(on_cadence >= 195, "30 fps cadence");
+	check(trace.average_latency(200) < double(Refresh60), "latency stays low at reduced rate");
+}
+
+static void test_gpu_spike()
+{
+	FramePacer pacer;
+	auto trace = simulate(&pacer, 400, Refresh60, [](unsigned i) -> FrameCost {
+		if (i >= 200 && i < 205)
+			return { 3 * Millisecond, 9 * Millisecond };
+		return { 3 * Millisecond, 2 * Millisecond };
+	});
+
+	auto &stats = pacer.get_statistics();
+	check(stats.missed_frames >= 1, "spike is detected as miss");
+	check(trace.count_repeats(250, Refresh60) <= 1, "pacing recovers after spike");
+	check(stats.presented_frames == 399, "every frame but the last is presented");
+}
+
+static void test_known_gpu_time()
+{
+	// With GPU timing available, the margin never has to be learned through misses.
+	FramePacer pacer;
+	pacer.set_nominal_refresh_interval(Refresh60);
+	pacer.record_gpu_time(6 * Millisecond);
+	auto trace = simulate(&pacer, 300, Refresh60, [](unsigned) -> FrameCost {
+		return { 3 * Millisecond, 6 * Millisecond };
+	});
+	check(pacer.get_statistics().missed_frames == 0, "no misses with known GPU time");
+	check(trace.average_latency(100) < double(Refresh60), "low latency with known GPU time");
+}
+
+int main()
+{
+	test_latency_reduction();
+	test_target_frame_rate();
+	test_gpu_spike();
+	test_known_gpu_time();
+	LOGI("All frame pacer tests passed.\n");
+}
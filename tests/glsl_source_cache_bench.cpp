@@ -0,0 +1,135 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "global_managers_init.hpp"
+#include "filesystem.hpp"
+#include "compiler.hpp"
+#include "path_utils.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <string.h>
+#include <vector>
+
+using namespace Granite;
+
+static void gather_shaders(Filesystem &fs, const std::string &dir, std::vector<std::string> &paths)
+{
+	for (auto &entry : fs.list(dir))
+	{
+		if (entry.type == PathType::Directory)
+			gather_shaders(fs, entry.path, paths);
+		else if (entry.type == PathType::File && Path::ext(entry.path) != "h")
+			paths.push_back(entry.path);
+	}
+}
+
+struct PassResult
+{
+	double preprocess_ns = 0.0;
+	double compile_ns = 0.0;
+	unsigned compiled = 0;
+	unsigned failed = 0;
+};
+
+// Mimics the shader manager: one compiler per shader template, a few variants each.
+static PassResult run_pass(Filesystem &fs, const std::vector<std::string> &paths, GLSLSourceCache *cache,
+                           unsigned num_variants, bool compile)
+{
+	PassResult result;
+	const std::vector<std::string> include_dirs = { "builtin://shaders" };
+
+	for (auto &path : paths)
+	{
+		for (unsigned variant = 0; variant < num_variants; variant++)
+		{
+			auto start_time = Util::get_current_time_nsecs();
+			GLSLCompiler compiler(fs);
+			compiler.set_target(Target::Vulkan11);
+			compiler.set_source_cache(cache);
+			compiler.set_include_directories(&include_dirs);
+			if (!compiler.set_source_from_file(path) || !compiler.preprocess())
+			{
+				result.failed++;
+				break;
+			}
+			result.preprocess_ns += double(Util::get_current_time_nsecs() - start_time);
+
+			if (compile)
+			{
+				start_time = Util::get_current_time_nsecs();
+				std::vector<std::pair<std::string, int>> defines = {{ "VARIANT_INDEX", int(variant) }};
+				std::string error;
+				if (compiler.compile(error, &defines).empty())
+					result.failed++;
+				else
+					result.compiled++;
+				result.compile_ns += double(Util::get_current_time_nsecs() - start_time);
+			}
+		}
+	}
+
+	return result;
+}
+
+static void report(const char *tag, const PassResult &result)
+{
+	LOGI("%-12s preprocess %8.3f ms, compile %9.3f ms, total %9.3f ms (%u compiled, %u failed).\n",
+	     tag, 1e-6 * result.preprocess_ns, 1e-6 * result.compile_ns,
+	     1e-6 * (result.preprocess_ns + result.compile_ns),
+	     result.compiled, result.failed);
+}
+
+int main(int argc, char **argv)
+{
+	Global::init(Global::MANAGER_FEATURE_FILESYSTEM_BIT);
+
+	// Compiling dominates, --preprocess-only isolates the part the cache affects.
+	bool compile = !(argc >= 2 && strcmp(argv[1], "--preprocess-only") == 0);
+	constexpr unsigned NumVariants = 4;
+
+	auto &fs = *GRANITE_FILESYSTEM();
+	std::vector<std::string> paths;
+	gather_shaders(fs, "builtin://shaders", paths);
+	LOGI("Found %u shaders, %u variants each.\n", unsigned(paths.size()), NumVariants);
+
+	report("uncached", run_pass(fs, paths, nullptr, NumVariants, compile));
+
+	GLSLSourceCache cache;
+	report("cache cold", run_pass(fs, paths, &cache, NumVariants, compile));
+	auto stats = cache.get_statistics();
+	LOGI("  files: %llu hits, %llu misses. preprocess: %llu hits, %llu misses.\n",
+	     static_cast<unsigned long long>(stats.file_hits), static_cast<unsigned long long>(stats.file_misses),
+	     static_cast<unsigned long long>(stats.preprocess_hits), static_cast<unsigned long long>(stats.preprocess_misses));
+
+	// Touching a shared header only drops the shaders which include it.
+	cache.reset_statistics();
+	cache.invalidate("builtin://shaders/inc/render_parameters.h");
+	report("invalidated", run_pass(fs, paths, &cache, NumVariants, compile));
+	stats = cache.get_statistics();
+	LOGI("  preprocess: %llu hits, %llu misses.\n",
+	     static_cast<unsigned long long>(stats.preprocess_hits), static_cast<unsigned long long>(stats.preprocess_misses));
+
+	report("cache warm", run_pass(fs, paths, &cache, NumVariants, compile));
+
+	Global::deinit();
+}
@@ -46,6 +46,8 @@ struct LatencyTest : Granite::Application, Granite::EventHandler
 	{
 		if (e.get_key_state() == KeyState::Pressed && e.get_key() == Key::Space)
 			state = !state;
+		else if (e.get_key_state() == KeyState::Pressed && e.get_key() == Key::P)
+			get_wsi().set_frame_pacing(!get_wsi().get_frame_pacing());
 		return true;
 	}
 
@@ -111,6 +113,22 @@ struct LatencyTest : Granite::Application, Granite::EventHandler
 		                 max_text, offset, size, vec4(1.0f, 1.0f, 0.0f, 1.0f),
 		                 Font::Alignment::TopRight, 1.0f);
 
+		if (wsi.get_frame_pacing())
+		{
+			auto &stats = wsi.get_frame_pacing_statistics();
+			char pacing_text[1024];
+			snprintf(pacing_text, sizeof(pacing_text),
+			         "Pacing: latency %.3f ms, delay %.3f ms, margin %.3f ms, missed %llu / %llu",
+			         1e-6 * double(stats.present_latency), 1e-6 * double(stats.frame_start_delay),
+			         1e-6 * double(stats.safety_margin),
+			         static_cast<unsigned long long>(stats.missed_frames),
+			         static_cast<unsigned long long>(stats.presented_frames));
+			offset.y += 30.0f;
+			flat.render_text(GRANITE_UI_MANAGER()->get_font(UI::FontSize::Normal),
+			                 pacing_text, offset, size, vec4(0.0f, 1.0f, 1.0f, 1.0f),
+			                 Font::Alignment::TopRight, 1.0f);
+		}
+
 		offset = { cmd->get_viewport().width - 410.0f, cmd->get_viewport().height - 110.0f, 0.0f };
 		size = { 400.0f, 100.0f };
 		flat.render_quad(offset, size, vec4(0.0f, 0.0f, 0.0f, 0.9f));
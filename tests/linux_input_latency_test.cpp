@@ -0,0 +1,239 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+// Measures input-to-submit latency of LinuxInputManager with a synthetic uinput gamepad,
+// comparing the polling path against the dedicated input thread.
+
+#include "logging.hpp"
+#include <stdlib.h>
+
+#ifdef HAVE_LINUX_INPUT
+#include "input_linux.hpp"
+#include "global_managers_init.hpp"
+#include "timer.hpp"
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+using namespace Granite;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+struct SyntheticGamepad
+{
+	~SyntheticGamepad()
+	{
+		if (fd >= 0)
+		{
+			ioctl(fd, UI_DEV_DESTROY);
+			close(fd);
+		}
+	}
+
+	bool init()
+	{
+		fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+		if (fd < 0)
+			return false;
+
+		if (ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0 ||
+		    ioctl(fd, UI_SET_EVBIT, EV_ABS) < 0 ||
+		    ioctl(fd, UI_SET_EVBIT, EV_SYN) < 0)
+			return false;
+
+		for (int key : { BTN_SOUTH, BTN_EAST, BTN_NORTH, BTN_WEST, BTN_START, BTN_SELECT, BTN_TL, BTN_TR })
+			if (ioctl(fd, UI_SET_KEYBIT, key) < 0)
+				return false;
+
+		// udev only tags the device as ID_INPUT_JOYSTICK if it has axes as well as gamepad buttons.
+		uinput_user_dev dev = {};
+		for (int axis : { ABS_X, ABS_Y, ABS_RX, ABS_RY })
+		{
+			if (ioctl(fd, UI_SET_ABSBIT, axis) < 0)
+				return false;
+			dev.absmin[axis] = -32768;
+			dev.absmax[axis] = 32767;
+		}
+
+		snprintf(dev.name, sizeof(dev.name), "Granite synthetic gamepad");
+		dev.id.bustype = BUS_VIRTUAL;
+		dev.id.vendor = 0x1234;
+		dev.id.product = 0x5678;
+		dev.id.version = 1;
+
+		if (write(fd, &dev, sizeof(dev)) != sizeof(dev))
+			return false;
+		return ioctl(fd, UI_DEV_CREATE) >= 0;
+	}
+
+	void emit(uint16_t type, uint16_t code, int32_t value)
+	{
+		input_event e = {};
+		e.type = type;
+		e.code = code;
+		e.value = value;
+		if (write(fd, &e, sizeof(e)) != sizeof(e))
+			LOGE("Failed to write uinput event.\n");
+	}
+
+	void press(bool pressed)
+	{
+		emit(EV_KEY, BTN_SOUTH, pressed ? 1 : 0);
+		emit(EV_SYN, SYN_REPORT, 0);
+	}
+
+	int fd = -1;
+};
+
+static int find_pressed_joypad(const InputTracker &tracker)
+{
+	for (unsigned i = 0; i < InputTracker::Joypads; i++)
+		if (tracker.joykey_pressed(i, JoypadKey::South))
+			return int(i);
+	return -1;
+}
+
+static int64_t percentile(std::vector<int64_t> values, double p)
+{
+	std::sort(values.begin(), values.end());
+	return values[std::min<size_t>(values.size() - 1, size_t(p * double(values.size())))];
+}
+
+enum class RunResult
+{
+	Ok,
+	DeviceNotFound
+};
+
+static RunResult run_latency(SyntheticGamepad &pad, bool threaded)
+{
+	const char *mode = threaded ? "input thread" : "polling";
+	InputTracker tracker;
+	LinuxInputManager manager;
+
+	LinuxInputManagerFlags flags = LINUX_INPUT_MANAGER_JOYPAD_BIT;
+	if (threaded)
+		flags |= LINUX_INPUT_MANAGER_INPUT_THREAD_BIT;
+	check(manager.init(flags, &tracker), "LinuxInputManager::init");
+
+	// Keep pressing until the device has been enumerated and we know which joypad index it got.
+	int index = -1;
+	for (int attempt = 0; attempt < 500 && index < 0; attempt++)
+	{
+		if ((attempt % 10) == 0)
+		{
+			// The kernel filters repeated key states, so make sure every attempt is an edge.
+			pad.press(false);
+			pad.press(true);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		manager.poll();
+		index = find_pressed_joypad(tracker);
+	}
+
+	if (index < 0)
+		return RunResult::DeviceNotFound;
+
+	constexpr unsigned Iterations = 200;
+	constexpr int64_t FrameWork = 2000000;
+	std::vector<int64_t> write_to_arrival, input_to_submit, poll_cost;
+	bool state = true;
+
+	for (unsigned i = 0; i < Iterations; i++)
+	{
+		state = !state;
+		int64_t written = Util::get_current_time_nsecs();
+		pad.press(state);
+
+		// Simulated frame work between the input arriving and the late-latch right before submission.
+		while (Util::get_current_time_nsecs() - written < FrameWork)
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+		int64_t latch_start = Util::get_current_time_nsecs();
+		manager.poll();
+		int64_t submit = Util::get_current_time_nsecs();
+
+		check(tracker.joykey_pressed(unsigned(index), JoypadKey::South) == state, "Late-latched state matches last event");
+		int64_t arrival = manager.get_last_event_arrival_time();
+		check(arrival >= written, "Arrival timestamp is after the event was written");
+
+		write_to_arrival.push_back(arrival - written);
+		input_to_submit.push_back(submit - written);
+		poll_cost.push_back(submit - latch_start);
+	}
+
+	check(manager.get_dropped_event_count() == 0, "No events dropped");
+
+	LOGI("[%s] write -> arrival: median %.1f us, p99 %.1f us.\n", mode,
+	     1e-3 * double(percentile(write_to_arrival, 0.5)), 1e-3 * double(percentile(write_to_arrival, 0.99)));
+	LOGI("[%s] input -> submit: median %.1f us, p99 %.1f us.\n", mode,
+	     1e-3 * double(percentile(input_to_submit, 0.5)), 1e-3 * double(percentile(input_to_submit, 0.99)));
+	LOGI("[%s] poll() on main thread: median %.1f us, p99 %.1f us.\n", mode,
+	     1e-3 * double(percentile(poll_cost, 0.5)), 1e-3 * double(percentile(poll_cost, 0.99)));
+	return RunResult::Ok;
+}
+
+int main()
+{
+	SyntheticGamepad pad;
+	if (!pad.init())
+	{
+		LOGI("/dev/uinput is not available, skipping input latency test.\n");
+		return EXIT_SUCCESS;
+	}
+
+	Global::init(Global::MANAGER_FEATURE_THREAD_GROUP_BIT);
+
+	for (bool threaded : { false, true })
+	{
+		if (run_latency(pad, threaded) == RunResult::DeviceNotFound)
+		{
+			LOGI("Synthetic gamepad was not picked up through udev (no udevd or no access to /dev/input), skipping.\n");
+			Global::deinit();
+			return EXIT_SUCCESS;
+		}
+	}
+
+	Global::deinit();
+	LOGI("All input latency tests passed.\n");
+}
+#else
+int main()
+{
+	LOGI("Linux input is not available, skipping input latency test.\n");
+	return EXIT_SUCCESS;
+}
+#endif
@@ -0,0 +1,162 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "material_table.hpp"
+#include "logging.hpp"
+#include <stdlib.h>
+
+using namespace Granite;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static MaterialInfo make_info(float roughness)
+{
+	MaterialInfo info;
+	info.uniform_roughness = roughness;
+	info.uniform_base_color = vec4(0.5f, 0.25f, 1.0f, 1.0f);
+	return info;
+}
+
+static void set_textures(ImageAssetID *textures, uint32_t base_color, uint32_t normal)
+{
+	for (unsigned i = 0; i < Util::ecast(TextureKind::Count); i++)
+		textures[i] = {};
+	textures[Util::ecast(TextureKind::BaseColor)].id = base_color;
+	textures[Util::ecast(TextureKind::Normal)].id = normal;
+}
+
+static void test_material_slots()
+{
+	MaterialTable table;
+	ImageAssetID textures[Util::ecast(TextureKind::Count)];
+	set_textures(textures, 10, 11);
+
+	uint32_t a = table.acquire_material(1, make_info(0.5f), textures);
+	uint32_t b = table.acquire_material(1, make_info(0.5f), textures);
+	check(a == b, "identical materials share a slot");
+
+	set_textures(textures, 10, 12);
+	uint32_t c = table.acquire_material(2, make_info(0.25f), textures);
+	check(c != a, "different materials get different slots");
+	check(table.get_num_live_materials() == 2, "live material count");
+	check(table.get_num_texture_slots() == 3, "textures are shared between materials");
+
+	auto &params = table.get_parameters()[c];
+	check(params.roughness == 0.25f, "parameters are written");
+	check(params.textures[Util::ecast(TextureKind::BaseColor)] == table.get_parameters()[a].textures[0],
+	      "shared texture resolves to the same index");
+	check(params.textures[Util::ecast(TextureKind::Occlusion)] == MaterialTable::InvalidIndex,
+	      "unused texture kinds are invalid");
+	check(table.get_texture(params.textures[Util::ecast(TextureKind::Normal)]).id == 12, "texture slot lookup");
+
+	table.release_material(a);
+	check(table.get_num_live_materials() == 2, "material is still referenced");
+	table.release_material(b);
+	check(table.get_num_live_materials() == 1, "material slot is released");
+	check(!table.get_texture(table.get_parameters()[a].textures[Util::ecast(TextureKind::Normal)]),
+	      "texture only used by released material is released");
+
+	set_textures(textures, 13, 14);
+	uint32_t d = table.acquire_material(3, make_info(1.0f), textures);
+	check(d == a, "freed material slot is reused");
+	check(table.get_num_texture_slots() == 4, "freed texture slot is reused");
+}
+
+static void test_dirty_ranges()
+{
+	MaterialTable table;
+	ImageAssetID textures[Util::ecast(TextureKind::Count)] = {};
+	std::vector<MaterialTable::Range> ranges;
+
+	for (uint32_t i = 0; i < 8; i++)
+		table.acquire_material(100 + i, make_info(float(i)), textures);
+
+	table.get_dirty_material_ranges(0, ranges);
+	check(ranges.size() == 1 && ranges[0].offset == 0 && ranges[0].count == 8, "initial upload is one range");
+
+	uint64_t uploaded = table.get_version();
+	table.get_dirty_material_ranges(uploaded, ranges);
+	check(ranges.empty(), "nothing is dirty after upload");
+
+	// Replace two materials in the middle, the rest must not be uploaded again.
+	table.release_material(2);
+	table.release_material(5);
+	uint32_t x = table.acquire_material(200, make_info(2.5f), textures);
+	uint32_t y = table.acquire_material(201, make_info(5.5f), textures);
+	check((x == 5 && y == 2) || (x == 2 && y == 5), "released slots are reused");
+
+	table.get_dirty_material_ranges(uploaded, ranges);
+	check(ranges.size() == 2, "two separate dirty ranges");
+	check(ranges[0].offset == 2 && ranges[0].count == 1, "first dirty range");
+	check(ranges[1].offset == 5 && ranges[1].count == 1, "second dirty range");
+
+	// A slot which was released and not reused is not uploaded.
+	uploaded = table.get_version();
+	table.release_material(7);
+	table.acquire_material(300, make_info(3.0f), textures);
+	table.acquire_material(301, make_info(3.5f), textures);
+	table.get_dirty_material_ranges(uploaded, ranges);
+	check(ranges.size() == 1 && ranges[0].offset == 7 && ranges[0].count == 2, "adjacent dirty slots coalesce");
+}
+
+static void test_descriptor_shadow()
+{
+	DescriptorArrayShadow shadow;
+	std::vector<uint32_t> updates;
+
+	uint64_t cookies[4] = { 10, 0, 30, 40 };
+	shadow.compute_updates(cookies, 4, updates);
+	check(updates.size() == 3, "initial write of used elements");
+
+	shadow.compute_updates(cookies, 4, updates);
+	check(updates.empty(), "unchanged elements are not rewritten");
+
+	// Texture streaming swapped the view of element 2, and element 1 got assigned.
+	cookies[1] = 20;
+	cookies[2] = 31;
+	shadow.compute_updates(cookies, 4, updates);
+	check(updates.size() == 2 && updates[0] == 1 && updates[1] == 2, "only changed elements are rewritten");
+
+	uint64_t grown[6] = { 10, 20, 31, 40, 50, 0 };
+	shadow.compute_updates(grown, 6, updates);
+	check(updates.size() == 1 && updates[0] == 4, "growing the array writes new elements");
+
+	shadow.reset();
+	shadow.compute_updates(grown, 6, updates);
+	check(updates.size() == 5, "reset rewrites everything");
+}
+
+int main()
+{
+	test_material_slots();
+	test_dirty_ranges();
+	test_descriptor_shadow();
+	LOGI("All material table tests passed.\n");
+}
@@ -0,0 +1,129 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "parallel_for.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <vector>
+#include <cmath>
+#include <stdlib.h>
+
+using namespace Granite;
+
+static constexpr size_t NumItems = 1u << 22;
+static constexpr unsigned Iterations = 20;
+static constexpr unsigned MaxChunks = 256;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void run_benchmark(unsigned num_threads)
+{
+	ThreadGroup group;
+	// The main thread helps out while waiting, so it counts as a worker.
+	group.start(num_threads - 1, 0, {});
+
+	std::vector<float> input(NumItems);
+	std::vector<float> output(NumItems);
+	std::vector<uint32_t> scan_output(NumItems);
+	for (size_t i = 0; i < NumItems; i++)
+		input[i] = float(i & 1023);
+
+	ParallelCostEstimator for_estimator, reduce_estimator, scan_estimator;
+	double for_time = 0.0, reduce_time = 0.0, scan_time = 0.0;
+	unsigned for_chunks = 0;
+
+	for (unsigned iter = 0; iter < Iterations; iter++)
+	{
+		{
+			TaskComposer composer(group);
+			auto start_time = Util::get_current_time_nsecs();
+			for_chunks = parallel_for(composer, "bench-for", NumItems, MaxChunks, &for_estimator,
+			                          [&](const ParallelChunk &chunk) {
+				                          for (size_t i = chunk.begin; i < chunk.end; i++)
+					                          output[i] = std::sqrt(input[i]) * 2.0f + 1.0f;
+			                          });
+			composer.get_outgoing_task()->wait();
+			for_time += double(Util::get_current_time_nsecs() - start_time);
+		}
+
+		{
+			TaskComposer composer(group);
+			uint64_t result = 0;
+			auto start_time = Util::get_current_time_nsecs();
+			parallel_reduce(composer, "bench-reduce", NumItems, MaxChunks, &reduce_estimator, &result, uint64_t(0),
+			                [&](const ParallelChunk &chunk) {
+				                uint64_t sum = 0;
+				                for (size_t i = chunk.begin; i < chunk.end; i++)
+					                sum += uint64_t(input[i]);
+				                return sum;
+			                },
+			                [](uint64_t a, uint64_t b) { return a + b; });
+			composer.get_outgoing_task()->wait();
+			reduce_time += double(Util::get_current_time_nsecs() - start_time);
+			check(result == uint64_t(NumItems / 1024) * (1023 * 1024 / 2), "reduce result");
+		}
+
+		{
+			TaskComposer composer(group);
+			auto start_time = Util::get_current_time_nsecs();
+			parallel_scan(composer, "bench-scan", NumItems, MaxChunks, &scan_estimator, uint32_t(0),
+			              [&](const ParallelChunk &chunk) {
+				              uint32_t sum = 0;
+				              for (size_t i = chunk.begin; i < chunk.end; i++)
+					              sum += uint32_t(i & 3);
+				              return sum;
+			              },
+			              [](uint32_t a, uint32_t b) { return a + b; },
+			              [&](const ParallelChunk &chunk, uint32_t prefix) {
+				              for (size_t i = chunk.begin; i < chunk.end; i++)
+				              {
+					              scan_output[i] = prefix;
+					              prefix += uint32_t(i & 3);
+				              }
+			              });
+			composer.get_outgoing_task()->wait();
+			scan_time += double(Util::get_current_time_nsecs() - start_time);
+			// Sum of (i & 3) over the first 4k items is 6k.
+			check(scan_output[4096] == 6 * 1024, "scan result");
+			check(scan_output[NumItems - 1] + 3 == 6 * (NumItems / 4), "scan total");
+		}
+	}
+
+	double scale = 1e-6 / double(Iterations);
+	LOGI("%2u threads: for %7.3f ms (%3u chunks, %.3f ns/item), reduce %7.3f ms, scan %7.3f ms.\n",
+	     num_threads, for_time * scale, for_chunks, for_estimator.get_nsecs_per_item(),
+	     reduce_time * scale, scan_time * scale);
+}
+
+int main()
+{
+	for (unsigned threads = 2; threads <= 64; threads *= 2)
+		run_benchmark(threads);
+}
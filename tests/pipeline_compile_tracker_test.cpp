@@ -0,0 +1,154 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "pipeline_compile_tracker.hpp"
+#include "logging.hpp"
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+
+using namespace Vulkan;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_synchronous()
+{
+	PipelineCompileTracker tracker;
+	auto decision = tracker.on_miss(1, true);
+	check(decision.action == PipelineMissAction::CompileSync, "sync policy compiles synchronously");
+	check(!decision.enqueue_async, "sync policy never enqueues");
+	tracker.begin_frame();
+	auto stats = tracker.get_frame_stats();
+	check(stats.misses == 1 && stats.sync_compiles == 1 && stats.enqueued == 0, "sync stats");
+}
+
+static void test_fallback()
+{
+	PipelineCompileTracker tracker;
+	tracker.set_policy(PipelineMissPolicy::AsyncFallbackOrSync);
+
+	auto decision = tracker.on_miss(1, true);
+	check(decision.action == PipelineMissAction::UseFallback, "fallback is used");
+	check(decision.enqueue_async, "first miss enqueues");
+
+	decision = tracker.on_miss(1, true);
+	check(decision.action == PipelineMissAction::UseFallback, "fallback is used while pending");
+	check(!decision.enqueue_async, "pending pipeline is not enqueued twice");
+
+	// Without a fallback, this policy compiles synchronously, but still gets a background compile going.
+	decision = tracker.on_miss(2, false);
+	check(decision.action == PipelineMissAction::CompileSync, "no fallback compiles synchronously");
+	check(decision.enqueue_async, "no fallback still enqueues");
+
+	tracker.begin_frame();
+	auto stats = tracker.get_frame_stats();
+	check(stats.misses == 3, "miss count");
+	check(stats.enqueued == 2, "enqueue count");
+	check(stats.fallback_draws == 2, "fallback count");
+	check(stats.sync_compiles == 1, "sync count");
+	check(stats.pending == 2, "pending count");
+
+	tracker.on_compile_complete(1, true);
+	tracker.on_compile_complete(2, true);
+	tracker.begin_frame();
+	stats = tracker.get_frame_stats();
+	check(stats.completed == 2 && stats.pending == 0 && stats.misses == 0, "completion stats");
+	check(tracker.get_total_stats().misses == 3, "total stats accumulate");
+}
+
+static void test_skip()
+{
+	PipelineCompileTracker tracker;
+	tracker.set_policy(PipelineMissPolicy::AsyncFallbackOrSkip);
+	tracker.set_max_skip_frames(2);
+
+	auto decision = tracker.on_miss(1, false);
+	check(decision.action == PipelineMissAction::Skip && decision.enqueue_async, "first miss skips and enqueues");
+	tracker.begin_frame();
+	decision = tracker.on_miss(1, false);
+	check(decision.action == PipelineMissAction::Skip && !decision.enqueue_async, "second frame still skips");
+	tracker.begin_frame();
+	decision = tracker.on_miss(1, false);
+	check(decision.action == PipelineMissAction::CompileSync, "skipping for too long forces sync compile");
+
+	// A failed background compile falls back to synchronous compile so the error surfaces.
+	tracker.on_compile_complete(1, false);
+	decision = tracker.on_miss(1, false);
+	check(decision.action == PipelineMissAction::CompileSync && !decision.enqueue_async, "failed compile goes sync");
+}
+
+static void test_max_pending()
+{
+	PipelineCompileTracker tracker;
+	tracker.set_policy(PipelineMissPolicy::AsyncFallbackOrSkip);
+	tracker.set_max_pending_compiles(2);
+
+	check(tracker.on_miss(1, false).enqueue_async, "slot 1");
+	check(tracker.on_miss(2, false).enqueue_async, "slot 2");
+	auto decision = tracker.on_miss(3, false);
+	check(decision.action == PipelineMissAction::CompileSync && !decision.enqueue_async,
+	      "full queue without fallback compiles synchronously");
+	decision = tracker.on_miss(4, true);
+	check(decision.action == PipelineMissAction::UseFallback && !decision.enqueue_async,
+	      "full queue with fallback defers enqueue");
+	check(tracker.get_num_pending() == 2, "pending is bounded");
+
+	tracker.on_compile_complete(1, true);
+	check(tracker.on_miss(4, true).enqueue_async, "freed slot is reused");
+}
+
+static void test_wait_idle()
+{
+	PipelineCompileTracker tracker;
+	tracker.set_policy(PipelineMissPolicy::AsyncFallbackOrSkip);
+
+	std::vector<std::thread> threads;
+	for (Util::Hash hash = 1; hash <= 16; hash++)
+	{
+		if (tracker.on_miss(hash, false).enqueue_async)
+			threads.emplace_back([&tracker, hash]() { tracker.on_compile_complete(hash, true); });
+	}
+
+	tracker.wait_idle();
+	check(tracker.get_num_pending() == 0, "wait_idle drains pending compiles");
+	for (auto &thread : threads)
+		thread.join();
+}
+
+int main()
+{
+	test_synchronous();
+	test_fallback();
+	test_skip();
+	test_max_pending();
+	test_wait_idle();
+	LOGI("All pipeline compile tracker tests passed.\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "pipeline_usage_profile.hpp"
+#include "logging.hpp"
+#include <stdlib.h>
+
+using namespace Vulkan;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_ordering()
+{
+	PipelineUsageProfile profile;
+	profile.set_time_bucket_ms(100);
+
+	// 4 is used first, 2 and 3 land in the same bucket and 3 is used more often.
+	Util::Hash first[] = { 4 };
+	profile.record_uses(first, 1, 10);
+	Util::Hash second[] = { 2, 3, 3, 3 };
+	profile.record_uses(second, 4, 500);
+	Util::Hash late[] = { 2 };
+	profile.record_uses(late, 1, 520);
+	Util::Hash last[] = { 6 };
+	profile.record_uses(last, 1, 5000);
+
+	Util::Hash hashes[] = { 1, 2, 3, 4, 5, 6, 7 };
+	size_t profiled = profile.sort_by_priority(hashes, 7);
+	check(profiled == 4, "profiled count");
+
+	const Util::Hash expected[] = { 4, 3, 2, 6, 1, 5, 7 };
+	for (unsigned i = 0; i < 7; i++)
+		check(hashes[i] == expected[i], "priority order");
+}
+
+static void test_roundtrip_and_decay()
+{
+	std::vector<uint8_t> blob;
+	{
+		PipelineUsageProfile profile;
+		Util::Hash hashes[] = { 10, 10, 10, 10, 11 };
+		profile.record_uses(hashes, 5, 1000);
+		blob = profile.serialize();
+	}
+
+	PipelineUsageProfile profile;
+	check(profile.parse(blob.data(), blob.size()), "parse serialized profile");
+	check(blob.size() == 12 + 2 * 16, "both entries are serialized");
+
+	// 11 was used once last session, which decays to nothing without fresh use.
+	check(profile.contains(10), "frequent pipeline is kept");
+	check(!profile.contains(11), "rare stale pipeline decays");
+
+	// The first use time moves towards the observed time.
+	Util::Hash hashes[] = { 10 };
+	profile.record_uses(hashes, 1, 0);
+	Util::Hash order[] = { 12, 10 };
+	check(profile.sort_by_priority(order, 2) == 1 && order[0] == 10, "history is used for ordering");
+
+	auto merged = profile.serialize();
+	PipelineUsageProfile reloaded;
+	check(reloaded.parse(merged.data(), merged.size()), "parse merged profile");
+	check(reloaded.get_num_entries() == 1, "merged profile drops decayed entries");
+}
+
+static void test_invalid()
+{
+	PipelineUsageProfile profile;
+	uint8_t garbage[16] = {};
+	check(!profile.parse(garbage, sizeof(garbage)), "bad magic is rejected");
+
+	auto blob = PipelineUsageProfile().serialize();
+	check(profile.parse(blob.data(), blob.size()), "empty profile parses");
+
+	Util::Hash hashes[] = { 1, 2 };
+	profile.record_uses(hashes, 2, 0);
+	blob = profile.serialize();
+	blob.pop_back();
+	check(!profile.parse(blob.data(), blob.size()), "truncated profile is rejected");
+}
+
+int main()
+{
+	test_ordering();
+	test_roundtrip_and_decay();
+	test_invalid();
+	LOGI("All pipeline usage profile tests passed.\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "rgb_to_yuv.hpp"
+#include "thread_group.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <thread>
+#include <random>
+#include <vector>
+
+using namespace Granite;
+
+static constexpr unsigned Iterations = 20;
+
+struct Target
+{
+	Target(unsigned width_, unsigned height_)
+		: width(width_), height(height_), rgbx(size_t(width) * height * 4)
+	{
+		std::mt19937 rnd(42);
+		for (auto &v : rgbx)
+			v = uint8_t(rnd());
+		for (auto &plane : planes)
+			plane.resize(size_t(width) * height);
+	}
+
+	RGBToYUVConversion conversion(ChromaSubsampling subsampling)
+	{
+		RGBToYUVConversion conv;
+		conv.rgbx = rgbx.data();
+		conv.rgbx_stride = int(width * 4);
+		conv.width = width;
+		conv.height = height;
+		conv.subsampling = subsampling;
+		unsigned chroma_width = subsampling == ChromaSubsampling::Chroma420 ? (width + 1) / 2 : width;
+		for (unsigned i = 0; i < 3; i++)
+		{
+			conv.planes[i] = planes[i].data();
+			conv.strides[i] = int(i ? chroma_width : width);
+		}
+		return conv;
+	}
+
+	unsigned width, height;
+	std::vector<uint8_t> rgbx;
+	std::vector<uint8_t> planes[3];
+};
+
+template <typename Func>
+static double measure_fps(Func &&func)
+{
+	func();
+	Util::Timer timer;
+	timer.start();
+	for (unsigned i = 0; i < Iterations; i++)
+		func();
+	return double(Iterations) / timer.end();
+}
+
+static void run(ThreadGroup &group, unsigned width, unsigned height)
+{
+	Target target(width, height);
+	for (auto subsampling : { ChromaSubsampling::Chroma444, ChromaSubsampling::Chroma420 })
+	{
+		auto conv = target.conversion(subsampling);
+		double scalar = measure_fps([&]() { convert_rgbx_to_yuv_scalar(conv, 0, height); });
+		double simd = measure_fps([&]() { convert_rgbx_to_yuv(conv, 0, height); });
+		double parallel = measure_fps([&]() { convert_rgbx_to_yuv_parallel(group, conv); });
+
+		LOGI("%ux%u %s: scalar %7.1f fps, SIMD %7.1f fps, SIMD + %u threads %7.1f fps.\n",
+		     width, height, subsampling == ChromaSubsampling::Chroma420 ? "4:2:0" : "4:4:4",
+		     scalar, simd, group.get_num_threads(), parallel);
+	}
+}
+
+int main()
+{
+	ThreadGroup group;
+	group.start(std::max(1u, std::thread::hardware_concurrency()), 0, {});
+
+	run(group, 1920, 1080);
+	run(group, 3840, 2160);
+}
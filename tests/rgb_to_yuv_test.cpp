@@ -0,0 +1,212 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "rgb_to_yuv.hpp"
+#include "thread_group.hpp"
+#include "logging.hpp"
+#include <stdlib.h>
+#include <math.h>
+#include <random>
+#include <vector>
+
+using namespace Granite;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+struct Image
+{
+	Image(unsigned width_, unsigned height_, ChromaSubsampling subsampling)
+		: width(width_), height(height_)
+	{
+		unsigned chroma_width = subsampling == ChromaSubsampling::Chroma420 ? (width + 1) / 2 : width;
+		unsigned chroma_height = subsampling == ChromaSubsampling::Chroma420 ? (height + 1) / 2 : height;
+		// Pad strides to catch stride bugs.
+		strides[0] = int(width + 7);
+		strides[1] = int(chroma_width + 3);
+		strides[2] = int(chroma_width + 5);
+		planes[0].resize(size_t(strides[0]) * height);
+		planes[1].resize(size_t(strides[1]) * chroma_height);
+		planes[2].resize(size_t(strides[2]) * chroma_height);
+	}
+
+	RGBToYUVConversion conversion(const std::vector<uint8_t> &rgbx, ChromaSubsampling subsampling)
+	{
+		RGBToYUVConversion conv;
+		conv.rgbx = rgbx.data();
+		conv.rgbx_stride = int(width * 4 + 12);
+		conv.width = width;
+		conv.height = height;
+		conv.subsampling = subsampling;
+		for (unsigned i = 0; i < 3; i++)
+		{
+			conv.planes[i] = planes[i].data();
+			conv.strides[i] = strides[i];
+		}
+		return conv;
+	}
+
+	unsigned width, height;
+	std::vector<uint8_t> planes[3];
+	int strides[3];
+};
+
+static std::vector<uint8_t> random_rgbx(unsigned width, unsigned height, std::mt19937 &rnd)
+{
+	std::vector<uint8_t> rgbx(size_t(width * 4 + 12) * height);
+	std::uniform_int_distribution<int> dist(0, 255);
+	for (auto &v : rgbx)
+		v = uint8_t(dist(rnd));
+	return rgbx;
+}
+
+static void test_matches_scalar(ThreadGroup &group, unsigned width, unsigned height,
+                                ChromaSubsampling subsampling, std::mt19937 &rnd)
+{
+	auto rgbx = random_rgbx(width, height, rnd);
+	Image simd(width, height, subsampling), scalar(width, height, subsampling), parallel(width, height, subsampling);
+
+	auto conv = simd.conversion(rgbx, subsampling);
+	convert_rgbx_to_yuv(conv, 0, height);
+	conv = scalar.conversion(rgbx, subsampling);
+	convert_rgbx_to_yuv_scalar(conv, 0, height);
+	conv = parallel.conversion(rgbx, subsampling);
+	convert_rgbx_to_yuv_parallel(group, conv);
+
+	for (unsigned i = 0; i < 3; i++)
+	{
+		check(simd.planes[i] == scalar.planes[i], "SIMD output matches scalar reference");
+		check(parallel.planes[i] == scalar.planes[i], "Parallel output matches scalar reference");
+	}
+}
+
+static void test_against_float_reference(std::mt19937 &rnd)
+{
+	const unsigned width = 67, height = 9;
+	auto rgbx = random_rgbx(width, height, rnd);
+	Image img(width, height, ChromaSubsampling::Chroma444);
+	auto conv = img.conversion(rgbx, ChromaSubsampling::Chroma444);
+	convert_rgbx_to_yuv(conv, 0, height);
+
+	int max_error = 0;
+	for (unsigned y = 0; y < height; y++)
+	{
+		for (unsigned x = 0; x < width; x++)
+		{
+			const uint8_t *p = rgbx.data() + y * conv.rgbx_stride + 4 * x;
+			double r = p[0] / 255.0, g = p[1] / 255.0, b = p[2] / 255.0;
+			double luma = 0.2126 * r + 0.7152 * g + 0.0722 * b;
+			double ref[3] = {
+				16.0 + 219.0 * luma,
+				128.0 + 224.0 * (b - luma) / 1.8556,
+				128.0 + 224.0 * (r - luma) / 1.5748,
+			};
+
+			for (unsigned c = 0; c < 3; c++)
+			{
+				int v = img.planes[c][y * img.strides[c] + x];
+				max_error = std::max(max_error, int(fabs(double(v) - ref[c]) + 0.5));
+			}
+		}
+	}
+
+	LOGI("Max error against float BT.709: %d.\n", max_error);
+	check(max_error <= 1, "Within one step of float BT.709");
+}
+
+static void test_chroma420_filter()
+{
+	// Solid colour must produce exactly the per-pixel chroma.
+	const unsigned width = 37, height = 7;
+	std::vector<uint8_t> rgbx(size_t(width * 4 + 12) * height);
+	for (unsigned y = 0; y < height; y++)
+	{
+		for (unsigned x = 0; x < width; x++)
+		{
+			uint8_t *p = rgbx.data() + y * (width * 4 + 12) + 4 * x;
+			p[0] = 200;
+			p[1] = 50;
+			p[2] = 90;
+		}
+	}
+
+	Image img420(width, height, ChromaSubsampling::Chroma420);
+	Image img444(width, height, ChromaSubsampling::Chroma444);
+	auto conv = img420.conversion(rgbx, ChromaSubsampling::Chroma420);
+	convert_rgbx_to_yuv(conv, 0, height);
+	conv = img444.conversion(rgbx, ChromaSubsampling::Chroma444);
+	convert_rgbx_to_yuv(conv, 0, height);
+
+	for (unsigned y = 0; y < (height + 1) / 2; y++)
+	{
+		for (unsigned x = 0; x < (width + 1) / 2; x++)
+		{
+			check(img420.planes[1][y * img420.strides[1] + x] == img444.planes[1][0], "Solid Cb");
+			check(img420.planes[2][y * img420.strides[2] + x] == img444.planes[2][0], "Solid Cr");
+		}
+	}
+
+	// A vertical edge between two columns is blended by the [1 2 1] filter rather than point sampled.
+	for (unsigned y = 0; y < height; y++)
+	{
+		for (unsigned x = 0; x < width; x++)
+		{
+			uint8_t *p = rgbx.data() + y * (width * 4 + 12) + 4 * x;
+			p[0] = p[1] = p[2] = x < 17 ? 0 : 255;
+			p[2] = x < 17 ? 255 : 0;
+		}
+	}
+
+	conv = img420.conversion(rgbx, ChromaSubsampling::Chroma420);
+	convert_rgbx_to_yuv(conv, 0, height);
+	int left = img420.planes[1][7];
+	int edge = img420.planes[1][8];
+	int right = img420.planes[1][9];
+	check(edge > right && edge < left, "Chroma across an edge is filtered");
+}
+
+int main()
+{
+	ThreadGroup group;
+	group.start(4, 0, {});
+	std::mt19937 rnd(1234);
+
+	for (auto subsampling : { ChromaSubsampling::Chroma444, ChromaSubsampling::Chroma420 })
+	{
+		for (unsigned width : { 1u, 2u, 15u, 16u, 17u, 33u, 64u, 127u })
+			for (unsigned height : { 1u, 2u, 3u, 18u, 35u })
+				test_matches_scalar(group, width, height, subsampling, rnd);
+		test_matches_scalar(group, 1920, 1080, subsampling, rnd);
+	}
+
+	test_against_float_reference(rnd);
+	test_chroma420_filter();
+
+	LOGI("All RGB to YUV tests passed.\n");
+}
@@ -4,8 +4,12 @@
 #include "logging.hpp"
 #include "transforms.hpp"
 #include "frustum.hpp"
+#include "timer.hpp"
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
+#include <vector>
+#include <algorithm>
 
 using namespace Granite;
 
@@ -98,11 +102,230 @@ static void test_quat()
 	}
 }
 
-int main()
+static mat4 scalar_model_transform(vec3 s, quat rot, vec3 trans, const mat4 &parent)
+{
+	return parent * translate(trans) * mat4_cast(rot) * scale(s);
+}
+
+static void test_inverse_affine()
+{
+	mat4 m;
+	compute_model_transform(m, vec3(2.0f, -0.5f, 3.0f), angleAxis(1.3f, normalize(vec3(0.3f, -0.2f, 0.9f))),
+	                        vec3(-4.0f, 10.0f, 0.25f), mat4(1.0f));
+
+	mat4 ref = inverse(m);
+	mat4 optim;
+	SIMD::inverse_affine(optim, m);
+
+	for (int i = 0; i < 4; i++)
+	{
+		if (distance(ref[i], optim[i]) > 0.0001f)
+		{
+			LOGE("Error in affine inverse!\n");
+			exit(1);
+		}
+	}
+
+	// In-place must work as well.
+	SIMD::inverse_affine(m, m);
+	if (memcmp(&m, &optim, sizeof(mat4)) != 0)
+	{
+		LOGE("Error in in-place affine inverse!\n");
+		exit(1);
+	}
+}
+
+static const BatchTransformPath batch_transform_paths[] = {
+	BatchTransformPath::Generic, BatchTransformPath::AVX2, BatchTransformPath::AVX512,
+};
+
+static const char *batch_transform_path_name(BatchTransformPath path)
+{
+	switch (path)
+	{
+	case BatchTransformPath::AVX2:
+		return "AVX2";
+	case BatchTransformPath::AVX512:
+		return "AVX-512";
+	default:
+		return "generic";
+	}
+}
+
+static void test_batch_transforms()
+{
+	// Not a multiple of any vector width, so the tail paths are exercised as well.
+	static const unsigned Count = 61;
+	std::vector<vec3> scales, translations;
+	std::vector<quat> rotations;
+	std::vector<mat4> parents(Count), world(Count);
+	std::vector<const mat4 *> parent_ptrs;
+	std::vector<mat4 *> world_ptrs;
+
+	for (unsigned i = 0; i < Count; i++)
+	{
+		float f = float(i);
+		scales.emplace_back(1.0f + 0.1f * f, 2.0f - 0.05f * f, 0.5f);
+		translations.emplace_back(f, -2.0f * f, 0.5f * f);
+		rotations.push_back(angleAxis(0.1f * f, normalize(vec3(1.0f, f, 2.0f))));
+		compute_model_transform(parents[i], vec3(2.0f - 0.01f * f),
+		                        angleAxis(0.4f + 0.03f * f, normalize(vec3(f, 1.0f, -1.0f))),
+		                        vec3(1.0f, 2.0f, -f), mat4(1.0f));
+		parent_ptrs.push_back(&parents[i]);
+		world_ptrs.push_back(&world[i]);
+	}
+
+	auto default_path = get_batch_transform_path();
+
+	for (auto path : batch_transform_paths)
+	{
+		if (!set_batch_transform_path(path))
+		{
+			LOGI("Skipping %s batched transforms, not supported.\n", batch_transform_path_name(path));
+			continue;
+		}
+
+		std::fill(world.begin(), world.end(), mat4(0.0f));
+		compute_model_transforms(world_ptrs.data(), parent_ptrs.data(),
+		                         scales.data(), rotations.data(), translations.data(), Count);
+
+		for (unsigned i = 0; i < Count; i++)
+		{
+			mat4 ref = scalar_model_transform(scales[i], rotations[i], translations[i], parents[i]);
+			for (int c = 0; c < 4; c++)
+			{
+				if (distance(ref[c], world[i][c]) > 0.0005f * max(1.0f, length(ref[c])))
+				{
+					LOGE("Error in %s batched model transform!\n", batch_transform_path_name(path));
+					exit(1);
+				}
+			}
+		}
+	}
+
+	set_batch_transform_path(default_path);
+}
+
+template <typename Func>
+static double time_loop(unsigned iterations, const Func &func)
+{
+	auto start = Util::get_current_time_nsecs();
+	for (unsigned i = 0; i < iterations; i++)
+		func();
+	return double(Util::get_current_time_nsecs() - start) / double(iterations);
+}
+
+static void run_benchmarks()
+{
+	static const unsigned Count = 4096;
+	static const unsigned Iterations = 200;
+
+	std::vector<mat4> a(Count), b(Count), c(Count);
+	std::vector<vec3> scales(Count), translations(Count);
+	std::vector<quat> rotations(Count);
+	for (unsigned i = 0; i < Count; i++)
+	{
+		float f = float(i) * 0.001f;
+		scales[i] = vec3(1.0f + f);
+		translations[i] = vec3(f, -f, 2.0f * f);
+		rotations[i] = angleAxis(f, normalize(vec3(1.0f, 2.0f, 3.0f)));
+		compute_model_transform(a[i], scales[i], rotations[i], translations[i], mat4(1.0f));
+		b[i] = a[i];
+	}
+
+	// Keep the results alive so the loops are not optimized out.
+	volatile float sink = 0.0f;
+
+	double scalar_mul = time_loop(Iterations, [&]() {
+		for (unsigned i = 0; i < Count; i++)
+			c[i] = a[i] * b[i];
+		sink = sink + c[Count - 1][3].x;
+	});
+	double simd_mul = time_loop(Iterations, [&]() {
+		for (unsigned i = 0; i < Count; i++)
+			SIMD::mul(c[i], a[i], b[i]);
+		sink = sink + c[Count - 1][3].x;
+	});
+
+	double scalar_inverse = time_loop(Iterations, [&]() {
+		for (unsigned i = 0; i < Count; i++)
+			c[i] = inverse(a[i]);
+		sink = sink + c[Count - 1][3].x;
+	});
+	double simd_inverse = time_loop(Iterations, [&]() {
+		for (unsigned i = 0; i < Count; i++)
+			SIMD::inverse_affine(c[i], a[i]);
+		sink = sink + c[Count - 1][3].x;
+	});
+
+	double scalar_quat = time_loop(Iterations, [&]() {
+		for (unsigned i = 0; i < Count; i++)
+			c[i] = mat4(mat3_cast(rotations[i]));
+		sink = sink + c[Count - 1][0].x;
+	});
+	double simd_quat = time_loop(Iterations, [&]() {
+		for (unsigned i = 0; i < Count; i++)
+			SIMD::convert_quaternion_with_scale(&c[i][0], rotations[i], vec3(1.0f));
+		sink = sink + c[Count - 1][0].x;
+	});
+
+	std::vector<const mat4 *> parent_ptrs(Count);
+	std::vector<mat4 *> world_ptrs(Count);
+	for (unsigned i = 0; i < Count; i++)
+	{
+		parent_ptrs[i] = &b[i];
+		world_ptrs[i] = &c[i];
+	}
+
+	double scalar_trs = time_loop(Iterations, [&]() {
+		for (unsigned i = 0; i < Count; i++)
+			c[i] = scalar_model_transform(scales[i], rotations[i], translations[i], b[i]);
+		sink = sink + c[Count - 1][3].x;
+	});
+
+	double batch_trs[3] = {};
+	auto default_path = get_batch_transform_path();
+	for (auto path : batch_transform_paths)
+	{
+		if (!set_batch_transform_path(path))
+			continue;
+		batch_trs[unsigned(path)] = time_loop(Iterations, [&]() {
+			compute_model_transforms(world_ptrs.data(), parent_ptrs.data(),
+			                         scales.data(), rotations.data(), translations.data(), Count);
+			sink = sink + c[Count - 1][3].x;
+		});
+	}
+	set_batch_transform_path(default_path);
+
+	const auto report = [](const char *tag, double scalar, double simd) {
+		LOGI("%-24s scalar %8.2f ns, SIMD %8.2f ns, %.2fx.\n", tag,
+		     scalar / Count, simd / Count, scalar / simd);
+	};
+
+	report("mat4 * mat4", scalar_mul, simd_mul);
+	report("Affine inverse", scalar_inverse, simd_inverse);
+	report("quat -> mat", scalar_quat, simd_quat);
+	for (auto path : batch_transform_paths)
+	{
+		if (batch_trs[unsigned(path)] == 0.0)
+			continue;
+		char tag[64];
+		snprintf(tag, sizeof(tag), "TRS compose (%s)", batch_transform_path_name(path));
+		report(tag, scalar_trs, batch_trs[unsigned(path)]);
+	}
+}
+
+int main(int argc, char **argv)
 {
 	test_matrix_multiply();
 	test_frustum_cull();
 	test_aabb_transform();
 	test_quat();
+	test_inverse_affine();
+	test_batch_transforms();
+
+	if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+		run_benchmarks();
+
 	LOGI(":D\n");
 }
\ No newline at end of file
@@ -0,0 +1,173 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "global_managers_init.hpp"
+#include "filesystem.hpp"
+#include "compiler.hpp"
+#include "path_utils.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <unordered_set>
+#include <vector>
+#include <stdlib.h>
+
+using namespace Granite;
+
+static void gather_shaders(Filesystem &fs, const std::string &dir, std::vector<std::string> &paths)
+{
+	for (auto &entry : fs.list(dir))
+	{
+		if (entry.type == PathType::Directory)
+			gather_shaders(fs, entry.path, paths);
+		else if (entry.type == PathType::File && Path::ext(entry.path) != "h")
+			paths.push_back(entry.path);
+	}
+}
+
+struct Statistics
+{
+	uint64_t compile_ns = 0;
+	uint64_t specialize_ns = 0;
+	unsigned compiles = 0;
+	unsigned specializations = 0;
+	unsigned modules = 0;
+	unsigned failed = 0;
+};
+
+static Util::Hash hash_module(const std::vector<uint32_t> &spirv)
+{
+	Util::Hasher h;
+	h.data(spirv.data(), spirv.size() * sizeof(uint32_t));
+	return h.get();
+}
+
+static void report(const char *tag, const Statistics &stats)
+{
+	LOGI("%-10s %4u glslang compiles (%9.3f ms), %4u specializations (%9.3f ms), %4u unique modules, %u failed.\n",
+	     tag, stats.compiles, 1e-6 * double(stats.compile_ns),
+	     stats.specializations, 1e-6 * double(stats.specialize_ns),
+	     stats.modules, stats.failed);
+}
+
+int main()
+{
+	Global::init(Global::MANAGER_FEATURE_FILESYSTEM_BIT);
+	auto &fs = *GRANITE_FILESYSTEM();
+
+	std::vector<std::string> paths;
+	gather_shaders(fs, "builtin://shaders", paths);
+	const std::vector<std::string> include_dirs = { "builtin://shaders" };
+
+	Statistics total_separate, total_folded;
+	unsigned num_spec_shaders = 0;
+	unsigned num_variants = 0;
+
+	for (auto &path : paths)
+	{
+		GLSLCompiler compiler(fs);
+		compiler.set_target(Target::Vulkan11);
+		compiler.set_include_directories(&include_dirs);
+		if (!compiler.set_source_from_file(path) || !compiler.preprocess())
+			continue;
+
+		auto &spec_defines = compiler.get_spec_defines();
+		if (spec_defines.empty())
+			continue;
+		num_spec_shaders++;
+
+		// Every combination of spec define values is a variant the shader manager could request.
+		unsigned combinations = 1u << spec_defines.size();
+		Statistics separate, folded;
+		std::unordered_set<Util::Hash> separate_modules, folded_modules;
+		std::string error;
+
+		auto start_ts = Util::get_current_time_nsecs();
+		auto base = compiler.compile_specializable(error);
+		folded.compile_ns += Util::get_current_time_nsecs() - start_ts;
+		folded.compiles++;
+		if (base.empty())
+		{
+			LOGE("Failed to compile %s:\n%s\n", path.c_str(), error.c_str());
+			folded.failed++;
+		}
+
+		for (unsigned mask = 0; mask < combinations; mask++)
+		{
+			std::vector<std::pair<std::string, int>> defines;
+			for (size_t i = 0; i < spec_defines.size(); i++)
+				defines.emplace_back(spec_defines[i], int((mask >> i) & 1));
+
+			start_ts = Util::get_current_time_nsecs();
+			auto spirv = compiler.compile(error, &defines);
+			separate.compile_ns += Util::get_current_time_nsecs() - start_ts;
+			separate.compiles++;
+			if (spirv.empty())
+				separate.failed++;
+			else
+				separate_modules.insert(hash_module(spirv));
+
+			if (base.empty())
+				continue;
+
+			start_ts = Util::get_current_time_nsecs();
+			std::vector<uint32_t> specialized;
+			bool ret = compiler.specialize(base, defines, specialized, error);
+			folded.specialize_ns += Util::get_current_time_nsecs() - start_ts;
+			folded.specializations++;
+			if (!ret)
+			{
+				LOGE("Failed to specialize %s:\n%s\n", path.c_str(), error.c_str());
+				folded.failed++;
+			}
+			else
+				folded_modules.insert(hash_module(specialized));
+		}
+
+		separate.modules = unsigned(separate_modules.size());
+		folded.modules = unsigned(folded_modules.size());
+		num_variants += combinations;
+
+		LOGI("%s: %u spec defines, %u variants.\n", path.c_str(), unsigned(spec_defines.size()), combinations);
+		report("  separate", separate);
+		report("  folded", folded);
+
+		total_separate.compile_ns += separate.compile_ns;
+		total_separate.compiles += separate.compiles;
+		total_separate.modules += separate.modules;
+		total_separate.failed += separate.failed;
+		total_folded.compile_ns += folded.compile_ns;
+		total_folded.specialize_ns += folded.specialize_ns;
+		total_folded.compiles += folded.compiles;
+		total_folded.specializations += folded.specializations;
+		total_folded.modules += folded.modules;
+		total_folded.failed += folded.failed;
+	}
+
+	LOGI("%u of %u builtin shaders declare spec defines, %u variants in total.\n",
+	     num_spec_shaders, unsigned(paths.size()), num_variants);
+	report("separate", total_separate);
+	report("folded", total_folded);
+
+	Global::deinit();
+	return total_separate.failed || total_folded.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
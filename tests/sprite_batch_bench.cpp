@@ -0,0 +1,237 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "global_managers_init.hpp"
+#include "filesystem.hpp"
+#include "device.hpp"
+#include "context.hpp"
+#include "flat_renderer.hpp"
+#include "sprite.hpp"
+#include "sprite_atlas.hpp"
+#include "event.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <random>
+#include <vector>
+
+using namespace Granite;
+using namespace Vulkan;
+
+static constexpr unsigned NumSprites = 100000;
+static constexpr unsigned NumTextures = 256;
+static constexpr unsigned TextureSize = 16;
+static constexpr unsigned NumLayers = 8;
+static constexpr unsigned Iterations = 10;
+static constexpr unsigned Width = 1920;
+static constexpr unsigned Height = 1080;
+
+struct SpriteDesc
+{
+	vec3 offset;
+	vec2 size;
+	unsigned texture;
+	uint8_t color[4];
+};
+
+struct Timing
+{
+	double submit = 0.0;
+	double flush = 0.0;
+};
+
+static void flush_frame(Device &device, FlatRenderer &flat, const Image &rt, const Image &ds, Timing &timing)
+{
+	auto start_time = Util::get_current_time_nsecs();
+
+	RenderPassInfo rp;
+	rp.num_color_attachments = 1;
+	rp.color_attachments[0] = &rt.get_view();
+	rp.depth_stencil = &ds.get_view();
+	rp.store_attachments = 1;
+	rp.op_flags = RENDER_PASS_OP_CLEAR_DEPTH_STENCIL_BIT;
+
+	auto cmd = device.request_command_buffer();
+	cmd->begin_render_pass(rp);
+	flat.flush(*cmd, vec3(0.0f), vec3(float(Width), float(Height), float(NumLayers)));
+	cmd->end_render_pass();
+	device.submit(cmd);
+	device.next_frame_context();
+
+	timing.flush += double(Util::get_current_time_nsecs() - start_time);
+}
+
+// Baseline: one render_textured_quad() per sprite, every texture is a separate image.
+static void run_per_quad(FlatRenderer &flat, const std::vector<SpriteDesc> &sprites,
+                         const std::vector<ImageHandle> &textures, DrawPipeline pipeline, Timing &timing)
+{
+	auto start_time = Util::get_current_time_nsecs();
+	flat.begin();
+	for (auto &sprite : sprites)
+	{
+		vec4 color = vec4(sprite.color[0], sprite.color[1], sprite.color[2], sprite.color[3]) * (1.0f / 255.0f);
+		flat.render_textured_quad(textures[sprite.texture]->get_view(), sprite.offset, sprite.size,
+		                          vec2(0.0f), vec2(float(TextureSize)), pipeline, color);
+	}
+	timing.submit += double(Util::get_current_time_nsecs() - start_time);
+}
+
+// Atlas: all sprites reference one array texture and go through push_sprite_batch().
+static void run_batched(FlatRenderer &flat, const std::vector<SpriteDesc> &sprites,
+                        const SpriteAtlas &atlas, DrawPipeline pipeline,
+                        std::vector<QuadData> &quads, Timing &timing)
+{
+	auto start_time = Util::get_current_time_nsecs();
+	flat.begin();
+
+	quads.resize(sprites.size());
+	for (size_t i = 0; i < sprites.size(); i++)
+	{
+		auto &sprite = sprites[i];
+		auto &entry = atlas.get_entry(sprite.texture);
+		auto &quad = quads[i];
+		quad.pos_off_x = sprite.offset.x;
+		quad.pos_off_y = sprite.offset.y;
+		quad.pos_scale_x = sprite.size.x;
+		quad.pos_scale_y = sprite.size.y;
+		quad.tex_off_x = entry.tex_offset.x;
+		quad.tex_off_y = entry.tex_offset.y;
+		quad.tex_scale_x = entry.tex_size.x;
+		quad.tex_scale_y = entry.tex_size.y;
+		quad.rotation[0] = 1.0f;
+		quad.rotation[1] = 0.0f;
+		quad.rotation[2] = 0.0f;
+		quad.rotation[3] = 1.0f;
+		for (unsigned c = 0; c < 4; c++)
+			quad.color[c] = sprite.color[c];
+		quad.layer = sprite.offset.z;
+		quad.array_layer = float(entry.layer);
+		quad.blend_factor = 0.0f;
+	}
+
+	SpriteBatchInfo info;
+	info.view = &atlas.get_view();
+	info.pipeline = pipeline;
+	flat.push_sprite_batch(info, quads.data(), unsigned(quads.size()));
+	timing.submit += double(Util::get_current_time_nsecs() - start_time);
+}
+
+static void report(const char *tag, const Timing &timing)
+{
+	double submit = timing.submit / Iterations;
+	double flush = timing.flush / Iterations;
+	LOGI("%-26s submit %8.3f ms (%6.1f ns/sprite), flush %8.3f ms, total %8.3f ms.\n",
+	     tag, 1e-6 * submit, submit / NumSprites, 1e-6 * flush, 1e-6 * (submit + flush));
+}
+
+static int main_inner()
+{
+	// Only CPU cost is interesting here, so keep the GPU side of each frame trivial.
+	if (!Context::init_loader(nullptr))
+		return EXIT_FAILURE;
+
+	Context ctx;
+	Context::SystemHandles handles;
+	handles.filesystem = GRANITE_FILESYSTEM();
+	handles.thread_group = GRANITE_THREAD_GROUP();
+	ctx.set_system_handles(handles);
+	if (!ctx.init_instance_and_device(nullptr, 0, nullptr, 0))
+		return EXIT_FAILURE;
+
+	Device device;
+	device.set_context(ctx);
+	GRANITE_EVENT_MANAGER()->enqueue_latched<DeviceShaderModuleReadyEvent>(&device, &device.get_shader_manager());
+
+	std::mt19937 rnd(42);
+	std::vector<uint32_t> texels(TextureSize * TextureSize);
+	std::vector<ImageHandle> textures;
+	SpriteAtlas atlas;
+	auto tex_info = ImageCreateInfo::immutable_2d_image(TextureSize, TextureSize, VK_FORMAT_R8G8B8A8_SRGB);
+
+	for (unsigned i = 0; i < NumTextures; i++)
+	{
+		for (auto &t : texels)
+			t = rnd();
+		ImageInitialData initial = { texels.data(), 0, 0 };
+		textures.push_back(device.create_image(tex_info, &initial));
+		atlas.add_image(TextureSize, TextureSize, texels.data());
+	}
+
+	if (!atlas.bake(device, 512))
+		return EXIT_FAILURE;
+
+	std::uniform_real_distribution<float> pos_x(0.0f, float(Width));
+	std::uniform_real_distribution<float> pos_y(0.0f, float(Height));
+	std::uniform_int_distribution<unsigned> layer(0, NumLayers - 1);
+	std::uniform_int_distribution<unsigned> tex(0, NumTextures - 1);
+	std::vector<SpriteDesc> sprites(NumSprites);
+	for (auto &sprite : sprites)
+	{
+		sprite.offset = vec3(pos_x(rnd), pos_y(rnd), float(layer(rnd)) + 0.5f);
+		sprite.size = vec2(float(TextureSize));
+		sprite.texture = tex(rnd);
+		sprite.color[0] = sprite.color[1] = sprite.color[2] = 0xff;
+		sprite.color[3] = 0x80;
+	}
+
+	auto rt = device.create_image(ImageCreateInfo::render_target(Width, Height, VK_FORMAT_R8G8B8A8_UNORM));
+	auto ds = device.create_image(ImageCreateInfo::render_target(Width, Height, VK_FORMAT_D32_SFLOAT));
+
+	FlatRenderer flat;
+	std::vector<QuadData> quads;
+
+	for (auto pipeline : { DrawPipeline::Opaque, DrawPipeline::AlphaBlend })
+	{
+		const char *name = pipeline == DrawPipeline::Opaque ? "opaque" : "alpha blend";
+
+		// Warm up pipeline and descriptor caches so we only measure steady state.
+		Timing warmup;
+		run_per_quad(flat, sprites, textures, pipeline, warmup);
+		flush_frame(device, flat, *rt, *ds, warmup);
+		run_batched(flat, sprites, atlas, pipeline, quads, warmup);
+		flush_frame(device, flat, *rt, *ds, warmup);
+
+		Timing per_quad, batched;
+		for (unsigned i = 0; i < Iterations; i++)
+		{
+			run_per_quad(flat, sprites, textures, pipeline, per_quad);
+			flush_frame(device, flat, *rt, *ds, per_quad);
+			run_batched(flat, sprites, atlas, pipeline, quads, batched);
+			flush_frame(device, flat, *rt, *ds, batched);
+		}
+
+		LOGI("%u sprites, %u textures, %u layers, %s:\n", NumSprites, NumTextures, NumLayers, name);
+		report("  Per-quad, per-texture:", per_quad);
+		report("  Atlas + batch:", batched);
+	}
+
+	GRANITE_EVENT_MANAGER()->dequeue_all_latched(DeviceShaderModuleReadyEvent::get_type_id());
+	device.wait_idle();
+	return EXIT_SUCCESS;
+}
+
+int main()
+{
+	Global::init(Global::MANAGER_FEATURE_DEFAULT_BITS, 1);
+	int ret = main_inner();
+	Global::deinit();
+	return ret;
+}
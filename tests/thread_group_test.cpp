@@ -22,14 +22,103 @@
 
 #include "thread_group.hpp"
 #include "logging.hpp"
+#include "timer.hpp"
+#include <atomic>
 
 using namespace Granite;
 
+static void run_fork_join_benchmark(ThreadGroup &group, unsigned num_tasks)
+{
+	constexpr unsigned Iterations = 10000;
+	std::atomic_uint counter;
+	counter.store(0, std::memory_order_relaxed);
+
+	auto start_time = Util::get_current_time_nsecs();
+	for (unsigned iter = 0; iter < Iterations; iter++)
+	{
+		auto task = group.create_task();
+		for (unsigned i = 0; i < num_tasks; i++)
+		{
+			task->enqueue_task([&counter]() {
+				counter.fetch_add(1, std::memory_order_relaxed);
+			});
+		}
+		task->wait();
+	}
+	auto end_time = Util::get_current_time_nsecs();
+
+	if (counter.load(std::memory_order_relaxed) != Iterations * num_tasks)
+		LOGE("Mismatch in completed task count.\n");
+
+	LOGI("Fork-join (%u tasks): %.3f us / iteration.\n", num_tasks,
+	     1e-3 * double(end_time - start_time) / double(Iterations));
+}
+
+// Wide fan-in, typical for render graph and scene update stages.
+static void run_dependency_benchmark(ThreadGroup &group, unsigned num_deps)
+{
+	constexpr unsigned Iterations = 2000;
+	std::atomic_uint counter;
+	counter.store(0, std::memory_order_relaxed);
+
+	auto start_time = Util::get_current_time_nsecs();
+	for (unsigned iter = 0; iter < Iterations; iter++)
+	{
+		auto join = group.create_task([&counter]() {
+			counter.fetch_add(1, std::memory_order_relaxed);
+		});
+
+		for (unsigned i = 0; i < num_deps; i++)
+		{
+			auto task = group.create_task([&counter]() {
+				counter.fetch_add(1, std::memory_order_relaxed);
+			});
+			group.add_dependency(*join, *task);
+			group.submit(task);
+		}
+
+		join->wait();
+	}
+	auto end_time = Util::get_current_time_nsecs();
+
+	if (counter.load(std::memory_order_relaxed) != Iterations * (num_deps + 1))
+		LOGE("Mismatch in completed task count.\n");
+
+	LOGI("Fan-in (%u dependencies): %.3f us / iteration.\n", num_deps,
+	     1e-3 * double(end_time - start_time) / double(Iterations));
+}
+
+static void run_signal_benchmark(ThreadGroup &group)
+{
+	constexpr unsigned Iterations = 10000;
+	TaskSignal signal;
+
+	auto start_time = Util::get_current_time_nsecs();
+	for (unsigned iter = 0; iter < Iterations; iter++)
+	{
+		auto task = group.create_task([]() {});
+		task->set_fence_counter_signal(&signal);
+		group.submit(task);
+		signal.wait_until_at_least(iter + 1);
+	}
+	auto end_time = Util::get_current_time_nsecs();
+
+	LOGI("Signal round-trip: %.3f us / iteration.\n",
+	     1e-3 * double(end_time - start_time) / double(Iterations));
+}
+
 int main()
 {
 	ThreadGroup group;
 	group.start(4, 0, {});
 
+	run_fork_join_benchmark(group, 1);
+	run_fork_join_benchmark(group, 4);
+	run_fork_join_benchmark(group, 64);
+	run_dependency_benchmark(group, 16);
+	run_dependency_benchmark(group, 128);
+	run_signal_benchmark(group);
+
 	auto task1 = group.create_task([]() {
 		LOGI("Ohai!\n");
 	});
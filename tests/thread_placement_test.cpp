@@ -0,0 +1,120 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "task_composer.hpp"
+#include "cpu_topology.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+
+using namespace Granite;
+
+static constexpr unsigned NumFrames = 200;
+static constexpr unsigned NumSlices = 64;
+static constexpr size_t SliceSize = 64 * 1024;
+
+// Models a typical frame: one stage produces data which the next stage consumes on other threads.
+static double run_frames(ThreadPlacement placement, unsigned num_threads)
+{
+	ThreadGroup group;
+	group.set_thread_placement(placement);
+	group.start(num_threads, 0, {});
+
+	std::vector<uint32_t> buffer(NumSlices * SliceSize);
+	std::vector<uint64_t> sums(NumSlices);
+
+	auto start_time = Util::get_current_time_nsecs();
+
+	for (unsigned frame = 0; frame < NumFrames; frame++)
+	{
+		TaskComposer composer(group);
+
+		auto &produce = composer.begin_pipeline_stage();
+		for (unsigned slice = 0; slice < NumSlices; slice++)
+		{
+			produce.enqueue_task([&buffer, slice, frame]() {
+				uint32_t *data = buffer.data() + slice * SliceSize;
+				for (size_t i = 0; i < SliceSize; i++)
+					data[i] = uint32_t(i * frame + slice);
+			});
+		}
+
+		auto &consume = composer.begin_pipeline_stage();
+		for (unsigned slice = 0; slice < NumSlices; slice++)
+		{
+			consume.enqueue_task([&buffer, &sums, slice]() {
+				// Read a slice which was most likely produced by another thread.
+				const uint32_t *data = buffer.data() + ((slice * 7 + 3) % NumSlices) * SliceSize;
+				uint64_t sum = 0;
+				for (size_t i = 0; i < SliceSize; i++)
+					sum += data[i];
+				sums[slice] = sum;
+			});
+		}
+
+		composer.get_outgoing_task()->wait();
+	}
+
+	auto end_time = Util::get_current_time_nsecs();
+	return 1e-9 * double(end_time - start_time);
+}
+
+int main()
+{
+	Util::CPUTopology topology;
+	if (topology.discover())
+	{
+		LOGI("Found %u logical CPUs, %u NUMA nodes, hybrid: %s.\n",
+		     unsigned(topology.cpus.size()), topology.num_numa_nodes, topology.is_hybrid ? "yes" : "no");
+		for (auto &cpu : topology.cpus)
+		{
+			LOGI("  CPU %u: package %u, core %u, SMT %u, node %u, %s\n",
+			     cpu.id, cpu.package_id, cpu.core_id, cpu.smt_index, cpu.numa_node,
+			     cpu.performance_core ? "P-core" : "E-core");
+		}
+	}
+	else
+		LOGW("Could not query CPU topology.\n");
+
+	unsigned num_threads = std::thread::hardware_concurrency();
+	num_threads = num_threads > 1 ? num_threads - 1 : 1;
+
+	std::vector<unsigned> affinity_before, affinity_after;
+	Util::get_current_thread_affinity(affinity_before);
+
+	double default_time = run_frames(ThreadPlacement::Default, num_threads);
+	double pinned_time = run_frames(ThreadPlacement::Pinned, num_threads);
+
+	// Pinning also affects the main thread, but it must be undone when the group stops.
+	Util::get_current_thread_affinity(affinity_after);
+	if (affinity_before != affinity_after)
+	{
+		LOGE("Main thread affinity was not restored after stopping a pinned thread group.\n");
+		return EXIT_FAILURE;
+	}
+
+	LOGI("Default placement: %.1f frames/s.\n", NumFrames / default_time);
+	LOGI("Pinned placement: %.1f frames/s.\n", NumFrames / pinned_time);
+}
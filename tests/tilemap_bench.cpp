@@ -0,0 +1,326 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "global_managers_init.hpp"
+#include "filesystem.hpp"
+#include "device.hpp"
+#include "context.hpp"
+#include "flat_renderer.hpp"
+#include "tilemap.hpp"
+#include "tmx_parser.hpp"
+#include "rapidjson_wrapper.hpp"
+#include "stb_image_write.h"
+#include "event.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <stdio.h>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Granite;
+using namespace Vulkan;
+
+static constexpr unsigned MapSize = 4096;
+static constexpr unsigned TileSize = 16;
+static constexpr unsigned TilesetColumns = 8;
+static constexpr unsigned NumTiles = TilesetColumns * TilesetColumns;
+static constexpr unsigned Frames = 60;
+static constexpr unsigned ViewWidth = 1920;
+static constexpr unsigned ViewHeight = 1080;
+
+// Tiles in the last two rows have transparent texels, half of them fully transparent (alpha test),
+// half of them translucent (blend). Everything else is opaque.
+static bool write_tileset(const std::string &path)
+{
+	unsigned dim = TilesetColumns * TileSize;
+	std::vector<uint8_t> texels(dim * dim * 4);
+	for (unsigned y = 0; y < dim; y++)
+	{
+		for (unsigned x = 0; x < dim; x++)
+		{
+			unsigned tile = (y / TileSize) * TilesetColumns + x / TileSize;
+			uint8_t *t = &texels[(y * dim + x) * 4];
+			t[0] = uint8_t(tile * 4);
+			t[1] = uint8_t(x);
+			t[2] = uint8_t(y);
+			t[3] = 0xff;
+
+			bool edge = (x % TileSize) < 4;
+			if (tile >= NumTiles - TilesetColumns && edge)
+				t[3] = 0x80;
+			else if (tile >= NumTiles - 2 * TilesetColumns && edge)
+				t[3] = 0;
+		}
+	}
+
+	return stbi_write_png(path.c_str(), int(dim), int(dim), 4, texels.data(), int(dim * 4)) != 0;
+}
+
+static void append_layer(std::string &json, std::mt19937 &rnd, unsigned id, bool decoration)
+{
+	std::uniform_int_distribution<unsigned> ground(1, NumTiles - 2 * TilesetColumns);
+	std::uniform_int_distribution<unsigned> deco(NumTiles - 2 * TilesetColumns + 1, NumTiles);
+	std::uniform_int_distribution<unsigned> chance(0, 9);
+
+	json += "{\"type\":\"tilelayer\",\"id\":" + std::to_string(id) +
+	        ",\"width\":" + std::to_string(MapSize) + ",\"height\":" + std::to_string(MapSize) +
+	        ",\"visible\":true,\"opacity\":1,\"data\":[";
+
+	char buf[16];
+	for (unsigned i = 0; i < MapSize * MapSize; i++)
+	{
+		unsigned gid = decoration ? (chance(rnd) == 0 ? deco(rnd) : 0) : ground(rnd);
+		int len = snprintf(buf, sizeof(buf), i ? ",%u" : "%u", gid);
+		json.append(buf, size_t(len));
+	}
+	json += "]}";
+}
+
+static bool write_map(const std::string &path)
+{
+	std::mt19937 rnd(7);
+	std::string json;
+	json.reserve(size_t(MapSize) * MapSize * 6);
+	json += "{\"width\":" + std::to_string(MapSize) + ",\"height\":" + std::to_string(MapSize) +
+	        ",\"tilewidth\":" + std::to_string(TileSize) + ",\"tileheight\":" + std::to_string(TileSize) +
+	        ",\"orientation\":\"orthogonal\",\"renderorder\":\"right-down\",\"layers\":[";
+	append_layer(json, rnd, 1, false);
+	json += ",";
+	append_layer(json, rnd, 2, true);
+	json += "],\"tilesets\":[{\"firstgid\":1,\"image\":\"tileset.png\",\"columns\":" + std::to_string(TilesetColumns) +
+	        ",\"tilecount\":" + std::to_string(NumTiles) + ",\"margin\":0,\"spacing\":0}]}";
+
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+	bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+	fclose(file);
+	return ok;
+}
+
+// What parsing the layer data cost before it was streamed: a full DOM with one Value per tile.
+static double time_dom_parse(const std::string &path)
+{
+	auto start_time = Util::get_current_time_nsecs();
+	std::string str;
+	if (!GRANITE_FILESYSTEM()->read_file_to_string(path, str))
+		return 0.0;
+
+	rapidjson::Document doc;
+	doc.Parse(str);
+	size_t count = 0;
+	for (auto itr = doc["layers"].Begin(); itr != doc["layers"].End(); ++itr)
+	{
+		std::vector<int> indices;
+		indices.reserve((*itr)["data"].GetArray().Size());
+		for (auto tile_itr = (*itr)["data"].Begin(); tile_itr != (*itr)["data"].End(); ++tile_itr)
+			indices.push_back(int(tile_itr->GetUint()) - 1);
+		count += indices.size();
+	}
+	(void)count;
+	return 1e-6 * double(Util::get_current_time_nsecs() - start_time);
+}
+
+struct Timing
+{
+	double submit = 0.0;
+	double flush = 0.0;
+};
+
+static void flush_frame(Device &device, FlatRenderer &flat, const Image &rt, const Image &ds,
+                        const vec2 &view_offset, Timing &timing)
+{
+	auto start_time = Util::get_current_time_nsecs();
+
+	RenderPassInfo rp;
+	rp.num_color_attachments = 1;
+	rp.color_attachments[0] = &rt.get_view();
+	rp.depth_stencil = &ds.get_view();
+	rp.store_attachments = 1;
+	rp.op_flags = RENDER_PASS_OP_CLEAR_DEPTH_STENCIL_BIT;
+
+	auto cmd = device.request_command_buffer();
+	cmd->begin_render_pass(rp);
+	flat.flush(*cmd, vec3(view_offset, 0.0f), vec3(float(ViewWidth), float(ViewHeight), 4.0f));
+	cmd->end_render_pass();
+	device.submit(cmd);
+	device.next_frame_context();
+
+	timing.flush += double(Util::get_current_time_nsecs() - start_time);
+}
+
+static vec2 view_for_frame(unsigned frame)
+{
+	// Pan diagonally, roughly a screen every 10 frames.
+	return vec2(float(frame * 200), float(frame * 110));
+}
+
+// Baseline: every visible tile pushed as its own textured quad.
+static void submit_per_tile(FlatRenderer &flat, const TMXParser &parser, const ImageView &view,
+                            const vec2 &view_offset, Timing &timing)
+{
+	auto start_time = Util::get_current_time_nsecs();
+	flat.begin();
+
+	auto &tiles = parser.get_tiles();
+	uvec2 lo = uvec2(max(view_offset, vec2(0.0f))) / uvec2(TileSize);
+	uvec2 hi = min(uvec2(view_offset + vec2(float(ViewWidth), float(ViewHeight))) / uvec2(TileSize) + uvec2(1u),
+	               uvec2(MapSize));
+
+	float z = float(parser.get_layers().size());
+	for (auto &layer : parser.get_layers())
+	{
+		z -= 1.0f;
+		for (unsigned y = lo.y; y < hi.y; y++)
+		{
+			for (unsigned x = lo.x; x < hi.x; x++)
+			{
+				int tile = layer.tile_indices[y * layer.size.x + x];
+				if (tile < 0)
+					continue;
+				flat.render_textured_quad(view, vec3(float(x * TileSize), float(y * TileSize), z),
+				                          vec2(float(TileSize)), vec2(0.0f), vec2(float(TileSize)),
+				                          tiles[tile].pipeline, vec4(1.0f), StockSampler::NearestClamp, unsigned(tile));
+			}
+		}
+	}
+
+	timing.submit += double(Util::get_current_time_nsecs() - start_time);
+}
+
+static void submit_chunked(FlatRenderer &flat, TileMap &map, const ImageView &view,
+                           const vec2 &view_offset, Timing &timing)
+{
+	auto start_time = Util::get_current_time_nsecs();
+	flat.begin();
+	map.render(flat, view, view_offset, vec2(float(ViewWidth), float(ViewHeight)));
+	timing.submit += double(Util::get_current_time_nsecs() - start_time);
+}
+
+static void report(const char *tag, const Timing &timing)
+{
+	LOGI("%-24s submit %8.3f ms, flush %8.3f ms per frame.\n", tag,
+	     1e-6 * timing.submit / Frames, 1e-6 * timing.flush / Frames);
+}
+
+static int main_inner(const std::string &dir)
+{
+	std::string map_path = dir + "/map.json";
+	if (!write_tileset(dir + "/tileset.png") || !write_map(map_path))
+	{
+		LOGE("Failed to write benchmark map to %s.\n", dir.c_str());
+		return EXIT_FAILURE;
+	}
+
+	LOGI("DOM parse of layer data: %.1f ms.\n", time_dom_parse(map_path));
+
+	auto start_time = Util::get_current_time_nsecs();
+	TMXParser parser(map_path);
+	auto parsed_time = Util::get_current_time_nsecs();
+	TileMap map(uvec2(TileSize));
+	parser.build_tile_map(map);
+	auto built_time = Util::get_current_time_nsecs();
+	LOGI("TMXParser load: %.1f ms, TileMap setup: %.1f ms.\n",
+	     1e-6 * double(parsed_time - start_time), 1e-6 * double(built_time - parsed_time));
+
+	// Only CPU cost is interesting here, so keep the GPU side of each frame trivial.
+	if (!Context::init_loader(nullptr))
+		return EXIT_FAILURE;
+
+	Context ctx;
+	Context::SystemHandles handles;
+	handles.filesystem = GRANITE_FILESYSTEM();
+	handles.thread_group = GRANITE_THREAD_GROUP();
+	ctx.set_system_handles(handles);
+	if (!ctx.init_instance_and_device(nullptr, 0, nullptr, 0))
+		return EXIT_FAILURE;
+
+	Device device;
+	device.set_context(ctx);
+	GRANITE_EVENT_MANAGER()->enqueue_latched<DeviceShaderModuleReadyEvent>(&device, &device.get_shader_manager());
+
+	auto &layout = parser.get_tilemap_image_layout();
+	auto tex_info = ImageCreateInfo::immutable_image(layout);
+	tex_info.misc |= IMAGE_MISC_FORCE_ARRAY_BIT;
+	auto staging = device.create_image_staging_buffer(layout);
+	auto tiles = device.create_image_from_staging_buffer(tex_info, &staging);
+	auto rt = device.create_image(ImageCreateInfo::render_target(ViewWidth, ViewHeight, VK_FORMAT_R8G8B8A8_UNORM));
+	auto ds = device.create_image(ImageCreateInfo::render_target(ViewWidth, ViewHeight, VK_FORMAT_D32_SFLOAT));
+
+	{
+		FlatRenderer flat;
+
+		// Warm up pipeline caches.
+		Timing warmup;
+		submit_per_tile(flat, parser, tiles->get_view(), vec2(0.0f), warmup);
+		flush_frame(device, flat, *rt, *ds, vec2(0.0f), warmup);
+		submit_chunked(flat, map, tiles->get_view(), vec2(0.0f), warmup);
+		flush_frame(device, flat, *rt, *ds, vec2(0.0f), warmup);
+
+		Timing per_tile, chunked;
+		unsigned rebuilt = 0, visible_quads = 0;
+		for (unsigned i = 0; i < Frames; i++)
+		{
+			vec2 view_offset = view_for_frame(i);
+			submit_per_tile(flat, parser, tiles->get_view(), view_offset, per_tile);
+			flush_frame(device, flat, *rt, *ds, view_offset, per_tile);
+			submit_chunked(flat, map, tiles->get_view(), view_offset, chunked);
+			flush_frame(device, flat, *rt, *ds, view_offset, chunked);
+			rebuilt += map.get_stats().rebuilt_chunks;
+			visible_quads += map.get_stats().visible_quads;
+		}
+
+		// Standing still with a few tile edits per frame.
+		Timing edited;
+		std::mt19937 rnd(3);
+		std::uniform_int_distribution<unsigned> coord_x(0, ViewWidth / TileSize - 1);
+		std::uniform_int_distribution<unsigned> coord_y(0, ViewHeight / TileSize - 1);
+		std::uniform_int_distribution<int> tile(0, int(NumTiles) - 1);
+		for (unsigned i = 0; i < Frames; i++)
+		{
+			for (unsigned j = 0; j < 4; j++)
+				map.set_tile(0, uvec2(coord_x(rnd), coord_y(rnd)), tile(rnd));
+			submit_chunked(flat, map, tiles->get_view(), vec2(0.0f), edited);
+			flush_frame(device, flat, *rt, *ds, vec2(0.0f), edited);
+		}
+
+		LOGI("%ux%u map, %ux%u view, %u visible tiles per frame on average:\n",
+		     MapSize, MapSize, ViewWidth, ViewHeight, visible_quads / Frames);
+		report("  Per-tile quads:", per_tile);
+		report("  Chunked, panning:", chunked);
+		LOGI("  %.1f chunks rebuilt per frame while panning.\n", double(rebuilt) / Frames);
+		report("  Chunked, 4 edits/frame:", edited);
+	}
+
+	GRANITE_EVENT_MANAGER()->dequeue_all_latched(DeviceShaderModuleReadyEvent::get_type_id());
+	device.wait_idle();
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	Global::init(Global::MANAGER_FEATURE_DEFAULT_BITS, 1);
+	int ret = main_inner(argc > 1 ? argv[1] : ".");
+	Global::deinit();
+	return ret;
+}
@@ -0,0 +1,185 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "tilemap.hpp"
+#include "logging.hpp"
+#include <stdlib.h>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace Granite;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static constexpr unsigned TileSize = 16;
+static constexpr unsigned ChunkTiles = 8;
+static constexpr unsigned MapWidth = 100;
+static constexpr unsigned MapHeight = 70;
+
+static std::vector<int> random_tiles(std::mt19937 &rnd, unsigned num_tiles)
+{
+	std::uniform_int_distribution<int> dist(-1, int(num_tiles) - 1);
+	std::vector<int> tiles(MapWidth * MapHeight);
+	for (auto &t : tiles)
+		t = dist(rnd);
+	return tiles;
+}
+
+// Every non-empty tile overlapping the view must be drawn exactly once,
+// and nothing may be drawn outside the chunks overlapping the view.
+static void check_coverage(TileMap &map, const std::vector<int> &tiles, const vec2 &view_offset, const vec2 &view_size)
+{
+	std::vector<TileMap::ChunkBatch> batches;
+	map.get_visible_batches(view_offset, view_size, batches);
+
+	std::set<std::pair<int, int>> drawn;
+	for (auto &batch : batches)
+	{
+		for (unsigned i = 0; i < batch.count; i++)
+		{
+			auto &quad = batch.quads[i];
+			int x = int(quad.pos_off_x) / int(TileSize);
+			int y = int(quad.pos_off_y) / int(TileSize);
+			check(quad.pos_off_x >= batch.offset.x && quad.pos_off_y >= batch.offset.y &&
+			      quad.pos_off_x + quad.pos_scale_x <= batch.offset.x + batch.size.x &&
+			      quad.pos_off_y + quad.pos_scale_y <= batch.offset.y + batch.size.y, "Quad outside chunk bounds.");
+			check(drawn.insert({ x, y }).second, "Tile drawn twice.");
+			check(int(quad.array_layer) == tiles[y * MapWidth + x], "Wrong tile index.");
+		}
+	}
+
+	for (unsigned y = 0; y < MapHeight; y++)
+	{
+		for (unsigned x = 0; x < MapWidth; x++)
+		{
+			float x0 = float(x * TileSize), y0 = float(y * TileSize);
+			bool overlaps = x0 + TileSize > view_offset.x && x0 < view_offset.x + view_size.x &&
+			                y0 + TileSize > view_offset.y && y0 < view_offset.y + view_size.y;
+			bool present = drawn.count({ int(x), int(y) }) != 0;
+			if (overlaps && tiles[y * MapWidth + x] >= 0)
+				check(present, "Visible tile was culled.");
+
+			int chunk_x0 = int(x / ChunkTiles) * ChunkTiles * TileSize;
+			int chunk_y0 = int(y / ChunkTiles) * ChunkTiles * TileSize;
+			int chunk_size = ChunkTiles * TileSize;
+			bool chunk_overlaps = float(chunk_x0 + chunk_size) > view_offset.x && float(chunk_x0) < view_offset.x + view_size.x &&
+			                      float(chunk_y0 + chunk_size) > view_offset.y && float(chunk_y0) < view_offset.y + view_size.y;
+			if (present)
+				check(chunk_overlaps, "Tile from a chunk outside the view was drawn.");
+		}
+	}
+}
+
+int main()
+{
+	std::mt19937 rnd(99);
+	const unsigned num_tile_types = 12;
+
+	auto tiles = random_tiles(rnd, num_tile_types);
+	TileMap map(uvec2(TileSize), ChunkTiles);
+	std::vector<DrawPipeline> pipelines(num_tile_types, DrawPipeline::Opaque);
+	pipelines[3] = DrawPipeline::AlphaBlend;
+	pipelines[7] = DrawPipeline::AlphaTest;
+	map.set_tile_pipelines(pipelines);
+	unsigned layer = map.add_layer(uvec2(MapWidth, MapHeight), tiles, 1.0f);
+
+	const vec2 views[][2] = {
+		{ vec2(0.0f), vec2(320.0f, 240.0f) },
+		{ vec2(37.0f, 91.0f), vec2(400.0f, 300.0f) },
+		{ vec2(-500.0f, -500.0f), vec2(520.0f, 510.0f) },
+		{ vec2(1500.0f, 1000.0f), vec2(1000.0f, 1000.0f) },
+		{ vec2(-10.0f), vec2(4000.0f) },
+	};
+	for (auto &view : views)
+		check_coverage(map, tiles, view[0], view[1]);
+
+	{
+		std::vector<TileMap::ChunkBatch> batches;
+		map.get_visible_batches(vec2(5000.0f), vec2(100.0f), batches);
+		check(batches.empty(), "View outside the map produced batches.");
+		check(map.get_stats().visible_chunks == 0, "View outside the map visited chunks.");
+
+		// Everything has been built once by now, so a repeated view rebuilds nothing.
+		map.get_visible_batches(vec2(0.0f), vec2(320.0f, 240.0f), batches);
+		check(map.get_stats().rebuilt_chunks == 0, "Unchanged chunks were rebuilt.");
+
+		for (auto &batch : batches)
+		{
+			for (unsigned i = 0; i < batch.count; i++)
+			{
+				int tile = int(batch.quads[i].array_layer);
+				check(batch.pipeline == pipelines[tile], "Tile in wrong pipeline batch.");
+			}
+		}
+
+		// Edits only rebuild the affected chunk, and only once it is visible.
+		map.set_tile(layer, uvec2(2, 2), 5);
+		tiles[2 * MapWidth + 2] = 5;
+		map.set_tile(layer, uvec2(90, 60), 5);
+		tiles[60 * MapWidth + 90] = 5;
+
+		map.get_visible_batches(vec2(0.0f), vec2(320.0f, 240.0f), batches);
+		check(map.get_stats().rebuilt_chunks == 1, "Expected exactly one rebuilt chunk.");
+		check_coverage(map, tiles, vec2(0.0f), vec2(320.0f, 240.0f));
+
+		map.get_visible_batches(vec2(1400.0f, 950.0f), vec2(64.0f), batches);
+		check(map.get_stats().rebuilt_chunks == 1, "Edited off-screen chunk was not rebuilt when it became visible.");
+		check_coverage(map, tiles, vec2(1400.0f, 950.0f), vec2(64.0f));
+	}
+
+	{
+		// With a small residency budget, panning keeps the number of built chunks bounded.
+		map.set_max_resident_chunks(16);
+		std::vector<TileMap::ChunkBatch> batches;
+		for (unsigned i = 0; i < 20; i++)
+		{
+			map.get_visible_batches(vec2(float(i * 64), float(i * 40)), vec2(256.0f), batches);
+			check(map.get_stats().resident_chunks <= 16, "Resident chunk budget exceeded.");
+		}
+		check_coverage(map, tiles, vec2(0.0f), vec2(320.0f, 240.0f));
+	}
+
+	{
+		// Layer opacity forces blending, hidden layers draw nothing.
+		TileMap faded(uvec2(TileSize), ChunkTiles);
+		faded.add_layer(uvec2(MapWidth, MapHeight), tiles, 2.0f, ivec2(0), 0.5f);
+		std::vector<TileMap::ChunkBatch> batches;
+		faded.get_visible_batches(vec2(0.0f), vec2(320.0f), batches);
+		check(!batches.empty(), "Faded layer drew nothing.");
+		for (auto &batch : batches)
+			check(batch.pipeline == DrawPipeline::AlphaBlend && batch.quads[0].color[3] == 128, "Faded layer not blended.");
+
+		faded.set_layer_visible(0, false);
+		faded.get_visible_batches(vec2(0.0f), vec2(320.0f), batches);
+		check(batches.empty(), "Hidden layer drew tiles.");
+	}
+
+	LOGI("All tilemap tests passed.\n");
+}
@@ -0,0 +1,191 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "triangle_bvh.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <math.h>
+#include <random>
+#include <vector>
+
+using namespace Granite;
+
+// Terrain-like collision mesh, roughly the size of a large level.
+static constexpr unsigned GridSize = 512;
+static constexpr unsigned NumRays = 1 << 20;
+static constexpr unsigned Iterations = 3;
+
+struct Mesh
+{
+	std::vector<vec4> positions;
+	std::vector<uint32_t> indices;
+};
+
+static Mesh build_terrain()
+{
+	Mesh mesh;
+	for (unsigned y = 0; y <= GridSize; y++)
+	{
+		for (unsigned x = 0; x <= GridSize; x++)
+		{
+			float fx = float(x), fy = float(y);
+			float h = 8.0f * sinf(fx * 0.031f) * cosf(fy * 0.027f) + 1.5f * sinf(fx * 0.21f + fy * 0.17f);
+			mesh.positions.emplace_back(fx, h, fy, 1.0f);
+		}
+	}
+
+	for (unsigned y = 0; y < GridSize; y++)
+	{
+		for (unsigned x = 0; x < GridSize; x++)
+		{
+			uint32_t i = y * (GridSize + 1) + x;
+			uint32_t quad[6] = { i, i + GridSize + 1, i + 1, i + 1, i + GridSize + 1, i + GridSize + 2 };
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+	return mesh;
+}
+
+// Pinhole camera looking down at the terrain, rays in scanline order.
+static std::vector<TriangleBVH::Ray> build_coherent_rays()
+{
+	std::vector<TriangleBVH::Ray> rays(NumRays);
+	unsigned width = 1024;
+	unsigned height = NumRays / width;
+	vec3 origin(-50.0f, 60.0f, -50.0f);
+	vec3 forward = normalize(vec3(GridSize * 0.5f, 0.0f, GridSize * 0.5f) - origin);
+	vec3 right = normalize(cross(forward, vec3(0.0f, 1.0f, 0.0f)));
+	vec3 up = cross(right, forward);
+
+	for (unsigned y = 0; y < height; y++)
+	{
+		for (unsigned x = 0; x < width; x++)
+		{
+			float u = (float(x) + 0.5f) / float(width) * 2.0f - 1.0f;
+			float v = (float(y) + 0.5f) / float(height) * 2.0f - 1.0f;
+			auto &ray = rays[y * width + x];
+			ray.origin = origin;
+			ray.direction = normalize(forward + 0.6f * u * right + 0.6f * v * up);
+			ray.tmax = 10000.0f;
+		}
+	}
+	return rays;
+}
+
+// Short random probes, e.g. line of sight checks or AI sensors.
+static std::vector<TriangleBVH::Ray> build_incoherent_rays()
+{
+	std::mt19937 rnd(42);
+	std::uniform_real_distribution<float> pos(0.0f, float(GridSize));
+	std::uniform_real_distribution<float> dir(-1.0f, 1.0f);
+	std::vector<TriangleBVH::Ray> rays(NumRays);
+	for (auto &ray : rays)
+	{
+		ray.origin = vec3(pos(rnd), 20.0f, pos(rnd));
+		ray.direction = normalize(vec3(dir(rnd), -1.0f, dir(rnd)));
+		ray.tmax = 100.0f;
+	}
+	return rays;
+}
+
+template <typename Func>
+static double measure_ms(const Func &func)
+{
+	double total = 0.0;
+	for (unsigned i = 0; i < Iterations; i++)
+	{
+		auto start = Util::get_current_time_nsecs();
+		func();
+		total += double(Util::get_current_time_nsecs() - start);
+	}
+	return 1e-6 * total / Iterations;
+}
+
+static void bench_rays(const char *tag, const TriangleBVH &bvh, const std::vector<TriangleBVH::Ray> &rays)
+{
+	std::vector<TriangleBVH::Hit> hits(rays.size());
+
+	double single_ms = measure_ms([&]() {
+		for (size_t i = 0; i < rays.size(); i++)
+			bvh.raycast(rays[i], hits[i]);
+	});
+
+	double stream_ms = measure_ms([&]() {
+		bvh.raycast(rays.data(), hits.data(), rays.size());
+	});
+
+	size_t num_hits = 0;
+	for (auto &hit : hits)
+		if (hit.triangle != TriangleBVH::InvalidTriangle)
+			num_hits++;
+
+	double mrays = 1e-3 * double(rays.size());
+	LOGI("%-12s single: %7.2f Mrays/s, stream: %7.2f Mrays/s (%.1f %% hit).\n", tag,
+	     mrays / single_ms, mrays / stream_ms, 100.0 * double(num_hits) / double(hits.size()));
+}
+
+int main()
+{
+	auto mesh = build_terrain();
+	size_t num_triangles = mesh.indices.size() / 3;
+	LOGI("Terrain: %zu triangles.\n", num_triangles);
+
+	TriangleBVH bvh;
+	TriangleBVH::BuildOptions options;
+	options.num_threads = 1;
+	double serial_ms = measure_ms([&]() {
+		bvh.build(mesh.positions.data(), mesh.indices.data(), num_triangles, options);
+	});
+
+	options.num_threads = 0;
+	double parallel_ms = measure_ms([&]() {
+		bvh.build(mesh.positions.data(), mesh.indices.data(), num_triangles, options);
+	});
+
+	LOGI("Build: %.2f ms serial, %.2f ms parallel, %zu nodes, depth %u.\n",
+	     serial_ms, parallel_ms, bvh.get_node_count(), bvh.get_depth());
+
+	auto animated = mesh.positions;
+	for (auto &p : animated)
+		p.y += 0.5f * sinf(p.x * 0.1f);
+	double refit_ms = measure_ms([&]() {
+		bvh.refit(animated.data());
+	});
+	LOGI("Refit: %.2f ms.\n", refit_ms);
+	bvh.refit(mesh.positions.data());
+
+	bench_rays("Coherent", bvh, build_coherent_rays());
+	bench_rays("Incoherent", bvh, build_incoherent_rays());
+
+	std::vector<uint32_t> result;
+	std::mt19937 rnd(5);
+	std::uniform_real_distribution<float> pos(0.0f, float(GridSize));
+	double sphere_ms = measure_ms([&]() {
+		for (unsigned i = 0; i < 100000; i++)
+		{
+			result.clear();
+			bvh.query_sphere(vec3(pos(rnd), 0.0f, pos(rnd)), 2.0f, result);
+		}
+	});
+	LOGI("Sphere queries: %.2f M/s.\n", 0.1 / (1e-3 * sphere_ms));
+}
@@ -0,0 +1,340 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "triangle_bvh.hpp"
+#include "logging.hpp"
+#include <stdlib.h>
+#include <float.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace Granite;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+struct Mesh
+{
+	std::vector<vec4> positions;
+	std::vector<uint32_t> indices;
+};
+
+static Mesh build_soup(std::mt19937 &rnd, unsigned count)
+{
+	std::uniform_real_distribution<float> pos(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+	Mesh mesh;
+	for (unsigned i = 0; i < count; i++)
+	{
+		vec3 center(pos(rnd), pos(rnd), pos(rnd));
+		for (unsigned j = 0; j < 3; j++)
+		{
+			mesh.indices.push_back(uint32_t(mesh.positions.size()));
+			mesh.positions.emplace_back(center + vec3(offset(rnd), offset(rnd), offset(rnd)), 1.0f);
+		}
+	}
+	return mesh;
+}
+
+// Shared vertices and many coplanar, axis aligned triangles, which stresses degenerate splits.
+static Mesh build_grid(unsigned size)
+{
+	Mesh mesh;
+	for (unsigned y = 0; y <= size; y++)
+		for (unsigned x = 0; x <= size; x++)
+			mesh.positions.emplace_back(float(x), 0.0f, float(y), 1.0f);
+
+	for (unsigned y = 0; y < size; y++)
+	{
+		for (unsigned x = 0; x < size; x++)
+		{
+			uint32_t i = y * (size + 1) + x;
+			uint32_t quad[6] = { i, i + size + 1, i + 1, i + 1, i + size + 1, i + size + 2 };
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+	return mesh;
+}
+
+static bool brute_force_ray(const Mesh &mesh, const TriangleBVH::Ray &ray, TriangleBVH::Hit &hit)
+{
+	hit.t = ray.tmax;
+	hit.triangle = TriangleBVH::InvalidTriangle;
+	for (size_t i = 0; i < mesh.indices.size() / 3; i++)
+	{
+		vec3 a = mesh.positions[mesh.indices[3 * i + 0]].xyz();
+		vec3 e1 = mesh.positions[mesh.indices[3 * i + 1]].xyz() - a;
+		vec3 e2 = mesh.positions[mesh.indices[3 * i + 2]].xyz() - a;
+		vec3 p = cross(ray.direction, e2);
+		float det = dot(e1, p);
+		if (std::abs(det) < 1e-20f)
+			continue;
+		vec3 s = ray.origin - a;
+		float u = dot(s, p) / det;
+		vec3 q = cross(s, e1);
+		float v = dot(ray.direction, q) / det;
+		float t = dot(e2, q) / det;
+		if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < hit.t)
+		{
+			hit.t = t;
+			hit.triangle = uint32_t(i);
+		}
+	}
+	return hit.triangle != TriangleBVH::InvalidTriangle;
+}
+
+static bool same_hit(const TriangleBVH::Hit &a, const TriangleBVH::Hit &b)
+{
+	if ((a.triangle == TriangleBVH::InvalidTriangle) != (b.triangle == TriangleBVH::InvalidTriangle))
+		return false;
+	if (a.triangle == TriangleBVH::InvalidTriangle)
+		return true;
+	// Rays through shared edges can legitimately report either triangle.
+	return std::abs(a.t - b.t) <= 1e-4f * std::max(1.0f, std::abs(a.t));
+}
+
+static std::vector<TriangleBVH::Ray> generate_rays(std::mt19937 &rnd, unsigned count, vec3 target_lo, vec3 target_hi)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<TriangleBVH::Ray> rays(count);
+	for (auto &ray : rays)
+	{
+		vec3 origin = mix(target_lo, target_hi, vec3(unit(rnd), unit(rnd), unit(rnd))) * 2.0f;
+		vec3 target = mix(target_lo, target_hi, vec3(unit(rnd), unit(rnd), unit(rnd)));
+		ray.origin = origin;
+		ray.direction = normalize(target - origin);
+		ray.tmax = unit(rnd) < 0.1f ? 1.0f : 1000.0f;
+	}
+
+	// Axis aligned directions, exercising the zero component handling.
+	for (unsigned i = 0; i < count / 16; i++)
+	{
+		rays[i].direction = vec3(0.0f);
+		rays[i].direction[i % 3] = i & 4 ? -1.0f : 1.0f;
+	}
+	return rays;
+}
+
+static void test_raycast(const Mesh &mesh, const TriangleBVH &bvh, std::mt19937 &rnd)
+{
+	auto bounds = bvh.get_bounds();
+	auto rays = generate_rays(rnd, 2003, bounds.get_minimum(), bounds.get_maximum());
+	std::vector<TriangleBVH::Hit> stream_hits(rays.size());
+	bvh.raycast(rays.data(), stream_hits.data(), rays.size());
+
+	unsigned num_hits = 0;
+	for (size_t i = 0; i < rays.size(); i++)
+	{
+		TriangleBVH::Hit reference, hit;
+		bool expected = brute_force_ray(mesh, rays[i], reference);
+		check(bvh.raycast(rays[i], hit) == expected, "Closest hit mismatch.");
+		check(same_hit(hit, reference), "Closest hit distance mismatch.");
+		check(same_hit(stream_hits[i], reference), "Ray stream hit mismatch.");
+		check(bvh.raycast_any(rays[i]) == expected, "Any hit mismatch.");
+		if (expected)
+		{
+			num_hits++;
+			vec3 a = mesh.positions[mesh.indices[3 * hit.triangle + 0]].xyz();
+			vec3 b = mesh.positions[mesh.indices[3 * hit.triangle + 1]].xyz();
+			vec3 c = mesh.positions[mesh.indices[3 * hit.triangle + 2]].xyz();
+			vec3 p = a * (1.0f - hit.u - hit.v) + b * hit.u + c * hit.v;
+			vec3 expected_p = rays[i].origin + rays[i].direction * hit.t;
+			check(distance(p, expected_p) < 1e-3f, "Barycentrics do not match hit point.");
+		}
+	}
+
+	check(num_hits > 0 && num_hits < rays.size(), "Expected a mix of hits and misses.");
+}
+
+static float distance_sq_triangle(vec3 p, vec3 a, vec3 b, vec3 c)
+{
+	// Brute force by sampling is too imprecise, use distance to plane + edges instead.
+	vec3 n = normalize(cross(b - a, c - a));
+	vec3 proj = p - n * dot(p - a, n);
+	vec3 v0 = b - a, v1 = c - a, v2 = proj - a;
+	float d00 = dot(v0, v0), d01 = dot(v0, v1), d11 = dot(v1, v1);
+	float d20 = dot(v2, v0), d21 = dot(v2, v1);
+	float denom = d00 * d11 - d01 * d01;
+	float v = (d11 * d20 - d01 * d21) / denom;
+	float w = (d00 * d21 - d01 * d20) / denom;
+	if (v >= 0.0f && w >= 0.0f && v + w <= 1.0f)
+		return dot(p - proj, p - proj);
+
+	auto segment = [&](vec3 x, vec3 y) {
+		vec3 d = y - x;
+		float t = clamp(dot(p - x, d) / dot(d, d), 0.0f, 1.0f);
+		vec3 q = x + d * t - p;
+		return dot(q, q);
+	};
+	return std::min(std::min(segment(a, b), segment(b, c)), segment(c, a));
+}
+
+static void test_overlap(const Mesh &mesh, const TriangleBVH &bvh, std::mt19937 &rnd)
+{
+	auto bounds = bvh.get_bounds();
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<uint32_t> result;
+	size_t num_triangles = mesh.indices.size() / 3;
+	unsigned total_found = 0;
+
+	for (unsigned iter = 0; iter < 100; iter++)
+	{
+		vec3 center = mix(bounds.get_minimum(), bounds.get_maximum(), vec3(unit(rnd), unit(rnd), unit(rnd)));
+		float radius = 0.1f + 2.0f * unit(rnd);
+
+		result.clear();
+		bvh.query_sphere(center, radius, result);
+		std::sort(result.begin(), result.end());
+		check(std::unique(result.begin(), result.end()) == result.end(), "Duplicate sphere result.");
+
+		for (size_t i = 0; i < num_triangles; i++)
+		{
+			vec3 a = mesh.positions[mesh.indices[3 * i + 0]].xyz();
+			vec3 b = mesh.positions[mesh.indices[3 * i + 1]].xyz();
+			vec3 c = mesh.positions[mesh.indices[3 * i + 2]].xyz();
+			float d = std::sqrt(distance_sq_triangle(center, a, b, c));
+			bool found = std::binary_search(result.begin(), result.end(), uint32_t(i));
+			// Ignore borderline cases.
+			if (std::abs(d - radius) > 1e-3f)
+				check(found == (d < radius), "Sphere query mismatch.");
+		}
+		total_found += unsigned(result.size());
+
+		vec3 extent = vec3(unit(rnd), unit(rnd), unit(rnd)) * 2.0f;
+		AABB aabb(center - extent, center + extent);
+		result.clear();
+		bvh.query_aabb(aabb, result);
+		std::sort(result.begin(), result.end());
+		check(std::unique(result.begin(), result.end()) == result.end(), "Duplicate AABB result.");
+
+		// Every triangle with a vertex strictly inside the box must be reported,
+		// and every reported triangle must at least overlap the box bounds.
+		for (size_t i = 0; i < num_triangles; i++)
+		{
+			bool found = std::binary_search(result.begin(), result.end(), uint32_t(i));
+			vec3 lo(FLT_MAX), hi(-FLT_MAX);
+			bool vertex_inside = false;
+			for (unsigned k = 0; k < 3; k++)
+			{
+				vec3 p = mesh.positions[mesh.indices[3 * i + k]].xyz();
+				lo = min(lo, p);
+				hi = max(hi, p);
+				if (all(greaterThan(p, aabb.get_minimum())) && all(lessThan(p, aabb.get_maximum())))
+					vertex_inside = true;
+			}
+
+			if (vertex_inside)
+				check(found, "AABB query missed triangle.");
+			if (found)
+			{
+				check(all(lessThanEqual(lo, aabb.get_maximum())) && all(greaterThanEqual(hi, aabb.get_minimum())),
+				      "AABB query reported disjoint triangle.");
+			}
+
+			// The box contains the sphere of radius min(extent), so those triangles must also be found.
+			vec3 a = mesh.positions[mesh.indices[3 * i + 0]].xyz();
+			vec3 b = mesh.positions[mesh.indices[3 * i + 1]].xyz();
+			vec3 c = mesh.positions[mesh.indices[3 * i + 2]].xyz();
+			float inner = std::min(std::min(extent.x, extent.y), extent.z);
+			if (std::sqrt(distance_sq_triangle(center, a, b, c)) < inner - 1e-3f)
+				check(found, "AABB query missed triangle inside inscribed sphere.");
+		}
+	}
+
+	check(total_found > 0, "Overlap queries found nothing.");
+}
+
+static void test_build_determinism(const Mesh &mesh)
+{
+	TriangleBVH serial, parallel;
+	TriangleBVH::BuildOptions options;
+	options.num_threads = 1;
+	serial.build(mesh.positions.data(), mesh.indices.data(), mesh.indices.size() / 3, options);
+	options.num_threads = 8;
+	parallel.build(mesh.positions.data(), mesh.indices.data(), mesh.indices.size() / 3, options);
+
+	check(serial.get_node_count() == parallel.get_node_count(), "Node count differs between serial and parallel build.");
+	check(serial.get_depth() == parallel.get_depth(), "Depth differs between serial and parallel build.");
+
+	std::mt19937 rnd(7);
+	auto bounds = serial.get_bounds();
+	auto rays = generate_rays(rnd, 1000, bounds.get_minimum(), bounds.get_maximum());
+	for (auto &ray : rays)
+	{
+		TriangleBVH::Hit a, b;
+		serial.raycast(ray, a);
+		parallel.raycast(ray, b);
+		check(a.triangle == b.triangle && a.t == b.t, "Serial and parallel builds disagree.");
+	}
+}
+
+static void test_refit(Mesh mesh, std::mt19937 &rnd)
+{
+	TriangleBVH bvh;
+	bvh.build(mesh.positions.data(), mesh.indices.data(), mesh.indices.size() / 3);
+	size_t node_count = bvh.get_node_count();
+
+	// Deform the mesh, refit and make sure queries reflect the new positions.
+	for (auto &p : mesh.positions)
+		p = vec4(p.x * 1.5f, p.y + 0.25f * std::sin(p.x), p.z - 3.0f, 1.0f);
+	bvh.refit(mesh.positions.data());
+
+	check(bvh.get_node_count() == node_count, "Refit changed topology.");
+	test_raycast(mesh, bvh, rnd);
+	test_overlap(mesh, bvh, rnd);
+}
+
+int main()
+{
+	std::mt19937 rnd(1337);
+
+	TriangleBVH empty;
+	empty.build(nullptr, nullptr, 0);
+	TriangleBVH::Hit hit;
+	check(!empty.raycast({ vec3(0.0f), vec3(0.0f, 0.0f, 1.0f), 100.0f }, hit), "Empty BVH reported hit.");
+	check(hit.triangle == TriangleBVH::InvalidTriangle, "Empty BVH returned triangle.");
+
+	auto soup = build_soup(rnd, 3000);
+	TriangleBVH soup_bvh;
+	soup_bvh.build(soup.positions.data(), soup.indices.data(), soup.indices.size() / 3);
+	test_raycast(soup, soup_bvh, rnd);
+	test_overlap(soup, soup_bvh, rnd);
+
+	auto grid = build_grid(40);
+	TriangleBVH grid_bvh;
+	grid_bvh.build(grid.positions.data(), grid.indices.data(), grid.indices.size() / 3);
+	test_raycast(grid, grid_bvh, rnd);
+	test_overlap(grid, grid_bvh, rnd);
+
+	test_build_determinism(build_soup(rnd, 40000));
+	test_refit(soup, rnd);
+
+	LOGI("All triangle BVH tests passed.\n");
+}
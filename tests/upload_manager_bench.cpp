@@ -0,0 +1,175 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "global_managers_init.hpp"
+#include "filesystem.hpp"
+#include "device.hpp"
+#include "context.hpp"
+#include "upload_manager.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <vector>
+#include <random>
+
+using namespace Granite;
+using namespace Vulkan;
+
+// Roughly what a large glTF scene looks like: many small vertex and index buffers.
+static constexpr unsigned NumMeshes = 4000;
+static constexpr unsigned MeshesPerFrame = 500;
+static constexpr unsigned Iterations = 5;
+
+struct Scene
+{
+	std::vector<std::vector<uint8_t>> buffers;
+};
+
+static Scene build_scene()
+{
+	Scene scene;
+	std::mt19937 rnd(1234);
+	std::uniform_int_distribution<unsigned> dist(1, 64);
+	scene.buffers.resize(NumMeshes);
+	for (auto &buffer : scene.buffers)
+		buffer.resize(dist(rnd) * 1024, 0xaa);
+	return scene;
+}
+
+static BufferCreateInfo mesh_info(size_t size)
+{
+	BufferCreateInfo info = {};
+	info.domain = BufferDomain::Device;
+	info.size = size;
+	info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	return info;
+}
+
+static double load_direct(Device &device, const Scene &scene)
+{
+	std::vector<BufferHandle> handles;
+	handles.reserve(scene.buffers.size());
+
+	auto start_time = Util::get_current_time_nsecs();
+	for (size_t i = 0; i < scene.buffers.size(); i++)
+	{
+		auto &data = scene.buffers[i];
+		handles.push_back(device.create_buffer(mesh_info(data.size()), data.data()));
+		if ((i + 1) % MeshesPerFrame == 0)
+			device.next_frame_context();
+	}
+	device.next_frame_context();
+	device.wait_idle();
+	return double(Util::get_current_time_nsecs() - start_time);
+}
+
+static double load_batched(Device &device, const Scene &scene, VkDeviceSize budget, unsigned *frames)
+{
+	std::vector<BufferHandle> handles;
+	handles.reserve(scene.buffers.size());
+
+	auto start_time = Util::get_current_time_nsecs();
+	{
+		UploadManager uploads(device);
+		uploads.set_frame_budget(budget);
+		*frames = 0;
+
+		for (size_t i = 0; i < scene.buffers.size(); i++)
+		{
+			auto &data = scene.buffers[i];
+			handles.push_back(uploads.create_buffer(mesh_info(data.size()), data.data()));
+			if ((i + 1) % MeshesPerFrame == 0)
+			{
+				uploads.flush();
+				device.next_frame_context();
+				(*frames)++;
+			}
+		}
+
+		while (uploads.has_pending_uploads())
+		{
+			uploads.flush();
+			device.next_frame_context();
+			(*frames)++;
+		}
+		device.wait_idle();
+	}
+	return double(Util::get_current_time_nsecs() - start_time);
+}
+
+static int main_inner()
+{
+	// Only CPU overhead is interesting here, so keep the GPU side of each frame trivial.
+	if (!Context::init_loader(nullptr))
+		return EXIT_FAILURE;
+
+	Context ctx;
+	Context::SystemHandles handles;
+	handles.filesystem = GRANITE_FILESYSTEM();
+	handles.thread_group = GRANITE_THREAD_GROUP();
+	ctx.set_system_handles(handles);
+	if (!ctx.init_instance_and_device(nullptr, 0, nullptr, 0))
+		return EXIT_FAILURE;
+
+	Device device;
+	device.set_context(ctx);
+
+	auto scene = build_scene();
+	size_t total_bytes = 0;
+	for (auto &buffer : scene.buffers)
+		total_bytes += buffer.size();
+	LOGI("Scene: %u buffers, %.1f MiB.\n", NumMeshes, double(total_bytes) / (1024.0 * 1024.0));
+
+	double total_time = 0.0;
+	for (unsigned i = 0; i < Iterations; i++)
+		total_time += load_direct(device, scene);
+	LOGI("%-24s %8.3f ms.\n", "Direct create_buffer", 1e-6 * total_time / Iterations);
+
+	static const struct
+	{
+		const char *tag;
+		VkDeviceSize budget;
+	} scenarios[] = {
+		{ "Batched, no budget", 0 },
+		{ "Batched, 32 MiB/frame", 32 * 1024 * 1024 },
+		{ "Batched, 8 MiB/frame", 8 * 1024 * 1024 },
+	};
+
+	for (auto &scenario : scenarios)
+	{
+		unsigned frames = 0;
+		total_time = 0.0;
+		for (unsigned i = 0; i < Iterations; i++)
+			total_time += load_batched(device, scene, scenario.budget, &frames);
+		LOGI("%-24s %8.3f ms, %u frames.\n", scenario.tag, 1e-6 * total_time / Iterations, frames);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int main()
+{
+	Global::init(Global::MANAGER_FEATURE_DEFAULT_BITS, 1);
+	int ret = main_inner();
+	Global::deinit();
+	return ret;
+}
@@ -0,0 +1,149 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "upload_scheduler.hpp"
+#include "logging.hpp"
+#include <stdlib.h>
+
+using namespace Vulkan;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_packing()
+{
+	UploadScheduler scheduler;
+	scheduler.set_block_size(1024);
+
+	check(scheduler.push(100, 16) == 1, "first ticket");
+	check(scheduler.push(100, 64) == 2, "second ticket");
+	check(scheduler.push(900, 16) == 3, "third ticket");
+	check(scheduler.push(4000, 16) == 4, "fourth ticket");
+	check(scheduler.push(8, 4) == 5, "fifth ticket");
+	check(scheduler.get_pending_bytes() == 5108, "pending bytes");
+
+	UploadScheduler::Batch batch;
+	check(scheduler.schedule(batch), "schedule");
+	check(batch.copies.size() == 5, "everything scheduled without budget");
+	check(batch.bytes == 5108, "batch bytes");
+	check(scheduler.get_pending_count() == 0, "nothing pending");
+
+	// 1 and 2 share a block with alignment, 3 spills to a new block,
+	// 4 gets a dedicated block and 5 keeps filling the block 3 started.
+	check(batch.block_sizes.size() == 3, "block count");
+	check(batch.block_sizes[0] == 1024 && batch.block_sizes[1] == 1024, "regular blocks");
+	check(batch.block_sizes[2] == 4000, "dedicated block");
+
+	check(batch.copies[0].block == 0 && batch.copies[0].offset == 0, "copy 1");
+	check(batch.copies[1].block == 0 && batch.copies[1].offset == 128, "copy 2 aligned");
+	check(batch.copies[2].block == 1 && batch.copies[2].offset == 0, "copy 3");
+	check(batch.copies[3].block == 2 && batch.copies[3].offset == 0, "copy 4");
+	check(batch.copies[4].block == 1 && batch.copies[4].offset == 900, "copy 5");
+
+	for (unsigned i = 0; i < 5; i++)
+		check(batch.copies[i].ticket == i + 1, "tickets in order");
+
+	check(!scheduler.schedule(batch), "empty schedule");
+	check(batch.copies.empty() && batch.block_sizes.empty(), "empty batch is cleared");
+}
+
+static void test_budget()
+{
+	UploadScheduler scheduler;
+	scheduler.set_block_size(1024);
+	scheduler.set_frame_budget(256);
+
+	for (unsigned i = 0; i < 10; i++)
+		scheduler.push(100, 4);
+	scheduler.push(1000, 4);
+	scheduler.push(10, 4);
+
+	UploadScheduler::Batch batch;
+	unsigned frames = 0;
+	unsigned expected_counts[] = { 2, 2, 2, 2, 2, 1, 1 };
+	while (scheduler.schedule(batch))
+	{
+		check(frames < 7, "frame count");
+		check(batch.copies.size() == expected_counts[frames], "copies per frame");
+		// The 1000 byte upload goes out alone, even if it is above budget.
+		check(batch.bytes <= 256 || batch.copies.size() == 1, "budget respected");
+		check(scheduler.is_scheduled(batch.copies.back().ticket), "ticket scheduled");
+		if (scheduler.get_pending_count())
+			check(!scheduler.is_scheduled(batch.copies.back().ticket + 1), "next ticket not scheduled");
+		frames++;
+	}
+	check(frames == 7, "all frames");
+	check(scheduler.get_pending_bytes() == 0, "all bytes scheduled");
+}
+
+static void test_required()
+{
+	UploadScheduler scheduler;
+	scheduler.set_block_size(1024);
+	scheduler.set_frame_budget(256);
+
+	scheduler.push(200, 4);
+	uint64_t required = scheduler.push(200, 4, true);
+	scheduler.push(200, 4);
+	check(scheduler.has_required_uploads(), "required upload pending");
+
+	// Everything up to the required upload goes out, regardless of budget.
+	UploadScheduler::Batch batch;
+	check(scheduler.schedule_required(batch), "schedule required");
+	check(batch.copies.size() == 2 && batch.bytes == 400, "required batch");
+	check(scheduler.is_scheduled(required), "required ticket scheduled");
+	check(!scheduler.is_scheduled(required + 1), "deferred ticket not scheduled");
+	check(!scheduler.has_required_uploads(), "no required uploads left");
+	check(!scheduler.schedule_required(batch), "nothing more required");
+
+	// Required uploads used up this frame's budget, so the frame flush defers the rest.
+	check(!scheduler.schedule(batch), "budget spent by required uploads");
+	check(scheduler.get_pending_count() == 1, "deferred upload still pending");
+
+	// The next frame has a fresh budget.
+	check(scheduler.schedule(batch), "next frame");
+	check(batch.copies.size() == 1 && batch.copies[0].ticket == required + 1, "deferred upload");
+
+	// Partially spent budgets are honored, and do not allow overshooting.
+	scheduler.push(100, 4, true);
+	scheduler.push(100, 4);
+	scheduler.push(100, 4);
+	check(scheduler.schedule_required(batch) && batch.bytes == 100, "required within frame");
+	check(scheduler.schedule(batch) && batch.copies.size() == 1, "remaining budget");
+	check(scheduler.schedule(batch) && batch.copies.size() == 1, "last upload next frame");
+	check(scheduler.get_pending_count() == 0, "all scheduled");
+}
+
+int main()
+{
+	test_packing();
+	test_budget();
+	test_required();
+	LOGI("All upload scheduler tests passed.\n");
+}
@@ -0,0 +1,169 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "scene_formats.hpp"
+#include "thread_group.hpp"
+#include "global_managers_init.hpp"
+#include "global_managers.hpp"
+#include "logging.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace Granite;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond)
+	{
+		LOGE("Check failed: %s\n", what);
+		exit(EXIT_FAILURE);
+	}
+}
+
+// Builds a mesh where vertices are drawn from a smaller pool, so many vertices are duplicated.
+// Pool entries use few distinct byte values, so near-identical vertices are common too.
+static SceneFormats::Mesh build_mesh(std::mt19937 &rnd, unsigned count,
+                                     uint32_t position_stride, uint32_t attribute_stride)
+{
+	unsigned pool_size = count / 3 + 1;
+	std::vector<uint8_t> pool(pool_size * (position_stride + attribute_stride));
+	for (auto &b : pool)
+		b = uint8_t(rnd() & 3);
+
+	SceneFormats::Mesh mesh;
+	mesh.position_stride = position_stride;
+	mesh.attribute_stride = attribute_stride;
+	mesh.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	mesh.count = count;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		auto *src = pool.data() + (rnd() % pool_size) * (position_stride + attribute_stride);
+		mesh.positions.insert(mesh.positions.end(), src, src + position_stride);
+		if (attribute_stride)
+			mesh.attributes.insert(mesh.attributes.end(), src + position_stride, src + position_stride + attribute_stride);
+	}
+
+	return mesh;
+}
+
+static SceneFormats::VertexRemap build_reference_remap(const SceneFormats::Mesh &mesh)
+{
+	std::map<std::vector<uint8_t>, uint32_t> unique;
+	SceneFormats::VertexRemap remap;
+	size_t count = mesh.positions.size() / mesh.position_stride;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		std::vector<uint8_t> key(mesh.positions.begin() + i * mesh.position_stride,
+		                         mesh.positions.begin() + (i + 1) * mesh.position_stride);
+		if (!mesh.attributes.empty())
+		{
+			key.insert(key.end(), mesh.attributes.begin() + i * mesh.attribute_stride,
+			           mesh.attributes.begin() + (i + 1) * mesh.attribute_stride);
+		}
+
+		auto itr = unique.find(key);
+		if (itr == unique.end())
+		{
+			uint32_t id = uint32_t(remap.unique_attrib_to_source_index.size());
+			unique[key] = id;
+			remap.index_remap.push_back(id);
+			remap.unique_attrib_to_source_index.push_back(uint32_t(i));
+		}
+		else
+			remap.index_remap.push_back(itr->second);
+	}
+
+	return remap;
+}
+
+static bool equal_remap(const SceneFormats::VertexRemap &a, const SceneFormats::VertexRemap &b)
+{
+	return a.index_remap == b.index_remap && a.unique_attrib_to_source_index == b.unique_attrib_to_source_index;
+}
+
+static void test_deduplicate(const SceneFormats::Mesh &original)
+{
+	auto mesh = original;
+	SceneFormats::mesh_deduplicate_vertices(mesh);
+
+	size_t unique_count = mesh.positions.size() / mesh.position_stride;
+	check(mesh.index_type == VK_INDEX_TYPE_UINT32, "index type");
+	check(mesh.count == original.count, "index count");
+
+	auto *indices = reinterpret_cast<const uint32_t *>(mesh.indices.data());
+	for (unsigned i = 0; i < mesh.count; i++)
+	{
+		check(indices[i] < unique_count, "index in range");
+		check(memcmp(mesh.positions.data() + indices[i] * mesh.position_stride,
+		             original.positions.data() + i * original.position_stride,
+		             original.position_stride) == 0, "position preserved");
+		if (original.attribute_stride)
+		{
+			check(memcmp(mesh.attributes.data() + indices[i] * mesh.attribute_stride,
+			             original.attributes.data() + i * original.attribute_stride,
+			             original.attribute_stride) == 0, "attribute preserved");
+		}
+	}
+}
+
+int main()
+{
+	// mesh_deduplicate_vertices() picks up the global thread group.
+	Global::init(Global::MANAGER_FEATURE_THREAD_GROUP_BIT, 4);
+	auto *group = GRANITE_THREAD_GROUP();
+	std::mt19937 rnd(1234);
+
+	static const uint32_t position_strides[] = { 12, 16, 7 };
+	static const uint32_t attribute_strides[] = { 0, 20, 5 };
+	// Covers both the serial path and the parallel path for large meshes.
+	static const unsigned counts[] = { 1, 3000, 200000 };
+
+	for (auto position_stride : position_strides)
+	{
+		for (auto attribute_stride : attribute_strides)
+		{
+			for (auto count : counts)
+			{
+				auto mesh = build_mesh(rnd, count, position_stride, attribute_stride);
+				auto reference = build_reference_remap(mesh);
+				auto serial = SceneFormats::mesh_build_vertex_remap(mesh, nullptr);
+				auto parallel = SceneFormats::mesh_build_vertex_remap(mesh, group);
+
+				check(equal_remap(reference, serial), "serial remap matches reference");
+				check(equal_remap(reference, parallel), "parallel remap matches reference");
+				test_deduplicate(mesh);
+
+				LOGI("Stride %u + %u, %u vertices -> %zu unique.\n", position_stride, attribute_stride, count,
+				     reference.unique_attrib_to_source_index.size());
+			}
+		}
+	}
+
+	LOGI("All tests passed.\n");
+	Global::deinit();
+}
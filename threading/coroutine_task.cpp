@@ -0,0 +1,198 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "coroutine_task.hpp"
+#include "libco.h"
+#include <vector>
+#include <stdexcept>
+#include <exception>
+#include <assert.h>
+
+namespace Granite
+{
+namespace Internal
+{
+// Deep enough for decoders and parsers running inside asset loading tasks.
+static constexpr unsigned CoroutineStackSize = 256 * 1024;
+
+struct CoroutineFiber
+{
+	cothread_t handle = nullptr;
+	cothread_t caller = nullptr;
+	CoroutineJob *job = nullptr;
+};
+
+static void fiber_entry(void *arg)
+{
+	auto *fiber = static_cast<CoroutineFiber *>(arg);
+	for (;;)
+	{
+		{
+			CoroutineContext ctx(*fiber->job);
+			fiber->job->func(ctx);
+		}
+		fiber->job->complete = true;
+		co_switch(fiber->caller);
+	}
+}
+
+// Fibers can only be resumed on the thread which created them, so pool them per thread.
+struct FiberPool
+{
+	~FiberPool()
+	{
+		for (auto *fiber : fibers)
+		{
+			co_delete(fiber->handle);
+			delete fiber;
+		}
+	}
+
+	CoroutineFiber *allocate()
+	{
+		if (!fibers.empty())
+		{
+			auto *fiber = fibers.back();
+			fibers.pop_back();
+			return fiber;
+		}
+
+		auto *fiber = new CoroutineFiber;
+		fiber->handle = co_create(CoroutineStackSize, fiber_entry, fiber);
+		if (!fiber->handle)
+		{
+			delete fiber;
+			throw std::bad_alloc();
+		}
+		return fiber;
+	}
+
+	void free(CoroutineFiber *fiber)
+	{
+		fibers.push_back(fiber);
+	}
+
+	std::vector<CoroutineFiber *> fibers;
+};
+
+static thread_local FiberPool fiber_pool;
+static thread_local CoroutineJob *suspended_job;
+static thread_local bool suspend_allowed;
+
+bool set_coroutine_suspend_allowed(bool allowed)
+{
+	bool old_allowed = suspend_allowed;
+	suspend_allowed = allowed;
+	return old_allowed;
+}
+
+CoroutineJob *take_suspended_coroutine()
+{
+	auto *job = suspended_job;
+	suspended_job = nullptr;
+	return job;
+}
+
+void run_coroutine_job(CoroutineJob *job)
+{
+	if (!job->fiber)
+	{
+		if (!suspend_allowed)
+		{
+			// Run inline, awaits will block.
+			CoroutineContext ctx(*job);
+			job->func(ctx);
+			delete job;
+			return;
+		}
+
+		job->fiber = fiber_pool.allocate();
+		job->fiber->job = job;
+	}
+
+	auto *fiber = job->fiber;
+	fiber->caller = co_active();
+	co_switch(fiber->handle);
+
+	if (job->complete)
+	{
+		fiber->job = nullptr;
+		fiber_pool.free(fiber);
+		delete job;
+	}
+	else
+	{
+		assert(!suspended_job);
+		suspended_job = job;
+	}
+}
+}
+
+CoroutineContext::CoroutineContext(Internal::CoroutineJob &job_)
+	: job(job_)
+{
+}
+
+bool CoroutineContext::can_suspend() const
+{
+	return job.fiber != nullptr;
+}
+
+void CoroutineContext::await_ready(std::function<bool ()> ready, Internal::CoroutineWakeList &wake_list)
+{
+	if (ready())
+		return;
+
+	job.ready = std::move(ready);
+	job.wake_list = &wake_list;
+	co_switch(job.fiber->caller);
+	job.ready = {};
+	job.wake_list = nullptr;
+}
+
+void CoroutineContext::await(TaskGroup &group)
+{
+	if (!group.flushed)
+		group.flush();
+
+	if (!can_suspend())
+	{
+		group.wait();
+		return;
+	}
+
+	auto *deps = group.deps.get();
+	await_ready([deps]() { return deps->done.is_signalled(); }, deps->coroutine_waiters);
+}
+
+void CoroutineContext::await(TaskSignal &signal, uint64_t count)
+{
+	if (!can_suspend())
+	{
+		signal.wait_until_at_least(count);
+		return;
+	}
+
+	await_ready([&signal, count]() { return signal.get_count() >= count; }, signal.coroutine_waiters);
+}
+}
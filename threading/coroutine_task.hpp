@@ -0,0 +1,105 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "thread_group.hpp"
+#include <functional>
+#include <stdint.h>
+
+namespace Granite
+{
+namespace Internal
+{
+struct CoroutineFiber;
+
+struct CoroutineJob
+{
+	CoroutineJob(ThreadGroup *group_, std::function<void (CoroutineContext &)> func_)
+		: group(group_), func(std::move(func_))
+	{
+	}
+
+	ThreadGroup *group;
+	std::function<void (CoroutineContext &)> func;
+
+	// Set while the job is suspended. The worker thread checks this to decide when to resume,
+	// and is woken up through wake_list whenever the awaited object changes.
+	std::function<bool ()> ready;
+	CoroutineWakeList *wake_list = nullptr;
+	CoroutineFiber *fiber = nullptr;
+	bool complete = false;
+};
+
+// Starts or resumes a job on the calling thread.
+// If the job suspends, it is handed over through take_suspended_coroutine().
+void run_coroutine_job(CoroutineJob *job);
+CoroutineJob *take_suspended_coroutine();
+
+// Only worker threads running tasks from their main loop can suspend.
+// Everywhere else, awaits block. Returns the previous state.
+bool set_coroutine_suspend_allowed(bool allowed);
+}
+
+// Passed to tasks enqueued with enqueue_coroutine_task().
+// Awaiting suspends the task and frees the worker thread to run other tasks.
+// A suspended task is always resumed on the thread it started on.
+class CoroutineContext
+{
+public:
+	explicit CoroutineContext(Internal::CoroutineJob &job);
+
+	void await(TaskGroup &group);
+	void await(TaskSignal &signal, uint64_t count);
+
+	// Runs func as a background task, e.g. for blocking file I/O, and suspends until it completes.
+	template <typename Func>
+	void await_background(Func &&func);
+
+	// Returns false if awaits on this thread will block rather than suspend.
+	bool can_suspend() const;
+
+private:
+	Internal::CoroutineJob &job;
+	void await_ready(std::function<bool ()> ready, Internal::CoroutineWakeList &wake_list);
+};
+
+template <typename Func>
+void CoroutineContext::await_background(Func &&func)
+{
+	auto task = job.group->create_task(std::forward<Func>(func));
+	task->set_desc("coroutine-await-background");
+	if (job.group->get_num_background_threads())
+		task->set_task_class(TaskClass::Background);
+	await(*task);
+}
+
+template <typename Func>
+void ThreadGroup::enqueue_coroutine_task(TaskGroup &group, Func &&func)
+{
+	auto *job = new Internal::CoroutineJob(this, std::forward<Func>(func));
+	enqueue_task(group, [job]() {
+		Internal::run_coroutine_job(job);
+	});
+}
+}
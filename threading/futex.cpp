@@ -0,0 +1,147 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "futex.hpp"
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <limits.h>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
+
+namespace Granite
+{
+namespace Futex
+{
+#if defined(__linux__)
+void wait(std::atomic_uint32_t &value, uint32_t expected)
+{
+	static_assert(sizeof(std::atomic_uint32_t) == sizeof(uint32_t), "Unexpected size of atomic.");
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(&value), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void wake_all(std::atomic_uint32_t &value)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(&value), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+#elif defined(_WIN32)
+void wait(std::atomic_uint32_t &value, uint32_t expected)
+{
+	WaitOnAddress(&value, &expected, sizeof(expected), INFINITE);
+}
+
+void wake_all(std::atomic_uint32_t &value)
+{
+	WakeByAddressAll(&value);
+}
+#else
+namespace
+{
+struct WaitBucket
+{
+	std::mutex lock;
+	std::condition_variable cond;
+};
+}
+
+static WaitBucket &get_bucket(const void *addr)
+{
+	enum { NumBuckets = 64 };
+	static WaitBucket buckets[NumBuckets];
+	auto index = (reinterpret_cast<uintptr_t>(addr) >> 4) % NumBuckets;
+	return buckets[index];
+}
+
+void wait(std::atomic_uint32_t &value, uint32_t expected)
+{
+	auto &bucket = get_bucket(&value);
+	std::unique_lock<std::mutex> holder{bucket.lock};
+	if (value.load(std::memory_order_acquire) == expected)
+		bucket.cond.wait(holder);
+}
+
+void wake_all(std::atomic_uint32_t &value)
+{
+	auto &bucket = get_bucket(&value);
+	std::lock_guard<std::mutex> holder{bucket.lock};
+	bucket.cond.notify_all();
+}
+#endif
+
+AdaptiveSpinner::AdaptiveSpinner()
+{
+	// Spinning on a single core only steals time from the thread we're waiting for.
+	enabled = std::thread::hardware_concurrency() > 1;
+	spin_limit.store(enabled ? MinSpins * 4 : 0, std::memory_order_relaxed);
+}
+
+Event::Event()
+{
+	state.store(Unsignalled, std::memory_order_relaxed);
+}
+
+void Event::signal()
+{
+	if (state.exchange(Signalled, std::memory_order_acq_rel) == Waiting)
+		Futex::wake_all(state);
+}
+
+bool Event::is_signalled() const
+{
+	return state.load(std::memory_order_acquire) == Signalled;
+}
+
+void Event::reset()
+{
+	state.store(Unsignalled, std::memory_order_relaxed);
+}
+
+void Event::wait(AdaptiveSpinner &spinner)
+{
+	if (spinner.spin([this]() { return is_signalled(); }))
+		return;
+
+	for (;;)
+	{
+		uint32_t expected = Unsignalled;
+		if (!state.compare_exchange_strong(expected, Waiting, std::memory_order_acq_rel, std::memory_order_acquire) &&
+		    expected == Signalled)
+		{
+			return;
+		}
+
+		Futex::wait(state, Waiting);
+		if (is_signalled())
+			return;
+	}
+}
+}
+}
@@ -0,0 +1,118 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Granite
+{
+namespace Futex
+{
+// Address based wait / wake.
+// Linux and Android use futex, Windows uses WaitOnAddress,
+// other platforms fall back to a hashed table of condition variables.
+// wait() blocks while value == expected, and can return spuriously.
+void wait(std::atomic_uint32_t &value, uint32_t expected);
+void wake_all(std::atomic_uint32_t &value);
+
+static inline void cpu_relax()
+{
+#ifdef __SSE2__
+	_mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ volatile("yield");
+#endif
+}
+
+// Tracks how long spinning tends to take before a condition is satisfied,
+// similar to adaptive mutexes. If spinning never pays off, the spin budget decays towards zero
+// and waiters go straight to sleep.
+class AdaptiveSpinner
+{
+public:
+	AdaptiveSpinner();
+
+	template <typename Pred>
+	bool spin(const Pred &pred)
+	{
+		if (!enabled)
+			return pred();
+
+		uint32_t limit = spin_limit.load(std::memory_order_relaxed);
+		// Always probe a little so we can recover from a decayed estimate.
+		uint32_t max_spins = 2 * limit + MinSpins;
+		if (max_spins > MaxSpins)
+			max_spins = MaxSpins;
+
+		for (uint32_t i = 0; i < max_spins; i++)
+		{
+			if (pred())
+			{
+				update(limit, i);
+				return true;
+			}
+			cpu_relax();
+		}
+
+		update(limit, limit > 0 ? limit - 1 : 0);
+		return pred();
+	}
+
+private:
+	enum { MinSpins = 16, MaxSpins = 4096 };
+	std::atomic_uint32_t spin_limit;
+	bool enabled;
+
+	void update(uint32_t limit, uint32_t observed)
+	{
+		// Moving average, like glibc's adaptive mutex.
+		int32_t delta = (int32_t(observed) - int32_t(limit)) / 8;
+		if (delta != 0)
+			spin_limit.store(uint32_t(int32_t(limit) + delta), std::memory_order_relaxed);
+	}
+};
+
+// One-shot event. Signalling when nobody is waiting is a single atomic exchange.
+class Event
+{
+public:
+	Event();
+	void signal();
+	void wait(AdaptiveSpinner &spinner);
+	bool is_signalled() const;
+
+	// Not thread-safe, only reset when there cannot be any waiters.
+	void reset();
+
+private:
+	enum { Unsignalled = 0, Waiting = 1, Signalled = 2 };
+	std::atomic_uint32_t state;
+};
+}
+}
@@ -0,0 +1,80 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "parallel_for.hpp"
+#include <algorithm>
+
+namespace Granite
+{
+// Aim for chunks which take roughly this long to execute.
+// Task dispatch overhead is on the order of a microsecond, so this keeps overhead in the low percentages.
+static constexpr int64_t TargetChunkNsecs = 50000;
+// Before anything is measured, assume chunks of this many items are reasonable.
+static constexpr size_t DefaultGrainSize = 256;
+// Over-split slightly so that imbalanced chunks even out.
+static constexpr unsigned ChunksPerThread = 2;
+
+ParallelCostEstimator::ParallelCostEstimator()
+{
+	cost_per_item.store(0, std::memory_order_relaxed);
+}
+
+double ParallelCostEstimator::get_nsecs_per_item() const
+{
+	return double(cost_per_item.load(std::memory_order_relaxed)) / 256.0;
+}
+
+void ParallelCostEstimator::record(size_t items, int64_t nsecs)
+{
+	if (items == 0 || nsecs <= 0)
+		return;
+
+	uint64_t observed = (uint64_t(nsecs) * 256) / items;
+	uint64_t current = cost_per_item.load(std::memory_order_relaxed);
+
+	// Racy read-modify-write is fine, this is just a heuristic.
+	if (current == 0)
+		current = observed;
+	else
+		current = current - (current >> 3) + (observed >> 3);
+	cost_per_item.store(std::max<uint64_t>(current, 1), std::memory_order_relaxed);
+}
+
+unsigned ParallelCostEstimator::compute_num_chunks(const ThreadGroup &group, size_t count, unsigned max_chunks) const
+{
+	if (max_chunks <= 1 || count == 0)
+		return 1;
+
+	size_t grain = DefaultGrainSize;
+	uint64_t cost = cost_per_item.load(std::memory_order_relaxed);
+	if (cost != 0)
+		grain = std::max<size_t>(size_t((uint64_t(TargetChunkNsecs) * 256) / cost), 1);
+
+	// Threads waiting for the stage can help execute chunks, so count the calling thread as well.
+	size_t max_useful_chunks = size_t(group.get_num_foreground_threads() + 1) * ChunksPerThread;
+	size_t num_chunks = (count + grain - 1) / grain;
+	num_chunks = std::min<size_t>(num_chunks, max_useful_chunks);
+	num_chunks = std::min<size_t>(num_chunks, max_chunks);
+	return unsigned(std::max<size_t>(num_chunks, 1));
+}
+}
@@ -0,0 +1,231 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "task_composer.hpp"
+#include "timer.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Data-parallel helpers which split an index range into chunks and enqueue them as
+// a pipeline stage of a TaskComposer.
+
+namespace Granite
+{
+struct ParallelChunk
+{
+	size_t begin;
+	size_t end;
+	// Chunk index can be used to address per-chunk scratch data, e.g. one VisibilityList per chunk.
+	unsigned index;
+	unsigned count;
+};
+
+// Keeps a running estimate of the cost per item for a particular loop.
+// Used to pick a grain size which is large enough to amortize task overhead,
+// but small enough to spread work over all worker threads.
+// Typically one estimator is kept per call site.
+class ParallelCostEstimator
+{
+public:
+	ParallelCostEstimator();
+
+	unsigned compute_num_chunks(const ThreadGroup &group, size_t count, unsigned max_chunks) const;
+	void record(size_t items, int64_t nsecs);
+
+	// Returns 0 if nothing has been recorded yet.
+	double get_nsecs_per_item() const;
+
+private:
+	// Fixed point, 1/256th nanoseconds per item.
+	std::atomic_uint64_t cost_per_item;
+};
+
+namespace Internal
+{
+template <typename Func>
+struct ParallelForState
+{
+	explicit ParallelForState(Func &&func_)
+		: func(std::move(func_))
+	{
+	}
+
+	Func func;
+	ParallelCostEstimator *estimator = nullptr;
+	size_t count = 0;
+	unsigned num_chunks = 0;
+
+	ParallelChunk get_chunk(unsigned index) const
+	{
+		ParallelChunk chunk;
+		chunk.begin = (index * count) / num_chunks;
+		chunk.end = ((index + 1) * count) / num_chunks;
+		chunk.index = index;
+		chunk.count = num_chunks;
+		return chunk;
+	}
+
+	void run(unsigned index)
+	{
+		auto chunk = get_chunk(index);
+		if (estimator)
+		{
+			auto start_time = Util::get_current_time_nsecs();
+			func(chunk);
+			auto end_time = Util::get_current_time_nsecs();
+			estimator->record(chunk.end - chunk.begin, end_time - start_time);
+		}
+		else
+			func(chunk);
+	}
+};
+
+static inline unsigned compute_num_parallel_chunks(TaskComposer &composer, size_t count, unsigned max_chunks,
+                                                   const ParallelCostEstimator *estimator)
+{
+	if (estimator)
+		return estimator->compute_num_chunks(composer.get_thread_group(), count, max_chunks);
+	else
+		return max_chunks ? max_chunks : 1;
+}
+
+template <typename Func>
+void enqueue_parallel_chunks(TaskGroup &group, size_t count, unsigned num_chunks,
+                             ParallelCostEstimator *estimator, Func &&func)
+{
+	using State = ParallelForState<std::decay_t<Func>>;
+	auto state = std::make_shared<State>(std::decay_t<Func>(std::forward<Func>(func)));
+	state->estimator = estimator;
+	state->count = count;
+	state->num_chunks = num_chunks;
+
+	for (unsigned i = 0; i < num_chunks; i++)
+	{
+		group.enqueue_task([state, i]() {
+			state->run(i);
+		});
+	}
+}
+}
+
+// Begins a new pipeline stage and calls func(const ParallelChunk &) for every chunk of [0, count).
+// The range is split into at most max_chunks chunks. If an estimator is provided, the chunk count adapts to the
+// measured cost per item, otherwise max_chunks is used as-is.
+// At least one chunk is always dispatched, even for an empty range, so chunk 0 can be used for one-off work.
+// count must not change before the stage executes. Returns the number of chunks dispatched.
+template <typename Func>
+unsigned parallel_for(TaskComposer &composer, const char *desc, size_t count, unsigned max_chunks,
+                      ParallelCostEstimator *estimator, Func &&func)
+{
+	unsigned num_chunks = Internal::compute_num_parallel_chunks(composer, count, max_chunks, estimator);
+	auto &group = composer.begin_pipeline_stage();
+	group.set_desc(desc);
+	Internal::enqueue_parallel_chunks(group, count, num_chunks, estimator, std::forward<Func>(func));
+	return num_chunks;
+}
+
+// Begins two pipeline stages. map(const ParallelChunk &) -> T is called for every chunk,
+// and the partial results are folded in chunk order with combine(T, T) -> T.
+// The final value is written to *result, which must remain valid until the stage completes.
+// Since chunks are combined in order, combine only has to be associative.
+template <typename T, typename MapFunc, typename CombineFunc>
+void parallel_reduce(TaskComposer &composer, const char *desc, size_t count, unsigned max_chunks,
+                     ParallelCostEstimator *estimator, T *result, T identity,
+                     MapFunc &&map, CombineFunc &&combine)
+{
+	unsigned num_chunks = Internal::compute_num_parallel_chunks(composer, count, max_chunks, estimator);
+	auto partials = std::make_shared<std::vector<T>>(num_chunks, identity);
+
+	{
+		auto &group = composer.begin_pipeline_stage();
+		group.set_desc(desc);
+		Internal::enqueue_parallel_chunks(
+				group, count, num_chunks, estimator,
+				[partials, map = std::forward<MapFunc>(map)](const ParallelChunk &chunk) mutable {
+					(*partials)[chunk.index] = map(chunk);
+				});
+	}
+
+	{
+		auto &group = composer.begin_pipeline_stage();
+		group.set_desc(desc);
+		group.enqueue_task([partials, result, identity, combine = std::forward<CombineFunc>(combine)]() mutable {
+			T value = identity;
+			for (auto &partial : *partials)
+				value = combine(value, partial);
+			*result = value;
+		});
+	}
+}
+
+// Begins three pipeline stages implementing a chunked exclusive scan.
+// reduce(const ParallelChunk &) -> T computes the total of each chunk,
+// the chunk totals are scanned with combine(T, T) -> T, and finally
+// scan(const ParallelChunk &, T prefix) is called for every chunk with the combined total of all preceding chunks.
+template <typename T, typename ReduceFunc, typename CombineFunc, typename ScanFunc>
+void parallel_scan(TaskComposer &composer, const char *desc, size_t count, unsigned max_chunks,
+                   ParallelCostEstimator *estimator, T identity,
+                   ReduceFunc &&reduce, CombineFunc &&combine, ScanFunc &&scan)
+{
+	unsigned num_chunks = Internal::compute_num_parallel_chunks(composer, count, max_chunks, estimator);
+	auto partials = std::make_shared<std::vector<T>>(num_chunks, identity);
+
+	{
+		auto &group = composer.begin_pipeline_stage();
+		group.set_desc(desc);
+		Internal::enqueue_parallel_chunks(
+				group, count, num_chunks, estimator,
+				[partials, reduce = std::forward<ReduceFunc>(reduce)](const ParallelChunk &chunk) mutable {
+					(*partials)[chunk.index] = reduce(chunk);
+				});
+	}
+
+	{
+		auto &group = composer.begin_pipeline_stage();
+		group.set_desc(desc);
+		group.enqueue_task([partials, identity, combine = std::forward<CombineFunc>(combine)]() mutable {
+			T value = identity;
+			for (auto &partial : *partials)
+			{
+				T next = combine(value, partial);
+				partial = value;
+				value = next;
+			}
+		});
+	}
+
+	{
+		auto &group = composer.begin_pipeline_stage();
+		group.set_desc(desc);
+		// Chunking must match the reduce pass.
+		Internal::enqueue_parallel_chunks(
+				group, count, num_chunks, nullptr,
+				[partials, scan = std::forward<ScanFunc>(scan)](const ParallelChunk &chunk) mutable {
+					scan(chunk, (*partials)[chunk.index]);
+				});
+	}
+}
+}
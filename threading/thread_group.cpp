@@ -22,6 +22,7 @@
 
 #include "thread_group.hpp"
 #include <assert.h>
+#include <algorithm>
 #include <stdexcept>
 #include <type_traits>
 #include "logging.hpp"
@@ -30,25 +31,124 @@
 #include "string_helpers.hpp"
 #include "timeline_trace_file.hpp"
 #include "thread_name.hpp"
+#include "cpu_topology.hpp"
+#include "coroutine_task.hpp"
+#include <string.h>
 
 namespace Granite
 {
+static Futex::AdaptiveSpinner task_group_spinner;
+// Waiting threads run ready tasks of the group they wait for, which may in turn wait and help.
+// Nesting is capped so the stack cannot grow without bound.
+static thread_local unsigned thread_help_depth;
+static constexpr unsigned MaxHelpDepth = 8;
+
+struct SuspendedCoroutine
+{
+	Internal::Task *task;
+	Internal::CoroutineJob *job;
+};
+// Suspended coroutines are owned by the worker thread they started on.
+static thread_local std::vector<SuspendedCoroutine> suspended_coroutines;
+static thread_local Internal::Worker *current_worker;
+
 namespace Internal
 {
+CoroutineWakeList::CoroutineWakeList()
+{
+	count.store(0, std::memory_order_relaxed);
+}
+
+void CoroutineWakeList::add(Worker *worker)
+{
+	{
+		std::lock_guard<std::mutex> holder{lock};
+		workers.push_back(worker);
+		count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Pairs with wake(). Either the waker observes us, or the caller observes the new state
+	// when it checks again after registering.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void CoroutineWakeList::remove(Worker *worker)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	auto itr = std::find(workers.begin(), workers.end(), worker);
+	assert(itr != workers.end());
+	*itr = workers.back();
+	workers.pop_back();
+	count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void CoroutineWakeList::wake()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (count.load(std::memory_order_relaxed) == 0)
+		return;
+
+	std::lock_guard<std::mutex> holder{lock};
+	for (auto *worker : workers)
+		worker->wake_for_coroutine();
+}
+
+void Worker::wake_for_coroutine()
+{
+	std::lock_guard<std::mutex> holder{pool->cond_lock};
+	coroutine_wake = true;
+	if (sleeping)
+	{
+		pool->sleepers.erase(std::find(pool->sleepers.begin(), pool->sleepers.end(), this));
+		sleeping = false;
+	}
+	cond.notify_one();
+}
+
+void Worker::wait_for_coroutine_wake()
+{
+	std::unique_lock<std::mutex> holder{pool->cond_lock};
+	cond.wait(holder, [this]() { return coroutine_wake; });
+	coroutine_wake = false;
+}
+
+void WorkerPool::wake_sleepers(size_t wake_count)
+{
+	// Wake workers in the order they went idle. Waking the most recently idle one first
+	// was measurably slower on fan-in heavy workloads.
+	while (wake_count-- && !sleepers.empty())
+	{
+		auto *worker = sleepers.front();
+		sleepers.erase(sleepers.begin());
+		worker->sleeping = false;
+		worker->cond.notify_one();
+	}
+}
+
+void WorkerPool::wake_all()
+{
+	for (auto &worker : workers)
+	{
+		worker->sleeping = false;
+		worker->cond.notify_one();
+	}
+	sleepers.clear();
+}
+
 void TaskDeps::notify_dependees()
 {
 	if (signal)
 		signal->signal_increment();
 
-	for (auto &dep : pending)
+	for (auto *dep : pending)
 		dep->dependency_satisfied();
 	pending.clear();
 
-	{
-		std::lock_guard<std::mutex> holder{cond_lock};
-		done = true;
-		cond.notify_all();
-	}
+	done.signal();
+	coroutine_waiters.wake();
+
+	// No task or dependency edge can refer to us anymore.
+	release_reference();
 }
 
 void TaskDeps::task_completed()
@@ -70,8 +170,12 @@ void TaskDeps::dependency_satisfied()
 			notify_dependees();
 		else
 		{
-			group->move_to_ready_tasks(pending_tasks);
+			// Once the tasks are visible to workers, they can complete and drop the execution reference,
+			// so don't touch this object after handing them over.
+			auto *thread_group = group;
+			auto ready_tasks = std::move(pending_tasks);
 			pending_tasks.clear();
+			thread_group->move_to_ready_tasks(ready_tasks);
 		}
 	}
 }
@@ -96,10 +200,27 @@ void TaskGroup::wait()
 	if (!flushed)
 		flush();
 
-	std::unique_lock<std::mutex> holder{deps->cond_lock};
-	deps->cond.wait(holder, [this]() {
-		return deps->done;
-	});
+	// Rather than going to sleep right away, run tasks of this group which are still queued.
+	// A task we help with may wait in turn, and if it could not help as well, every thread can end up
+	// blocked on tasks which are still queued. Unrelated tasks are left alone, since they could take
+	// arbitrarily long, or need a lock the caller is holding. Coroutines picked up here must run inline.
+	// A suspended coroutine can only be resumed by this thread, which is stuck in this wait.
+	if (thread_help_depth < MaxHelpDepth)
+	{
+		thread_help_depth++;
+		bool suspend_allowed = Internal::set_coroutine_suspend_allowed(false);
+		while (!deps->done.is_signalled() && group->try_execute_ready_task(*deps))
+			;
+		Internal::set_coroutine_suspend_allowed(suspend_allowed);
+		thread_help_depth--;
+	}
+
+	// If this is a worker with suspended coroutines, we might be waiting for one of them,
+	// and nobody else can resume them. Keep resuming them until the group completes.
+	if (ThreadGroup::has_suspended_coroutines())
+		ThreadGroup::wait_resuming_coroutines(*deps);
+
+	deps->done.wait(task_group_spinner);
 }
 
 bool TaskGroup::poll()
@@ -140,6 +261,39 @@ static void set_worker_thread_name_and_prio(unsigned index, TaskClass task_class
 	                                  Util::ThreadPriority::Default : Util::ThreadPriority::Low);
 }
 
+static void compute_thread_placement(const Util::CPUTopology &topology,
+                                     std::vector<unsigned> &fg_cpus, std::vector<unsigned> &bg_cpus)
+{
+	unsigned node = 0;
+	if (auto *cpu = topology.find_cpu(Util::get_current_cpu()))
+		node = cpu->numa_node;
+
+	for (auto &cpu : topology.cpus)
+		if (cpu.numa_node == node && cpu.performance_core)
+			fg_cpus.push_back(cpu.id);
+
+	if (fg_cpus.empty())
+		for (auto &cpu : topology.cpus)
+			if (cpu.numa_node == node)
+				fg_cpus.push_back(cpu.id);
+
+	for (auto &cpu : topology.cpus)
+		if (std::find(fg_cpus.begin(), fg_cpus.end(), cpu.id) == fg_cpus.end())
+			bg_cpus.push_back(cpu.id);
+
+	// Single node without E-cores, nothing to separate.
+	if (bg_cpus.empty())
+		bg_cpus = fg_cpus;
+}
+
+void ThreadGroup::set_thread_placement(ThreadPlacement placement_)
+{
+	if (active)
+		throw std::logic_error("Cannot change thread placement after thread group has started.");
+	placement = placement_;
+	placement_is_explicit = true;
+}
+
 void ThreadGroup::refresh_global_timeline_trace_file()
 {
 	Util::TimelineTraceFile::set_per_thread(timeline_trace_file.get());
@@ -168,6 +322,16 @@ void ThreadGroup::start(unsigned num_threads_foreground,
 	fg.thread_group.resize(num_threads_foreground);
 	bg.thread_group.resize(num_threads_background);
 
+	for (auto *ctx : { &fg, &bg })
+	{
+		ctx->workers.resize(ctx->thread_group.size());
+		for (auto &worker : ctx->workers)
+		{
+			worker = std::make_unique<Internal::Worker>();
+			worker->pool = ctx;
+		}
+	}
+
 	if (const char *env = getenv("GRANITE_TIMELINE_TRACE"))
 	{
 		LOGI("Enabling JSON timeline tracing to %s.\n", env);
@@ -177,27 +341,56 @@ void ThreadGroup::start(unsigned num_threads_foreground,
 	refresh_global_timeline_trace_file();
 	set_main_thread_name();
 
+	if (!placement_is_explicit)
+		if (const char *env = getenv("GRANITE_THREAD_PLACEMENT"))
+			placement = strcmp(env, "pinned") == 0 ? ThreadPlacement::Pinned : ThreadPlacement::Default;
+
+	std::vector<unsigned> fg_cpus, bg_cpus;
+	if (placement == ThreadPlacement::Pinned)
+	{
+		Util::CPUTopology topology;
+		if (topology.discover())
+		{
+			compute_thread_placement(topology, fg_cpus, bg_cpus);
+			LOGI("Pinning %u FG threads to %u CPUs, %u BG threads to %u CPUs (%u NUMA nodes%s).\n",
+			     num_threads_foreground, unsigned(fg_cpus.size()),
+			     num_threads_background, unsigned(bg_cpus.size()),
+			     topology.num_numa_nodes, topology.is_hybrid ? ", hybrid" : "");
+			if (Util::get_current_thread_affinity(saved_main_thread_affinity))
+				main_thread_id = std::this_thread::get_id();
+			Util::set_current_thread_affinity(fg_cpus);
+		}
+		else
+			LOGW("Failed to query CPU topology, ignoring thread placement.\n");
+	}
+
 	unsigned self_index = 1;
-	for (auto &t : fg.thread_group)
+	for (size_t i = 0; i < fg.thread_group.size(); i++)
 	{
-		t = std::make_unique<std::thread>([this, on_thread_begin, self_index]() {
+		auto *worker = fg.workers[i].get();
+		fg.thread_group[i] = std::make_unique<std::thread>([this, on_thread_begin, self_index, fg_cpus, worker]() {
 			refresh_global_timeline_trace_file();
 			set_worker_thread_name_and_prio(self_index - 1, TaskClass::Foreground);
+			if (!fg_cpus.empty())
+				Util::set_current_thread_affinity(fg_cpus);
 			if (on_thread_begin)
 				on_thread_begin();
-			thread_looper(self_index, TaskClass::Foreground);
+			thread_looper(self_index, TaskClass::Foreground, *worker);
 		});
 		self_index++;
 	}
 
-	for (auto &t : bg.thread_group)
+	for (size_t i = 0; i < bg.thread_group.size(); i++)
 	{
-		t = std::make_unique<std::thread>([this, on_thread_begin, self_index]() {
+		auto *worker = bg.workers[i].get();
+		bg.thread_group[i] = std::make_unique<std::thread>([this, on_thread_begin, self_index, bg_cpus, worker]() {
 			refresh_global_timeline_trace_file();
 			set_worker_thread_name_and_prio(self_index - 1, TaskClass::Background);
+			if (!bg_cpus.empty())
+				Util::set_current_thread_affinity(bg_cpus);
 			if (on_thread_begin)
 				on_thread_begin();
-			thread_looper(self_index, TaskClass::Background);
+			thread_looper(self_index, TaskClass::Background, *worker);
 		});
 		self_index++;
 	}
@@ -216,7 +409,7 @@ void ThreadGroup::add_dependency(TaskGroup &dependee, TaskGroup &dependency)
 	if (dependee.flushed)
 		throw std::logic_error("Cannot add dependency to task group which has been flushed.");
 
-	dependency.deps->pending.push_back(dependee.deps);
+	dependency.deps->pending.push_back(dependee.deps.get());
 	dependee.deps->dependency_count.fetch_add(1, std::memory_order_relaxed);
 }
 
@@ -239,15 +432,8 @@ void ThreadGroup::move_to_ready_tasks(const Util::SmallVector<Internal::Task *>
 		std::lock_guard<std::mutex> holder{fg.cond_lock};
 
 		for (auto &t : list)
-			fg.ready_tasks.push(t);
-
-		if (fg_task_count >= fg.thread_group.size())
-			fg.cond.notify_all();
-		else
-		{
-			for (unsigned i = 0; i < fg_task_count; i++)
-				fg.cond.notify_one();
-		}
+			fg.ready_tasks.push_back(t);
+		fg.wake_sleepers(fg_task_count);
 	}
 
 	if (bg_task_count)
@@ -255,15 +441,8 @@ void ThreadGroup::move_to_ready_tasks(const Util::SmallVector<Internal::Task *>
 		std::lock_guard<std::mutex> holder{bg.cond_lock};
 
 		for (auto &t : list)
-			bg.ready_tasks.push(t);
-
-		if (bg_task_count >= bg.thread_group.size())
-			bg.cond.notify_all();
-		else
-		{
-			for (unsigned i = 0; i < bg_task_count; i++)
-				bg.cond.notify_one();
-		}
+			bg.ready_tasks.push_back(t);
+		bg.wake_sleepers(bg_task_count);
 	}
 }
 
@@ -287,25 +466,49 @@ void ThreadGroup::free_task_deps(Internal::TaskDeps *deps)
 	task_deps_pool.free(deps);
 }
 
+TaskSignal::TaskSignal()
+{
+	counter.store(0, std::memory_order_relaxed);
+	waiters.store(0, std::memory_order_relaxed);
+	wake_sequence.store(0, std::memory_order_relaxed);
+}
+
 void TaskSignal::signal_increment()
 {
-	std::lock_guard<std::mutex> holder{lock};
-	counter++;
-	cond.notify_all();
+	// Sequentially consistent ordering between counter and waiters is required,
+	// so that either we observe the waiter or the waiter observes the new counter.
+	counter.fetch_add(1, std::memory_order_seq_cst);
+	if (waiters.load(std::memory_order_seq_cst) != 0)
+	{
+		wake_sequence.fetch_add(1, std::memory_order_seq_cst);
+		Futex::wake_all(wake_sequence);
+	}
+
+	coroutine_waiters.wake();
 }
 
 void TaskSignal::wait_until_at_least(uint64_t count)
 {
-	std::unique_lock<std::mutex> holder{lock};
-	cond.wait(holder, [&]() -> bool {
-		return counter >= count;
-	});
+	if (spinner.spin([&]() { return counter.load(std::memory_order_acquire) >= count; }))
+		return;
+
+	for (;;)
+	{
+		waiters.fetch_add(1, std::memory_order_seq_cst);
+		uint32_t seq = wake_sequence.load(std::memory_order_seq_cst);
+		bool satisfied = counter.load(std::memory_order_seq_cst) >= count;
+		if (!satisfied)
+			Futex::wait(wake_sequence, seq);
+		waiters.fetch_sub(1, std::memory_order_relaxed);
+
+		if (satisfied || counter.load(std::memory_order_acquire) >= count)
+			break;
+	}
 }
 
 uint64_t TaskSignal::get_count()
 {
-	std::lock_guard<std::mutex> holder{lock};
-	return counter;
+	return counter.load(std::memory_order_acquire);
 }
 
 TaskGroupHandle ThreadGroup::create_task()
@@ -349,48 +552,165 @@ bool ThreadGroup::is_idle()
 	return total_tasks.load(std::memory_order_acquire) == completed_tasks.load(std::memory_order_acquire);
 }
 
-void ThreadGroup::thread_looper(unsigned index, TaskClass task_class)
+void ThreadGroup::thread_looper(unsigned index, TaskClass task_class, Internal::Worker &worker)
 {
 	Util::register_thread_index(index);
+	Internal::set_coroutine_suspend_allowed(true);
+	current_worker = &worker;
 	auto &ctx = task_class == TaskClass::Foreground ? fg : bg;
 
 	for (;;)
 	{
 		Internal::Task *task = nullptr;
 
+		while (resume_ready_coroutines())
+			;
+
 		{
 			std::unique_lock<std::mutex> holder{ctx.cond_lock};
-			ctx.cond.wait(holder, [&]() {
-				return dead || !ctx.ready_tasks.empty();
-			});
 
-			if (dead && ctx.ready_tasks.empty())
-				break;
+			// Cannot exit until suspended coroutines have completed.
+			while (ctx.ready_tasks.empty() && !worker.coroutine_wake && !(dead && suspended_coroutines.empty()))
+			{
+				worker.sleeping = true;
+				ctx.sleepers.push_back(&worker);
+				worker.cond.wait(holder);
+
+				// Spurious wakeup, nobody took us off the list.
+				if (worker.sleeping)
+				{
+					ctx.sleepers.erase(std::find(ctx.sleepers.begin(), ctx.sleepers.end(), &worker));
+					worker.sleeping = false;
+				}
+			}
+
+			// Suspended coroutines are polled again before going back to sleep.
+			worker.coroutine_wake = false;
+
+			if (ctx.ready_tasks.empty())
+			{
+				if (dead && suspended_coroutines.empty())
+					break;
+				continue;
+			}
 
 			task = ctx.ready_tasks.front();
-			ctx.ready_tasks.pop();
+			ctx.ready_tasks.pop_front();
 		}
 
-		if (task->callable)
+		execute_task(task);
+	}
+}
+
+bool ThreadGroup::has_suspended_coroutines()
+{
+	return !suspended_coroutines.empty();
+}
+
+void ThreadGroup::wait_resuming_coroutines(Internal::TaskDeps &deps)
+{
+	// Completing the group wakes us up the same way a suspended coroutine becoming ready does.
+	deps.coroutine_waiters.add(current_worker);
+	while (!deps.done.is_signalled() && has_suspended_coroutines())
+		if (!resume_ready_coroutines())
+			current_worker->wait_for_coroutine_wake();
+	deps.coroutine_waiters.remove(current_worker);
+}
+
+bool ThreadGroup::resume_ready_coroutines()
+{
+	bool resumed = false;
+
+	for (size_t i = 0; i < suspended_coroutines.size(); )
+	{
+		auto suspended = suspended_coroutines[i];
+		if (!suspended.job->ready())
 		{
-			GRANITE_SCOPED_TIMELINE_EVENT_FILE(timeline_trace_file.get(), task->deps->desc);
-			task->callable.call();
+			i++;
+			continue;
 		}
 
-		task->deps->task_completed();
-		task_pool.free(task);
+		// This can be called from TaskGroup::wait() on any group, so use the group which owns the task.
+		auto *owner = suspended.task->deps->group;
+
+		suspended_coroutines[i] = suspended_coroutines.back();
+		suspended_coroutines.pop_back();
+		suspended.job->wake_list->remove(current_worker);
+		resumed = true;
 
 		{
-			auto completed = completed_tasks.fetch_add(1, std::memory_order_relaxed) + 1;
-			//LOGI("Task completed (%u / %u)!\n", completed, total_tasks.load(memory_order_relaxed));
+#ifndef GRANITE_SHIPPING
+			char desc[sizeof(suspended.task->deps->desc) + 16];
+			snprintf(desc, sizeof(desc), "%s (resume)", suspended.task->deps->desc);
+#endif
+			GRANITE_SCOPED_TIMELINE_EVENT_FILE(owner->timeline_trace_file.get(), desc);
+			Internal::run_coroutine_job(suspended.job);
+		}
 
-			if (completed == total_tasks.load(std::memory_order_relaxed))
-			{
-				std::lock_guard<std::mutex> holder{wait_cond_lock};
-				wait_cond.notify_all();
-			}
+		if (auto *job = Internal::take_suspended_coroutine())
+		{
+			suspended_coroutines.push_back({ suspended.task, job });
+			job->wake_list->add(current_worker);
 		}
+		else
+			owner->complete_task(suspended.task);
 	}
+
+	return resumed;
+}
+
+void ThreadGroup::execute_task(Internal::Task *task)
+{
+	if (task->callable)
+	{
+		GRANITE_SCOPED_TIMELINE_EVENT_FILE(timeline_trace_file.get(), task->deps->desc);
+		task->callable.call();
+	}
+
+	// The task was a coroutine which suspended itself, it is completed once it is resumed and returns.
+	if (auto *job = Internal::take_suspended_coroutine())
+	{
+		suspended_coroutines.push_back({ task, job });
+		job->wake_list->add(current_worker);
+		return;
+	}
+
+	complete_task(task);
+}
+
+void ThreadGroup::complete_task(Internal::Task *task)
+{
+	task->deps->task_completed();
+	task_pool.free(task);
+
+	auto completed = completed_tasks.fetch_add(1, std::memory_order_relaxed) + 1;
+	//LOGI("Task completed (%u / %u)!\n", completed, total_tasks.load(memory_order_relaxed));
+
+	if (completed == total_tasks.load(std::memory_order_relaxed))
+	{
+		std::lock_guard<std::mutex> holder{wait_cond_lock};
+		wait_cond.notify_all();
+	}
+}
+
+bool ThreadGroup::try_execute_ready_task(Internal::TaskDeps &deps)
+{
+	auto &ctx = deps.task_class == TaskClass::Foreground ? fg : bg;
+	Internal::Task *task = nullptr;
+
+	{
+		std::lock_guard<std::mutex> holder{ctx.cond_lock};
+		auto itr = std::find_if(ctx.ready_tasks.begin(), ctx.ready_tasks.end(), [&](const Internal::Task *t) {
+			return t->deps == &deps;
+		});
+		if (itr == ctx.ready_tasks.end())
+			return false;
+		task = *itr;
+		ctx.ready_tasks.erase(itr);
+	}
+
+	execute_task(task);
+	return true;
 }
 
 ThreadGroup::ThreadGroup()
@@ -415,8 +735,8 @@ void ThreadGroup::stop()
 		std::lock_guard<std::mutex> holder_fg{fg.cond_lock};
 		std::lock_guard<std::mutex> holder_bg{bg.cond_lock};
 		dead = true;
-		fg.cond.notify_all();
-		bg.cond.notify_all();
+		fg.wake_all();
+		bg.wake_all();
 	}
 
 	for (auto &t : fg.thread_group)
@@ -437,6 +757,18 @@ void ThreadGroup::stop()
 		}
 	}
 
+	fg.workers.clear();
+	bg.workers.clear();
+
+	if (!saved_main_thread_affinity.empty())
+	{
+		if (main_thread_id == std::this_thread::get_id())
+			Util::set_current_thread_affinity(saved_main_thread_affinity);
+		else
+			LOGW("ThreadGroup stopped on a different thread than it was started on, cannot restore affinity.\n");
+		saved_main_thread_affinity.clear();
+	}
+
 	active = false;
 	dead = false;
 }
@@ -26,7 +26,7 @@
 #include <mutex>
 #include <thread>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <future>
 #include <memory>
 #include "object_pool.hpp"
@@ -36,16 +36,44 @@
 #include "global_managers.hpp"
 #include "small_vector.hpp"
 #include "small_callable.hpp"
+#include "futex.hpp"
 
 namespace Granite
 {
 class ThreadGroup;
+class CoroutineContext;
 
-struct TaskSignal
+namespace Internal
 {
-	std::condition_variable cond;
+struct Worker;
+
+// Worker threads with a coroutine suspended on a TaskGroup or TaskSignal register here,
+// so they are woken up directly once it may be ready, rather than polling for it.
+class CoroutineWakeList
+{
+public:
+	CoroutineWakeList();
+	void add(Worker *worker);
+	void remove(Worker *worker);
+	void wake();
+
+private:
 	std::mutex lock;
-	uint64_t counter = 0;
+	Util::SmallVector<Worker *> workers;
+	std::atomic_uint32_t count;
+};
+}
+
+struct TaskSignal
+{
+	TaskSignal();
+
+	// Signalling only enters the kernel if there are threads parked in wait_until_at_least().
+	std::atomic_uint64_t counter;
+	std::atomic_uint32_t waiters;
+	std::atomic_uint32_t wake_sequence;
+	Futex::AdaptiveSpinner spinner;
+	Internal::CoroutineWakeList coroutine_waiters;
 
 	void signal_increment();
 	void wait_until_at_least(uint64_t count);
@@ -58,6 +86,16 @@ enum class TaskClass : uint8_t
 	Background
 };
 
+enum class ThreadPlacement
+{
+	// Leave scheduling entirely to the OS.
+	Default,
+	// The main thread and foreground workers are confined to the NUMA node the main thread is running on,
+	// preferring performance cores on hybrid CPUs. Background workers are confined to the remaining CPUs.
+	// Can be enabled with GRANITE_THREAD_PLACEMENT=pinned unless set_thread_placement() was called.
+	Pinned
+};
+
 struct TaskGroup;
 namespace Internal
 {
@@ -74,6 +112,10 @@ struct TaskGroupDeleter
 	void operator()(TaskGroup *group);
 };
 
+// Tasks and dependency edges refer to TaskDeps with plain pointers.
+// Rather than taking a reference per task and per edge, which costs two contended atomics each,
+// a single execution reference is held from creation until notify_dependees(),
+// which covers every task and edge since neither can outlive that point.
 struct TaskDeps : Util::IntrusivePtrEnabled<TaskDeps, TaskDepsDeleter, Util::MultiThreadCounter>
 {
 	explicit TaskDeps(ThreadGroup *group_)
@@ -83,10 +125,11 @@ struct TaskDeps : Util::IntrusivePtrEnabled<TaskDeps, TaskDepsDeleter, Util::Mul
 		// One implicit dependency is the flush() happening.
 		dependency_count.store(1, std::memory_order_relaxed);
 		desc[0] = '\0';
+		add_reference();
 	}
 
 	ThreadGroup *group;
-	Util::SmallVector<Util::IntrusivePtr<TaskDeps>> pending;
+	Util::SmallVector<TaskDeps *> pending;
 	std::atomic_uint count;
 
 	Util::SmallVector<Task *> pending_tasks;
@@ -97,9 +140,8 @@ struct TaskDeps : Util::IntrusivePtrEnabled<TaskDeps, TaskDepsDeleter, Util::Mul
 	void dependency_satisfied();
 	void notify_dependees();
 
-	std::condition_variable cond;
-	std::mutex cond_lock;
-	bool done = false;
+	Futex::Event done;
+	CoroutineWakeList coroutine_waiters;
 	TaskClass task_class = TaskClass::Foreground;
 
 	char desc[64];
@@ -109,18 +151,48 @@ using TaskDepsHandle = Util::IntrusivePtr<TaskDeps>;
 struct Task
 {
 	template <typename Func>
-	Task(TaskDepsHandle deps_, Func&& func)
-		: callable(std::forward<Func>(func)), deps(std::move(deps_))
+	Task(TaskDeps *deps_, Func&& func)
+		: callable(std::forward<Func>(func)), deps(deps_)
 	{
 	}
 
 	Task() = default;
 
-	Util::SmallCallable<void (), 64 - sizeof(TaskDepsHandle), alignof(TaskDepsHandle)> callable;
-	TaskDepsHandle deps;
+	Util::SmallCallable<void (), 64 - sizeof(TaskDeps *), alignof(TaskDeps *)> callable;
+	// Kept alive by the execution reference of TaskDeps.
+	TaskDeps *deps = nullptr;
 };
 
 static_assert(sizeof(Task) == 64, "sizeof(Task) is unexpected.");
+
+struct WorkerPool;
+
+// Each worker sleeps on its own condition, so that it can be woken up on its own,
+// either to pick up new tasks, or because one of its suspended coroutines may be ready.
+struct Worker
+{
+	WorkerPool *pool = nullptr;
+	std::condition_variable cond;
+	// Guarded by the pool's cond_lock.
+	bool sleeping = false;
+	bool coroutine_wake = false;
+
+	void wake_for_coroutine();
+	void wait_for_coroutine_wake();
+};
+
+struct WorkerPool
+{
+	std::vector<std::unique_ptr<std::thread>> thread_group;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::deque<Task *> ready_tasks;
+	std::mutex cond_lock;
+	// Idle workers, most recently idle last. Guarded by cond_lock.
+	std::vector<Worker *> sleepers;
+
+	void wake_sleepers(size_t count);
+	void wake_all();
+};
 }
 
 struct TaskGroup : Util::IntrusivePtrEnabled<TaskGroup, Internal::TaskGroupDeleter, Util::MultiThreadCounter>
@@ -166,16 +238,46 @@ public:
 		return unsigned(fg.thread_group.size() + bg.thread_group.size());
 	}
 
+	unsigned get_num_foreground_threads() const
+	{
+		return unsigned(fg.thread_group.size());
+	}
+
+	unsigned get_num_background_threads() const
+	{
+		return unsigned(bg.thread_group.size());
+	}
+
 	void stop();
 
+	// Must be called before start(). Takes precedence over GRANITE_THREAD_PLACEMENT.
+	void set_thread_placement(ThreadPlacement placement);
+
 	template <typename Func>
 	void enqueue_task(TaskGroup &group, Func&& func);
 	template <typename Func>
 	TaskGroupHandle create_task(Func&& func);
 	TaskGroupHandle create_task();
 
+	// func is called as void (CoroutineContext &) and may suspend while awaiting other work.
+	// Defined in coroutine_task.hpp.
+	template <typename Func>
+	void enqueue_coroutine_task(TaskGroup &group, Func &&func);
+
 	void move_to_ready_tasks(const Util::SmallVector<Internal::Task *> &list);
 
+	// Called by threads waiting for a TaskGroup. Pulls one ready task belonging to deps and runs it
+	// on the calling thread. Returns false if there was nothing to run.
+	bool try_execute_ready_task(Internal::TaskDeps &deps);
+
+	// Coroutines are resumed on the worker thread they suspended on.
+	// Called by the worker looper, and by TaskGroup::wait() so that a worker blocking on a group
+	// can still resume the coroutines it owns. Returns true if any coroutine was resumed.
+	static bool resume_ready_coroutines();
+	static bool has_suspended_coroutines();
+	// Called by a worker with suspended coroutines which needs to block until deps completes.
+	static void wait_resuming_coroutines(Internal::TaskDeps &deps);
+
 	void add_dependency(TaskGroup &dependee, TaskGroup &dependency);
 
 	void free_task_group(TaskGroup *group);
@@ -195,18 +297,19 @@ private:
 	Util::ThreadSafeObjectPool<TaskGroup> task_group_pool;
 	Util::ThreadSafeObjectPool<Internal::TaskDeps> task_deps_pool;
 
-	struct
-	{
-		std::vector<std::unique_ptr<std::thread>> thread_group;
-		std::queue<Internal::Task *> ready_tasks;
-		std::mutex cond_lock;
-		std::condition_variable cond;
-	} fg, bg;
+	Internal::WorkerPool fg, bg;
 
-	void thread_looper(unsigned self_index, TaskClass task_class);
+	void thread_looper(unsigned self_index, TaskClass task_class, Internal::Worker &worker);
+	void execute_task(Internal::Task *task);
+	void complete_task(Internal::Task *task);
 
 	bool active = false;
 	bool dead = false;
+	ThreadPlacement placement = ThreadPlacement::Default;
+	bool placement_is_explicit = false;
+	// Pinned placement changes the affinity of the thread calling start(), which is restored in stop().
+	std::vector<unsigned> saved_main_thread_affinity;
+	std::thread::id main_thread_id;
 
 	std::condition_variable wait_cond;
 	std::mutex wait_cond_lock;
@@ -222,7 +325,7 @@ TaskGroupHandle ThreadGroup::create_task(Func&& func)
 {
 	TaskGroupHandle group(task_group_pool.allocate(this));
 	group->deps = Internal::TaskDepsHandle(task_deps_pool.allocate(this));
-	group->deps->pending_tasks.push_back(task_pool.allocate(group->deps, std::forward<Func>(func)));
+	group->deps->pending_tasks.push_back(task_pool.allocate(group->deps.get(), std::forward<Func>(func)));
 	group->deps->count.store(1, std::memory_order_relaxed);
 	return group;
 }
@@ -232,7 +335,7 @@ void ThreadGroup::enqueue_task(TaskGroup &group, Func&& func)
 {
 	if (group.flushed)
 		throw std::logic_error("Cannot enqueue work to a flushed task group.");
-	group.deps->pending_tasks.push_back(task_pool.allocate(group.deps, std::forward<Func>(func)));
+	group.deps->pending_tasks.push_back(task_pool.allocate(group.deps.get(), std::forward<Func>(func)));
 	group.deps->count.fetch_add(1, std::memory_order_relaxed);
 }
 
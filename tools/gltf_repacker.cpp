@@ -27,6 +27,11 @@
 #include "cli_parser.hpp"
 #include "rapidjson_wrapper.hpp"
 #include "global_managers_init.hpp"
+#include "global_managers.hpp"
+#include "thread_group.hpp"
+#include "timer.hpp"
+#include "hash.hpp"
+#include <unordered_map>
 
 using namespace Granite;
 using namespace Util;
@@ -46,6 +51,97 @@ static SceneFormats::TextureCompressionFamily string_to_compression(const std::s
 	}
 }
 
+// The deduplication used before mesh_build_vertex_remap(). Only the 64-bit hash is compared,
+// so colliding vertices are merged. Kept here as a baseline for --benchmark-vertex-dedup.
+static SceneFormats::VertexRemap build_vertex_remap_hashed(const SceneFormats::Mesh &mesh)
+{
+	unsigned attribute_count = unsigned(mesh.positions.size() / mesh.position_stride);
+	std::unordered_map<Util::Hash, unsigned> attribute_remapper;
+	SceneFormats::VertexRemap remapped;
+	remapped.index_remap.reserve(attribute_count);
+
+	unsigned unique_count = 0;
+	for (unsigned i = 0; i < attribute_count; i++)
+	{
+		Util::Hasher h;
+		h.data(mesh.positions.data() + i * mesh.position_stride, mesh.position_stride);
+		if (!mesh.attributes.empty())
+			h.data(mesh.attributes.data() + i * mesh.attribute_stride, mesh.attribute_stride);
+
+		auto hash = h.get();
+		auto itr = attribute_remapper.find(hash);
+		if (itr != end(attribute_remapper))
+		{
+			remapped.index_remap.push_back(itr->second);
+		}
+		else
+		{
+			attribute_remapper[hash] = unique_count;
+			remapped.index_remap.push_back(unique_count);
+			remapped.unique_attrib_to_source_index.push_back(i);
+			unique_count++;
+		}
+	}
+
+	return remapped;
+}
+
+static bool benchmark_vertex_dedup(Util::ArrayView<const SceneFormats::Mesh> meshes, unsigned iterations)
+{
+	auto *group = GRANITE_THREAD_GROUP();
+	double hashed_time = 0.0, serial_time = 0.0, parallel_time = 0.0;
+	size_t total_vertices = 0;
+	bool success = true;
+
+	const auto measure = [iterations](auto &&func, double &total) {
+		SceneFormats::VertexRemap remap;
+		for (unsigned i = 0; i < iterations; i++)
+		{
+			auto start_time = Util::get_current_time_nsecs();
+			remap = func();
+			total += double(Util::get_current_time_nsecs() - start_time);
+		}
+		return remap;
+	};
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		auto &mesh = meshes[i];
+		if (!mesh.position_stride)
+			continue;
+
+		auto hashed = measure([&]() { return build_vertex_remap_hashed(mesh); }, hashed_time);
+		auto serial = measure([&]() { return SceneFormats::mesh_build_vertex_remap(mesh, nullptr); }, serial_time);
+		auto parallel = measure([&]() { return SceneFormats::mesh_build_vertex_remap(mesh, group); }, parallel_time);
+		total_vertices += serial.index_remap.size();
+
+		if (serial.index_remap != parallel.index_remap ||
+		    serial.unique_attrib_to_source_index != parallel.unique_attrib_to_source_index)
+		{
+			LOGE("Mesh #%zu: serial and parallel deduplication differ.\n", i);
+			success = false;
+		}
+
+		if (hashed.unique_attrib_to_source_index.size() != serial.unique_attrib_to_source_index.size())
+		{
+			LOGW("Mesh #%zu: hashed deduplication merged %zu distinct vertices.\n", i,
+			     serial.unique_attrib_to_source_index.size() - hashed.unique_attrib_to_source_index.size());
+		}
+	}
+
+	const auto report = [&](const char *tag, double total) {
+		double msecs = 1e-6 * total / iterations;
+		LOGI("%-16s %10.3f ms, %8.2f Mverts/s\n", tag, msecs, 1e-3 * double(total_vertices) / msecs);
+	};
+
+	LOGI("Deduplicated %u meshes, %zu vertices, %u threads.\n",
+	     unsigned(meshes.size()), total_vertices, group ? group->get_num_threads() + 1 : 1);
+	report("hashed (legacy)", hashed_time);
+	report("exact (serial)", serial_time);
+	report("exact (parallel)", parallel_time);
+	return success;
+}
+
 static void print_help()
 {
 	LOGI("Usage: [--output <out.glb>] [--texcomp <type>]\n");
@@ -67,6 +163,7 @@ static void print_help()
 	LOGI("[--flip-tangent-w]\n");
 	LOGI("[--renormalize-normals]\n");
 	LOGI("[--gltf]\n");
+	LOGI("[--benchmark-vertex-dedup <iterations>]\n");
 }
 
 int main(int argc, char *argv[])
@@ -90,6 +187,7 @@ int main(int argc, char *argv[])
 	bool renormalize_normals = false;
 	float animate_cameras_speed = 1.0f;
 	float animate_cameras_sharpness = 0.0f;
+	unsigned benchmark_dedup_iterations = 0;
 
 	CLICallbacks cbs;
 	cbs.add("--output", [&](CLIParser &parser) { args.output = parser.next_string(); });
@@ -110,6 +208,7 @@ int main(int argc, char *argv[])
 	cbs.add("--flip-tangent-w", [&](CLIParser &) { flip_tangent_w = true; });
 	cbs.add("--renormalize-normals", [&](CLIParser &) { renormalize_normals = true; });
 	cbs.add("--gltf", [&](CLIParser &) { options.gltf = true; });
+	cbs.add("--benchmark-vertex-dedup", [&](CLIParser &parser) { benchmark_dedup_iterations = parser.next_uint(); });
 
 	cbs.add("--fog-color", [&](CLIParser &parser) {
 		for (unsigned i = 0; i < 3; i++)
@@ -142,7 +241,7 @@ int main(int argc, char *argv[])
 	else if (cli_parser.is_ended_state())
 		return 0;
 
-	if (args.input.empty() || args.output.empty())
+	if (args.input.empty() || (args.output.empty() && !benchmark_dedup_iterations))
 	{
 		print_help();
 		return 1;
@@ -200,6 +299,9 @@ int main(int argc, char *argv[])
 		info.meshes = meshes;
 	}
 
+	if (benchmark_dedup_iterations)
+		return benchmark_vertex_dedup(info.meshes, benchmark_dedup_iterations) ? 0 : 1;
+
 	std::vector<SceneFormats::CameraInfo> cameras;
 	std::vector<SceneFormats::Animation> animations;
 	if (!extra_cameras.empty())
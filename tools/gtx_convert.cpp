@@ -27,6 +27,22 @@
 #include "memory_mapped_texture.hpp"
 #include "global_managers_init.hpp"
 #include "texture_utils.hpp"
+#include "filesystem.hpp"
+#include "path_utils.hpp"
+#include "string_helpers.hpp"
+#include "hash.hpp"
+#include "timer.hpp"
+#include <unordered_map>
+#include <condition_variable>
+#include <mutex>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <inttypes.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 
 using namespace Granite;
 using namespace Granite::SceneFormats;
@@ -45,7 +61,16 @@ static void print_help()
 	     "\t[--normal-la]\n"
 	     "\t[--mask-la]\n"
 	     "\t--output <out.gtx>\n"
-	     "\t<in.gtx>\n");
+	     "\t<in.gtx>\n"
+	     "Batch mode: \n"
+	     "\t--batch <directory or manifest>\n"
+	     "\t[--memory-budget <MiB>]\n"
+	     "\t[--cache <path>]\n"
+	     "\t[options applying to every texture]\n"
+	     "\t[--output <directory>]\n"
+	     "A directory converts every image in it to <output>/<name>.gtx.\n"
+	     "A manifest has one texture per line, given as <in> [options] [--output <out.gtx>].\n"
+	     "Relative paths in a manifest are relative to the manifest.\n");
 }
 
 static VkComponentSwizzle parse_swizzle(const char c)
@@ -97,107 +122,471 @@ static VkComponentMapping parse_swizzle(const char *str)
 	};
 }
 
-int main(int argc, char *argv[])
+struct ConvertOptions
 {
-	Global::init(Global::MANAGER_FEATURE_THREAD_GROUP_BIT |
-	             Global::MANAGER_FEATURE_FILESYSTEM_BIT |
-	             Global::MANAGER_FEATURE_EVENT_BIT);
-
-	std::string input_path;
-	bool generate_mipmap = false;
-	bool deferred_generate_mipmap = false;
-	bool fixup_alpha = false;
 	CompressorArguments args;
-
 	VkComponentMapping swizzle = {
 		VK_COMPONENT_SWIZZLE_R,
 		VK_COMPONENT_SWIZZLE_G,
 		VK_COMPONENT_SWIZZLE_B,
 		VK_COMPONENT_SWIZZLE_A,
 	};
+	bool generate_mipmap = false;
+	bool deferred_generate_mipmap = false;
+	bool fixup_alpha = false;
+};
 
-	args.mode = TextureMode::RGB;
+static void add_convert_callbacks(CLICallbacks &cbs, ConvertOptions &opts)
+{
+	cbs.add("--quality", [&](CLIParser &parser) { opts.args.quality = parser.next_uint(); });
+	cbs.add("--format", [&](CLIParser &parser) { opts.args.format = string_to_format(parser.next_string()); });
+	cbs.add("--output", [&](CLIParser &parser) { opts.args.output = parser.next_string(); });
+	cbs.add("--alpha", [&](CLIParser &) { opts.args.mode = TextureMode::RGBA; });
+	cbs.add("--normal-la", [&](CLIParser &) { opts.args.mode = TextureMode::NormalLA; });
+	cbs.add("--mask-la", [&](CLIParser &) { opts.args.mode = TextureMode::MaskLA; });
+	cbs.add("--fixup-alpha", [&](CLIParser &) { opts.fixup_alpha = true; });
+	cbs.add("--mipgen", [&](CLIParser &) { opts.generate_mipmap = true; });
+	cbs.add("--deferred-mipgen", [&](CLIParser &) { opts.deferred_generate_mipmap = true; });
+	cbs.add("--swizzle", [&](CLIParser &parser) { opts.swizzle = parse_swizzle(parser.next_string()); });
+}
 
-	CLICallbacks cbs;
-	cbs.add("--help", [&](CLIParser &parser) { print_help(); parser.end(); });
-	cbs.add("--quality", [&](CLIParser &parser) { args.quality = parser.next_uint(); });
-	cbs.add("--format", [&](CLIParser &parser) { args.format = string_to_format(parser.next_string()); });
-	cbs.add("--output", [&](CLIParser &parser) { args.output = parser.next_string(); });
-	cbs.add("--alpha", [&](CLIParser &) { args.mode = TextureMode::RGBA; });
-	cbs.add("--normal-la", [&](CLIParser &) { args.mode = TextureMode::NormalLA; });
-	cbs.add("--mask-la", [&](CLIParser &) { args.mode = TextureMode::MaskLA; });
-	cbs.add("--fixup-alpha", [&](CLIParser &) { fixup_alpha = true; });
-	cbs.add("--mipgen", [&](CLIParser &) { generate_mipmap = true; });
-	cbs.add("--deferred-mipgen", [&](CLIParser &) { deferred_generate_mipmap = true; });
-	cbs.add("--swizzle", [&](CLIParser &parser) { swizzle = parse_swizzle(parser.next_string()); });
-	cbs.default_handler = [&](const char *arg) { input_path = arg; };
-	cbs.error_handler = []() { print_help(); };
-	CLIParser parser(std::move(cbs), argc - 1, argv + 1);
+struct ConvertJob
+{
+	std::string input_path;
+	ConvertOptions opts;
 
-	if (!parser.parse())
-		return 1;
-	else if (parser.is_ended_state())
-		return 0;
+	size_t decoded_size = 0;
+	size_t budget_size = 0;
+	Hash hash = 0;
+	bool skipped = false;
+	bool failed = false;
+};
 
-	if (args.format == VK_FORMAT_UNDEFINED)
+// Bounds the estimated working set of textures in flight, so a batch of large images
+// cannot all be decoded at once. A texture larger than the budget runs on its own.
+struct MemoryBudget
+{
+	explicit MemoryBudget(size_t limit_)
+		: limit(limit_)
 	{
-		LOGE("Must provide a format.\n");
-		return 1;
 	}
 
-	if (args.output.empty() || input_path.empty())
+	void acquire(size_t size)
 	{
-		LOGE("Must provide input and output paths.\n");
-		return 1;
+		std::unique_lock<std::mutex> holder{lock};
+		cond.wait(holder, [&]() { return in_flight == 0 || in_flight + size <= limit; });
+		in_flight += size;
+		peak = std::max(peak, in_flight);
 	}
 
-	Vulkan::ColorSpace color = Vulkan::format_is_srgb(args.format) ?
-	                           Vulkan::ColorSpace::sRGB : Vulkan::ColorSpace::Linear;
+	void release(size_t size)
+	{
+		std::lock_guard<std::mutex> holder{lock};
+		in_flight -= size;
+		cond.notify_all();
+	}
 
-	auto input = std::make_shared<Vulkan::MemoryMappedTexture>(
-			Vulkan::load_texture_from_file(*GRANITE_FILESYSTEM(), input_path, color));
+	std::mutex lock;
+	std::condition_variable cond;
+	size_t limit;
+	size_t in_flight = 0;
+	size_t peak = 0;
+};
 
-	if (input->get_layout().get_required_size() == 0)
+using HashCache = std::unordered_map<std::string, Hash>;
+
+static HashCache load_hash_cache(const std::string &path)
+{
+	HashCache cache;
+	std::string str;
+	if (path.empty() || !GRANITE_FILESYSTEM()->read_file_to_string(path, str))
+		return cache;
+
+	for (auto &line : Util::split_no_empty(str, "\n"))
 	{
-		LOGE("Failed to load texture %s.\n", input_path.c_str());
-		return 1;
+		auto space = line.find(' ');
+		if (space == std::string::npos)
+			continue;
+		cache[line.substr(space + 1)] = strtoull(line.substr(0, space).c_str(), nullptr, 16);
 	}
 
-	args.deferred_mipgen = deferred_generate_mipmap;
+	return cache;
+}
 
-	if (generate_mipmap)
+static bool save_hash_cache(const std::string &path, const HashCache &cache)
+{
+	std::string str;
+	char hex[32];
+	for (auto &entry : cache)
 	{
-		*input = generate_mipmaps(input->get_layout(), input->get_flags());
+		snprintf(hex, sizeof(hex), "%016" PRIx64 " ", uint64_t(entry.second));
+		str += hex;
+		str += entry.first;
+		str += '\n';
+	}
+	return GRANITE_FILESYSTEM()->write_string_to_file(path, str);
+}
+
+static Hash hash_job(const ConvertOptions &opts, const void *data, size_t size)
+{
+	Hasher h;
+	// Bump if conversion output changes for the same inputs.
+	h.u32(1);
+	h.u32(opts.args.format);
+	h.u32(opts.args.quality);
+	h.u32(uint32_t(opts.args.mode));
+	h.u32(opts.swizzle.r);
+	h.u32(opts.swizzle.g);
+	h.u32(opts.swizzle.b);
+	h.u32(opts.swizzle.a);
+	h.u32(opts.generate_mipmap);
+	h.u32(opts.deferred_generate_mipmap);
+	h.u32(opts.fixup_alpha);
+
+	auto *bytes = static_cast<const uint8_t *>(data);
+	h.u64(size);
+	h.data(reinterpret_cast<const uint64_t *>(bytes), size & ~size_t(7));
+	for (size_t i = size & ~size_t(7); i < size; i++)
+		h.u32(bytes[i]);
+	return h.get();
+}
+
+// Runs the whole conversion of one texture on the thread group. completion is flushed once the job is done,
+// whether it was converted, skipped or failed.
+static void enqueue_conversion(ThreadGroup &group, ConvertJob &job, const HashCache &cache, TaskGroupHandle completion)
+{
+	auto task = group.create_task([&group, &job, &cache, completion = std::move(completion)]() mutable {
+		auto &args = job.opts.args;
+		auto file = GRANITE_FILESYSTEM()->open(job.input_path, FileMode::ReadOnly);
+		auto mapped = file ? file->map() : FileMappingHandle{};
+		if (!mapped)
+		{
+			LOGE("Failed to load texture %s.\n", job.input_path.c_str());
+			job.failed = true;
+			return;
+		}
+
+		job.hash = hash_job(job.opts, mapped->data(), mapped->get_size());
+		auto itr = cache.find(args.output);
+		FileStat s;
+		if (itr != cache.end() && itr->second == job.hash &&
+		    GRANITE_FILESYSTEM()->stat(args.output, s) && s.type == PathType::File)
+		{
+			job.skipped = true;
+			return;
+		}
+
+		Vulkan::ColorSpace color = Vulkan::format_is_srgb(args.format) ?
+		                           Vulkan::ColorSpace::sRGB : Vulkan::ColorSpace::Linear;
+
+		auto input = std::make_shared<Vulkan::MemoryMappedTexture>();
+		if (Vulkan::MemoryMappedTexture::is_header(mapped->data(), mapped->get_size()))
+			input->map_read(std::move(mapped));
+		else
+			*input = Vulkan::load_texture_from_memory(mapped->data(), mapped->get_size(), color);
+		mapped.reset();
+
 		if (input->get_layout().get_required_size() == 0)
 		{
-			LOGE("Failed to save texture: %s\n", args.output.c_str());
-			return 1;
+			LOGE("Failed to load texture %s.\n", job.input_path.c_str());
+			job.failed = true;
+			return;
+		}
+
+		args.deferred_mipgen = job.opts.deferred_generate_mipmap;
+
+		if (job.opts.generate_mipmap)
+		{
+			*input = generate_mipmaps(input->get_layout(), input->get_flags());
+			if (input->get_layout().get_required_size() == 0)
+			{
+				LOGE("Failed to save texture: %s\n", args.output.c_str());
+				job.failed = true;
+				return;
+			}
 		}
+
+		if (job.opts.fixup_alpha)
+		{
+			*input = fixup_alpha_edges(input->get_layout(), input->get_flags());
+			if (input->get_layout().get_required_size() == 0)
+			{
+				LOGE("Failed to save texture: %s\n", args.output.c_str());
+				job.failed = true;
+				return;
+			}
+		}
+
+		if (input->get_layout().get_format() == VK_FORMAT_R16G16B16A16_SFLOAT)
+			args.mode = TextureMode::HDR;
+
+		if (!swizzle_image(*input, job.opts.swizzle))
+		{
+			LOGE("Failed to swizzle image.\n");
+			job.failed = true;
+			return;
+		}
+
+		auto dep = group.create_task();
+		compress_texture(group, args, input, dep, nullptr, std::move(completion), &job.failed);
+	});
+	task->set_desc("gtx-convert-load");
+}
+
+static bool is_image_path(const std::string &path)
+{
+	auto ext = Path::ext(path);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return char(tolower(c)); });
+	return ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "hdr" || ext == "gtx" || ext == "tga" || ext == "bmp";
+}
+
+static std::string output_path_for_input(const std::string &output_dir, const std::string &input)
+{
+	auto name = Path::basename(input);
+	auto dot = name.find_last_of('.');
+	if (dot != std::string::npos)
+		name = name.substr(0, dot);
+	return Path::join(output_dir, name + ".gtx");
+}
+
+static bool gather_jobs(const std::string &batch_path, const ConvertOptions &defaults,
+                        std::vector<std::unique_ptr<ConvertJob>> &jobs)
+{
+	FileStat s;
+	if (!GRANITE_FILESYSTEM()->stat(batch_path, s))
+	{
+		LOGE("Batch path %s does not exist.\n", batch_path.c_str());
+		return false;
 	}
 
-	if (fixup_alpha)
+	if (s.type == PathType::Directory)
 	{
-		*input = fixup_alpha_edges(input->get_layout(), input->get_flags());
-		if (input->get_layout().get_required_size() == 0)
+		if (defaults.args.output.empty())
 		{
-			LOGE("Failed to save texture: %s\n", args.output.c_str());
-			return 1;
+			LOGE("Must provide output directory in batch mode.\n");
+			return false;
+		}
+
+		auto entries = GRANITE_FILESYSTEM()->list(batch_path);
+		std::sort(entries.begin(), entries.end(), [](const ListEntry &a, const ListEntry &b) { return a.path < b.path; });
+		for (auto &entry : entries)
+		{
+			if (entry.type != PathType::File || !is_image_path(entry.path))
+				continue;
+
+			auto job = std::make_unique<ConvertJob>();
+			job->opts = defaults;
+			job->input_path = entry.path;
+			job->opts.args.output = output_path_for_input(defaults.args.output, entry.path);
+			jobs.push_back(std::move(job));
 		}
+		return true;
 	}
 
-	if (input->get_layout().get_format() == VK_FORMAT_R16G16B16A16_SFLOAT)
-		args.mode = TextureMode::HDR;
+	std::string manifest;
+	if (!GRANITE_FILESYSTEM()->read_file_to_string(batch_path, manifest))
+	{
+		LOGE("Failed to read manifest %s.\n", batch_path.c_str());
+		return false;
+	}
 
-	if (!swizzle_image(*input, swizzle))
+	for (auto &line : Util::split_no_empty(manifest, "\n"))
 	{
-		LOGE("Failed to swizzle image.\n");
-		return 1;
+		auto tokens = Util::split_no_empty(line, " \t\r");
+		if (tokens.empty() || tokens.front()[0] == '#')
+			continue;
+
+		auto job = std::make_unique<ConvertJob>();
+		job->opts = defaults;
+		job->opts.args.output.clear();
+
+		std::vector<char *> argv;
+		for (auto &token : tokens)
+			argv.push_back(&token[0]);
+
+		CLICallbacks cbs;
+		add_convert_callbacks(cbs, job->opts);
+		cbs.default_handler = [&](const char *arg) { job->input_path = Path::relpath(batch_path, arg); };
+		CLIParser parser(std::move(cbs), int(argv.size()), argv.data());
+		if (!parser.parse() || job->input_path.empty())
+		{
+			LOGE("Invalid manifest line: %s\n", line.c_str());
+			return false;
+		}
+
+		if (!job->opts.args.output.empty())
+			job->opts.args.output = Path::relpath(batch_path, job->opts.args.output);
+		else if (!defaults.args.output.empty())
+			job->opts.args.output = output_path_for_input(defaults.args.output, job->input_path);
+		else
+		{
+			LOGE("No output for %s.\n", job->input_path.c_str());
+			return false;
+		}
+
+		jobs.push_back(std::move(job));
+	}
+
+	return true;
+}
+
+static bool validate_job(const ConvertJob &job)
+{
+	if (job.opts.args.format == VK_FORMAT_UNDEFINED)
+	{
+		LOGE("Must provide a format for %s.\n", job.input_path.c_str());
+		return false;
 	}
 
+	if (job.opts.args.output.empty() || job.input_path.empty())
+	{
+		LOGE("Must provide input and output paths.\n");
+		return false;
+	}
+
+	return true;
+}
+
+// Estimates the peak working set of a conversion from the image header: the decoded source,
+// a mip chain or alpha fixup copy which is produced while the source is still alive, and the mapped output.
+static size_t estimate_job_memory(ConvertJob &job)
+{
+	auto file = GRANITE_FILESYSTEM()->open(job.input_path, FileMode::ReadOnly);
+	auto mapped = file ? file->map() : FileMappingHandle{};
+	if (!mapped)
+		return 0;
+
+	job.decoded_size = Vulkan::get_decoded_texture_size(mapped->data(), mapped->get_size());
+	size_t with_mips = job.opts.generate_mipmap ? job.decoded_size + job.decoded_size / 3 : job.decoded_size;
+	return job.decoded_size + 2 * with_mips;
+}
+
+static uint64_t get_peak_rss()
+{
+#ifndef _WIN32
+	struct rusage usage = {};
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+	return 0;
+}
+
+static bool run_jobs(std::vector<std::unique_ptr<ConvertJob>> &jobs, size_t memory_budget, const std::string &cache_path)
+{
 	ThreadGroup &group = *GRANITE_THREAD_GROUP();
+	MemoryBudget budget(memory_budget);
+	auto cache = load_hash_cache(cache_path);
+	int64_t start_time = Util::get_current_time_nsecs();
+
+	for (auto &job : jobs)
+	{
+		job->budget_size = estimate_job_memory(*job);
+		budget.acquire(job->budget_size);
+
+		auto completion = group.create_task([&budget, j = job.get()]() {
+			budget.release(j->budget_size);
+		});
+		completion->set_desc("gtx-convert-complete");
+		enqueue_conversion(group, *job, cache, std::move(completion));
+	}
 
-	auto dummy = group.create_task();
-	compress_texture(group, args, input, dummy, nullptr);
-	dummy->flush();
 	group.wait_idle();
+	int64_t end_time = Util::get_current_time_nsecs();
+
+	unsigned converted = 0, skipped = 0, failed = 0;
+	uint64_t decoded_bytes = 0;
+	for (auto &job : jobs)
+	{
+		if (job->failed)
+		{
+			failed++;
+			cache.erase(job->opts.args.output);
+		}
+		else if (job->skipped)
+			skipped++;
+		else
+		{
+			converted++;
+			decoded_bytes += job->decoded_size;
+			cache[job->opts.args.output] = job->hash;
+		}
+	}
+
+	if (!cache_path.empty() && !save_hash_cache(cache_path, cache))
+		LOGE("Failed to write hash cache %s.\n", cache_path.c_str());
+
+	if (jobs.size() > 1)
+	{
+		double seconds = 1e-9 * double(end_time - start_time);
+		LOGI("Converted %u textures (%u skipped, %u failed) in %.3f s.\n", converted, skipped, failed, seconds);
+		LOGI("  Throughput: %.2f textures/s, %.2f MiB/s decoded.\n",
+		     double(converted) / seconds, double(decoded_bytes) / (1024.0 * 1024.0 * seconds));
+		LOGI("  Peak estimated working set: %.2f MiB (budget %.2f MiB), peak RSS: %.2f MiB.\n",
+		     double(budget.peak) / (1024.0 * 1024.0), double(memory_budget) / (1024.0 * 1024.0),
+		     double(get_peak_rss()) / (1024.0 * 1024.0));
+	}
+
+	return failed == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	Global::init(Global::MANAGER_FEATURE_THREAD_GROUP_BIT |
+	             Global::MANAGER_FEATURE_FILESYSTEM_BIT |
+	             Global::MANAGER_FEATURE_EVENT_BIT);
+
+	std::string input_path;
+	std::string batch_path;
+	std::string cache_path;
+	size_t memory_budget = 2048;
+	ConvertOptions opts;
+	opts.args.mode = TextureMode::RGB;
+
+	CLICallbacks cbs;
+	cbs.add("--help", [&](CLIParser &parser) { print_help(); parser.end(); });
+	add_convert_callbacks(cbs, opts);
+	cbs.add("--batch", [&](CLIParser &parser) { batch_path = parser.next_string(); });
+	cbs.add("--memory-budget", [&](CLIParser &parser) { memory_budget = parser.next_uint(); });
+	cbs.add("--cache", [&](CLIParser &parser) { cache_path = parser.next_string(); });
+	cbs.default_handler = [&](const char *arg) { input_path = arg; };
+	cbs.error_handler = []() { print_help(); };
+	CLIParser parser(std::move(cbs), argc - 1, argv + 1);
+
+	if (!parser.parse())
+		return 1;
+	else if (parser.is_ended_state())
+		return 0;
+
+	std::vector<std::unique_ptr<ConvertJob>> jobs;
+	if (!batch_path.empty())
+	{
+		if (!gather_jobs(batch_path, opts, jobs))
+			return 1;
+
+		if (cache_path.empty())
+		{
+			FileStat s;
+			if (GRANITE_FILESYSTEM()->stat(batch_path, s) && s.type == PathType::Directory)
+				cache_path = Path::join(opts.args.output, "gtx_convert.cache");
+			else
+				cache_path = batch_path + ".cache";
+		}
+		LOGI("Batch converting %u textures.\n", unsigned(jobs.size()));
+	}
+	else
+	{
+		// A single texture is just a batch of one, without a budget or cache.
+		auto job = std::make_unique<ConvertJob>();
+		job->opts = opts;
+		job->input_path = input_path;
+		jobs.push_back(std::move(job));
+		memory_budget = 0;
+	}
+
+	for (auto &job : jobs)
+		if (!validate_job(*job))
+			return 1;
+
+	if (!run_jobs(jobs, memory_budget * 1024 * 1024, cache_path))
+		return 1;
 }
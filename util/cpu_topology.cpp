@@ -0,0 +1,260 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "cpu_topology.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace Util
+{
+#ifdef __linux__
+static bool read_sysfs_line(const std::string &path, std::string &line)
+{
+	FILE *file = fopen(path.c_str(), "r");
+	if (!file)
+		return false;
+
+	char buffer[4096];
+	bool ret = fgets(buffer, sizeof(buffer), file) != nullptr;
+	fclose(file);
+
+	if (ret)
+	{
+		line = buffer;
+		while (!line.empty() && (line.back() == '\n' || line.back() == ' '))
+			line.pop_back();
+	}
+	return ret;
+}
+
+static bool read_sysfs_uint(const std::string &path, unsigned &value)
+{
+	std::string line;
+	if (!read_sysfs_line(path, line) || line.empty())
+		return false;
+	value = unsigned(strtoul(line.c_str(), nullptr, 0));
+	return true;
+}
+
+// Parses the kernel's cpulist format, e.g. "0-3,8,10-11".
+static std::vector<unsigned> parse_cpu_list(const std::string &list)
+{
+	std::vector<unsigned> ret;
+	const char *str = list.c_str();
+
+	while (*str != '\0')
+	{
+		char *end = nullptr;
+		unsigned first = unsigned(strtoul(str, &end, 10));
+		if (end == str)
+			break;
+		str = end;
+
+		unsigned last = first;
+		if (*str == '-')
+		{
+			str++;
+			last = unsigned(strtoul(str, &end, 10));
+			if (end == str)
+				break;
+			str = end;
+		}
+
+		for (unsigned i = first; i <= last; i++)
+			ret.push_back(i);
+
+		if (*str == ',')
+			str++;
+		else
+			break;
+	}
+
+	return ret;
+}
+
+static bool read_sysfs_cpu_list(const std::string &path, std::vector<unsigned> &cpus)
+{
+	std::string line;
+	if (!read_sysfs_line(path, line))
+		return false;
+	cpus = parse_cpu_list(line);
+	return true;
+}
+
+bool CPUTopology::discover()
+{
+	cpus.clear();
+	num_numa_nodes = 1;
+	is_hybrid = false;
+
+	std::vector<unsigned> online;
+	if (!read_sysfs_cpu_list("/sys/devices/system/cpu/online", online) || online.empty())
+		return false;
+
+	for (auto id : online)
+	{
+		LogicalCPU cpu;
+		cpu.id = id;
+		auto base = std::string("/sys/devices/system/cpu/cpu") + std::to_string(id) + "/topology/";
+		read_sysfs_uint(base + "core_id", cpu.core_id);
+		read_sysfs_uint(base + "physical_package_id", cpu.package_id);
+
+		std::vector<unsigned> siblings;
+		if (read_sysfs_cpu_list(base + "thread_siblings_list", siblings))
+		{
+			auto itr = std::find(siblings.begin(), siblings.end(), id);
+			if (itr != siblings.end())
+				cpu.smt_index = unsigned(itr - siblings.begin());
+		}
+
+		cpus.push_back(cpu);
+	}
+
+	std::vector<unsigned> nodes;
+	if (read_sysfs_cpu_list("/sys/devices/system/node/online", nodes) && !nodes.empty())
+	{
+		num_numa_nodes = unsigned(nodes.size());
+		for (auto node : nodes)
+		{
+			std::vector<unsigned> node_cpus;
+			if (!read_sysfs_cpu_list(std::string("/sys/devices/system/node/node") + std::to_string(node) + "/cpulist",
+			                         node_cpus))
+				continue;
+
+			for (auto &cpu : cpus)
+				if (std::find(node_cpus.begin(), node_cpus.end(), cpu.id) != node_cpus.end())
+					cpu.numa_node = node;
+		}
+	}
+
+	// Intel hybrid CPUs expose separate PMUs for P-cores and E-cores.
+	std::vector<unsigned> p_cores;
+	if (read_sysfs_cpu_list("/sys/devices/cpu_core/cpus", p_cores) && !p_cores.empty() && p_cores.size() < cpus.size())
+	{
+		is_hybrid = true;
+		for (auto &cpu : cpus)
+			cpu.performance_core = std::find(p_cores.begin(), p_cores.end(), cpu.id) != p_cores.end();
+	}
+	else
+	{
+		// ARM big.LITTLE reports relative capacity per core.
+		std::vector<unsigned> capacities;
+		unsigned max_capacity = 0;
+		for (auto &cpu : cpus)
+		{
+			unsigned capacity = 0;
+			if (!read_sysfs_uint(std::string("/sys/devices/system/cpu/cpu") + std::to_string(cpu.id) + "/cpu_capacity",
+			                     capacity))
+			{
+				capacities.clear();
+				break;
+			}
+			capacities.push_back(capacity);
+			max_capacity = std::max(max_capacity, capacity);
+		}
+
+		for (size_t i = 0; i < capacities.size(); i++)
+		{
+			cpus[i].performance_core = capacities[i] == max_capacity;
+			if (!cpus[i].performance_core)
+				is_hybrid = true;
+		}
+	}
+
+	return true;
+}
+
+unsigned get_current_cpu()
+{
+	int cpu = sched_getcpu();
+	return cpu >= 0 ? unsigned(cpu) : ~0u;
+}
+
+bool set_current_thread_affinity(const std::vector<unsigned> &cpu_ids)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (auto id : cpu_ids)
+		if (id < CPU_SETSIZE)
+			CPU_SET(id, &set);
+
+	// Thread ID 0 refers to the calling thread. Also works on Android, which lacks pthread_setaffinity_np.
+	if (sched_setaffinity(0, sizeof(set), &set) != 0)
+	{
+		LOGE("Failed to set thread affinity.\n");
+		return false;
+	}
+	return true;
+}
+
+bool get_current_thread_affinity(std::vector<unsigned> &cpu_ids)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) != 0)
+		return false;
+
+	cpu_ids.clear();
+	for (unsigned id = 0; id < CPU_SETSIZE; id++)
+		if (CPU_ISSET(id, &set))
+			cpu_ids.push_back(id);
+	return true;
+}
+#else
+bool CPUTopology::discover()
+{
+	cpus.clear();
+	return false;
+}
+
+unsigned get_current_cpu()
+{
+	return ~0u;
+}
+
+bool set_current_thread_affinity(const std::vector<unsigned> &)
+{
+	return false;
+}
+
+bool get_current_thread_affinity(std::vector<unsigned> &)
+{
+	return false;
+}
+#endif
+
+const LogicalCPU *CPUTopology::find_cpu(unsigned id) const
+{
+	for (auto &cpu : cpus)
+		if (cpu.id == id)
+			return &cpu;
+	return nullptr;
+}
+}
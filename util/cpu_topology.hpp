@@ -0,0 +1,62 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+namespace Util
+{
+struct LogicalCPU
+{
+	unsigned id = 0;
+	// Physical core. Logical CPUs with the same core_id and package_id are SMT siblings.
+	unsigned core_id = 0;
+	unsigned package_id = 0;
+	unsigned numa_node = 0;
+	// 0 for the first hardware thread of a core, 1 for the next sibling, etc.
+	unsigned smt_index = 0;
+	// False for efficiency cores on hybrid systems (Intel P/E, ARM big.LITTLE).
+	bool performance_core = true;
+};
+
+struct CPUTopology
+{
+	std::vector<LogicalCPU> cpus;
+	unsigned num_numa_nodes = 1;
+	bool is_hybrid = false;
+
+	// Only implemented on Linux, where it is parsed from sysfs.
+	// Returns false if the topology could not be determined.
+	bool discover();
+
+	const LogicalCPU *find_cpu(unsigned id) const;
+};
+
+// Returns ~0u if unknown.
+unsigned get_current_cpu();
+
+bool set_current_thread_affinity(const std::vector<unsigned> &cpu_ids);
+bool get_current_thread_affinity(std::vector<unsigned> &cpu_ids);
+}
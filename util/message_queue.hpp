@@ -71,8 +71,8 @@ public:
 
 	bool write_and_move(T *values, size_t count) noexcept
 	{
-		size_t current_written = read_count.load(std::memory_order_relaxed);
-		size_t current_read = write_count.load(std::memory_order_acquire);
+		size_t current_read = read_count.load(std::memory_order_acquire);
+		size_t current_written = write_count.load(std::memory_order_relaxed);
 		if (count > ring.size() - (current_written - current_read))
 			return false;
 
@@ -41,19 +41,8 @@ public:
 	T *allocate(P &&... p)
 	{
 #ifndef OBJECT_POOL_DEBUG
-		if (vacants.empty())
-		{
-			unsigned num_objects = 64u << memory.size();
-			T *ptr = static_cast<T *>(memalign_alloc(std::max<size_t>(64, alignof(T)),
-			                                         num_objects * sizeof(T)));
-			if (!ptr)
-				return nullptr;
-
-			for (unsigned i = 0; i < num_objects; i++)
-				vacants.push_back(&ptr[i]);
-
-			memory.emplace_back(ptr);
-		}
+		if (vacants.empty() && !allocate_block(64u << memory.size()))
+			return nullptr;
 
 		T *ptr = vacants.back();
 		vacants.pop_back();
@@ -74,6 +63,17 @@ public:
 #endif
 	}
 
+	// Ensures the next count allocations do not need to allocate memory.
+	void reserve(size_t count)
+	{
+#ifndef OBJECT_POOL_DEBUG
+		if (vacants.size() < count)
+			allocate_block(std::max<size_t>(count - vacants.size(), 64u << memory.size()));
+#else
+		(void)count;
+#endif
+	}
+
 	void clear()
 	{
 #ifndef OBJECT_POOL_DEBUG
@@ -95,6 +95,22 @@ protected:
 	};
 
 	std::vector<std::unique_ptr<T, MallocDeleter>> memory;
+
+	bool allocate_block(size_t num_objects)
+	{
+		T *ptr = static_cast<T *>(memalign_alloc(std::max<size_t>(64, alignof(T)),
+		                                         num_objects * sizeof(T)));
+		if (!ptr)
+			return false;
+
+		// Push in reverse so consecutive allocations are handed out in address order.
+		vacants.reserve(vacants.size() + num_objects);
+		for (size_t i = num_objects; i; i--)
+			vacants.push_back(&ptr[i - 1]);
+
+		memory.emplace_back(ptr);
+		return true;
+	}
 #endif
 };
 
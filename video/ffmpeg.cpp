@@ -27,15 +27,18 @@ extern "C"
 #include <libavcodec/avcodec.h>
 #include <libavutil/avutil.h>
 #include <libavutil/channel_layout.h>
-#include <libswscale/swscale.h>
 }
 
 #include "ffmpeg.hpp"
 #include "logging.hpp"
 #include "thread_latch.hpp"
+#include "thread_group.hpp"
+#include "thread_name.hpp"
+#include "timer.hpp"
 #include <condition_variable>
 #include <mutex>
 #include <thread>
+#include <queue>
 #ifdef HAVE_GRANITE_AUDIO
 #include "audio_interface.hpp"
 #endif
@@ -43,6 +46,8 @@ extern "C"
 namespace Granite
 {
 static constexpr unsigned NumFrames = 4;
+static constexpr unsigned NumConvertedFrames = 3;
+static constexpr unsigned NumQueuedPackets = 64;
 
 struct CodecStream
 {
@@ -50,7 +55,55 @@ struct CodecStream
 	AVFrame *av_frame = nullptr;
 	AVCodecContext *av_ctx = nullptr;
 	AVPacket *av_pkt = nullptr;
-	SwsContext *sws_ctx = nullptr;
+};
+
+// Hands work between pipeline stages. push() blocks while full, pop() blocks while empty.
+// Once closed, push() fails and pop() drains what is left before failing.
+template <typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity_)
+		: capacity(capacity_)
+	{
+	}
+
+	bool push(T value)
+	{
+		std::unique_lock<std::mutex> holder{lock};
+		cond.wait(holder, [this]() { return closed || queue.size() < capacity; });
+		if (closed)
+			return false;
+		queue.push(std::move(value));
+		cond.notify_all();
+		return true;
+	}
+
+	bool pop(T &value)
+	{
+		std::unique_lock<std::mutex> holder{lock};
+		cond.wait(holder, [this]() { return closed || !queue.empty(); });
+		if (queue.empty())
+			return false;
+		value = std::move(queue.front());
+		queue.pop();
+		cond.notify_all();
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> holder{lock};
+		closed = true;
+		cond.notify_all();
+	}
+
+private:
+	std::mutex lock;
+	std::condition_variable cond;
+	std::queue<T> queue;
+	size_t capacity;
+	bool closed = false;
 };
 
 struct VideoEncoder::Impl
@@ -82,7 +135,25 @@ struct VideoEncoder::Impl
 	};
 	Frame frames[NumFrames];
 	unsigned frame_index = 0;
-	std::thread thr;
+
+	// Readback happens on the calling thread. Colour conversion, encoding and muxing each get a thread,
+	// connected by bounded queues, so a slow stage only stalls the others once its queue is full.
+	struct EncodeItem
+	{
+		AVFrame *frame = nullptr;
+		std::vector<int16_t> audio_buffer;
+	};
+	std::vector<AVFrame *> video_frames;
+	BoundedQueue<AVFrame *> free_video_frames{NumConvertedFrames};
+	BoundedQueue<EncodeItem> encode_queue{NumConvertedFrames};
+	BoundedQueue<AVPacket *> mux_queue{NumQueuedPackets};
+	std::thread convert_thread, encode_thread, mux_thread;
+
+	void convert_thread_main();
+	void encode_thread_main();
+	void mux_thread_main();
+	bool encode_audio(const std::vector<int16_t> &audio_buffer, int64_t &encode_audio_pts, int &current_audio_frames);
+	void abort_pipeline();
 
 	bool enqueue_buffer_readback(
 			const Vulkan::Image &image, VkImageLayout layout,
@@ -92,13 +163,15 @@ struct VideoEncoder::Impl
 
 	bool drain_packets(CodecStream &stream);
 	void drain();
-	void thread_main();
 
 	bool init_video_codec();
 	bool init_audio_codec();
 
 	int64_t audio_pts = 0;
 	int64_t video_pts = 0;
+
+	int64_t first_frame_time = 0;
+	unsigned encoded_frames = 0;
 };
 
 void VideoEncoder::Impl::drain()
@@ -115,8 +188,6 @@ static void free_av_objects(CodecStream &stream)
 {
 	if (stream.av_frame)
 		av_frame_free(&stream.av_frame);
-	if (stream.sws_ctx)
-		sws_freeContext(stream.sws_ctx);
 	if (stream.av_pkt)
 		av_packet_free(&stream.av_pkt);
 	if (stream.av_ctx)
@@ -125,17 +196,9 @@ static void free_av_objects(CodecStream &stream)
 
 void VideoEncoder::Impl::drain_codec()
 {
+	// The encode thread has flushed the codec at this point.
 	if (av_format_ctx)
 	{
-		if (video.av_pkt)
-		{
-			int ret = avcodec_send_frame(video.av_ctx, nullptr);
-			if (ret < 0)
-				LOGE("Failed to send packet to codec: %d\n", ret);
-			else if (!drain_packets(video))
-				LOGE("Failed to drain codec of packets.\n");
-		}
-
 		av_write_trailer(av_format_ctx);
 		if (!(av_format_ctx->flags & AVFMT_NOFILE))
 			avio_closep(&av_format_ctx->pb);
@@ -145,19 +208,37 @@ void VideoEncoder::Impl::drain_codec()
 
 	free_av_objects(video);
 	free_av_objects(audio);
+
+	for (auto *frame : video_frames)
+		av_frame_free(&frame);
+	video_frames.clear();
 }
 
 VideoEncoder::Impl::~Impl()
 {
+	// Conversion stops here, the later stages finish what has been queued.
 	for (auto &frame : frames)
 		frame.latch.kill_latch();
 
-	if (thr.joinable())
-		thr.join();
+	if (convert_thread.joinable())
+		convert_thread.join();
+	if (encode_thread.joinable())
+		encode_thread.join();
+	if (mux_thread.joinable())
+		mux_thread.join();
 
 	drain_codec();
 }
 
+void VideoEncoder::Impl::abort_pipeline()
+{
+	for (auto &frame : frames)
+		frame.latch.kill_latch();
+	free_video_frames.close();
+	encode_queue.close();
+	mux_queue.close();
+}
+
 bool VideoEncoder::Impl::enqueue_buffer_readback(
 		const Vulkan::Image &image, VkImageLayout layout,
 		Vulkan::CommandBuffer::Type type,
@@ -241,10 +322,19 @@ bool VideoEncoder::Impl::drain_packets(CodecStream &stream)
 
 		av_packet_rescale_ts(stream.av_pkt, stream.av_ctx->time_base, stream.av_stream->time_base);
 		stream.av_pkt->stream_index = stream.av_stream->index;
-		ret = av_interleaved_write_frame(av_format_ctx, stream.av_pkt);
-		if (ret < 0)
+
+		AVPacket *pkt = av_packet_alloc();
+		if (!pkt)
+		{
+			ret = AVERROR(ENOMEM);
+			break;
+		}
+
+		av_packet_move_ref(pkt, stream.av_pkt);
+		if (!mux_queue.push(pkt))
 		{
-			LOGE("Failed to write packet: %d\n", ret);
+			av_packet_free(&pkt);
+			ret = AVERROR_EXIT;
 			break;
 		}
 	}
@@ -252,12 +342,57 @@ bool VideoEncoder::Impl::drain_packets(CodecStream &stream)
 	return ret == 0 || ret == AVERROR_EOF || ret == AVERROR(EAGAIN);
 }
 
-void VideoEncoder::Impl::thread_main()
+bool VideoEncoder::Impl::encode_audio(const std::vector<int16_t> &audio_buffer,
+                                      int64_t &encode_audio_pts, int &current_audio_frames)
+{
+	int ret;
+	for (size_t i = 0, n = audio_buffer.size() / 2; i < n; )
+	{
+		int to_copy = std::min<int>(int(n - i), audio.av_frame->nb_samples - current_audio_frames);
+
+		if (current_audio_frames == 0)
+		{
+			if ((ret = av_frame_make_writable(audio.av_frame)) < 0)
+			{
+				LOGE("Failed to make frame writable: %d.\n", ret);
+				return false;
+			}
+		}
+
+		memcpy(reinterpret_cast<int16_t *>(audio.av_frame->data[0]) + 2 * current_audio_frames,
+		       audio_buffer.data() + 2 * i, to_copy * 2 * sizeof(int16_t));
+
+		current_audio_frames += to_copy;
+
+		if (current_audio_frames == audio.av_frame->nb_samples)
+		{
+			audio.av_frame->pts = encode_audio_pts;
+			encode_audio_pts += current_audio_frames;
+			current_audio_frames = 0;
+
+			ret = avcodec_send_frame(audio.av_ctx, audio.av_frame);
+			if (ret < 0)
+			{
+				LOGE("Failed to send packet to codec: %d\n", ret);
+				return false;
+			}
+
+			if (!drain_packets(audio))
+				return false;
+		}
+
+		i += to_copy;
+	}
+
+	return true;
+}
+
+void VideoEncoder::Impl::convert_thread_main()
 {
+	Util::set_current_thread_name("video-convert");
+	auto *group = GRANITE_THREAD_GROUP();
 	unsigned index = 0;
 	int64_t encode_video_pts = 0;
-	int64_t encode_audio_pts = 0;
-	int current_audio_frames = 0;
 	int ret;
 
 	for (;;)
@@ -265,58 +400,20 @@ void VideoEncoder::Impl::thread_main()
 		index = (index + 1) % NumFrames;
 		auto &frame = frames[index];
 		if (!frame.latch.wait_latch_set())
-			return;
+			break;
 
-		if (audio.av_pkt)
-		{
-			for (size_t i = 0, n = frame.audio_buffer.size() / 2; i < n; )
-			{
-				int to_copy = std::min<int>(int(n - i), audio.av_frame->nb_samples - current_audio_frames);
-
-				if (current_audio_frames == 0)
-				{
-					if ((ret = av_frame_make_writable(audio.av_frame)) < 0)
-					{
-						LOGE("Failed to make frame writable: %d.\n", ret);
-						frame.latch.kill_latch();
-						return;
-					}
-				}
-
-				memcpy(reinterpret_cast<int16_t *>(audio.av_frame->data[0]) + 2 * current_audio_frames,
-				       frame.audio_buffer.data() + 2 * i, to_copy * 2 * sizeof(int16_t));
-
-				current_audio_frames += to_copy;
-
-				if (current_audio_frames == audio.av_frame->nb_samples)
-				{
-					audio.av_frame->pts = encode_audio_pts;
-					encode_audio_pts += current_audio_frames;
-					current_audio_frames = 0;
-
-					ret = avcodec_send_frame(audio.av_ctx, audio.av_frame);
-					if (ret < 0)
-					{
-						LOGE("Failed to send packet to codec: %d\n", ret);
-						frame.latch.kill_latch();
-						return;
-					}
-
-					if (!drain_packets(audio))
-					{
-						frame.latch.kill_latch();
-						return;
-					}
-				}
-
-				i += to_copy;
-			}
-		}
+		if (!first_frame_time)
+			first_frame_time = Util::get_current_time_nsecs();
+
+		AVFrame *av_frame = nullptr;
+		if (!free_video_frames.pop(av_frame))
+			break;
 
-		if ((ret = av_frame_make_writable(video.av_frame)) < 0)
+		// The encoder may still reference the previous contents, in which case this reallocates.
+		if ((ret = av_frame_make_writable(av_frame)) < 0)
 		{
 			LOGE("Failed to make frame writable: %d.\n", ret);
-			frame.latch.kill_latch();
+			abort_pipeline();
 			return;
 		}
 
@@ -326,34 +423,115 @@ void VideoEncoder::Impl::thread_main()
 			frame.fence.reset();
 		}
 
-		const uint8_t *src_slices[4] = {
-			static_cast<const uint8_t *>(device->map_host_buffer(*frame.buffer, Vulkan::MEMORY_ACCESS_READ_BIT)),
-		};
-
-		const int linesizes[4] = { frame.stride };
+		RGBToYUVConversion conv;
+		conv.rgbx = static_cast<const uint8_t *>(device->map_host_buffer(*frame.buffer, Vulkan::MEMORY_ACCESS_READ_BIT));
+		conv.rgbx_stride = frame.stride;
+		conv.width = options.width;
+		conv.height = options.height;
+		conv.subsampling = options.subsampling;
+		for (unsigned i = 0; i < 3; i++)
+		{
+			conv.planes[i] = av_frame->data[i];
+			conv.strides[i] = av_frame->linesize[i];
+		}
 
-		sws_scale(video.sws_ctx, src_slices, linesizes,
-		          0, int(options.height),
-		          video.av_frame->data, video.av_frame->linesize);
-		video.av_frame->pts = encode_video_pts++;
+		if (group)
+			convert_rgbx_to_yuv_parallel(*group, conv);
+		else
+			convert_rgbx_to_yuv(conv, 0, options.height);
 
 		device->unmap_host_buffer(*frame.buffer, Vulkan::MEMORY_ACCESS_READ_BIT);
+		av_frame->pts = encode_video_pts++;
 
+		EncodeItem item;
+		item.frame = av_frame;
+		item.audio_buffer = std::move(frame.audio_buffer);
+		frame.audio_buffer.clear();
+
+		// The readback buffer is free for the next frame as soon as it has been converted.
 		frame.latch.clear_latch();
 
-		ret = avcodec_send_frame(video.av_ctx, video.av_frame);
-		if (ret < 0)
+		if (!encode_queue.push(std::move(item)))
 		{
-			LOGE("Failed to send packet to codec: %d\n", ret);
-			frame.latch.kill_latch();
+			abort_pipeline();
 			return;
 		}
+	}
+
+	encode_queue.close();
+}
+
+void VideoEncoder::Impl::encode_thread_main()
+{
+	Util::set_current_thread_name("video-encode");
+	int64_t encode_audio_pts = 0;
+	int current_audio_frames = 0;
+	bool ok = true;
+	int ret;
+
+	EncodeItem item;
+	while (ok && encode_queue.pop(item))
+	{
+		if (audio.av_pkt && !encode_audio(item.audio_buffer, encode_audio_pts, current_audio_frames))
+			ok = false;
 
-		if (!drain_packets(video))
+		if (ok && (ret = avcodec_send_frame(video.av_ctx, item.frame)) < 0)
 		{
-			frame.latch.kill_latch();
-			return;
+			LOGE("Failed to send packet to codec: %d\n", ret);
+			ok = false;
+		}
+
+		// The codec took its own reference if it needs to hold on to the frame.
+		free_video_frames.push(item.frame);
+
+		if (ok && !drain_packets(video))
+			ok = false;
+
+		if (ok)
+			encoded_frames++;
+	}
+
+	if (ok)
+	{
+		// Flush frames delayed by the encoder.
+		if ((ret = avcodec_send_frame(video.av_ctx, nullptr)) < 0)
+			LOGE("Failed to send packet to codec: %d\n", ret);
+		else if (!drain_packets(video))
+			LOGE("Failed to drain codec of packets.\n");
+
+		if (encoded_frames)
+		{
+			double seconds = 1e-9 * double(Util::get_current_time_nsecs() - first_frame_time);
+			LOGI("Encoded %u frames in %.3f s, %.1f FPS.\n", encoded_frames, seconds, double(encoded_frames) / seconds);
+		}
+	}
+	else
+		abort_pipeline();
+
+	mux_queue.close();
+}
+
+void VideoEncoder::Impl::mux_thread_main()
+{
+	Util::set_current_thread_name("video-mux");
+	AVPacket *pkt = nullptr;
+	bool ok = true;
+
+	// Keep popping after a failure so queued packets are freed.
+	while (mux_queue.pop(pkt))
+	{
+		if (ok)
+		{
+			int ret = av_interleaved_write_frame(av_format_ctx, pkt);
+			if (ret < 0)
+			{
+				LOGE("Failed to write packet: %d\n", ret);
+				ok = false;
+				abort_pipeline();
+			}
 		}
+
+		av_packet_free(&pkt);
 	}
 }
 
@@ -466,7 +644,16 @@ bool VideoEncoder::Impl::init_video_codec()
 
 	video.av_ctx->width = options.width;
 	video.av_ctx->height = options.height;
-	video.av_ctx->pix_fmt = AV_PIX_FMT_YUV444P;
+	video.av_ctx->pix_fmt = options.subsampling == ChromaSubsampling::Chroma420 ?
+	                        AV_PIX_FMT_YUV420P : AV_PIX_FMT_YUV444P;
+
+	// Readback is sRGB encoded, converted with the limited range BT.709 matrix.
+	video.av_ctx->color_range = AVCOL_RANGE_MPEG;
+	video.av_ctx->colorspace = AVCOL_SPC_BT709;
+	video.av_ctx->color_primaries = AVCOL_PRI_BT709;
+	video.av_ctx->color_trc = AVCOL_TRC_IEC61966_2_1;
+	if (options.subsampling == ChromaSubsampling::Chroma420)
+		video.av_ctx->chroma_sample_location = AVCHROMA_LOC_LEFT;
 	video.av_ctx->framerate = { options.frame_timebase.den, options.frame_timebase.num };
 	video.av_ctx->time_base = { options.frame_timebase.num, options.frame_timebase.den };
 
@@ -490,21 +677,18 @@ bool VideoEncoder::Impl::init_video_codec()
 
 	avcodec_parameters_from_context(video.av_stream->codecpar, video.av_ctx);
 
-	video.av_frame = alloc_video_frame(video.av_ctx->pix_fmt, options.width, options.height);
-	if (!video.av_frame)
+	for (unsigned i = 0; i < NumConvertedFrames; i++)
 	{
-		LOGE("Failed to allocate AVFrame.\n");
-		return false;
+		auto *frame = alloc_video_frame(video.av_ctx->pix_fmt, options.width, options.height);
+		if (!frame)
+		{
+			LOGE("Failed to allocate AVFrame.\n");
+			return false;
+		}
+		video_frames.push_back(frame);
+		free_video_frames.push(frame);
 	}
 
-	video.sws_ctx = sws_getContext(options.width, options.height,
-	                               AV_PIX_FMT_RGB0,
-	                               options.width, options.height,
-	                               AV_PIX_FMT_YUV444P, SWS_POINT,
-	                               nullptr, nullptr, nullptr);
-	if (!video.sws_ctx)
-		return false;
-
 	video.av_pkt = av_packet_alloc();
 	if (!video.av_pkt)
 		return false;
@@ -516,6 +700,12 @@ bool VideoEncoder::Impl::init(Vulkan::Device *device_, const char *path, const O
 	device = device_;
 	options = options_;
 
+	if (options.subsampling == ChromaSubsampling::Chroma420 && ((options.width | options.height) & 1) != 0)
+	{
+		LOGE("4:2:0 encoding requires even dimensions.\n");
+		return false;
+	}
+
 	int ret;
 	if ((ret = avformat_alloc_output_context2(&av_format_ctx, nullptr, nullptr, path)) < 0)
 	{
@@ -546,7 +736,9 @@ bool VideoEncoder::Impl::init(Vulkan::Device *device_, const char *path, const O
 		return false;
 	}
 
-	thr = std::thread(&Impl::thread_main, this);
+	convert_thread = std::thread(&Impl::convert_thread_main, this);
+	encode_thread = std::thread(&Impl::encode_thread_main, this);
+	mux_thread = std::thread(&Impl::mux_thread_main, this);
 	return true;
 }
 
@@ -24,6 +24,7 @@
 
 #include "device.hpp"
 #include "image.hpp"
+#include "rgb_to_yuv.hpp"
 
 namespace Granite
 {
@@ -49,6 +50,7 @@ public:
 		unsigned width;
 		unsigned height;
 		Timebase frame_timebase;
+		ChromaSubsampling subsampling = ChromaSubsampling::Chroma444;
 	};
 
 	void set_audio_source(Audio::DumpBackend *backend);
@@ -0,0 +1,273 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "rgb_to_yuv.hpp"
+#include "thread_group.hpp"
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Granite
+{
+// Limited range BT.709 with 8-bit fractional coefficients.
+// Chroma coefficients sum to zero so grey maps exactly to 128.
+static inline uint8_t rgb_to_y(int r, int g, int b)
+{
+	return uint8_t(((47 * r + 157 * g + 16 * b + 128) >> 8) + 16);
+}
+
+static inline uint8_t rgb_to_cb(int r, int g, int b)
+{
+	return uint8_t(((-26 * r - 86 * g + 112 * b + 128) >> 8) + 128);
+}
+
+static inline uint8_t rgb_to_cr(int r, int g, int b)
+{
+	return uint8_t(((112 * r - 102 * g - 10 * b + 128) >> 8) + 128);
+}
+
+static void convert_luma_row_scalar(const uint8_t *src, uint8_t *y, unsigned begin, unsigned width)
+{
+	for (unsigned x = begin; x < width; x++)
+	{
+		const uint8_t *p = src + 4 * x;
+		y[x] = rgb_to_y(p[0], p[1], p[2]);
+	}
+}
+
+static void convert_chroma444_row_scalar(const uint8_t *src, uint8_t *cb, uint8_t *cr, unsigned begin, unsigned width)
+{
+	for (unsigned x = begin; x < width; x++)
+	{
+		const uint8_t *p = src + 4 * x;
+		cb[x] = rgb_to_cb(p[0], p[1], p[2]);
+		cr[x] = rgb_to_cr(p[0], p[1], p[2]);
+	}
+}
+
+static void convert_chroma420_row_scalar(const uint8_t *row0, const uint8_t *row1, uint8_t *cb, uint8_t *cr,
+                                         unsigned begin, unsigned width)
+{
+	unsigned chroma_width = (width + 1) / 2;
+	for (unsigned cx = begin; cx < chroma_width; cx++)
+	{
+		unsigned x = 2 * cx;
+		unsigned left = x ? x - 1 : 0;
+		unsigned right = std::min(x + 1, width - 1);
+
+		int avg[3];
+		for (unsigned c = 0; c < 3; c++)
+		{
+			int l = row0[4 * left + c] + row1[4 * left + c];
+			int m = row0[4 * x + c] + row1[4 * x + c];
+			int r = row0[4 * right + c] + row1[4 * right + c];
+			avg[c] = (l + 2 * m + r + 4) >> 3;
+		}
+
+		cb[cx] = rgb_to_cb(avg[0], avg[1], avg[2]);
+		cr[cx] = rgb_to_cr(avg[0], avg[1], avg[2]);
+	}
+}
+
+#ifdef __SSE2__
+// Deinterleaves 8 RGBX pixels into 16-bit R, G and B vectors.
+static inline void load_rgb8(const uint8_t *src, __m128i &r, __m128i &g, __m128i &b)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+	__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+	r = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask), _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+	b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask), _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+}
+
+// 16-bit lanes wrap, but the final sums are in range, so the results match the scalar path exactly.
+static inline __m128i rgb_to_y8(__m128i r, __m128i g, __m128i b)
+{
+	__m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(47)), _mm_mullo_epi16(g, _mm_set1_epi16(157)));
+	y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(16)));
+	y = _mm_add_epi16(y, _mm_set1_epi16(128));
+	return _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(16));
+}
+
+static inline __m128i rgb_to_chroma8(__m128i r, __m128i g, __m128i b, int16_t kr, int16_t kg, int16_t kb)
+{
+	__m128i c = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(kr)), _mm_mullo_epi16(g, _mm_set1_epi16(kg)));
+	c = _mm_add_epi16(c, _mm_mullo_epi16(b, _mm_set1_epi16(kb)));
+	c = _mm_add_epi16(c, _mm_set1_epi16(128));
+	return _mm_add_epi16(_mm_srai_epi16(c, 8), _mm_set1_epi16(128));
+}
+
+static unsigned convert_luma_row_sse2(const uint8_t *src, uint8_t *y, unsigned width)
+{
+	unsigned x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i r0, g0, b0, r1, g1, b1;
+		load_rgb8(src + 4 * x, r0, g0, b0);
+		load_rgb8(src + 4 * x + 32, r1, g1, b1);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(y + x),
+		                 _mm_packus_epi16(rgb_to_y8(r0, g0, b0), rgb_to_y8(r1, g1, b1)));
+	}
+	return x;
+}
+
+static unsigned convert_chroma444_row_sse2(const uint8_t *src, uint8_t *cb, uint8_t *cr, unsigned width)
+{
+	unsigned x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i r0, g0, b0, r1, g1, b1;
+		load_rgb8(src + 4 * x, r0, g0, b0);
+		load_rgb8(src + 4 * x + 32, r1, g1, b1);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(cb + x),
+		                 _mm_packus_epi16(rgb_to_chroma8(r0, g0, b0, -26, -86, 112),
+		                                  rgb_to_chroma8(r1, g1, b1, -26, -86, 112)));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(cr + x),
+		                 _mm_packus_epi16(rgb_to_chroma8(r0, g0, b0, 112, -102, -10),
+		                                  rgb_to_chroma8(r1, g1, b1, 112, -102, -10)));
+	}
+	return x;
+}
+
+// Applies [1 2 1] to 16 vertically summed samples, producing the 8 even-sited outputs.
+// carry holds the sample left of the block in lane 0.
+static inline __m128i filter_121(__m128i lo, __m128i hi, __m128i &carry)
+{
+	__m128i even = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(lo, 16), 16),
+	                               _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16));
+	__m128i odd = _mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16));
+	__m128i prev_odd = _mm_or_si128(_mm_slli_si128(odd, 2), carry);
+	carry = _mm_srli_si128(odd, 14);
+
+	__m128i sum = _mm_add_epi16(_mm_add_epi16(prev_odd, odd), _mm_slli_epi16(even, 1));
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(4)), 3);
+}
+
+static unsigned convert_chroma420_row_sse2(const uint8_t *row0, const uint8_t *row1, uint8_t *cb, uint8_t *cr,
+                                           unsigned width)
+{
+	if (width < 16)
+		return 0;
+
+	// The first chroma sample clamps its left neighbour to column 0.
+	__m128i carry_r = _mm_cvtsi32_si128(row0[0] + row1[0]);
+	__m128i carry_g = _mm_cvtsi32_si128(row0[1] + row1[1]);
+	__m128i carry_b = _mm_cvtsi32_si128(row0[2] + row1[2]);
+
+	unsigned x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i r0, g0, b0, r1, g1, b1;
+		__m128i r2, g2, b2, r3, g3, b3;
+		load_rgb8(row0 + 4 * x, r0, g0, b0);
+		load_rgb8(row0 + 4 * x + 32, r1, g1, b1);
+		load_rgb8(row1 + 4 * x, r2, g2, b2);
+		load_rgb8(row1 + 4 * x + 32, r3, g3, b3);
+
+		__m128i r = filter_121(_mm_add_epi16(r0, r2), _mm_add_epi16(r1, r3), carry_r);
+		__m128i g = filter_121(_mm_add_epi16(g0, g2), _mm_add_epi16(g1, g3), carry_g);
+		__m128i b = filter_121(_mm_add_epi16(b0, b2), _mm_add_epi16(b1, b3), carry_b);
+
+		__m128i u = rgb_to_chroma8(r, g, b, -26, -86, 112);
+		__m128i v = rgb_to_chroma8(r, g, b, 112, -102, -10);
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(cb + x / 2), _mm_packus_epi16(u, u));
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(cr + x / 2), _mm_packus_epi16(v, v));
+	}
+
+	return x / 2;
+}
+#endif
+
+template <bool use_simd>
+static void convert_rows(const RGBToYUVConversion &conv, unsigned begin_row, unsigned end_row)
+{
+	end_row = std::min(end_row, conv.height);
+
+	for (unsigned row = begin_row; row < end_row; row++)
+	{
+		const uint8_t *src = conv.rgbx + ptrdiff_t(row) * conv.rgbx_stride;
+		uint8_t *y = conv.planes[0] + ptrdiff_t(row) * conv.strides[0];
+		unsigned x = 0;
+#ifdef __SSE2__
+		if (use_simd)
+			x = convert_luma_row_sse2(src, y, conv.width);
+#endif
+		convert_luma_row_scalar(src, y, x, conv.width);
+
+		if (conv.subsampling == ChromaSubsampling::Chroma444)
+		{
+			uint8_t *cb = conv.planes[1] + ptrdiff_t(row) * conv.strides[1];
+			uint8_t *cr = conv.planes[2] + ptrdiff_t(row) * conv.strides[2];
+			x = 0;
+#ifdef __SSE2__
+			if (use_simd)
+				x = convert_chroma444_row_sse2(src, cb, cr, conv.width);
+#endif
+			convert_chroma444_row_scalar(src, cb, cr, x, conv.width);
+		}
+		else if ((row & 1) == 0)
+		{
+			// Odd heights replicate the last row.
+			const uint8_t *next = row + 1 < conv.height ? src + conv.rgbx_stride : src;
+			uint8_t *cb = conv.planes[1] + ptrdiff_t(row / 2) * conv.strides[1];
+			uint8_t *cr = conv.planes[2] + ptrdiff_t(row / 2) * conv.strides[2];
+			x = 0;
+#ifdef __SSE2__
+			if (use_simd)
+				x = convert_chroma420_row_sse2(src, next, cb, cr, conv.width);
+#endif
+			convert_chroma420_row_scalar(src, next, cb, cr, x, conv.width);
+		}
+	}
+}
+
+void convert_rgbx_to_yuv(const RGBToYUVConversion &conv, unsigned begin_row, unsigned end_row)
+{
+	convert_rows<true>(conv, begin_row, end_row);
+}
+
+void convert_rgbx_to_yuv_scalar(const RGBToYUVConversion &conv, unsigned begin_row, unsigned end_row)
+{
+	convert_rows<false>(conv, begin_row, end_row);
+}
+
+void convert_rgbx_to_yuv_parallel(ThreadGroup &group, const RGBToYUVConversion &conv)
+{
+	// A few slices per thread evens out workers which start late. Slices are even so 4:2:0 chroma rows are not split.
+	unsigned num_slices = std::max(1u, group.get_num_threads()) * 4;
+	unsigned rows_per_slice = (conv.height + num_slices - 1) / num_slices;
+	rows_per_slice = std::max(16u, (rows_per_slice + 1) & ~1u);
+
+	auto task = group.create_task();
+	task->set_desc("rgb-to-yuv");
+	for (unsigned row = 0; row < conv.height; row += rows_per_slice)
+	{
+		task->enqueue_task([&conv, row, rows_per_slice]() {
+			convert_rgbx_to_yuv(conv, row, row + rows_per_slice);
+		});
+	}
+	task->wait();
+}
+}
@@ -0,0 +1,61 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+
+namespace Granite
+{
+class ThreadGroup;
+
+enum class ChromaSubsampling
+{
+	Chroma444,
+	// Chroma is filtered with [1 2 1] horizontally and [1 1] vertically,
+	// which matches the left (MPEG-2 / H.264 default) chroma siting.
+	Chroma420
+};
+
+// Converts 8-bit RGBX (R in the lowest byte, X ignored) to limited range BT.709 Y'CbCr planes.
+struct RGBToYUVConversion
+{
+	const uint8_t *rgbx = nullptr;
+	int rgbx_stride = 0;
+	unsigned width = 0;
+	unsigned height = 0;
+	ChromaSubsampling subsampling = ChromaSubsampling::Chroma444;
+
+	uint8_t *planes[3] = {};
+	int strides[3] = {};
+};
+
+// Converts luma rows [begin_row, end_row). For 4:2:0, begin_row must be even.
+void convert_rgbx_to_yuv(const RGBToYUVConversion &conv, unsigned begin_row, unsigned end_row);
+
+// Plain C reference which produces bit-identical output to convert_rgbx_to_yuv().
+void convert_rgbx_to_yuv_scalar(const RGBToYUVConversion &conv, unsigned begin_row, unsigned end_row);
+
+// Splits the image into row slices on the thread group and waits for all of them.
+void convert_rgbx_to_yuv_parallel(ThreadGroup &group, const RGBToYUVConversion &conv);
+}
@@ -738,6 +738,10 @@ void CommandBuffer::begin_context()
 	pipeline_state.potential_static_state.internal_spec_constant_mask = 0;
 	memset(bindings.cookies, 0, sizeof(bindings.cookies));
 	memset(bindings.secondary_cookies, 0, sizeof(bindings.secondary_cookies));
+	memset(bindings.binding_hashes, 0, sizeof(bindings.binding_hashes));
+	memset(bindings.sampler_hashes, 0, sizeof(bindings.sampler_hashes));
+	memset(bindings.set_hashes, 0, sizeof(bindings.set_hashes));
+	memset(bindings.set_hash_binding_masks, 0, sizeof(bindings.set_hash_binding_masks));
 	memset(&index_state, 0, sizeof(index_state));
 	memset(vbo.buffers, 0, sizeof(vbo.buffers));
 
@@ -1441,7 +1445,7 @@ void CommandBuffer::update_hash_compute_pipeline(DeferredPipelineCompile &compil
 	compile.hash = h.get();
 }
 
-void CommandBuffer::update_hash_graphics_pipeline(DeferredPipelineCompile &compile, uint32_t &active_vbos)
+Hash CommandBuffer::hash_graphics_vertex_state(const DeferredPipelineCompile &compile, uint32_t &active_vbos)
 {
 	Hasher h;
 	active_vbos = 0;
@@ -1459,9 +1463,12 @@ void CommandBuffer::update_hash_graphics_pipeline(DeferredPipelineCompile &compi
 		h.u32(compile.strides[bit]);
 	});
 
-	h.u64(compile.compatible_render_pass->get_hash());
-	h.u32(compile.subpass_index);
-	h.u64(compile.program->get_hash());
+	return h.get();
+}
+
+Hash CommandBuffer::hash_graphics_static_state(const DeferredPipelineCompile &compile)
+{
+	Hasher h;
 	h.data(compile.static_state.words, sizeof(compile.static_state.words));
 
 	if (compile.static_state.state.blend_enable)
@@ -1479,6 +1486,7 @@ void CommandBuffer::update_hash_graphics_pipeline(DeferredPipelineCompile &compi
 	}
 
 	// Spec constants.
+	auto &layout = compile.program->get_pipeline_layout()->get_resource_layout();
 	uint32_t combined_spec_constant = layout.combined_spec_constant_mask;
 	combined_spec_constant &= get_combined_spec_constant_mask(compile);
 	h.u32(combined_spec_constant);
@@ -1486,22 +1494,100 @@ void CommandBuffer::update_hash_graphics_pipeline(DeferredPipelineCompile &compi
 		h.u32(compile.potential_static_state.spec_constants[bit]);
 	});
 
-	compile.hash = h.get();
+	return h.get();
+}
+
+Hash CommandBuffer::combine_graphics_pipeline_hash(const DeferredPipelineCompile &compile,
+                                                   Hash vertex_hash, Hash static_state_hash)
+{
+	Hasher h;
+	h.u64(vertex_hash);
+	h.u64(compile.compatible_render_pass->get_hash());
+	h.u32(compile.subpass_index);
+	h.u64(compile.program->get_hash());
+	h.u64(static_state_hash);
+	return h.get();
+}
+
+void CommandBuffer::update_hash_graphics_pipeline(DeferredPipelineCompile &compile, uint32_t &active_vbos)
+{
+	compile.hash = combine_graphics_pipeline_hash(compile,
+	                                              hash_graphics_vertex_state(compile, active_vbos),
+	                                              hash_graphics_static_state(compile));
 }
 
-bool CommandBuffer::flush_graphics_pipeline(bool synchronous)
+bool CommandBuffer::flush_graphics_pipeline(bool synchronous, CommandBufferDirtyFlags dirty_mask)
 {
-	update_hash_graphics_pipeline(pipeline_state, active_vbos);
+	// The sub-hashes are cached, only rehash the state which was actually invalidated.
+	// A program change affects the attribute and spec constant masks, so it invalidates everything.
+	// While drawing with a fallback, active_vbos belongs to the fallback program, so recompute it as well.
+	if (pipeline_is_fallback || (dirty_mask & (COMMAND_BUFFER_DIRTY_PIPELINE_BIT | COMMAND_BUFFER_DIRTY_STATIC_VERTEX_BIT)))
+		vertex_state_hash = hash_graphics_vertex_state(pipeline_state, active_vbos);
+	if (dirty_mask & (COMMAND_BUFFER_DIRTY_PIPELINE_BIT | COMMAND_BUFFER_DIRTY_STATIC_STATE_BIT))
+		static_state_hash = hash_graphics_static_state(pipeline_state);
+	pipeline_state.hash = combine_graphics_pipeline_hash(pipeline_state, vertex_state_hash, static_state_hash);
+
 	current_pipeline = pipeline_state.program->get_pipeline(pipeline_state.hash);
+	pipeline_is_fallback = false;
 	if (current_pipeline.pipeline == VK_NULL_HANDLE)
 	{
-		current_pipeline = build_graphics_pipeline(
-			device, pipeline_state,
-			synchronous ? CompileMode::Sync : CompileMode::FailOnCompileRequired);
+		if (synchronous)
+			current_pipeline = resolve_graphics_pipeline_miss();
+		else
+			current_pipeline = build_graphics_pipeline(device, pipeline_state, CompileMode::FailOnCompileRequired);
 	}
 	return current_pipeline.pipeline != VK_NULL_HANDLE;
 }
 
+Pipeline CommandBuffer::resolve_graphics_pipeline_miss()
+{
+	auto *fallback = pipeline_state.program->get_fallback_program();
+	auto decision = device->request_pipeline_compile(pipeline_state, fallback != nullptr);
+
+	switch (decision.action)
+	{
+	case PipelineMissAction::UseFallback:
+	{
+		// Keep pipeline_state.hash pointing to the real pipeline so we can promote to it later.
+		auto compile = pipeline_state;
+		uint32_t fallback_vbos = 0;
+		compile.program = fallback;
+
+		// Vertex input is taken from the fallback program's reflection. It can only read attributes
+		// which the real program also consumes, since nothing guarantees the others were ever set up.
+		VK_ASSERT((fallback->get_pipeline_layout()->get_resource_layout().attribute_mask &
+		           ~pipeline_state.program->get_pipeline_layout()->get_resource_layout().attribute_mask) == 0);
+
+		update_hash_graphics_pipeline(compile, fallback_vbos);
+		auto pipe = fallback->get_pipeline(compile.hash);
+		if (pipe.pipeline == VK_NULL_HANDLE)
+			pipe = build_graphics_pipeline(device, compile, CompileMode::Sync);
+		pipeline_is_fallback = pipe.pipeline != VK_NULL_HANDLE;
+
+		// Bind the vertex buffers the fallback pipeline consumes, not the ones of the real program.
+		if (pipeline_is_fallback)
+			active_vbos = fallback_vbos;
+		return pipe;
+	}
+
+	case PipelineMissAction::Skip:
+		pipeline_compile_deferred = true;
+		return {};
+
+	default:
+		return build_graphics_pipeline(device, pipeline_state, CompileMode::Sync);
+	}
+}
+
+void CommandBuffer::record_pipeline_usage()
+{
+#ifdef GRANITE_VULKAN_FOSSILIZE
+	// Record the real pipeline even if we are drawing with a fallback, it is the one we want warm next time.
+	if (device->recorder_state)
+		used_pipeline_hashes.push_back(pipeline_state.hash);
+#endif
+}
+
 void CommandBuffer::bind_pipeline(VkPipelineBindPoint bind_point, VkPipeline pipeline, uint32_t active_dynamic_state)
 {
 	table.vkCmdBindPipeline(cmd, bind_point, pipeline);
@@ -1528,7 +1614,10 @@ bool CommandBuffer::flush_compute_state(bool synchronous)
 			return false;
 
 		if (old_pipe != current_pipeline.pipeline)
+		{
 			bind_pipeline(VK_PIPELINE_BIND_POINT_COMPUTE, current_pipeline.pipeline, current_pipeline.dynamic_mask);
+			record_pipeline_usage();
+		}
 	}
 
 	if (current_pipeline.pipeline == VK_NULL_HANDLE)
@@ -1553,6 +1642,7 @@ bool CommandBuffer::flush_compute_state(bool synchronous)
 
 bool CommandBuffer::flush_render_state(bool synchronous)
 {
+	pipeline_compile_deferred = false;
 	if (!pipeline_state.program)
 		return false;
 	VK_ASSERT(current_layout);
@@ -1560,16 +1650,24 @@ bool CommandBuffer::flush_render_state(bool synchronous)
 	if (current_pipeline.pipeline == VK_NULL_HANDLE)
 		set_dirty(COMMAND_BUFFER_DIRTY_PIPELINE_BIT);
 
+	// Promote from the fallback program once the background compile has landed.
+	if (pipeline_is_fallback && pipeline_state.program->get_pipeline(pipeline_state.hash).pipeline != VK_NULL_HANDLE)
+		set_dirty(COMMAND_BUFFER_DIRTY_PIPELINE_BIT);
+
 	// We've invalidated pipeline state, update the VkPipeline.
-	if (get_and_clear(COMMAND_BUFFER_DIRTY_STATIC_STATE_BIT | COMMAND_BUFFER_DIRTY_PIPELINE_BIT |
-	                  COMMAND_BUFFER_DIRTY_STATIC_VERTEX_BIT))
+	if (auto pipeline_dirty = get_and_clear(COMMAND_BUFFER_DIRTY_STATIC_STATE_BIT |
+	                                        COMMAND_BUFFER_DIRTY_PIPELINE_BIT |
+	                                        COMMAND_BUFFER_DIRTY_STATIC_VERTEX_BIT))
 	{
 		VkPipeline old_pipe = current_pipeline.pipeline;
-		if (!flush_graphics_pipeline(synchronous))
+		if (!flush_graphics_pipeline(synchronous, pipeline_dirty))
 			return false;
 
 		if (old_pipe != current_pipeline.pipeline)
+		{
 			bind_pipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, current_pipeline.pipeline, current_pipeline.dynamic_mask);
+			record_pipeline_usage();
+		}
 
 #ifdef VULKAN_DEBUG
 		if (current_framebuffer_surface_transform != VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
@@ -1969,6 +2067,44 @@ void *CommandBuffer::allocate_vertex_data(unsigned binding, VkDeviceSize size, V
 	return data.host;
 }
 
+static uint64_t hash_binding_slot(uint32_t slot, uint64_t cookie, uint64_t aux0, uint64_t aux1)
+{
+	// An unbound slot contributes nothing, so a cleared set hashes to 0.
+	if (!cookie)
+		return 0;
+
+	Hasher h;
+	h.u32(slot);
+	h.u64(cookie);
+	h.u64(aux0);
+	h.u64(aux1);
+	return h.get();
+}
+
+void CommandBuffer::update_set_hash_slot(unsigned set, unsigned binding, uint64_t &slot_hash, uint64_t hash)
+{
+	bindings.set_hashes[set] ^= slot_hash ^ hash;
+	slot_hash = hash;
+
+	if (bindings.binding_hashes[set][binding] || bindings.sampler_hashes[set][binding])
+		bindings.set_hash_binding_masks[set] |= 1u << binding;
+	else
+		bindings.set_hash_binding_masks[set] &= ~(1u << binding);
+}
+
+void CommandBuffer::update_binding_hash(unsigned set, unsigned binding, uint64_t aux0, uint64_t aux1)
+{
+	update_set_hash_slot(set, binding, bindings.binding_hashes[set][binding],
+	                     hash_binding_slot(binding, bindings.cookies[set][binding], aux0, aux1));
+}
+
+void CommandBuffer::update_sampler_hash(unsigned set, unsigned binding)
+{
+	update_set_hash_slot(set, binding, bindings.sampler_hashes[set][binding],
+	                     hash_binding_slot(binding + VULKAN_NUM_BINDINGS,
+	                                       bindings.secondary_cookies[set][binding], 0, 0));
+}
+
 void CommandBuffer::set_uniform_buffer(unsigned set, unsigned binding, const Buffer &buffer, VkDeviceSize offset,
                                        VkDeviceSize range)
 {
@@ -1991,6 +2127,8 @@ void CommandBuffer::set_uniform_buffer(unsigned set, unsigned binding, const Buf
 		b.dynamic_offset = offset;
 		bindings.cookies[set][binding] = buffer.get_cookie();
 		bindings.secondary_cookies[set][binding] = 0;
+		update_binding_hash(set, binding, range);
+		update_sampler_hash(set, binding);
 		dirty_sets |= 1u << set;
 	}
 }
@@ -2010,6 +2148,8 @@ void CommandBuffer::set_storage_buffer(unsigned set, unsigned binding, const Buf
 	b.dynamic_offset = 0;
 	bindings.cookies[set][binding] = buffer.get_cookie();
 	bindings.secondary_cookies[set][binding] = 0;
+	update_binding_hash(set, binding, offset, range);
+	update_sampler_hash(set, binding);
 	dirty_sets |= 1u << set;
 }
 
@@ -2035,6 +2175,7 @@ void CommandBuffer::set_sampler(unsigned set, unsigned binding, const Sampler &s
 	b.image.integer.sampler = sampler.get_sampler();
 	dirty_sets |= 1u << set;
 	bindings.secondary_cookies[set][binding] = sampler.get_cookie();
+	update_sampler_hash(set, binding);
 }
 
 void CommandBuffer::set_buffer_view_common(unsigned set, unsigned binding, const BufferView &view)
@@ -2047,6 +2188,8 @@ void CommandBuffer::set_buffer_view_common(unsigned set, unsigned binding, const
 	b.buffer_view = view.get_view();
 	bindings.cookies[set][binding] = view.get_cookie();
 	bindings.secondary_cookies[set][binding] = 0;
+	update_binding_hash(set, binding, 0);
+	update_sampler_hash(set, binding);
 	dirty_sets |= 1u << set;
 }
 
@@ -2089,6 +2232,7 @@ void CommandBuffer::set_input_attachments(unsigned set, unsigned start_binding)
 		b.image.fp.imageView = view->get_float_view();
 		b.image.integer.imageView = view->get_integer_view();
 		bindings.cookies[set][start_binding + i] = view->get_cookie();
+		update_binding_hash(set, start_binding + i, ref.layout);
 		dirty_sets |= 1u << set;
 	}
 }
@@ -2110,6 +2254,7 @@ void CommandBuffer::set_texture(unsigned set, unsigned binding,
 	b.image.integer.imageLayout = layout;
 	b.image.integer.imageView = integer_view;
 	bindings.cookies[set][binding] = cookie;
+	update_binding_hash(set, binding, layout);
 	dirty_sets |= 1u << set;
 }
 
@@ -2231,44 +2376,85 @@ void CommandBuffer::flush_descriptor_set(uint32_t set)
 	auto &set_layout = layout.sets[set];
 	uint32_t num_dynamic_offsets = 0;
 	uint32_t dynamic_offsets[VULKAN_NUM_BINDINGS];
-	Hasher h;
-
-	h.u32(set_layout.fp_mask);
 
 	// UBOs
 	for_each_bit(set_layout.uniform_buffer_mask, [&](uint32_t binding) {
 		unsigned array_size = set_layout.array_size[binding];
 		for (unsigned i = 0; i < array_size; i++)
 		{
-			h.u64(bindings.cookies[set][binding + i]);
-			h.u32(bindings.bindings[set][binding + i].buffer.range);
 			VK_ASSERT(bindings.bindings[set][binding + i].buffer.buffer != VK_NULL_HANDLE);
-
 			VK_ASSERT(num_dynamic_offsets < VULKAN_NUM_BINDINGS);
 			dynamic_offsets[num_dynamic_offsets++] = bindings.bindings[set][binding + i].dynamic_offset;
 		}
 	});
 
+	uint32_t binding_mask = current_layout->get_binding_mask(set);
+#ifdef VULKAN_DEBUG
+	for_each_bit(binding_mask, [&](uint32_t binding) {
+		VK_ASSERT(bindings.cookies[set][binding] != 0 || bindings.secondary_cookies[set][binding] != 0);
+	});
+#endif
+
+	// The set hash is maintained incrementally as bindings change.
+	// Stale bindings which this layout does not consume would make otherwise identical sets hash differently,
+	// so in that case, only combine the slots which are actually used.
+	// Samplers bound to immutable sampler slots are never written, so they must not affect the hash either.
+	uint64_t set_hash = bindings.set_hashes[set];
+	if (bindings.set_hash_binding_masks[set] & ~binding_mask)
+	{
+		set_hash = 0;
+		for_each_bit(bindings.set_hash_binding_masks[set] & binding_mask, [&](uint32_t binding) {
+			set_hash ^= bindings.binding_hashes[set][binding];
+			if ((set_layout.immutable_sampler_mask & (1u << binding)) == 0)
+				set_hash ^= bindings.sampler_hashes[set][binding];
+		});
+	}
+	else
+	{
+		for_each_bit(bindings.set_hash_binding_masks[set] & set_layout.immutable_sampler_mask, [&](uint32_t binding) {
+			set_hash ^= bindings.sampler_hashes[set][binding];
+		});
+	}
+
+	Hasher h;
+	h.u32(set_layout.fp_mask);
+	h.u64(set_hash);
+
+	Hash hash = h.get();
+	auto allocated = current_layout->get_allocator(set)->find(thread_index, hash);
+
+	// The descriptor set was not successfully cached, rebuild.
+	if (!allocated.second)
+	{
+		validate_descriptor_set(set);
+		auto update_template = current_layout->get_update_template(set);
+		VK_ASSERT(update_template);
+		table.vkUpdateDescriptorSetWithTemplate(device->get_device(), allocated.first,
+		                                        update_template, bindings.bindings[set]);
+	}
+
+	table.vkCmdBindDescriptorSets(cmd, actual_render_pass ? VK_PIPELINE_BIND_POINT_GRAPHICS : VK_PIPELINE_BIND_POINT_COMPUTE,
+	                              current_pipeline_layout, set, 1, &allocated.first, num_dynamic_offsets, dynamic_offsets);
+	allocated_sets[set] = allocated.first;
+}
+
+void CommandBuffer::validate_descriptor_set(uint32_t set) const
+{
+#ifdef VULKAN_DEBUG
+	auto &set_layout = current_layout->get_resource_layout().sets[set];
+
 	// SSBOs
 	for_each_bit(set_layout.storage_buffer_mask, [&](uint32_t binding) {
 		unsigned array_size = set_layout.array_size[binding];
 		for (unsigned i = 0; i < array_size; i++)
-		{
-			h.u64(bindings.cookies[set][binding + i]);
-			h.u32(bindings.bindings[set][binding + i].buffer.offset);
-			h.u32(bindings.bindings[set][binding + i].buffer.range);
 			VK_ASSERT(bindings.bindings[set][binding + i].buffer.buffer != VK_NULL_HANDLE);
-		}
 	});
 
 	// Texel buffers
 	for_each_bit(set_layout.sampled_texel_buffer_mask | set_layout.storage_texel_buffer_mask, [&](uint32_t binding) {
 		unsigned array_size = set_layout.array_size[binding];
 		for (unsigned i = 0; i < array_size; i++)
-		{
-			h.u64(bindings.cookies[set][binding + i]);
 			VK_ASSERT(bindings.bindings[set][binding + i].buffer_view != VK_NULL_HANDLE);
-		}
 	});
 
 	// Sampled images
@@ -2276,75 +2462,29 @@ void CommandBuffer::flush_descriptor_set(uint32_t set)
 		unsigned array_size = set_layout.array_size[binding];
 		for (unsigned i = 0; i < array_size; i++)
 		{
-			h.u64(bindings.cookies[set][binding + i]);
 			if ((set_layout.immutable_sampler_mask & (1u << (binding + i))) == 0)
-			{
-				h.u64(bindings.secondary_cookies[set][binding + i]);
 				VK_ASSERT(bindings.bindings[set][binding + i].image.fp.sampler != VK_NULL_HANDLE);
-			}
-			h.u32(bindings.bindings[set][binding + i].image.fp.imageLayout);
 			VK_ASSERT(bindings.bindings[set][binding + i].image.fp.imageView != VK_NULL_HANDLE);
 		}
 	});
 
-	// Separate images
-	for_each_bit(set_layout.separate_image_mask, [&](uint32_t binding) {
+	// Separate images, storage images and input attachments
+	for_each_bit(set_layout.separate_image_mask | set_layout.storage_image_mask | set_layout.input_attachment_mask,
+	             [&](uint32_t binding) {
 		unsigned array_size = set_layout.array_size[binding];
 		for (unsigned i = 0; i < array_size; i++)
-		{
-			h.u64(bindings.cookies[set][binding + i]);
-			h.u32(bindings.bindings[set][binding + i].image.fp.imageLayout);
 			VK_ASSERT(bindings.bindings[set][binding + i].image.fp.imageView != VK_NULL_HANDLE);
-		}
 	});
 
 	// Separate samplers
 	for_each_bit(set_layout.sampler_mask & ~set_layout.immutable_sampler_mask, [&](uint32_t binding) {
 		unsigned array_size = set_layout.array_size[binding];
 		for (unsigned i = 0; i < array_size; i++)
-		{
-			h.u64(bindings.secondary_cookies[set][binding + i]);
 			VK_ASSERT(bindings.bindings[set][binding + i].image.fp.sampler != VK_NULL_HANDLE);
-		}
 	});
-
-	// Storage images
-	for_each_bit(set_layout.storage_image_mask, [&](uint32_t binding) {
-		unsigned array_size = set_layout.array_size[binding];
-		for (unsigned i = 0; i < array_size; i++)
-		{
-			h.u64(bindings.cookies[set][binding + i]);
-			h.u32(bindings.bindings[set][binding + i].image.fp.imageLayout);
-			VK_ASSERT(bindings.bindings[set][binding + i].image.fp.imageView != VK_NULL_HANDLE);
-		}
-	});
-
-	// Input attachments
-	for_each_bit(set_layout.input_attachment_mask, [&](uint32_t binding) {
-		unsigned array_size = set_layout.array_size[binding];
-		for (unsigned i = 0; i < array_size; i++)
-		{
-			h.u64(bindings.cookies[set][binding + i]);
-			h.u32(bindings.bindings[set][binding + i].image.fp.imageLayout);
-			VK_ASSERT(bindings.bindings[set][binding + i].image.fp.imageView != VK_NULL_HANDLE);
-		}
-	});
-
-	Hash hash = h.get();
-	auto allocated = current_layout->get_allocator(set)->find(thread_index, hash);
-
-	// The descriptor set was not successfully cached, rebuild.
-	if (!allocated.second)
-	{
-		auto update_template = current_layout->get_update_template(set);
-		VK_ASSERT(update_template);
-		table.vkUpdateDescriptorSetWithTemplate(device->get_device(), allocated.first,
-		                                        update_template, bindings.bindings[set]);
-	}
-
-	table.vkCmdBindDescriptorSets(cmd, actual_render_pass ? VK_PIPELINE_BIND_POINT_GRAPHICS : VK_PIPELINE_BIND_POINT_COMPUTE,
-	                              current_pipeline_layout, set, 1, &allocated.first, num_dynamic_offsets, dynamic_offsets);
-	allocated_sets[set] = allocated.first;
+#else
+	(void)set;
+#endif
 }
 
 void CommandBuffer::flush_descriptor_sets()
@@ -2372,7 +2512,7 @@ void CommandBuffer::draw(uint32_t vertex_count, uint32_t instance_count, uint32_
 		set_backtrace_checkpoint();
 		table.vkCmdDraw(cmd, vertex_count, instance_count, first_vertex, first_instance);
 	}
-	else
+	else if (!pipeline_compile_deferred)
 		LOGE("Failed to flush render state, draw call will be dropped.\n");
 }
 
@@ -2386,7 +2526,7 @@ void CommandBuffer::draw_indexed(uint32_t index_count, uint32_t instance_count,
 		set_backtrace_checkpoint();
 		table.vkCmdDrawIndexed(cmd, index_count, instance_count, first_index, vertex_offset, first_instance);
 	}
-	else
+	else if (!pipeline_compile_deferred)
 		LOGE("Failed to flush render state, draw call will be dropped.\n");
 }
 
@@ -2399,7 +2539,7 @@ void CommandBuffer::draw_indirect(const Vulkan::Buffer &buffer,
 		set_backtrace_checkpoint();
 		table.vkCmdDrawIndirect(cmd, buffer.get_buffer(), offset, draw_count, stride);
 	}
-	else
+	else if (!pipeline_compile_deferred)
 		LOGE("Failed to flush render state, draw call will be dropped.\n");
 }
 
@@ -2420,7 +2560,7 @@ void CommandBuffer::draw_multi_indirect(const Buffer &buffer, uint32_t offset, u
 		                                count.get_buffer(), count_offset,
 		                                draw_count, stride);
 	}
-	else
+	else if (!pipeline_compile_deferred)
 		LOGE("Failed to flush render state, draw call will be dropped.\n");
 }
 
@@ -2441,7 +2581,7 @@ void CommandBuffer::draw_indexed_multi_indirect(const Buffer &buffer, uint32_t o
 		                                       count.get_buffer(), count_offset,
 		                                       draw_count, stride);
 	}
-	else
+	else if (!pipeline_compile_deferred)
 		LOGE("Failed to flush render state, draw call will be dropped.\n");
 }
 
@@ -2454,7 +2594,7 @@ void CommandBuffer::draw_indexed_indirect(const Vulkan::Buffer &buffer,
 		table.vkCmdDrawIndexedIndirect(cmd, buffer.get_buffer(), offset, draw_count, stride);
 		set_backtrace_checkpoint();
 	}
-	else
+	else if (!pipeline_compile_deferred)
 		LOGE("Failed to flush render state, draw call will be dropped.\n");
 }
 
@@ -2482,17 +2622,19 @@ void CommandBuffer::dispatch(uint32_t groups_x, uint32_t groups_y, uint32_t grou
 		LOGE("Failed to flush render state, dispatch will be dropped.\n");
 }
 
-void CommandBuffer::clear_render_state()
+void CommandBuffer::set_static_state(const PipelineState &state)
 {
-	// Preserve spec constant mask.
-	auto &state = pipeline_state.static_state.state;
-	memset(&state, 0, sizeof(state));
+	if (memcmp(&state, &pipeline_state.static_state, sizeof(state)) != 0)
+	{
+		pipeline_state.static_state = state;
+		set_dirty(COMMAND_BUFFER_DIRTY_STATIC_STATE_BIT);
+	}
 }
 
-void CommandBuffer::set_opaque_state()
+void CommandBuffer::init_opaque_state(PipelineState &static_state)
 {
-	clear_render_state();
-	auto &state = pipeline_state.static_state.state;
+	auto &state = static_state.state;
+	memset(&state, 0, sizeof(state));
 	state.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 	state.cull_mode = VK_CULL_MODE_BACK_BIT;
 	state.blend_enable = false;
@@ -2504,13 +2646,12 @@ void CommandBuffer::set_opaque_state()
 	state.stencil_test = false;
 	state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	state.write_mask = ~0u;
-	set_dirty(COMMAND_BUFFER_DIRTY_STATIC_STATE_BIT);
 }
 
-void CommandBuffer::set_quad_state()
+void CommandBuffer::init_quad_state(PipelineState &static_state)
 {
-	clear_render_state();
-	auto &state = pipeline_state.static_state.state;
+	auto &state = static_state.state;
+	memset(&state, 0, sizeof(state));
 	state.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 	state.cull_mode = VK_CULL_MODE_NONE;
 	state.blend_enable = false;
@@ -2518,13 +2659,12 @@ void CommandBuffer::set_quad_state()
 	state.depth_write = false;
 	state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
 	state.write_mask = ~0u;
-	set_dirty(COMMAND_BUFFER_DIRTY_STATIC_STATE_BIT);
 }
 
-void CommandBuffer::set_opaque_sprite_state()
+void CommandBuffer::init_opaque_sprite_state(PipelineState &static_state)
 {
-	clear_render_state();
-	auto &state = pipeline_state.static_state.state;
+	auto &state = static_state.state;
+	memset(&state, 0, sizeof(state));
 	state.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 	state.cull_mode = VK_CULL_MODE_NONE;
 	state.blend_enable = false;
@@ -2533,13 +2673,12 @@ void CommandBuffer::set_opaque_sprite_state()
 	state.depth_write = true;
 	state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
 	state.write_mask = ~0u;
-	set_dirty(COMMAND_BUFFER_DIRTY_STATIC_STATE_BIT);
 }
 
-void CommandBuffer::set_transparent_sprite_state()
+void CommandBuffer::init_transparent_sprite_state(PipelineState &static_state)
 {
-	clear_render_state();
-	auto &state = pipeline_state.static_state.state;
+	auto &state = static_state.state;
+	memset(&state, 0, sizeof(state));
 	state.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 	state.cull_mode = VK_CULL_MODE_NONE;
 	state.blend_enable = true;
@@ -2551,10 +2690,35 @@ void CommandBuffer::set_transparent_sprite_state()
 
 	// The alpha layer should start at 1 (fully transparent).
 	// As layers are blended in, the transparency is multiplied with other transparencies (1 - alpha).
-	set_blend_factors(VK_BLEND_FACTOR_SRC_ALPHA, VK_BLEND_FACTOR_ZERO,
-	                  VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA);
-	set_blend_op(VK_BLEND_OP_ADD);
+	state.src_color_blend = VK_BLEND_FACTOR_SRC_ALPHA;
+	state.src_alpha_blend = VK_BLEND_FACTOR_ZERO;
+	state.dst_color_blend = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	state.dst_alpha_blend = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	state.color_blend_op = VK_BLEND_OP_ADD;
+	state.alpha_blend_op = VK_BLEND_OP_ADD;
+}
+
+void CommandBuffer::set_opaque_state()
+{
+	init_opaque_state(pipeline_state.static_state);
+	set_dirty(COMMAND_BUFFER_DIRTY_STATIC_STATE_BIT);
+}
 
+void CommandBuffer::set_quad_state()
+{
+	init_quad_state(pipeline_state.static_state);
+	set_dirty(COMMAND_BUFFER_DIRTY_STATIC_STATE_BIT);
+}
+
+void CommandBuffer::set_opaque_sprite_state()
+{
+	init_opaque_sprite_state(pipeline_state.static_state);
+	set_dirty(COMMAND_BUFFER_DIRTY_STATIC_STATE_BIT);
+}
+
+void CommandBuffer::set_transparent_sprite_state()
+{
+	init_transparent_sprite_state(pipeline_state.static_state);
 	set_dirty(COMMAND_BUFFER_DIRTY_STATIC_STATE_BIT);
 }
 
@@ -2572,6 +2736,10 @@ void CommandBuffer::restore_state(const CommandBufferSavedState &state)
 				memcpy(bindings.bindings[i], state.bindings.bindings[i], sizeof(bindings.bindings[i]));
 				memcpy(bindings.cookies[i], state.bindings.cookies[i], sizeof(bindings.cookies[i]));
 				memcpy(bindings.secondary_cookies[i], state.bindings.secondary_cookies[i], sizeof(bindings.secondary_cookies[i]));
+				memcpy(bindings.binding_hashes[i], state.bindings.binding_hashes[i], sizeof(bindings.binding_hashes[i]));
+				memcpy(bindings.sampler_hashes[i], state.bindings.sampler_hashes[i], sizeof(bindings.sampler_hashes[i]));
+				bindings.set_hashes[i] = state.bindings.set_hashes[i];
+				bindings.set_hash_binding_masks[i] = state.bindings.set_hash_binding_masks[i];
 				dirty_sets |= 1u << i;
 			}
 		}
@@ -2630,6 +2798,10 @@ void CommandBuffer::save_state(CommandBufferSaveStateFlags flags, CommandBufferS
 			memcpy(state.bindings.cookies[i], bindings.cookies[i], sizeof(bindings.cookies[i]));
 			memcpy(state.bindings.secondary_cookies[i], bindings.secondary_cookies[i],
 			       sizeof(bindings.secondary_cookies[i]));
+			memcpy(state.bindings.binding_hashes[i], bindings.binding_hashes[i], sizeof(bindings.binding_hashes[i]));
+			memcpy(state.bindings.sampler_hashes[i], bindings.sampler_hashes[i], sizeof(bindings.sampler_hashes[i]));
+			state.bindings.set_hashes[i] = bindings.set_hashes[i];
+			state.bindings.set_hash_binding_masks[i] = bindings.set_hash_binding_masks[i];
 		}
 	}
 
@@ -2703,6 +2875,14 @@ void CommandBuffer::end()
 {
 	end_threaded_recording();
 
+#ifdef GRANITE_VULKAN_FOSSILIZE
+	if (!used_pipeline_hashes.empty())
+	{
+		device->record_pipeline_usage(used_pipeline_hashes.data(), used_pipeline_hashes.size());
+		used_pipeline_hashes.clear();
+	}
+#endif
+
 	if (vbo_block.mapped)
 		device->request_vertex_block_nolock(vbo_block, 0);
 	if (ibo_block.mapped)
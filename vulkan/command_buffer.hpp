@@ -499,6 +499,18 @@ public:
 	void set_opaque_sprite_state();
 	void set_transparent_sprite_state();
 
+	// Presets used by the set_*_state() helpers, usable without a command buffer.
+	static void init_opaque_state(PipelineState &state);
+	static void init_quad_state(PipelineState &state);
+	static void init_opaque_sprite_state(PipelineState &state);
+	static void init_transparent_sprite_state(PipelineState &state);
+
+	void set_static_state(const PipelineState &state);
+	inline const PipelineState &get_static_state() const
+	{
+		return pipeline_state.static_state;
+	}
+
 	void save_state(CommandBufferSaveStateFlags flags, CommandBufferSavedState &state);
 	void restore_state(const CommandBufferSavedState &state);
 
@@ -790,8 +802,16 @@ private:
 	uint32_t dirty_sets_dynamic = 0;
 	uint32_t dirty_vbos = 0;
 	uint32_t active_vbos = 0;
+	Util::Hash vertex_state_hash = 0;
+	Util::Hash static_state_hash = 0;
 	VkPipelineStageFlags2 uses_swapchain_in_stages = 0;
+#ifdef GRANITE_VULKAN_FOSSILIZE
+	// Pipelines bound in this command buffer, fed into the Fossilize usage profile on end().
+	std::vector<Util::Hash> used_pipeline_hashes;
+#endif
 	bool is_compute = true;
+	bool pipeline_is_fallback = false;
+	bool pipeline_compile_deferred = false;
 	bool is_secondary = false;
 	bool is_ended = false;
 
@@ -816,13 +836,14 @@ private:
 
 	bool flush_render_state(bool synchronous);
 	bool flush_compute_state(bool synchronous);
-	void clear_render_state();
 
-	bool flush_graphics_pipeline(bool synchronous);
+	bool flush_graphics_pipeline(bool synchronous, CommandBufferDirtyFlags dirty_mask);
+	Pipeline resolve_graphics_pipeline_miss();
 	bool flush_compute_pipeline(bool synchronous);
 	void flush_descriptor_sets();
 	void begin_graphics();
 	void flush_descriptor_set(uint32_t set);
+	void validate_descriptor_set(uint32_t set) const;
 	void rebind_descriptor_set(uint32_t set);
 	void begin_compute();
 	void begin_context();
@@ -836,6 +857,9 @@ private:
 	                 VkImageLayout layout,
 	                 uint64_t cookie);
 	void set_buffer_view_common(unsigned set, unsigned binding, const BufferView &view);
+	void update_binding_hash(unsigned set, unsigned binding, uint64_t aux0, uint64_t aux1 = 0);
+	void update_sampler_hash(unsigned set, unsigned binding);
+	void update_set_hash_slot(unsigned set, unsigned binding, uint64_t &slot_hash, uint64_t hash);
 
 	void init_viewport_scissor(const RenderPassInfo &info, const Framebuffer *framebuffer);
 	void init_surface_transform(const RenderPassInfo &info);
@@ -847,8 +871,13 @@ private:
 	DebugChannelInterface *debug_channel_interface = nullptr;
 
 	void bind_pipeline(VkPipelineBindPoint bind_point, VkPipeline pipeline, uint32_t active_dynamic_state);
+	void record_pipeline_usage();
 
 	static void update_hash_graphics_pipeline(DeferredPipelineCompile &compile, uint32_t &active_vbos);
+	static Util::Hash hash_graphics_vertex_state(const DeferredPipelineCompile &compile, uint32_t &active_vbos);
+	static Util::Hash hash_graphics_static_state(const DeferredPipelineCompile &compile);
+	static Util::Hash combine_graphics_pipeline_hash(const DeferredPipelineCompile &compile,
+	                                                 Util::Hash vertex_hash, Util::Hash static_state_hash);
 	static void update_hash_compute_pipeline(DeferredPipelineCompile &compile);
 	void set_surface_transform_specialization_constants();
 };
@@ -0,0 +1,968 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "command_list.hpp"
+#include <algorithm>
+#include <new>
+#include <string.h>
+
+namespace Vulkan
+{
+enum class CommandListOp : uint32_t
+{
+	SetProgram,
+	SetStaticState,
+	SetSpecConstantMask,
+	SetSpecConstant,
+	SetViewport,
+	SetScissor,
+	SetDepthBias,
+	SetStencilReference,
+	SetTexture,
+	SetTextureSampler,
+	SetTextureStockSampler,
+	SetStorageTexture,
+	SetSampler,
+	SetStockSampler,
+	SetUniformBuffer,
+	SetStorageBuffer,
+	PushConstants,
+	ConstantData,
+	VertexData,
+	IndexData,
+	SetVertexAttrib,
+	SetVertexBinding,
+	SetIndexBuffer,
+	Draw,
+	DrawIndexed,
+	Dispatch
+};
+
+static constexpr size_t CommandAlignment = 16;
+
+struct CommandHeader
+{
+	CommandListOp op;
+	uint32_t size;
+};
+
+struct CmdProgram
+{
+	CommandHeader header;
+	Program *program;
+};
+
+struct CmdStaticState
+{
+	CommandHeader header;
+	PipelineState state;
+};
+
+struct CmdSpecConstant
+{
+	CommandHeader header;
+	uint32_t index;
+	uint32_t value;
+};
+
+struct CmdViewport
+{
+	CommandHeader header;
+	VkViewport viewport;
+};
+
+struct CmdScissor
+{
+	CommandHeader header;
+	VkRect2D scissor;
+};
+
+struct CmdDepthBias
+{
+	CommandHeader header;
+	float constant;
+	float slope;
+};
+
+struct CmdStencilReference
+{
+	CommandHeader header;
+	uint8_t compare_mask;
+	uint8_t write_mask;
+	uint8_t reference;
+};
+
+// Shared by everything which ends up in a descriptor binding.
+// For stock samplers, the sampler member holds the enum value.
+struct CmdBinding
+{
+	CommandHeader header;
+	uint32_t set;
+	uint32_t binding;
+	const void *resource;
+	const void *sampler;
+	VkDeviceSize offset;
+	VkDeviceSize range;
+};
+
+struct CmdPushConstants
+{
+	CommandHeader header;
+	uint32_t offset;
+	uint32_t range;
+};
+
+struct CmdData
+{
+	CommandHeader header;
+	uint32_t set;
+	uint32_t binding;
+	VkDeviceSize size;
+	VkDeviceSize stride;
+	VkVertexInputRate step_rate;
+	VkIndexType index_type;
+};
+
+struct CmdVertexAttrib
+{
+	CommandHeader header;
+	uint32_t attrib;
+	uint32_t binding;
+	VkFormat format;
+	VkDeviceSize offset;
+};
+
+struct CmdVertexBinding
+{
+	CommandHeader header;
+	uint32_t binding;
+	VkVertexInputRate step_rate;
+	const Buffer *buffer;
+	VkDeviceSize offset;
+	VkDeviceSize stride;
+};
+
+struct CmdIndexBuffer
+{
+	CommandHeader header;
+	VkIndexType index_type;
+	const Buffer *buffer;
+	VkDeviceSize offset;
+};
+
+struct CmdDraw
+{
+	CommandHeader header;
+	uint32_t count;
+	uint32_t instance_count;
+	uint32_t first;
+	int32_t vertex_offset;
+	uint32_t first_instance;
+};
+
+struct CmdDispatch
+{
+	CommandHeader header;
+	uint32_t groups[3];
+};
+
+template <typename T>
+static constexpr size_t payload_offset()
+{
+	return (sizeof(T) + CommandAlignment - 1) & ~(CommandAlignment - 1);
+}
+
+template <typename T>
+static uint8_t *payload(T *cmd)
+{
+	return reinterpret_cast<uint8_t *>(cmd) + payload_offset<T>();
+}
+
+template <typename T>
+static const uint8_t *payload(const T *cmd)
+{
+	return reinterpret_cast<const uint8_t *>(cmd) + payload_offset<T>();
+}
+
+CommandList::CommandList()
+{
+}
+
+CommandList::~CommandList()
+{
+}
+
+void CommandList::reset()
+{
+	for (auto &block : blocks)
+	{
+		if (block.size == BlockSize)
+		{
+			block.offset = 0;
+			recycled_blocks.push_back(std::move(block));
+		}
+	}
+
+	blocks.clear();
+	num_commands = 0;
+	static_state_valid = false;
+	static_state_dirty = false;
+}
+
+void *CommandList::allocate_command(size_t size)
+{
+	size = (size + CommandAlignment - 1) & ~(CommandAlignment - 1);
+
+	if (blocks.empty() || blocks.back().offset + size > blocks.back().size)
+	{
+		Block block;
+		if (size <= BlockSize && !recycled_blocks.empty())
+		{
+			block = std::move(recycled_blocks.back());
+			recycled_blocks.pop_back();
+		}
+		else
+		{
+			block.size = std::max<size_t>(size, BlockSize);
+			block.data.reset(new uint8_t[block.size]);
+		}
+		blocks.push_back(std::move(block));
+	}
+
+	auto &block = blocks.back();
+	void *ptr = block.data.get() + block.offset;
+	block.offset += size;
+	num_commands++;
+	return ptr;
+}
+
+template <typename T>
+T *CommandList::emit(CommandListOp op, size_t payload_size)
+{
+	size_t size = payload_offset<T>() + payload_size;
+	auto *cmd = new (allocate_command(size)) T;
+	cmd->header.op = op;
+	cmd->header.size = uint32_t((size + CommandAlignment - 1) & ~(CommandAlignment - 1));
+	return cmd;
+}
+
+void CommandList::set_program(Program *program)
+{
+	emit<CmdProgram>(CommandListOp::SetProgram)->program = program;
+}
+
+void CommandList::set_static_state(const PipelineState &state)
+{
+	if (!static_state_valid || memcmp(&state, &static_state, sizeof(state)) != 0)
+	{
+		static_state = state;
+		static_state_valid = true;
+		static_state_dirty = true;
+	}
+}
+
+void CommandList::mark_static_state_dirty()
+{
+	static_state_valid = true;
+	static_state_dirty = true;
+}
+
+void CommandList::set_opaque_state()
+{
+	CommandBuffer::init_opaque_state(static_state);
+	mark_static_state_dirty();
+}
+
+void CommandList::set_quad_state()
+{
+	CommandBuffer::init_quad_state(static_state);
+	mark_static_state_dirty();
+}
+
+void CommandList::set_opaque_sprite_state()
+{
+	CommandBuffer::init_opaque_sprite_state(static_state);
+	mark_static_state_dirty();
+}
+
+void CommandList::set_transparent_sprite_state()
+{
+	CommandBuffer::init_transparent_sprite_state(static_state);
+	mark_static_state_dirty();
+}
+
+#define SET_LIST_STATIC_STATE(value)                \
+	do                                              \
+	{                                               \
+		VK_ASSERT(static_state_valid);              \
+		if (static_state.state.value != value)      \
+		{                                           \
+			static_state.state.value = value;       \
+			static_state_dirty = true;              \
+		}                                           \
+	} while (0)
+
+void CommandList::set_depth_test(bool depth_test, bool depth_write)
+{
+	SET_LIST_STATIC_STATE(depth_test);
+	SET_LIST_STATIC_STATE(depth_write);
+}
+
+void CommandList::set_depth_compare(VkCompareOp depth_compare)
+{
+	SET_LIST_STATIC_STATE(depth_compare);
+}
+
+void CommandList::set_blend_enable(bool blend_enable)
+{
+	SET_LIST_STATIC_STATE(blend_enable);
+}
+
+void CommandList::set_blend_factors(VkBlendFactor src_color_blend, VkBlendFactor src_alpha_blend,
+                                    VkBlendFactor dst_color_blend, VkBlendFactor dst_alpha_blend)
+{
+	SET_LIST_STATIC_STATE(src_color_blend);
+	SET_LIST_STATIC_STATE(src_alpha_blend);
+	SET_LIST_STATIC_STATE(dst_color_blend);
+	SET_LIST_STATIC_STATE(dst_alpha_blend);
+}
+
+void CommandList::set_blend_op(VkBlendOp color_blend_op, VkBlendOp alpha_blend_op)
+{
+	SET_LIST_STATIC_STATE(color_blend_op);
+	SET_LIST_STATIC_STATE(alpha_blend_op);
+}
+
+void CommandList::set_cull_mode(VkCullModeFlags cull_mode)
+{
+	SET_LIST_STATIC_STATE(cull_mode);
+}
+
+void CommandList::set_front_face(VkFrontFace front_face)
+{
+	SET_LIST_STATIC_STATE(front_face);
+}
+
+void CommandList::set_primitive_topology(VkPrimitiveTopology topology)
+{
+	SET_LIST_STATIC_STATE(topology);
+}
+
+void CommandList::set_color_write_mask(uint32_t write_mask)
+{
+	SET_LIST_STATIC_STATE(write_mask);
+}
+
+void CommandList::set_depth_bias(bool depth_bias_enable)
+{
+	SET_LIST_STATIC_STATE(depth_bias_enable);
+}
+
+#undef SET_LIST_STATIC_STATE
+
+void CommandList::flush_static_state()
+{
+	if (static_state_dirty)
+	{
+		emit<CmdStaticState>(CommandListOp::SetStaticState)->state = static_state;
+		static_state_dirty = false;
+	}
+}
+
+void CommandList::set_specialization_constant_mask(uint32_t spec_constant_mask)
+{
+	VK_ASSERT((spec_constant_mask & ~((1u << VULKAN_NUM_USER_SPEC_CONSTANTS) - 1u)) == 0u);
+	emit<CmdSpecConstant>(CommandListOp::SetSpecConstantMask)->value = spec_constant_mask;
+}
+
+void CommandList::set_specialization_constant(unsigned index, uint32_t value)
+{
+	VK_ASSERT(index < VULKAN_NUM_USER_SPEC_CONSTANTS);
+	auto *cmd = emit<CmdSpecConstant>(CommandListOp::SetSpecConstant);
+	cmd->index = index;
+	cmd->value = value;
+}
+
+void CommandList::set_viewport(const VkViewport &viewport)
+{
+	emit<CmdViewport>(CommandListOp::SetViewport)->viewport = viewport;
+}
+
+void CommandList::set_scissor(const VkRect2D &rect)
+{
+	emit<CmdScissor>(CommandListOp::SetScissor)->scissor = rect;
+}
+
+void CommandList::set_depth_bias(float depth_bias_constant, float depth_bias_slope)
+{
+	auto *cmd = emit<CmdDepthBias>(CommandListOp::SetDepthBias);
+	cmd->constant = depth_bias_constant;
+	cmd->slope = depth_bias_slope;
+}
+
+void CommandList::set_stencil_reference(uint8_t compare_mask, uint8_t write_mask, uint8_t reference)
+{
+	auto *cmd = emit<CmdStencilReference>(CommandListOp::SetStencilReference);
+	cmd->compare_mask = compare_mask;
+	cmd->write_mask = write_mask;
+	cmd->reference = reference;
+}
+
+static void init_binding(CmdBinding *cmd, unsigned set, unsigned binding, const void *resource, const void *sampler,
+                         VkDeviceSize offset = 0, VkDeviceSize range = 0)
+{
+	VK_ASSERT(set < VULKAN_NUM_DESCRIPTOR_SETS);
+	VK_ASSERT(binding < VULKAN_NUM_BINDINGS);
+	cmd->set = set;
+	cmd->binding = binding;
+	cmd->resource = resource;
+	cmd->sampler = sampler;
+	cmd->offset = offset;
+	cmd->range = range;
+}
+
+static const void *stock_sampler_key(StockSampler sampler)
+{
+	return reinterpret_cast<const void *>(uintptr_t(sampler));
+}
+
+void CommandList::set_texture(unsigned set, unsigned binding, const ImageView &view)
+{
+	init_binding(emit<CmdBinding>(CommandListOp::SetTexture), set, binding, &view, nullptr);
+}
+
+void CommandList::set_texture(unsigned set, unsigned binding, const ImageView &view, const Sampler &sampler)
+{
+	init_binding(emit<CmdBinding>(CommandListOp::SetTextureSampler), set, binding, &view, &sampler);
+}
+
+void CommandList::set_texture(unsigned set, unsigned binding, const ImageView &view, StockSampler sampler)
+{
+	init_binding(emit<CmdBinding>(CommandListOp::SetTextureStockSampler), set, binding, &view,
+	             stock_sampler_key(sampler));
+}
+
+void CommandList::set_storage_texture(unsigned set, unsigned binding, const ImageView &view)
+{
+	init_binding(emit<CmdBinding>(CommandListOp::SetStorageTexture), set, binding, &view, nullptr);
+}
+
+void CommandList::set_sampler(unsigned set, unsigned binding, const Sampler &sampler)
+{
+	init_binding(emit<CmdBinding>(CommandListOp::SetSampler), set, binding, nullptr, &sampler);
+}
+
+void CommandList::set_sampler(unsigned set, unsigned binding, StockSampler sampler)
+{
+	init_binding(emit<CmdBinding>(CommandListOp::SetStockSampler), set, binding, nullptr,
+	             stock_sampler_key(sampler));
+}
+
+void CommandList::set_uniform_buffer(unsigned set, unsigned binding, const Buffer &buffer,
+                                     VkDeviceSize offset, VkDeviceSize range)
+{
+	init_binding(emit<CmdBinding>(CommandListOp::SetUniformBuffer), set, binding, &buffer, nullptr, offset, range);
+}
+
+void CommandList::set_storage_buffer(unsigned set, unsigned binding, const Buffer &buffer,
+                                     VkDeviceSize offset, VkDeviceSize range)
+{
+	init_binding(emit<CmdBinding>(CommandListOp::SetStorageBuffer), set, binding, &buffer, nullptr, offset, range);
+}
+
+void CommandList::push_constants(const void *data, VkDeviceSize offset, VkDeviceSize range)
+{
+	VK_ASSERT(offset + range <= VULKAN_PUSH_CONSTANT_SIZE);
+	auto *cmd = emit<CmdPushConstants>(CommandListOp::PushConstants, range);
+	cmd->offset = uint32_t(offset);
+	cmd->range = uint32_t(range);
+	memcpy(payload(cmd), data, range);
+}
+
+void *CommandList::allocate_constant_data(unsigned set, unsigned binding, VkDeviceSize size)
+{
+	VK_ASSERT(set < VULKAN_NUM_DESCRIPTOR_SETS);
+	VK_ASSERT(binding < VULKAN_NUM_BINDINGS);
+	auto *cmd = emit<CmdData>(CommandListOp::ConstantData, size);
+	cmd->set = set;
+	cmd->binding = binding;
+	cmd->size = size;
+	return payload(cmd);
+}
+
+void *CommandList::allocate_vertex_data(unsigned binding, VkDeviceSize size, VkDeviceSize stride,
+                                        VkVertexInputRate step_rate)
+{
+	VK_ASSERT(binding < VULKAN_NUM_VERTEX_BUFFERS);
+	auto *cmd = emit<CmdData>(CommandListOp::VertexData, size);
+	cmd->binding = binding;
+	cmd->size = size;
+	cmd->stride = stride;
+	cmd->step_rate = step_rate;
+	return payload(cmd);
+}
+
+void *CommandList::allocate_index_data(VkDeviceSize size, VkIndexType index_type)
+{
+	auto *cmd = emit<CmdData>(CommandListOp::IndexData, size);
+	cmd->size = size;
+	cmd->index_type = index_type;
+	return payload(cmd);
+}
+
+void CommandList::set_vertex_attrib(uint32_t attrib, uint32_t binding, VkFormat format, VkDeviceSize offset)
+{
+	VK_ASSERT(attrib < VULKAN_NUM_VERTEX_ATTRIBS);
+	VK_ASSERT(binding < VULKAN_NUM_VERTEX_BUFFERS);
+	auto *cmd = emit<CmdVertexAttrib>(CommandListOp::SetVertexAttrib);
+	cmd->attrib = attrib;
+	cmd->binding = binding;
+	cmd->format = format;
+	cmd->offset = offset;
+}
+
+void CommandList::set_vertex_binding(uint32_t binding, const Buffer &buffer, VkDeviceSize offset,
+                                     VkDeviceSize stride, VkVertexInputRate step_rate)
+{
+	VK_ASSERT(binding < VULKAN_NUM_VERTEX_BUFFERS);
+	auto *cmd = emit<CmdVertexBinding>(CommandListOp::SetVertexBinding);
+	cmd->binding = binding;
+	cmd->step_rate = step_rate;
+	cmd->buffer = &buffer;
+	cmd->offset = offset;
+	cmd->stride = stride;
+}
+
+void CommandList::set_index_buffer(const Buffer &buffer, VkDeviceSize offset, VkIndexType index_type)
+{
+	auto *cmd = emit<CmdIndexBuffer>(CommandListOp::SetIndexBuffer);
+	cmd->index_type = index_type;
+	cmd->buffer = &buffer;
+	cmd->offset = offset;
+}
+
+void CommandList::draw(uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex,
+                       uint32_t first_instance)
+{
+	flush_static_state();
+	auto *cmd = emit<CmdDraw>(CommandListOp::Draw);
+	cmd->count = vertex_count;
+	cmd->instance_count = instance_count;
+	cmd->first = first_vertex;
+	cmd->vertex_offset = 0;
+	cmd->first_instance = first_instance;
+}
+
+void CommandList::draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t first_index,
+                               int32_t vertex_offset, uint32_t first_instance)
+{
+	flush_static_state();
+	auto *cmd = emit<CmdDraw>(CommandListOp::DrawIndexed);
+	cmd->count = index_count;
+	cmd->instance_count = instance_count;
+	cmd->first = first_index;
+	cmd->vertex_offset = vertex_offset;
+	cmd->first_instance = first_instance;
+}
+
+void CommandList::dispatch(uint32_t groups_x, uint32_t groups_y, uint32_t groups_z)
+{
+	flush_static_state();
+	auto *cmd = emit<CmdDispatch>(CommandListOp::Dispatch);
+	cmd->groups[0] = groups_x;
+	cmd->groups[1] = groups_y;
+	cmd->groups[2] = groups_z;
+}
+
+// What the replayer last forwarded to the command buffer.
+// Everything starts out unknown, since the list inherits state from the command buffer.
+struct CommandListReplayState
+{
+	struct Binding
+	{
+		CommandListOp op;
+		const void *resource;
+		const void *sampler;
+		VkDeviceSize offset;
+		VkDeviceSize range;
+		bool valid;
+	};
+
+	struct VertexAttrib
+	{
+		uint32_t binding;
+		VkFormat format;
+		VkDeviceSize offset;
+		bool valid;
+	};
+
+	struct VertexBinding
+	{
+		const Buffer *buffer;
+		VkDeviceSize offset;
+		VkDeviceSize stride;
+		VkVertexInputRate step_rate;
+		bool valid;
+	};
+
+	Program *program;
+	PipelineState static_state;
+	VkViewport viewport;
+	VkRect2D scissor;
+	float depth_bias[2];
+	uint8_t stencil_reference[3];
+	uint32_t spec_constant_mask;
+	uint32_t spec_constants[VULKAN_NUM_USER_SPEC_CONSTANTS];
+	uint32_t valid_spec_constants;
+
+	Binding bindings[VULKAN_NUM_DESCRIPTOR_SETS][VULKAN_NUM_BINDINGS];
+	VertexAttrib attribs[VULKAN_NUM_VERTEX_ATTRIBS];
+	VertexBinding vbos[VULKAN_NUM_VERTEX_BUFFERS];
+
+	const Buffer *index_buffer;
+	VkDeviceSize index_offset;
+	VkIndexType index_type;
+
+	uint8_t push_constants[VULKAN_PUSH_CONSTANT_SIZE];
+	uint32_t push_constant_offset;
+	uint32_t push_constant_range;
+
+	bool program_valid;
+	bool static_state_valid;
+	bool viewport_valid;
+	bool scissor_valid;
+	bool depth_bias_valid;
+	bool stencil_reference_valid;
+	bool spec_constant_mask_valid;
+	bool index_valid;
+	bool push_constants_valid;
+};
+
+static bool replay_binding(CommandBuffer &cmd, CommandListReplayState &state, const CmdBinding &binding)
+{
+	auto &shadow = state.bindings[binding.set][binding.binding];
+	if (shadow.valid && shadow.op == binding.header.op && shadow.resource == binding.resource &&
+	    shadow.sampler == binding.sampler && shadow.offset == binding.offset && shadow.range == binding.range)
+	{
+		return false;
+	}
+
+	shadow.op = binding.header.op;
+	shadow.resource = binding.resource;
+	shadow.sampler = binding.sampler;
+	shadow.offset = binding.offset;
+	shadow.range = binding.range;
+	shadow.valid = true;
+
+	auto *view = static_cast<const ImageView *>(binding.resource);
+	auto *buffer = static_cast<const Buffer *>(binding.resource);
+	auto *sampler = static_cast<const Sampler *>(binding.sampler);
+	auto stock = StockSampler(reinterpret_cast<uintptr_t>(binding.sampler));
+
+	switch (binding.header.op)
+	{
+	case CommandListOp::SetTexture:
+		cmd.set_texture(binding.set, binding.binding, *view);
+		break;
+	case CommandListOp::SetTextureSampler:
+		cmd.set_texture(binding.set, binding.binding, *view, *sampler);
+		break;
+	case CommandListOp::SetTextureStockSampler:
+		cmd.set_texture(binding.set, binding.binding, *view, stock);
+		break;
+	case CommandListOp::SetStorageTexture:
+		cmd.set_storage_texture(binding.set, binding.binding, *view);
+		break;
+	case CommandListOp::SetSampler:
+		cmd.set_sampler(binding.set, binding.binding, *sampler);
+		break;
+	case CommandListOp::SetStockSampler:
+		cmd.set_sampler(binding.set, binding.binding, stock);
+		break;
+	case CommandListOp::SetUniformBuffer:
+		cmd.set_uniform_buffer(binding.set, binding.binding, *buffer, binding.offset, binding.range);
+		break;
+	case CommandListOp::SetStorageBuffer:
+		cmd.set_storage_buffer(binding.set, binding.binding, *buffer, binding.offset, binding.range);
+		break;
+	default:
+		break;
+	}
+
+	return true;
+}
+
+// Returns false if the command was redundant and skipped.
+static bool replay_command(CommandBuffer &cmd, CommandListReplayState &state, const CommandHeader *header)
+{
+	switch (header->op)
+	{
+	case CommandListOp::SetProgram:
+	{
+		auto *program = reinterpret_cast<const CmdProgram *>(header)->program;
+		if (state.program_valid && state.program == program)
+			return false;
+		state.program = program;
+		state.program_valid = true;
+		cmd.set_program(program);
+		break;
+	}
+
+	case CommandListOp::SetStaticState:
+	{
+		auto &static_state = reinterpret_cast<const CmdStaticState *>(header)->state;
+		if (state.static_state_valid && memcmp(&state.static_state, &static_state, sizeof(static_state)) == 0)
+			return false;
+		state.static_state = static_state;
+		state.static_state_valid = true;
+		cmd.set_static_state(static_state);
+		break;
+	}
+
+	case CommandListOp::SetSpecConstantMask:
+	{
+		uint32_t mask = reinterpret_cast<const CmdSpecConstant *>(header)->value;
+		if (state.spec_constant_mask_valid && state.spec_constant_mask == mask)
+			return false;
+		state.spec_constant_mask = mask;
+		state.spec_constant_mask_valid = true;
+		cmd.set_specialization_constant_mask(mask);
+		break;
+	}
+
+	case CommandListOp::SetSpecConstant:
+	{
+		auto *spec = reinterpret_cast<const CmdSpecConstant *>(header);
+		uint32_t bit = 1u << spec->index;
+		if ((state.valid_spec_constants & bit) != 0 && state.spec_constants[spec->index] == spec->value)
+			return false;
+		state.spec_constants[spec->index] = spec->value;
+		state.valid_spec_constants |= bit;
+		cmd.set_specialization_constant(spec->index, spec->value);
+		break;
+	}
+
+	case CommandListOp::SetViewport:
+	{
+		auto &viewport = reinterpret_cast<const CmdViewport *>(header)->viewport;
+		if (state.viewport_valid && memcmp(&state.viewport, &viewport, sizeof(viewport)) == 0)
+			return false;
+		state.viewport = viewport;
+		state.viewport_valid = true;
+		cmd.set_viewport(viewport);
+		break;
+	}
+
+	case CommandListOp::SetScissor:
+	{
+		auto &scissor = reinterpret_cast<const CmdScissor *>(header)->scissor;
+		if (state.scissor_valid && memcmp(&state.scissor, &scissor, sizeof(scissor)) == 0)
+			return false;
+		state.scissor = scissor;
+		state.scissor_valid = true;
+		cmd.set_scissor(scissor);
+		break;
+	}
+
+	case CommandListOp::SetDepthBias:
+	{
+		auto *bias = reinterpret_cast<const CmdDepthBias *>(header);
+		if (state.depth_bias_valid && state.depth_bias[0] == bias->constant && state.depth_bias[1] == bias->slope)
+			return false;
+		state.depth_bias[0] = bias->constant;
+		state.depth_bias[1] = bias->slope;
+		state.depth_bias_valid = true;
+		cmd.set_depth_bias(bias->constant, bias->slope);
+		break;
+	}
+
+	case CommandListOp::SetStencilReference:
+	{
+		auto *ref = reinterpret_cast<const CmdStencilReference *>(header);
+		const uint8_t values[3] = { ref->compare_mask, ref->write_mask, ref->reference };
+		if (state.stencil_reference_valid && memcmp(state.stencil_reference, values, sizeof(values)) == 0)
+			return false;
+		memcpy(state.stencil_reference, values, sizeof(values));
+		state.stencil_reference_valid = true;
+		cmd.set_stencil_reference(ref->compare_mask, ref->write_mask, ref->reference);
+		break;
+	}
+
+	case CommandListOp::SetTexture:
+	case CommandListOp::SetTextureSampler:
+	case CommandListOp::SetTextureStockSampler:
+	case CommandListOp::SetStorageTexture:
+	case CommandListOp::SetSampler:
+	case CommandListOp::SetStockSampler:
+	case CommandListOp::SetUniformBuffer:
+	case CommandListOp::SetStorageBuffer:
+		return replay_binding(cmd, state, *reinterpret_cast<const CmdBinding *>(header));
+
+	case CommandListOp::PushConstants:
+	{
+		auto *push = reinterpret_cast<const CmdPushConstants *>(header);
+		auto *data = payload(push);
+		if (state.push_constants_valid && state.push_constant_offset == push->offset &&
+		    state.push_constant_range == push->range &&
+		    memcmp(state.push_constants + push->offset, data, push->range) == 0)
+		{
+			return false;
+		}
+
+		memcpy(state.push_constants + push->offset, data, push->range);
+		state.push_constant_offset = push->offset;
+		state.push_constant_range = push->range;
+		state.push_constants_valid = true;
+		cmd.push_constants(data, push->offset, push->range);
+		break;
+	}
+
+	case CommandListOp::ConstantData:
+	{
+		auto *data = reinterpret_cast<const CmdData *>(header);
+		state.bindings[data->set][data->binding].valid = false;
+		memcpy(cmd.allocate_constant_data(data->set, data->binding, data->size), payload(data), data->size);
+		break;
+	}
+
+	case CommandListOp::VertexData:
+	{
+		auto *data = reinterpret_cast<const CmdData *>(header);
+		state.vbos[data->binding].valid = false;
+		memcpy(cmd.allocate_vertex_data(data->binding, data->size, data->stride, data->step_rate),
+		       payload(data), data->size);
+		break;
+	}
+
+	case CommandListOp::IndexData:
+	{
+		auto *data = reinterpret_cast<const CmdData *>(header);
+		state.index_valid = false;
+		memcpy(cmd.allocate_index_data(data->size, data->index_type), payload(data), data->size);
+		break;
+	}
+
+	case CommandListOp::SetVertexAttrib:
+	{
+		auto *attrib = reinterpret_cast<const CmdVertexAttrib *>(header);
+		auto &shadow = state.attribs[attrib->attrib];
+		if (shadow.valid && shadow.binding == attrib->binding && shadow.format == attrib->format &&
+		    shadow.offset == attrib->offset)
+		{
+			return false;
+		}
+
+		shadow.binding = attrib->binding;
+		shadow.format = attrib->format;
+		shadow.offset = attrib->offset;
+		shadow.valid = true;
+		cmd.set_vertex_attrib(attrib->attrib, attrib->binding, attrib->format, attrib->offset);
+		break;
+	}
+
+	case CommandListOp::SetVertexBinding:
+	{
+		auto *binding = reinterpret_cast<const CmdVertexBinding *>(header);
+		auto &shadow = state.vbos[binding->binding];
+		if (shadow.valid && shadow.buffer == binding->buffer && shadow.offset == binding->offset &&
+		    shadow.stride == binding->stride && shadow.step_rate == binding->step_rate)
+		{
+			return false;
+		}
+
+		shadow.buffer = binding->buffer;
+		shadow.offset = binding->offset;
+		shadow.stride = binding->stride;
+		shadow.step_rate = binding->step_rate;
+		shadow.valid = true;
+		cmd.set_vertex_binding(binding->binding, *binding->buffer, binding->offset, binding->stride,
+		                       binding->step_rate);
+		break;
+	}
+
+	case CommandListOp::SetIndexBuffer:
+	{
+		auto *index = reinterpret_cast<const CmdIndexBuffer *>(header);
+		if (state.index_valid && state.index_buffer == index->buffer && state.index_offset == index->offset &&
+		    state.index_type == index->index_type)
+		{
+			return false;
+		}
+
+		state.index_buffer = index->buffer;
+		state.index_offset = index->offset;
+		state.index_type = index->index_type;
+		state.index_valid = true;
+		cmd.set_index_buffer(*index->buffer, index->offset, index->index_type);
+		break;
+	}
+
+	case CommandListOp::Draw:
+	{
+		auto *draw = reinterpret_cast<const CmdDraw *>(header);
+		cmd.draw(draw->count, draw->instance_count, draw->first, draw->first_instance);
+		break;
+	}
+
+	case CommandListOp::DrawIndexed:
+	{
+		auto *draw = reinterpret_cast<const CmdDraw *>(header);
+		cmd.draw_indexed(draw->count, draw->instance_count, draw->first, draw->vertex_offset, draw->first_instance);
+		break;
+	}
+
+	case CommandListOp::Dispatch:
+	{
+		auto *dispatch = reinterpret_cast<const CmdDispatch *>(header);
+		cmd.dispatch(dispatch->groups[0], dispatch->groups[1], dispatch->groups[2]);
+		break;
+	}
+	}
+
+	return true;
+}
+
+void CommandList::replay(CommandBuffer &cmd, CommandListReplayStats *stats) const
+{
+	CommandListReplayState state = {};
+	unsigned redundant = 0;
+
+	for (auto &block : blocks)
+	{
+		size_t offset = 0;
+		while (offset < block.offset)
+		{
+			auto *header = reinterpret_cast<const CommandHeader *>(block.data.get() + offset);
+			offset += header->size;
+			if (!replay_command(cmd, state, header))
+				redundant++;
+		}
+	}
+
+	if (stats)
+	{
+		stats->commands += unsigned(num_commands);
+		stats->redundant += redundant;
+	}
+}
+}
@@ -0,0 +1,146 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "command_buffer.hpp"
+#include <memory>
+#include <vector>
+
+namespace Vulkan
+{
+enum class CommandListOp : uint32_t;
+
+struct CommandListReplayStats
+{
+	unsigned commands = 0;
+	unsigned redundant = 0;
+};
+
+// A compact, device independent command stream.
+// Recording only appends POD opcodes to bump-allocated blocks and never calls into Vulkan,
+// so lists can be recorded on any thread and replayed into a CommandBuffer later.
+// Programs, buffers, views and samplers are referenced by pointer and must outlive replay.
+// A list replays into whatever render pass or compute context the command buffer is in,
+// and any state the list does not set is inherited from the command buffer.
+class CommandList
+{
+public:
+	CommandList();
+	~CommandList();
+	CommandList(const CommandList &) = delete;
+	void operator=(const CommandList &) = delete;
+
+	// Keeps allocated blocks around for the next recording.
+	void reset();
+
+	size_t get_num_commands() const
+	{
+		return num_commands;
+	}
+
+	void set_program(Program *program);
+
+	// Static state must be established with set_static_state() or one of the presets
+	// before it is modified piecewise.
+	void set_static_state(const PipelineState &state);
+	void set_opaque_state();
+	void set_quad_state();
+	void set_opaque_sprite_state();
+	void set_transparent_sprite_state();
+	void set_depth_test(bool depth_test, bool depth_write);
+	void set_depth_compare(VkCompareOp depth_compare);
+	void set_blend_enable(bool blend_enable);
+	void set_blend_factors(VkBlendFactor src_color_blend, VkBlendFactor src_alpha_blend,
+	                       VkBlendFactor dst_color_blend, VkBlendFactor dst_alpha_blend);
+	void set_blend_op(VkBlendOp color_blend_op, VkBlendOp alpha_blend_op);
+	void set_cull_mode(VkCullModeFlags cull_mode);
+	void set_front_face(VkFrontFace front_face);
+	void set_primitive_topology(VkPrimitiveTopology topology);
+	void set_color_write_mask(uint32_t write_mask);
+	void set_depth_bias(bool depth_bias_enable);
+	void set_specialization_constant_mask(uint32_t spec_constant_mask);
+	void set_specialization_constant(unsigned index, uint32_t value);
+
+	void set_viewport(const VkViewport &viewport);
+	void set_scissor(const VkRect2D &rect);
+	void set_depth_bias(float depth_bias_constant, float depth_bias_slope);
+	void set_stencil_reference(uint8_t compare_mask, uint8_t write_mask, uint8_t reference);
+
+	void set_texture(unsigned set, unsigned binding, const ImageView &view);
+	void set_texture(unsigned set, unsigned binding, const ImageView &view, const Sampler &sampler);
+	void set_texture(unsigned set, unsigned binding, const ImageView &view, StockSampler sampler);
+	void set_storage_texture(unsigned set, unsigned binding, const ImageView &view);
+	void set_sampler(unsigned set, unsigned binding, const Sampler &sampler);
+	void set_sampler(unsigned set, unsigned binding, StockSampler sampler);
+	void set_uniform_buffer(unsigned set, unsigned binding, const Buffer &buffer, VkDeviceSize offset,
+	                        VkDeviceSize range);
+	void set_storage_buffer(unsigned set, unsigned binding, const Buffer &buffer, VkDeviceSize offset,
+	                        VkDeviceSize range);
+	void push_constants(const void *data, VkDeviceSize offset, VkDeviceSize range);
+
+	// Data is copied into the list and uploaded when replayed.
+	void *allocate_constant_data(unsigned set, unsigned binding, VkDeviceSize size);
+	void *allocate_vertex_data(unsigned binding, VkDeviceSize size, VkDeviceSize stride,
+	                           VkVertexInputRate step_rate = VK_VERTEX_INPUT_RATE_VERTEX);
+	void *allocate_index_data(VkDeviceSize size, VkIndexType index_type);
+
+	void set_vertex_attrib(uint32_t attrib, uint32_t binding, VkFormat format, VkDeviceSize offset);
+	void set_vertex_binding(uint32_t binding, const Buffer &buffer, VkDeviceSize offset, VkDeviceSize stride,
+	                        VkVertexInputRate step_rate = VK_VERTEX_INPUT_RATE_VERTEX);
+	void set_index_buffer(const Buffer &buffer, VkDeviceSize offset, VkIndexType index_type);
+
+	void draw(uint32_t vertex_count, uint32_t instance_count = 1, uint32_t first_vertex = 0,
+	          uint32_t first_instance = 0);
+	void draw_indexed(uint32_t index_count, uint32_t instance_count = 1, uint32_t first_index = 0,
+	                  int32_t vertex_offset = 0, uint32_t first_instance = 0);
+	void dispatch(uint32_t groups_x, uint32_t groups_y, uint32_t groups_z);
+
+	// Translates the list into cmd, skipping commands which would not change any state.
+	// Can be called any number of times, but not concurrently with recording.
+	void replay(CommandBuffer &cmd, CommandListReplayStats *stats = nullptr) const;
+
+private:
+	enum { BlockSize = 64 * 1024 };
+
+	struct Block
+	{
+		std::unique_ptr<uint8_t[]> data;
+		size_t size = 0;
+		size_t offset = 0;
+	};
+	std::vector<Block> blocks;
+	std::vector<Block> recycled_blocks;
+	size_t num_commands = 0;
+
+	PipelineState static_state = {};
+	bool static_state_valid = false;
+	bool static_state_dirty = false;
+
+	void *allocate_command(size_t size);
+	template <typename T>
+	T *emit(CommandListOp op, size_t payload_size = 0);
+	void flush_static_state();
+	void mark_static_state_dirty();
+};
+}
@@ -26,6 +26,7 @@
 #include "device_fossilize.hpp"
 #endif
 #include "format.hpp"
+#include "upload_manager.hpp"
 #include "timeline_trace_file.hpp"
 #include "type_to_string.hpp"
 #include "quirks.hpp"
@@ -41,6 +42,7 @@
 
 #ifdef GRANITE_VULKAN_SYSTEM_HANDLES
 #include "string_helpers.hpp"
+#include "thread_group.hpp"
 #endif
 
 #include "thread_id.hpp"
@@ -884,6 +886,8 @@ void Device::set_context(const Context &context)
 	if (system_handles.timeline_trace_file)
 		init_calibrated_timestamps();
 
+	upload_manager.reset(new UploadManager(*this));
+
 #ifdef GRANITE_VULKAN_SYSTEM_HANDLES
 	resource_manager.init();
 #endif
@@ -1121,6 +1125,11 @@ void Device::submit(CommandBufferHandle &cmd, Fence *fence, unsigned semaphore_c
 {
 	cmd->end_debug_channel();
 
+	// Work submitted after a required upload was queued might consume it.
+	// The upload manager submits its own copies on the transfer queue, so that cannot recurse.
+	if (upload_manager && cmd->get_command_buffer_type() != CommandBuffer::Type::AsyncTransfer)
+		upload_manager->flush_required();
+
 	LOCK();
 	submit_nolock(std::move(cmd), fence, semaphore_count, semaphores);
 }
@@ -2008,6 +2017,12 @@ Device::~Device()
 
 	wait_idle();
 
+	// Holds on to staging buffers and fences.
+	upload_manager.reset();
+
+	// Background pipeline compiles reference programs and render passes, so drain them first.
+	pipeline_compile_tracker.wait_idle();
+
 	managers.timestamps.log_simple();
 
 	if (pipeline_cache != VK_NULL_HANDLE)
@@ -2447,6 +2462,10 @@ void Device::promote_read_write_caches_to_read_only()
 
 void Device::next_frame_context()
 {
+	// Submits through the regular interfaces, so must happen before taking the lock.
+	if (upload_manager)
+		upload_manager->flush();
+
 	DRAIN_FRAME_LOCK();
 
 	if (frame_context_begin_ts)
@@ -2461,6 +2480,7 @@ void Device::next_frame_context()
 
 	framebuffer_allocator.begin_frame();
 	transient_allocator.begin_frame();
+	pipeline_compile_tracker.begin_frame();
 
 	for (auto &allocator : descriptor_set_allocators.get_read_only())
 		allocator.begin_frame();
@@ -3395,28 +3415,48 @@ ImageViewHandle Device::create_image_view(const ImageViewCreateInfo &create_info
 		return ImageViewHandle(nullptr);
 }
 
+VkDeviceSize Device::allocate_image_staging(InitialImageBuffer &staging, const TextureFormatLayout &layout)
+{
+	// bufferOffset must be a multiple of the texel block size and of 4.
+	// Use a multiple of 16 as well, which is friendlier to copy engines.
+	VkDeviceSize base_alignment = std::max<VkDeviceSize>(16u, gpu_props.limits.optimalBufferCopyOffsetAlignment);
+	VkDeviceSize alignment = base_alignment;
+	while (alignment % layout.get_block_stride())
+		alignment += base_alignment;
+
+	auto region = upload_manager->allocate_staging(layout.get_required_size(), alignment);
+	staging.buffer = std::move(region.buffer);
+	return region.offset;
+}
+
+UploadManager &Device::get_upload_manager()
+{
+	return *upload_manager;
+}
+
 InitialImageBuffer Device::create_image_staging_buffer(const TextureFormatLayout &layout)
 {
 	InitialImageBuffer result;
 
-	BufferCreateInfo buffer_info = {};
-	buffer_info.domain = BufferDomain::Host;
-	buffer_info.size = layout.get_required_size();
-	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	VkDeviceSize offset;
 	{
 		GRANITE_SCOPED_TIMELINE_EVENT_FILE(system_handles.timeline_trace_file, "allocate-image-staging-buffer");
-		result.buffer = create_buffer(buffer_info, nullptr);
+		offset = allocate_image_staging(result, layout);
 	}
-	set_name(*result.buffer, "image-upload-staging-buffer");
+	if (!result.buffer)
+		return {};
 
-	auto *mapped = static_cast<uint8_t *>(map_host_buffer(*result.buffer, MEMORY_ACCESS_WRITE_BIT));
+	VkDeviceSize size = layout.get_required_size();
+	auto *mapped = static_cast<uint8_t *>(map_host_buffer(*result.buffer, MEMORY_ACCESS_WRITE_BIT, offset, size));
 	{
 		GRANITE_SCOPED_TIMELINE_EVENT_FILE(system_handles.timeline_trace_file, "copy-image-staging-buffer");
-		memcpy(mapped, layout.data(), layout.get_required_size());
+		memcpy(mapped, layout.data(), size);
 	}
-	unmap_host_buffer(*result.buffer, MEMORY_ACCESS_WRITE_BIT);
+	unmap_host_buffer(*result.buffer, MEMORY_ACCESS_WRITE_BIT, offset, size);
 
 	layout.build_buffer_image_copies(result.blits);
+	for (auto &blit : result.blits)
+		blit.bufferOffset += offset;
 	return result;
 }
 
@@ -3450,21 +3490,20 @@ InitialImageBuffer Device::create_image_staging_buffer(const ImageCreateInfo &in
 		return {};
 	}
 
-	BufferCreateInfo buffer_info = {};
-	buffer_info.domain = BufferDomain::Host;
-	buffer_info.size = layout.get_required_size();
-	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	VkDeviceSize offset;
 	{
 		GRANITE_SCOPED_TIMELINE_EVENT_FILE(system_handles.timeline_trace_file, "allocate-image-staging-buffer");
-		result.buffer = create_buffer(buffer_info, nullptr);
+		offset = allocate_image_staging(result, layout);
 	}
-	set_name(*result.buffer, "image-upload-staging-buffer");
+	if (!result.buffer)
+		return {};
 
 	// And now, do the actual copy.
-	auto *mapped = static_cast<uint8_t *>(map_host_buffer(*result.buffer, MEMORY_ACCESS_WRITE_BIT));
+	VkDeviceSize size = layout.get_required_size();
+	auto *mapped = static_cast<uint8_t *>(map_host_buffer(*result.buffer, MEMORY_ACCESS_WRITE_BIT, offset, size));
 	unsigned index = 0;
 
-	layout.set_buffer(mapped, layout.get_required_size());
+	layout.set_buffer(mapped, size);
 
 	GRANITE_SCOPED_TIMELINE_EVENT_FILE(system_handles.timeline_trace_file, "copy-image-staging-buffer");
 	for (unsigned level = 0; level < copy_levels; level++)
@@ -3492,8 +3531,10 @@ InitialImageBuffer Device::create_image_staging_buffer(const ImageCreateInfo &in
 		}
 	}
 
-	unmap_host_buffer(*result.buffer, MEMORY_ACCESS_WRITE_BIT);
+	unmap_host_buffer(*result.buffer, MEMORY_ACCESS_WRITE_BIT, offset, size);
 	layout.build_buffer_image_copies(result.blits);
+	for (auto &blit : result.blits)
+		blit.bufferOffset += offset;
 	return result;
 }
 
@@ -5043,6 +5084,29 @@ PipelineEvent Device::begin_signal_event()
 	return request_pipeline_event();
 }
 
+PipelineMissDecision Device::request_pipeline_compile(const DeferredPipelineCompile &compile, bool has_fallback)
+{
+#ifdef GRANITE_VULKAN_SYSTEM_HANDLES
+	if (system_handles.thread_group)
+	{
+		auto decision = pipeline_compile_tracker.on_miss(compile.hash, has_fallback);
+		if (decision.enqueue_async)
+		{
+			system_handles.thread_group->create_task([this, c = std::make_unique<DeferredPipelineCompile>(compile)]() {
+				auto pipe = CommandBuffer::build_graphics_pipeline(this, *c, CommandBuffer::CompileMode::AsyncThread);
+				pipeline_compile_tracker.on_compile_complete(c->hash, pipe.pipeline != VK_NULL_HANDLE);
+			});
+		}
+		return decision;
+	}
+#else
+	(void)compile;
+	(void)has_fallback;
+#endif
+
+	return { PipelineMissAction::CompileSync, false };
+}
+
 #ifdef GRANITE_VULKAN_SYSTEM_HANDLES
 ResourceManager &Device::get_resource_manager()
 {
@@ -38,6 +38,7 @@
 #include "context.hpp"
 #include "query_pool.hpp"
 #include "buffer_pool.hpp"
+#include "pipeline_compile_tracker.hpp"
 #include <memory>
 #include <vector>
 #include <functional>
@@ -79,6 +80,8 @@ enum class SwapchainRenderPass
 	DepthStencil
 };
 
+class UploadManager;
+
 struct InitialImageBuffer
 {
 	BufferHandle buffer;
@@ -317,9 +320,14 @@ public:
 	DeviceAllocationOwnerHandle allocate_memory(const MemoryAllocateInfo &info);
 
 	// Create staging buffers for images.
+	// The staging memory is suballocated from the upload manager, so blits have a non-zero buffer offset.
 	InitialImageBuffer create_image_staging_buffer(const ImageCreateInfo &info, const ImageInitialData *initial);
 	InitialImageBuffer create_image_staging_buffer(const TextureFormatLayout &layout);
 
+	// Batched initial buffer uploads. Flushed once per frame in next_frame_context(),
+	// and required uploads are flushed before graphics and compute submissions.
+	UploadManager &get_upload_manager();
+
 	// Create image view, buffer views and samplers.
 	ImageViewHandle create_image_view(const ImageViewCreateInfo &view_info);
 	BufferViewHandle create_buffer_view(const BufferViewCreateInfo &view_info);
@@ -408,6 +416,21 @@ public:
 
 	const Sampler &get_stock_sampler(StockSampler sampler) const;
 
+	// Decides what draws do when they hit a pipeline which has not been compiled yet.
+	// Asynchronous policies compile on the ThreadGroup from system handles, and are
+	// equivalent to PipelineMissPolicy::Synchronous if there is none.
+	// Fallback programs are registered with Program::set_fallback_program().
+	PipelineCompileTracker &get_pipeline_compile_tracker()
+	{
+		return pipeline_compile_tracker;
+	}
+
+	// Statistics for the last completed frame context.
+	PipelineCompileStats get_pipeline_compile_stats() const
+	{
+		return pipeline_compile_tracker.get_frame_stats();
+	}
+
 #ifdef GRANITE_VULKAN_SYSTEM_HANDLES
 	// To obtain ShaderManager, ShaderModules must be observed to be complete
 	// in query_initialization_progress().
@@ -425,6 +448,9 @@ public:
 		// don't have SPIRV-Cross and/or shaderc to do on the fly compilation.
 		// For shipping configurations. We can still compile pipelines, but it may stutter.
 		ShaderModules,
+		// When this is done, pipelines which previous sessions used early or frequently have been compiled.
+		// Pipelines are replayed in that order, so this completes well before Pipelines.
+		PriorityPipelines,
 		// When this is done, pipelines should never stutter if Fossilize knows about the pipeline.
 		Pipelines
 	};
@@ -488,6 +514,13 @@ private:
 	uint64_t allocate_cookie();
 	void bake_program(Program &program);
 
+	PipelineCompileTracker pipeline_compile_tracker;
+	std::unique_ptr<UploadManager> upload_manager;
+	PipelineMissDecision request_pipeline_compile(const DeferredPipelineCompile &compile, bool has_fallback);
+
+	// Returns the offset of the staging memory in staging.buffer.
+	VkDeviceSize allocate_image_staging(InitialImageBuffer &staging, const TextureFormatLayout &layout);
+
 	void request_vertex_block(BufferBlock &block, VkDeviceSize size);
 	void request_index_block(BufferBlock &block, VkDeviceSize size);
 	void request_uniform_block(BufferBlock &block, VkDeviceSize size);
@@ -821,6 +854,8 @@ private:
 	void register_descriptor_set_layout(VkDescriptorSetLayout layout, Fossilize::Hash hash, const VkDescriptorSetLayoutCreateInfo &info);
 	void register_pipeline_layout(VkPipelineLayout layout, Fossilize::Hash hash, const VkPipelineLayoutCreateInfo &info);
 	void register_shader_module(VkShaderModule module, Fossilize::Hash hash, const VkShaderModuleCreateInfo &info);
+	void record_pipeline_usage(const Util::Hash *hashes, size_t count);
+	void mark_pipeline_replayed(Fossilize::Hash hash);
 	//void register_sampler(VkSampler sampler, Fossilize::Hash hash, const VkSamplerCreateInfo &info);
 
 	struct RecorderState;
@@ -25,12 +25,15 @@
 #include "thread_group.hpp"
 #include "fossilize_db.hpp"
 #include "dynamic_array.hpp"
+#include <algorithm>
+#include <string.h>
 
 namespace Vulkan
 {
 Device::RecorderState::RecorderState()
 {
 	recorder_ready.store(false, std::memory_order_relaxed);
+	start_time_ns = Util::get_current_time_nsecs();
 }
 
 Device::RecorderState::~RecorderState()
@@ -42,6 +45,9 @@ Device::ReplayerState::ReplayerState()
 	progress.prepare.store(0, std::memory_order_relaxed);
 	progress.modules.store(0, std::memory_order_relaxed);
 	progress.pipelines.store(0, std::memory_order_relaxed);
+	progress.priority_pipelines.store(0, std::memory_order_relaxed);
+	next_graphics_pipeline.store(0, std::memory_order_relaxed);
+	next_compute_pipeline.store(0, std::memory_order_relaxed);
 }
 
 Device::ReplayerState::~ReplayerState()
@@ -131,6 +137,22 @@ void Device::register_graphics_pipeline(Fossilize::Hash hash, const VkGraphicsPi
 		LOGW("Failed to register graphics pipeline.\n");
 }
 
+void Device::record_pipeline_usage(const Util::Hash *hashes, size_t count)
+{
+	if (!recorder_state)
+		return;
+
+	auto time_ms = (Util::get_current_time_nsecs() - recorder_state->start_time_ns) / 1000000;
+	recorder_state->usage_profile.record_uses(hashes, count, uint32_t(std::min<int64_t>(time_ms, UINT32_MAX)));
+}
+
+void Device::mark_pipeline_replayed(Fossilize::Hash hash)
+{
+	replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+	if (replayer_state->priority_hashes.count(hash))
+		replayer_state->progress.priority_pipelines.fetch_add(1, std::memory_order_release);
+}
+
 void Device::register_render_pass(VkRenderPass render_pass, Fossilize::Hash hash, const VkRenderPassCreateInfo2KHR &info)
 {
 	if (!recorder_state)
@@ -176,7 +198,7 @@ bool Device::fossilize_replay_graphics_pipeline(Fossilize::Hash hash, VkGraphics
 	    info.pStages[0].stage != VK_SHADER_STAGE_VERTEX_BIT ||
 	    info.pStages[1].stage != VK_SHADER_STAGE_FRAGMENT_BIT)
 	{
-		replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+		mark_pipeline_replayed(hash);
 		return false;
 	}
 
@@ -185,7 +207,7 @@ bool Device::fossilize_replay_graphics_pipeline(Fossilize::Hash hash, VkGraphics
 
 	if (!vert_shader || !frag_shader)
 	{
-		replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+		mark_pipeline_replayed(hash);
 		return false;
 	}
 
@@ -238,7 +260,7 @@ bool Device::fossilize_replay_graphics_pipeline(Fossilize::Hash hash, VkGraphics
 	if (res != VK_SUCCESS)
 	{
 		LOGE("Failed to create graphics pipeline!\n");
-		replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+		mark_pipeline_replayed(hash);
 		return false;
 	}
 
@@ -246,7 +268,7 @@ bool Device::fossilize_replay_graphics_pipeline(Fossilize::Hash hash, VkGraphics
 	if (actual_pipe != pipeline)
 		table->vkDestroyPipeline(device, pipeline, nullptr);
 
-	replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+	mark_pipeline_replayed(hash);
 	return actual_pipe != VK_NULL_HANDLE;
 }
 
@@ -256,7 +278,7 @@ bool Device::fossilize_replay_compute_pipeline(Fossilize::Hash hash, VkComputePi
 	auto *shader = shaders.find((Fossilize::Hash)info.stage.module);
 	if (!shader)
 	{
-		replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+		mark_pipeline_replayed(hash);
 		return false;
 	}
 
@@ -276,7 +298,7 @@ bool Device::fossilize_replay_compute_pipeline(Fossilize::Hash hash, VkComputePi
 	if (res != VK_SUCCESS)
 	{
 		LOGE("Failed to create compute pipeline!\n");
-		replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+		mark_pipeline_replayed(hash);
 		return false;
 	}
 
@@ -284,7 +306,7 @@ bool Device::fossilize_replay_compute_pipeline(Fossilize::Hash hash, VkComputePi
 	if (actual_pipe != pipeline)
 		table->vkDestroyPipeline(device, pipeline, nullptr);
 
-	replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+	mark_pipeline_replayed(hash);
 	return actual_pipe != VK_NULL_HANDLE;
 }
 
@@ -297,7 +319,7 @@ bool Device::enqueue_create_graphics_pipeline(Fossilize::Hash hash,
 		if (create_info->pStages[i].module == VK_NULL_HANDLE)
 		{
 			*pipeline = VK_NULL_HANDLE;
-			replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+			mark_pipeline_replayed(hash);
 			return true;
 		}
 	}
@@ -305,14 +327,14 @@ bool Device::enqueue_create_graphics_pipeline(Fossilize::Hash hash,
 	if (create_info->renderPass == VK_NULL_HANDLE || create_info->layout == VK_NULL_HANDLE)
 	{
 		*pipeline = VK_NULL_HANDLE;
-		replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+		mark_pipeline_replayed(hash);
 		return true;
 	}
 
 	if (!replayer_state->feature_filter->graphics_pipeline_is_supported(create_info))
 	{
 		*pipeline = VK_NULL_HANDLE;
-		replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+		mark_pipeline_replayed(hash);
 		return true;
 	}
 
@@ -328,14 +350,14 @@ bool Device::enqueue_create_compute_pipeline(Fossilize::Hash hash,
 	if (create_info->stage.module == VK_NULL_HANDLE || create_info->layout == VK_NULL_HANDLE)
 	{
 		*pipeline = VK_NULL_HANDLE;
-		replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+		mark_pipeline_replayed(hash);
 		return true;
 	}
 
 	if (!replayer_state->feature_filter->compute_pipeline_is_supported(create_info))
 	{
 		*pipeline = VK_NULL_HANDLE;
-		replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+		mark_pipeline_replayed(hash);
 		return true;
 	}
 
@@ -638,10 +660,17 @@ void Device::init_pipeline_state(const Fossilize::FeatureFilter &filter,
 		if (read_real_path.empty())
 		{
 			replayer_state->progress.modules.store(~0u, std::memory_order_release);
+			replayer_state->progress.priority_pipelines.store(~0u, std::memory_order_release);
 			replayer_state->progress.pipelines.store(~0u, std::memory_order_release);
 			return;
 		}
 
+		if (auto profile_file = fs->open_readonly_mapping("cache://fossilize/usage.bin"))
+		{
+			if (!recorder_state->usage_profile.parse(profile_file->data(), profile_file->get_size()))
+				LOGW("Fossilize: Failed to parse pipeline usage profile.\n");
+		}
+
 		replayer_state->db.reset(
 			Fossilize::create_stream_archive_database(read_real_path.c_str(), Fossilize::DatabaseMode::ReadOnly));
 
@@ -674,15 +703,26 @@ void Device::init_pipeline_state(const Fossilize::FeatureFilter &filter,
 			replayer_state->db->get_hash_list_for_resource_tag(Fossilize::RESOURCE_COMPUTE_PIPELINE, &count,
 			                                                   replayer_state->compute_hashes.data());
 
+			// Replay pipelines which were needed early and often in previous sessions first.
+			auto &profile = recorder_state->usage_profile;
+			auto &graphics = replayer_state->graphics_hashes;
+			auto &compute = replayer_state->compute_hashes;
+			size_t num_priority_graphics = profile.sort_by_priority(graphics.data(), graphics.size());
+			size_t num_priority_compute = profile.sort_by_priority(compute.data(), compute.size());
+			replayer_state->priority_hashes.insert(graphics.begin(), graphics.begin() + num_priority_graphics);
+			replayer_state->priority_hashes.insert(compute.begin(), compute.begin() + num_priority_compute);
+
 			replayer_state->progress.num_modules = replayer_state->module_hashes.size();
-			replayer_state->progress.num_pipelines =
-			    replayer_state->graphics_hashes.size() + replayer_state->compute_hashes.size();
+			replayer_state->progress.num_pipelines = graphics.size() + compute.size();
+			replayer_state->progress.num_priority_pipelines = num_priority_graphics + num_priority_compute;
 		}
 
 		if (replayer_state->progress.num_modules == 0)
 			replayer_state->progress.modules.store(~0u, std::memory_order_release);
 		if (replayer_state->progress.num_pipelines == 0)
 			replayer_state->progress.pipelines.store(~0u, std::memory_order_release);
+		if (replayer_state->progress.num_priority_pipelines == 0)
+			replayer_state->progress.priority_pipelines.store(~0u, std::memory_order_release);
 	});
 	prepare_task->set_desc("foz-prepare");
 
@@ -747,7 +787,7 @@ void Device::init_pipeline_state(const Fossilize::FeatureFilter &filter,
 
 			if (!replayer.parse(*this, &db, buffer.data(), size))
 			{
-				replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+				mark_pipeline_replayed(hash);
 				LOGW("Failed to parse graphics pipeline.\n");
 			}
 		}
@@ -776,7 +816,7 @@ void Device::init_pipeline_state(const Fossilize::FeatureFilter &filter,
 
 			if (!replayer.parse(*this, &db, buffer.data(), size))
 			{
-				replayer_state->progress.pipelines.fetch_add(1, std::memory_order_release);
+				mark_pipeline_replayed(hash);
 				LOGW("Failed to parse compute pipeline.\n");
 			}
 		}
@@ -792,26 +832,23 @@ void Device::init_pipeline_state(const Fossilize::FeatureFilter &filter,
 	group->add_dependency(*compile_graphics_task, *parse_graphics_task);
 	group->add_dependency(*compile_compute_task, *parse_modules_task);
 	group->add_dependency(*compile_compute_task, *parse_compute_task);
-	for (unsigned i = 0; i < NumTasks; i++)
-	{
-		compile_graphics_task->enqueue_task([this, i]() {
-			size_t start = (i * replayer_state->graphics_pipelines.size()) / NumTasks;
-			size_t end = ((i + 1) * replayer_state->graphics_pipelines.size()) / NumTasks;
-			for (; start < end; start++)
-			{
-				auto &pipe = replayer_state->graphics_pipelines[start];
-				fossilize_replay_graphics_pipeline(pipe.first, *pipe.second);
-			}
+	// Pipelines are sorted by priority, so pull them in order from a shared cursor
+	// rather than splitting into ranges, which would compile the tail concurrently with the head.
+	unsigned num_compile_tasks = std::max(NumTasks, group->get_num_threads());
+	for (unsigned i = 0; i < num_compile_tasks; i++)
+	{
+		compile_graphics_task->enqueue_task([this]() {
+			auto &pipelines = replayer_state->graphics_pipelines;
+			size_t index;
+			while ((index = replayer_state->next_graphics_pipeline.fetch_add(1, std::memory_order_relaxed)) < pipelines.size())
+				fossilize_replay_graphics_pipeline(pipelines[index].first, *pipelines[index].second);
 		});
 
-		compile_compute_task->enqueue_task([this, i]() {
-			size_t start = (i * replayer_state->compute_pipelines.size()) / NumTasks;
-			size_t end = ((i + 1) * replayer_state->compute_pipelines.size()) / NumTasks;
-			for (; start < end; start++)
-			{
-				auto &pipe = replayer_state->compute_pipelines[start];
-				fossilize_replay_compute_pipeline(pipe.first, *pipe.second);
-			}
+		compile_compute_task->enqueue_task([this]() {
+			auto &pipelines = replayer_state->compute_pipelines;
+			size_t index;
+			while ((index = replayer_state->next_compute_pipeline.fetch_add(1, std::memory_order_relaxed)) < pipelines.size())
+				fossilize_replay_compute_pipeline(pipelines[index].first, *pipelines[index].second);
 		});
 	}
 
@@ -863,6 +900,17 @@ void Device::flush_pipeline_state()
 
 	if (recorder_state)
 	{
+		auto *fs = get_system_handles().filesystem;
+		if (fs && recorder_state->usage_profile.get_num_entries())
+		{
+			auto blob = recorder_state->usage_profile.serialize();
+			auto file = fs->open_transactional_mapping("cache://fossilize/usage.bin", blob.size());
+			if (file)
+				memcpy(file->mutable_data(), blob.data(), blob.size());
+			else
+				LOGW("Fossilize: Failed to write pipeline usage profile.\n");
+		}
+
 		recorder_state->recorder.tear_down_recording_thread();
 		recorder_state.reset();
 	}
@@ -889,6 +937,17 @@ unsigned Device::query_initialization_progress(InitializationStage status) const
 		return (100u * done) / replayer_state->progress.num_modules;
 	}
 
+	case InitializationStage::PriorityPipelines:
+	{
+		unsigned done = replayer_state->progress.priority_pipelines.load(std::memory_order_acquire);
+		// Avoid 0/0.
+		if (!done)
+			return 0;
+		else if (done == ~0u)
+			return 100;
+		return (100u * done) / replayer_state->progress.num_priority_pipelines;
+	}
+
 	case InitializationStage::Pipelines:
 	{
 		unsigned done = replayer_state->progress.pipelines.load(std::memory_order_acquire);
@@ -24,6 +24,8 @@
 
 #include "device.hpp"
 #include "thread_group.hpp"
+#include "pipeline_usage_profile.hpp"
+#include <unordered_set>
 
 namespace Vulkan
 {
@@ -35,6 +37,9 @@ struct Device::RecorderState
 	std::unique_ptr<Fossilize::DatabaseInterface> db;
 	Fossilize::StateRecorder recorder;
 	std::atomic_bool recorder_ready;
+
+	PipelineUsageProfile usage_profile;
+	int64_t start_time_ns;
 };
 
 static constexpr unsigned NumTasks = 4;
@@ -58,12 +63,20 @@ struct Device::ReplayerState
 	std::vector<std::pair<Fossilize::Hash, VkGraphicsPipelineCreateInfo *>> graphics_pipelines;
 	std::vector<std::pair<Fossilize::Hash, VkComputePipelineCreateInfo *>> compute_pipelines;
 
+	// Pipelines seen in the usage profile. Read-only once the prepare task completes.
+	std::unordered_set<Fossilize::Hash> priority_hashes;
+	// Compile workers pull from shared cursors so that the priority order holds across threads.
+	std::atomic_size_t next_graphics_pipeline;
+	std::atomic_size_t next_compute_pipeline;
+
 	struct
 	{
 		std::atomic_uint32_t pipelines;
+		std::atomic_uint32_t priority_pipelines;
 		std::atomic_uint32_t modules;
 		std::atomic_uint32_t prepare;
 		uint32_t num_pipelines = 0;
+		uint32_t num_priority_pipelines = 0;
 		uint32_t num_modules = 0;
 	} progress;
 };
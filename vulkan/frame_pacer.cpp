@@ -0,0 +1,235 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "frame_pacer.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace Vulkan
+{
+// The first deltas are used to find the refresh interval. Taking the minimum
+// avoids locking on to a multiple of the interval if frames are missed during startup.
+static constexpr unsigned RefreshWarmupSamples = 8;
+// Deltas which deviate more than this from the estimate are considered noise.
+static constexpr double RefreshOutlierThreshold = 0.2;
+
+FramePacer::FramePacer()
+{
+	update_statistics();
+}
+
+void FramePacer::set_target_frame_rate(double fps)
+{
+	target_fps = std::max(fps, 0.0);
+	update_statistics();
+}
+
+void FramePacer::set_nominal_refresh_interval(int64_t interval)
+{
+	nominal_refresh_interval = double(interval);
+	update_statistics();
+}
+
+void FramePacer::set_min_safety_margin(int64_t margin)
+{
+	min_safety_margin = double(margin);
+	margin_floor = std::max(margin_floor, min_safety_margin);
+	safety_margin = std::max(safety_margin, min_safety_margin);
+	update_statistics();
+}
+
+double FramePacer::get_refresh_interval() const
+{
+	// Frames are not paced while warming up, so deltas are not multiples of the target interval.
+	return refresh_samples >= RefreshWarmupSamples ? refresh_interval : nominal_refresh_interval;
+}
+
+double FramePacer::get_target_interval() const
+{
+	double interval = get_refresh_interval();
+	if (interval == 0.0 || target_fps == 0.0)
+		return interval;
+
+	double swap_interval = std::round(1e9 / (target_fps * interval));
+	return std::max(swap_interval, 1.0) * interval;
+}
+
+double FramePacer::get_predicted_frame_time() const
+{
+	return cpu_time + gpu_time + safety_margin;
+}
+
+int64_t FramePacer::compute_target_present(int64_t now, bool *paced) const
+{
+	*paced = false;
+	double interval = get_target_interval();
+	if (!has_last_present || interval == 0.0)
+		return 0;
+
+	// With FIFO, every frame in flight takes one slot after the last observed present.
+	double earliest = double(last_present) + double(frames.size() + 1) * interval;
+	double ready = double(now) + get_predicted_frame_time();
+
+	if (ready <= earliest)
+	{
+		*paced = true;
+		return int64_t(earliest);
+	}
+
+	// We're behind, aim for the first slot we can make.
+	double slots = std::ceil((ready - double(last_present)) / interval);
+	return last_present + int64_t(slots * interval);
+}
+
+int64_t FramePacer::compute_frame_start_time(int64_t now)
+{
+	bool paced;
+	int64_t target = compute_target_present(now, &paced);
+	int64_t start = now;
+	if (paced)
+		start = std::max(now, target - int64_t(get_predicted_frame_time()));
+	stats.frame_start_delay = start - now;
+
+	// Recomputing the target in begin_frame() could land on the next slot due to rounding or wakeup delay.
+	pending_target = target;
+	pending_target_paced = paced;
+	has_pending_target = true;
+	return start;
+}
+
+void FramePacer::begin_frame(int64_t now)
+{
+	Frame frame = {};
+	frame.start = now;
+	if (has_pending_target)
+	{
+		frame.target_present = pending_target;
+		frame.delayed = pending_target_paced;
+		has_pending_target = false;
+	}
+	else
+		frame.target_present = compute_target_present(now, &frame.delayed);
+	frames.push_back(frame);
+	current_frame_start = now;
+}
+
+void FramePacer::end_frame(int64_t now)
+{
+	// Rise quickly, decay slowly, so a single fast frame does not cause misses.
+	double sample = double(now - current_frame_start);
+	if (sample > cpu_time)
+		cpu_time = sample;
+	else
+		cpu_time += 0.05 * (sample - cpu_time);
+	update_statistics();
+}
+
+void FramePacer::record_gpu_time(int64_t time)
+{
+	double sample = double(time);
+	if (sample > gpu_time)
+		gpu_time = sample;
+	else
+		gpu_time += 0.05 * (sample - gpu_time);
+	update_statistics();
+}
+
+void FramePacer::present_complete(int64_t time)
+{
+	if (has_last_present && time > last_present)
+	{
+		double delta = double(time - last_present);
+		if (refresh_samples < RefreshWarmupSamples)
+		{
+			refresh_interval = refresh_interval != 0.0 ? std::min(refresh_interval, delta) : delta;
+			refresh_samples++;
+		}
+		else
+		{
+			// Missed frames show up as multiples of the refresh interval.
+			double slots = std::max(std::round(delta / refresh_interval), 1.0);
+			double sample = delta / slots;
+			if (std::abs(sample - refresh_interval) < RefreshOutlierThreshold * refresh_interval)
+				refresh_interval += 0.05 * (sample - refresh_interval);
+		}
+	}
+
+	last_present = time;
+	has_last_present = true;
+
+	if (frames.empty())
+	{
+		update_statistics();
+		return;
+	}
+
+	auto frame = frames.front();
+	frames.pop_front();
+	stats.presented_frames++;
+
+	double latency = double(time - frame.start);
+	if (stats.presented_frames == 1)
+		present_latency = latency;
+	else
+		present_latency += 0.1 * (latency - present_latency);
+
+	// Presenting even one refresh late is a miss, also when pacing to a lower rate.
+	double interval = get_target_interval();
+	if (frame.target_present != 0 && double(time) > double(frame.target_present) + 0.5 * get_refresh_interval())
+	{
+		stats.missed_frames++;
+		// If we deferred the frame and still missed, the prediction was too optimistic.
+		if (frame.delayed)
+		{
+			margin_floor = std::min(1.25 * safety_margin, interval);
+			safety_margin = std::min(std::max(2.0 * safety_margin, min_safety_margin), interval);
+		}
+	}
+	else if (frame.target_present != 0)
+	{
+		// Back off towards the margin which last failed, and only very slowly probe below it.
+		// Without GPU timing, a miss is the only way to learn that the margin is too small.
+		margin_floor = std::max(margin_floor - 0.0002 * (margin_floor - min_safety_margin), min_safety_margin);
+		safety_margin = std::max(safety_margin - 0.02 * (safety_margin - margin_floor), margin_floor);
+	}
+
+	update_statistics();
+}
+
+void FramePacer::reset()
+{
+	frames.clear();
+	has_last_present = false;
+	has_pending_target = false;
+	update_statistics();
+}
+
+void FramePacer::update_statistics()
+{
+	stats.refresh_interval = int64_t(get_refresh_interval());
+	stats.target_interval = int64_t(get_target_interval());
+	stats.predicted_frame_time = int64_t(get_predicted_frame_time());
+	stats.safety_margin = int64_t(safety_margin);
+	stats.present_latency = int64_t(present_latency);
+}
+}
@@ -0,0 +1,128 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+
+namespace Vulkan
+{
+// Decides when CPU work for a frame should start so that it completes just in time
+// for the display slot it will be presented in, rather than as early as possible.
+// Starting a frame earlier than necessary only adds input latency, since FIFO presentation
+// cannot show it before its slot anyway.
+//
+// The model is driven by present completion times (VK_KHR_present_wait) and CPU frame times.
+// The refresh interval is estimated from present completion deltas.
+// GPU time is not observed directly. Instead, a safety margin on top of the predicted CPU time
+// grows when a delayed frame misses its slot and slowly decays while frames are on time.
+// If the application can measure GPU time, it can be fed in with record_gpu_time().
+//
+// All timestamps are in nanoseconds in the Util::get_current_time_nsecs() time base.
+// Does not touch any Vulkan objects, so it can be tested with simulated traces.
+class FramePacer
+{
+public:
+	struct Statistics
+	{
+		int64_t refresh_interval = 0;
+		int64_t target_interval = 0;
+		// Predicted time from frame start until the frame is ready to present, including margin.
+		int64_t predicted_frame_time = 0;
+		int64_t safety_margin = 0;
+		// How long the start of the last frame was deferred.
+		int64_t frame_start_delay = 0;
+		// Smoothed time between frame start and present completion.
+		int64_t present_latency = 0;
+		uint64_t presented_frames = 0;
+		uint64_t missed_frames = 0;
+	};
+
+	FramePacer();
+
+	// 0 means present at the display refresh rate.
+	// Otherwise, frames are paced to a multiple of the refresh interval.
+	void set_target_frame_rate(double fps);
+	// Used until the refresh interval has been measured.
+	void set_nominal_refresh_interval(int64_t interval);
+	void set_min_safety_margin(int64_t margin);
+
+	// Returns the time at which work for the next frame should start.
+	// Returns now if there is not enough present feedback to pace yet.
+	int64_t compute_frame_start_time(int64_t now);
+
+	// Marks the CPU start and end of a frame. Must be called in pairs.
+	void begin_frame(int64_t now);
+	void end_frame(int64_t now);
+
+	// Optional, if GPU execution time of frames is known.
+	void record_gpu_time(int64_t time);
+
+	// Called once per presented frame, in order.
+	void present_complete(int64_t time);
+
+	// Frames which were never presented (e.g. swapchain recreation) must be discarded.
+	void reset();
+
+	const Statistics &get_statistics() const
+	{
+		return stats;
+	}
+
+private:
+	struct Frame
+	{
+		int64_t start;
+		int64_t target_present;
+		bool delayed;
+	};
+
+	std::deque<Frame> frames;
+
+	double refresh_interval = 0.0;
+	double nominal_refresh_interval = 0.0;
+	double target_fps = 0.0;
+	double cpu_time = 0.0;
+	double gpu_time = 0.0;
+	double safety_margin = 4e6;
+	double min_safety_margin = 1e6;
+	double margin_floor = 1e6;
+	double present_latency = 0.0;
+
+	int64_t last_present = 0;
+	bool has_last_present = false;
+	unsigned refresh_samples = 0;
+	int64_t pending_target = 0;
+	bool pending_target_paced = false;
+	bool has_pending_target = false;
+	int64_t current_frame_start = 0;
+	Statistics stats;
+
+	double get_refresh_interval() const;
+	double get_target_interval() const;
+	double get_predicted_frame_time() const;
+	int64_t compute_target_present(int64_t now, bool *paced) const;
+	void update_statistics();
+};
+}
@@ -29,6 +29,7 @@
 #include "device.hpp"
 #include "rapidjson_wrapper.hpp"
 #include "timeline_trace_file.hpp"
+#include "timer.hpp"
 #include <algorithm>
 #include <cstring>
 
@@ -84,6 +85,7 @@ bool ShaderTemplate::init()
 
 	compiler = std::make_unique<Granite::GLSLCompiler>(*device->get_system_handles().filesystem);
 	compiler->set_target(Granite::Target::Vulkan11);
+	compiler->set_source_cache(&Granite::GLSLSourceCache::get_default());
 	if (!compiler->set_source_from_file(path, force_stage))
 		return false;
 	compiler->set_include_directories(&include_directories);
@@ -175,7 +177,7 @@ const ShaderTemplateVariant *ShaderTemplate::register_variant(const std::vector<
 				{
 					GRANITE_SCOPED_TIMELINE_EVENT_FILE(device->get_system_handles().timeline_trace_file,
 					                                   "glsl-compile");
-					variant->spirv = compiler->compile(error_message, defines);
+					variant->spirv = compile_variant(defines, error_message);
 				}
 
 				if (variant->spirv.empty())
@@ -214,7 +216,7 @@ const ShaderTemplateVariant *ShaderTemplate::register_variant(const std::vector<
 void ShaderTemplate::recompile_variant(ShaderTemplateVariant &variant)
 {
 	std::string error_message;
-	auto newspirv = compiler->compile(error_message, &variant.defines);
+	auto newspirv = compile_variant(&variant.defines, error_message);
 	if (newspirv.empty())
 	{
 		LOGE("Failed to compile shader: %s\n%s\n", path.c_str(), error_message.c_str());
@@ -229,6 +231,64 @@ void ShaderTemplate::recompile_variant(ShaderTemplateVariant &variant)
 }
 #endif
 
+std::vector<uint32_t> ShaderTemplate::compile_variant(const std::vector<std::pair<std::string, int>> *defines,
+                                                      std::string &error_message)
+{
+	if (!cache.fold_spec_defines || compiler->get_spec_defines().empty())
+	{
+		auto start_ts = get_current_time_nsecs();
+		auto spirv = compiler->compile(error_message, defines);
+		cache.glsl_compile_ns.fetch_add(get_current_time_nsecs() - start_ts, std::memory_order_relaxed);
+		cache.glsl_compiles.fetch_add(1, std::memory_order_relaxed);
+		return spirv;
+	}
+
+	std::vector<std::pair<std::string, int>> regular_defines, spec_define_values;
+	compiler->split_spec_defines(defines, regular_defines, spec_define_values);
+
+	Hasher h;
+	for (auto &define : regular_defines)
+	{
+		h.string(define.first);
+		h.s32(define.second);
+	}
+	auto hash = h.get();
+
+	std::shared_ptr<SpecDefineModule> module;
+	{
+		std::lock_guard<std::mutex> holder{spec_define_lock};
+		auto &entry = spec_define_modules[hash];
+		if (!entry)
+			entry = std::make_shared<SpecDefineModule>();
+		module = entry;
+	}
+
+	{
+		// Concurrent variants which share regular defines wait for the shared module instead of compiling it again.
+		std::lock_guard<std::mutex> holder{module->lock};
+		if (!module->compiled)
+		{
+			GRANITE_SCOPED_TIMELINE_EVENT_FILE(device->get_system_handles().timeline_trace_file, "glsl-compile-specializable");
+			auto start_ts = get_current_time_nsecs();
+			module->spirv = compiler->compile_specializable(error_message, &regular_defines);
+			cache.glsl_compile_ns.fetch_add(get_current_time_nsecs() - start_ts, std::memory_order_relaxed);
+			cache.glsl_compiles.fetch_add(1, std::memory_order_relaxed);
+			if (module->spirv.empty())
+				return {};
+			module->compiled = true;
+		}
+	}
+
+	std::vector<uint32_t> spirv;
+	auto start_ts = get_current_time_nsecs();
+	if (!compiler->specialize(module->spirv, spec_define_values, spirv, error_message))
+		spirv.clear();
+	cache.specialization_ns.fetch_add(get_current_time_nsecs() - start_ts, std::memory_order_relaxed);
+	cache.specializations.fetch_add(1, std::memory_order_relaxed);
+
+	return spirv;
+}
+
 void ShaderTemplate::update_variant_cache(const ShaderTemplateVariant &variant)
 {
 	if (variant.spirv.empty())
@@ -241,6 +301,10 @@ void ShaderTemplate::update_variant_cache(const ShaderTemplateVariant &variant)
 	ResourceLayout layout;
 	Shader::reflect_resource_layout(layout, variant.spirv.data(), variant.spirv.size() * sizeof(uint32_t));
 
+	// Variants which fold to the same module share a Vulkan shader module.
+	if (!cache.shader_to_layout.find(shader_hash))
+		cache.unique_modules.fetch_add(1, std::memory_order_relaxed);
+
 #ifndef GRANITE_SHIPPING
 	auto *var_to_shader = cache.variant_to_shader.find(variant.hash);
 	if (var_to_shader)
@@ -266,6 +330,7 @@ void ShaderTemplate::recompile()
 		return;
 	auto newcompiler = std::make_unique<Granite::GLSLCompiler>(*device->get_system_handles().filesystem);
 	newcompiler->set_target(Granite::Target::Vulkan11);
+	newcompiler->set_source_cache(&Granite::GLSLSourceCache::get_default());
 	if (!newcompiler->set_source_from_file(path, force_stage))
 		return;
 	newcompiler->set_include_directories(&include_directories);
@@ -277,6 +342,11 @@ void ShaderTemplate::recompile()
 	compiler = std::move(newcompiler);
 	source_hash = compiler->get_source_hash();
 
+	{
+		std::lock_guard<std::mutex> holder{spec_define_lock};
+		spec_define_modules.clear();
+	}
+
 	for (auto &variant : variants.get_read_only())
 		recompile_variant(variant);
 	for (auto &variant : variants.get_read_write())
@@ -532,6 +602,7 @@ void ShaderManager::register_dependency_nolock(ShaderTemplate *shader, const std
 void ShaderManager::recompile(const Granite::FileNotifyInfo &info)
 {
 	DEPENDENCY_LOCK();
+	Granite::GLSLSourceCache::get_default().invalidate(info.path);
 	if (info.type == Granite::FileNotifyType::FileDeleted)
 		return;
 
@@ -611,6 +682,24 @@ void ShaderManager::add_include_directory(const std::string &path)
 		include_directories.push_back(path);
 }
 
+#ifdef GRANITE_VULKAN_SHADER_MANAGER_RUNTIME_COMPILER
+void ShaderManager::set_spec_define_folding(bool enable)
+{
+	meta_cache.fold_spec_defines = enable;
+}
+
+ShaderCompileStatistics ShaderManager::get_compile_statistics() const
+{
+	ShaderCompileStatistics stats;
+	stats.glsl_compiles = meta_cache.glsl_compiles.load(std::memory_order_relaxed);
+	stats.glsl_compile_ns = meta_cache.glsl_compile_ns.load(std::memory_order_relaxed);
+	stats.specializations = meta_cache.specializations.load(std::memory_order_relaxed);
+	stats.specialization_ns = meta_cache.specialization_ns.load(std::memory_order_relaxed);
+	stats.unique_modules = meta_cache.unique_modules.load(std::memory_order_relaxed);
+	return stats;
+}
+#endif
+
 void ShaderManager::promote_read_write_caches_to_read_only()
 {
 	shaders.move_to_read_only();
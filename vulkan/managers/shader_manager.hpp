@@ -26,6 +26,8 @@
 #include "vulkan_common.hpp"
 #include "filesystem.hpp"
 #include <memory>
+#include <mutex>
+#include <atomic>
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
@@ -54,10 +56,28 @@ struct PrecomputedMeta : Util::IntrusiveHashMapEnabled<PrecomputedMeta>
 using PrecomputedShaderCache = VulkanCache<PrecomputedMeta>;
 using ReflectionCache = VulkanCache<Util::IntrusivePODWrapper<ResourceLayout>>;
 
+struct ShaderCompileStatistics
+{
+	uint64_t glsl_compiles = 0;
+	uint64_t glsl_compile_ns = 0;
+	uint64_t specializations = 0;
+	uint64_t specialization_ns = 0;
+	uint64_t unique_modules = 0;
+};
+
 struct MetaCache
 {
 	PrecomputedShaderCache variant_to_shader;
 	ReflectionCache shader_to_layout;
+
+#ifdef GRANITE_VULKAN_SHADER_MANAGER_RUNTIME_COMPILER
+	bool fold_spec_defines = true;
+	std::atomic<uint64_t> glsl_compiles{0};
+	std::atomic<uint64_t> glsl_compile_ns{0};
+	std::atomic<uint64_t> specializations{0};
+	std::atomic<uint64_t> specialization_ns{0};
+	std::atomic<uint64_t> unique_modules{0};
+#endif
 };
 
 class ShaderManager;
@@ -111,6 +131,20 @@ private:
 	const std::vector<std::string> &include_directories;
 	void update_variant_cache(const ShaderTemplateVariant &variant);
 	Util::Hash source_hash = 0;
+
+	// Modules compiled with spec defines as specialization constants, keyed by the remaining defines.
+	// spec_define_lock only guards the map. Each module is compiled once under its own lock,
+	// and is immutable afterwards, so specialization runs concurrently.
+	struct SpecDefineModule
+	{
+		std::mutex lock;
+		bool compiled = false;
+		std::vector<uint32_t> spirv;
+	};
+	std::unordered_map<Util::Hash, std::shared_ptr<SpecDefineModule>> spec_define_modules;
+	std::mutex spec_define_lock;
+	std::vector<uint32_t> compile_variant(const std::vector<std::pair<std::string, int>> *defines,
+	                                      std::string &error_message);
 #ifndef GRANITE_SHIPPING
 	// We'll never want to recompile shaders in runtime outside a dev environment.
 	void recompile_variant(ShaderTemplateVariant &variant);
@@ -201,6 +235,12 @@ public:
 
 	void promote_read_write_caches_to_read_only();
 
+#ifdef GRANITE_VULKAN_SHADER_MANAGER_RUNTIME_COMPILER
+	// Variants which only differ in spec defines share one GLSL compile, see GLSLCompiler::get_spec_defines().
+	void set_spec_define_folding(bool enable);
+	ShaderCompileStatistics get_compile_statistics() const;
+#endif
+
 private:
 	Device *device;
 
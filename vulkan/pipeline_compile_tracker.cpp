@@ -0,0 +1,162 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "pipeline_compile_tracker.hpp"
+
+namespace Vulkan
+{
+void PipelineCompileTracker::set_policy(PipelineMissPolicy policy_)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	policy = policy_;
+}
+
+PipelineMissPolicy PipelineCompileTracker::get_policy() const
+{
+	std::lock_guard<std::mutex> holder{lock};
+	return policy;
+}
+
+void PipelineCompileTracker::set_max_pending_compiles(unsigned count)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	max_pending_compiles = count;
+}
+
+void PipelineCompileTracker::set_max_skip_frames(unsigned count)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	max_skip_frames = count;
+}
+
+PipelineMissDecision PipelineCompileTracker::on_miss(Util::Hash hash, bool has_fallback)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	PipelineMissDecision decision = { PipelineMissAction::CompileSync, false };
+	current_stats.misses++;
+
+	if (policy == PipelineMissPolicy::Synchronous || failed.count(hash))
+	{
+		// If a background compile failed, compile synchronously so the error is reported where the draw is.
+		current_stats.sync_compiles++;
+		return decision;
+	}
+
+	uint64_t first_miss_frame = frame_index;
+	auto itr = pending.find(hash);
+	if (itr != pending.end())
+	{
+		first_miss_frame = itr->second.first_miss_frame;
+	}
+	else if (pending.size() < max_pending_compiles)
+	{
+		pending.insert({ hash, { frame_index }});
+		decision.enqueue_async = true;
+		current_stats.enqueued++;
+	}
+	else if (!has_fallback)
+	{
+		// No room for another background compile, and nothing to show in the meantime.
+		current_stats.sync_compiles++;
+		return decision;
+	}
+
+	if (has_fallback)
+	{
+		decision.action = PipelineMissAction::UseFallback;
+		current_stats.fallback_draws++;
+	}
+	else if (policy == PipelineMissPolicy::AsyncFallbackOrSkip &&
+	         frame_index - first_miss_frame < max_skip_frames)
+	{
+		decision.action = PipelineMissAction::Skip;
+		current_stats.skipped_draws++;
+	}
+	else
+		current_stats.sync_compiles++;
+
+	return decision;
+}
+
+void PipelineCompileTracker::on_compile_complete(Util::Hash hash, bool success)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	pending.erase(hash);
+	if (success)
+		current_stats.completed++;
+	else
+	{
+		failed.insert(hash);
+		current_stats.failed++;
+	}
+	cond.notify_all();
+}
+
+static void accumulate_stats(PipelineCompileStats &total, const PipelineCompileStats &stats)
+{
+	total.misses += stats.misses;
+	total.enqueued += stats.enqueued;
+	total.completed += stats.completed;
+	total.failed += stats.failed;
+	total.fallback_draws += stats.fallback_draws;
+	total.skipped_draws += stats.skipped_draws;
+	total.sync_compiles += stats.sync_compiles;
+}
+
+void PipelineCompileTracker::begin_frame()
+{
+	std::lock_guard<std::mutex> holder{lock};
+	current_stats.pending = uint32_t(pending.size());
+	accumulate_stats(total_stats, current_stats);
+	last_frame_stats = current_stats;
+	current_stats = {};
+	frame_index++;
+}
+
+PipelineCompileStats PipelineCompileTracker::get_frame_stats() const
+{
+	std::lock_guard<std::mutex> holder{lock};
+	return last_frame_stats;
+}
+
+PipelineCompileStats PipelineCompileTracker::get_total_stats() const
+{
+	std::lock_guard<std::mutex> holder{lock};
+	auto stats = total_stats;
+	accumulate_stats(stats, current_stats);
+	stats.pending = uint32_t(pending.size());
+	return stats;
+}
+
+unsigned PipelineCompileTracker::get_num_pending() const
+{
+	std::lock_guard<std::mutex> holder{lock};
+	return unsigned(pending.size());
+}
+
+void PipelineCompileTracker::wait_idle()
+{
+	std::unique_lock<std::mutex> holder{lock};
+	cond.wait(holder, [this]() { return pending.empty(); });
+}
+}
@@ -0,0 +1,118 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "hash.hpp"
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Vulkan
+{
+enum class PipelineMissPolicy
+{
+	// Compile on the recording thread, stalling it. This is the default.
+	Synchronous,
+	// Compile on a background thread. Use the fallback program if there is one,
+	// otherwise drop the draw until the pipeline is ready (or max_skip_frames is exceeded).
+	AsyncFallbackOrSkip,
+	// Compile on a background thread. Use the fallback program if there is one,
+	// otherwise compile synchronously.
+	AsyncFallbackOrSync
+};
+
+enum class PipelineMissAction
+{
+	CompileSync,
+	UseFallback,
+	Skip
+};
+
+struct PipelineMissDecision
+{
+	PipelineMissAction action;
+	// The caller must kick off a background compile and report back with on_compile_complete().
+	bool enqueue_async;
+};
+
+struct PipelineCompileStats
+{
+	uint32_t misses;
+	uint32_t enqueued;
+	uint32_t completed;
+	uint32_t failed;
+	uint32_t fallback_draws;
+	uint32_t skipped_draws;
+	uint32_t sync_compiles;
+	uint32_t pending;
+};
+
+// Bookkeeping for pipeline cache misses at draw time.
+// Does not touch any Vulkan objects, so it can be tested without a device.
+class PipelineCompileTracker
+{
+public:
+	void set_policy(PipelineMissPolicy policy);
+	PipelineMissPolicy get_policy() const;
+
+	// Bounds the number of outstanding background compiles.
+	void set_max_pending_compiles(unsigned count);
+	// If a pipeline has been pending for this many frames without a fallback, compile it synchronously instead.
+	void set_max_skip_frames(unsigned count);
+
+	PipelineMissDecision on_miss(Util::Hash hash, bool has_fallback);
+	void on_compile_complete(Util::Hash hash, bool success);
+
+	// Rolls over per-frame statistics.
+	void begin_frame();
+	PipelineCompileStats get_frame_stats() const;
+	PipelineCompileStats get_total_stats() const;
+	unsigned get_num_pending() const;
+
+	// Blocks until every background compile has called on_compile_complete().
+	void wait_idle();
+
+private:
+	mutable std::mutex lock;
+	std::condition_variable cond;
+
+	struct PendingCompile
+	{
+		uint64_t first_miss_frame;
+	};
+	std::unordered_map<Util::Hash, PendingCompile> pending;
+	std::unordered_set<Util::Hash> failed;
+
+	PipelineMissPolicy policy = PipelineMissPolicy::Synchronous;
+	unsigned max_pending_compiles = 64;
+	unsigned max_skip_frames = 8;
+	uint64_t frame_index = 0;
+
+	PipelineCompileStats current_stats = {};
+	PipelineCompileStats last_frame_stats = {};
+	PipelineCompileStats total_stats = {};
+};
+}
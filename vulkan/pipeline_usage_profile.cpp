@@ -0,0 +1,209 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "pipeline_usage_profile.hpp"
+#include <algorithm>
+#include <string.h>
+
+namespace Vulkan
+{
+static constexpr uint32_t ProfileMagic = 0x50555047; // GPUP
+static constexpr uint32_t ProfileVersion = 1;
+
+struct SerializedEntry
+{
+	uint64_t hash;
+	uint32_t first_use_ms;
+	uint32_t use_count;
+};
+static_assert(sizeof(SerializedEntry) == 16, "Unexpected padding in SerializedEntry.");
+
+void PipelineUsageProfile::record_uses(const Util::Hash *hashes, size_t count, uint32_t time_ms)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	for (size_t i = 0; i < count; i++)
+	{
+		auto itr = session.find(hashes[i]);
+		if (itr == session.end())
+			session.insert({ hashes[i], { time_ms, 1 }});
+		else
+		{
+			itr->second.first_use_ms = std::min(itr->second.first_use_ms, time_ms);
+			if (itr->second.use_count != UINT32_MAX)
+				itr->second.use_count++;
+		}
+	}
+}
+
+bool PipelineUsageProfile::lookup(Util::Hash hash, Entry &entry) const
+{
+	auto hist_itr = history.find(hash);
+	auto session_itr = session.find(hash);
+	bool in_history = hist_itr != history.end();
+	bool in_session = session_itr != session.end();
+
+	if (in_history && in_session)
+	{
+		// Move the first use time towards what we observed this session, and decay old use counts.
+		auto &hist = hist_itr->second;
+		auto &sess = session_itr->second;
+		entry.first_use_ms = uint32_t((uint64_t(hist.first_use_ms) * 3 + sess.first_use_ms) / 4);
+		entry.use_count = uint32_t(std::min<uint64_t>(hist.use_count / 2 + uint64_t(sess.use_count), UINT32_MAX));
+		return true;
+	}
+	else if (in_session)
+	{
+		entry = session_itr->second;
+		return true;
+	}
+	else if (in_history)
+	{
+		entry = hist_itr->second;
+		entry.use_count /= 2;
+		return entry.use_count != 0;
+	}
+	else
+		return false;
+}
+
+bool PipelineUsageProfile::parse(const void *data, size_t size)
+{
+	uint32_t header[3];
+	if (size < sizeof(header))
+		return false;
+	memcpy(header, data, sizeof(header));
+
+	if (header[0] != ProfileMagic || header[1] != ProfileVersion)
+		return false;
+	if ((size - sizeof(header)) / sizeof(SerializedEntry) < header[2])
+		return false;
+
+	std::lock_guard<std::mutex> holder{lock};
+	history.clear();
+	history.reserve(header[2]);
+
+	auto *entries = static_cast<const uint8_t *>(data) + sizeof(header);
+	for (uint32_t i = 0; i < header[2]; i++)
+	{
+		SerializedEntry entry;
+		memcpy(&entry, entries + i * sizeof(SerializedEntry), sizeof(entry));
+		history[entry.hash] = { entry.first_use_ms, entry.use_count };
+	}
+
+	return true;
+}
+
+std::vector<uint8_t> PipelineUsageProfile::serialize() const
+{
+	std::lock_guard<std::mutex> holder{lock};
+	std::vector<SerializedEntry> entries;
+	entries.reserve(history.size() + session.size());
+
+	const auto add_entry = [&](Util::Hash hash) {
+		Entry entry;
+		if (lookup(hash, entry))
+			entries.push_back({ hash, entry.first_use_ms, entry.use_count });
+	};
+
+	for (auto &hist : history)
+		add_entry(hist.first);
+	for (auto &sess : session)
+		if (!history.count(sess.first))
+			add_entry(sess.first);
+
+	// Keep the output deterministic.
+	std::sort(entries.begin(), entries.end(), [](const SerializedEntry &a, const SerializedEntry &b) {
+		return a.hash < b.hash;
+	});
+
+	uint32_t header[3] = { ProfileMagic, ProfileVersion, uint32_t(entries.size()) };
+	std::vector<uint8_t> blob(sizeof(header) + entries.size() * sizeof(SerializedEntry));
+	memcpy(blob.data(), header, sizeof(header));
+	if (!entries.empty())
+		memcpy(blob.data() + sizeof(header), entries.data(), entries.size() * sizeof(SerializedEntry));
+	return blob;
+}
+
+void PipelineUsageProfile::set_time_bucket_ms(uint32_t ms)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	time_bucket_ms = std::max(ms, 1u);
+}
+
+size_t PipelineUsageProfile::sort_by_priority(Util::Hash *hashes, size_t count) const
+{
+	std::lock_guard<std::mutex> holder{lock};
+
+	struct SortEntry
+	{
+		Util::Hash hash;
+		uint32_t bucket;
+		uint32_t use_count;
+	};
+	std::vector<SortEntry> profiled;
+	std::vector<Util::Hash> unprofiled;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		Entry entry;
+		if (lookup(hashes[i], entry))
+			profiled.push_back({ hashes[i], entry.first_use_ms / time_bucket_ms, entry.use_count });
+		else
+			unprofiled.push_back(hashes[i]);
+	}
+
+	std::stable_sort(profiled.begin(), profiled.end(), [](const SortEntry &a, const SortEntry &b) {
+		if (a.bucket != b.bucket)
+			return a.bucket < b.bucket;
+		return a.use_count > b.use_count;
+	});
+
+	for (auto &entry : profiled)
+		*hashes++ = entry.hash;
+	for (auto hash : unprofiled)
+		*hashes++ = hash;
+
+	return profiled.size();
+}
+
+bool PipelineUsageProfile::contains(Util::Hash hash) const
+{
+	std::lock_guard<std::mutex> holder{lock};
+	Entry entry;
+	return lookup(hash, entry);
+}
+
+size_t PipelineUsageProfile::get_num_entries() const
+{
+	std::lock_guard<std::mutex> holder{lock};
+	size_t count = 0;
+	Entry entry;
+	for (auto &hist : history)
+		if (lookup(hist.first, entry))
+			count++;
+	for (auto &sess : session)
+		if (!history.count(sess.first))
+			count++;
+	return count;
+}
+}
@@ -0,0 +1,73 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "hash.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+namespace Vulkan
+{
+// Tracks when a pipeline is first used in a session and how often it is bound.
+// The profile is persisted next to the Fossilize archive and used to
+// replay pipelines which are needed early and often first.
+// Does not touch any Vulkan objects, so it can be tested without a device.
+class PipelineUsageProfile
+{
+public:
+	void record_uses(const Util::Hash *hashes, size_t count, uint32_t time_ms);
+
+	// Loads a profile from a previous session. Previous sessions are decayed when merged
+	// with the current one, so pipelines which stop being used eventually fall out.
+	bool parse(const void *data, size_t size);
+	std::vector<uint8_t> serialize() const;
+
+	// Pipelines first used within the same time bucket are ordered by use count.
+	void set_time_bucket_ms(uint32_t ms);
+
+	// Stable reorder of hashes by priority. Pipelines not in the profile keep their relative order
+	// and are placed last. Returns the number of profiled pipelines.
+	size_t sort_by_priority(Util::Hash *hashes, size_t count) const;
+
+	bool contains(Util::Hash hash) const;
+	size_t get_num_entries() const;
+
+private:
+	struct Entry
+	{
+		uint32_t first_use_ms;
+		uint32_t use_count;
+	};
+
+	mutable std::mutex lock;
+	std::unordered_map<Util::Hash, Entry> history;
+	std::unordered_map<Util::Hash, Entry> session;
+	uint32_t time_bucket_ms = 250;
+
+	bool lookup(Util::Hash hash, Entry &entry) const;
+};
+}
@@ -115,6 +115,17 @@ void PipelineLayout::create_update_templates()
 
 		auto &set_layout = layout.sets[desc_set];
 
+		uint32_t active_bindings = set_layout.uniform_buffer_mask | set_layout.storage_buffer_mask |
+		                           set_layout.sampled_texel_buffer_mask | set_layout.storage_texel_buffer_mask |
+		                           set_layout.sampled_image_mask | set_layout.separate_image_mask |
+		                           set_layout.sampler_mask | set_layout.storage_image_mask |
+		                           set_layout.input_attachment_mask;
+		for_each_bit(active_bindings, [&](uint32_t binding) {
+			unsigned array_size = set_layout.array_size[binding];
+			for (unsigned i = 0; i < array_size; i++)
+				binding_masks[desc_set] |= 1u << (binding + i);
+		});
+
 		for_each_bit(set_layout.uniform_buffer_mask, [&](uint32_t binding) {
 			unsigned array_size = set_layout.array_size[binding];
 			VK_ASSERT(update_count < VULKAN_NUM_BINDINGS);
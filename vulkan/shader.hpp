@@ -100,6 +100,14 @@ struct ResourceBindings
 	ResourceBinding bindings[VULKAN_NUM_DESCRIPTOR_SETS][VULKAN_NUM_BINDINGS];
 	uint64_t cookies[VULKAN_NUM_DESCRIPTOR_SETS][VULKAN_NUM_BINDINGS];
 	uint64_t secondary_cookies[VULKAN_NUM_DESCRIPTOR_SETS][VULKAN_NUM_BINDINGS];
+
+	// Per-binding hashes of cookies and layout/range state, XOR-ed together into set_hashes
+	// as bindings change so a descriptor set lookup does not have to rehash every binding.
+	uint64_t binding_hashes[VULKAN_NUM_DESCRIPTOR_SETS][VULKAN_NUM_BINDINGS];
+	uint64_t sampler_hashes[VULKAN_NUM_DESCRIPTOR_SETS][VULKAN_NUM_BINDINGS];
+	uint64_t set_hashes[VULKAN_NUM_DESCRIPTOR_SETS];
+	uint32_t set_hash_binding_masks[VULKAN_NUM_DESCRIPTOR_SETS];
+
 	uint8_t push_constant_data[VULKAN_PUSH_CONSTANT_SIZE];
 };
 
@@ -136,12 +144,19 @@ public:
 		return update_template[set];
 	}
 
+	// Mask of all binding slots (including array elements) consumed by a set.
+	uint32_t get_binding_mask(unsigned set) const
+	{
+		return binding_masks[set];
+	}
+
 private:
 	Device *device;
 	VkPipelineLayout pipe_layout = VK_NULL_HANDLE;
 	CombinedResourceLayout layout;
 	DescriptorSetAllocator *set_allocators[VULKAN_NUM_DESCRIPTOR_SETS] = {};
 	VkDescriptorUpdateTemplate update_template[VULKAN_NUM_DESCRIPTOR_SETS] = {};
+	uint32_t binding_masks[VULKAN_NUM_DESCRIPTOR_SETS] = {};
 	void create_update_templates();
 };
 
@@ -210,6 +225,19 @@ public:
 	Pipeline get_pipeline(Util::Hash hash) const;
 	Pipeline add_pipeline(Util::Hash hash, const Pipeline &pipeline);
 
+	// A cheaper program with the same pipeline layout (e.g. an ubershader) which
+	// can be drawn with while pipelines for this program compile in the background.
+	void set_fallback_program(Program *fallback)
+	{
+		VK_ASSERT(!fallback || fallback->get_pipeline_layout() == layout);
+		fallback_program = fallback;
+	}
+
+	Program *get_fallback_program() const
+	{
+		return fallback_program;
+	}
+
 	void promote_read_write_to_read_only();
 
 private:
@@ -217,6 +245,7 @@ private:
 	Device *device;
 	Shader *shaders[Util::ecast(ShaderStage::Count)] = {};
 	PipelineLayout *layout = nullptr;
+	Program *fallback_program = nullptr;
 	VulkanCache<Util::IntrusivePODWrapper<Pipeline>> pipelines;
 	void destroy_pipeline(const Pipeline &pipeline);
 };
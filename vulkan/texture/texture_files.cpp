@@ -102,6 +102,20 @@ MemoryMappedTexture load_texture_from_memory(const void *data, size_t size, Colo
 	}
 }
 
+size_t get_decoded_texture_size(const void *data, size_t size)
+{
+	if (MemoryMappedTexture::is_header(data, size))
+		return size;
+
+	int width, height, components;
+	if (!stbi_info_from_memory(static_cast<const stbi_uc *>(data), int(size), &width, &height, &components))
+		return 0;
+
+	// HDR is expanded to RGBA16F, everything else to RGBA8.
+	size_t texel_size = stbi_is_hdr_from_memory(static_cast<const stbi_uc *>(data), int(size)) ? 8 : 4;
+	return size_t(width) * size_t(height) * texel_size;
+}
+
 MemoryMappedTexture load_texture_from_file(Granite::Filesystem &fs, const std::string &path, ColorSpace color)
 {
 	auto file = fs.open(path, Granite::FileMode::ReadOnly);
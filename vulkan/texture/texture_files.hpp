@@ -41,4 +41,8 @@ enum class ColorSpace
 MemoryMappedTexture load_texture_from_file(Granite::Filesystem &fs, const std::string &path, ColorSpace color = ColorSpace::sRGB);
 MemoryMappedTexture load_texture_from_memory(const void *data, size_t size,
                                              ColorSpace color = ColorSpace::sRGB);
+
+// Number of bytes load_texture_from_memory() decodes data into, only parsing the header.
+// Returns 0 if the image cannot be parsed.
+size_t get_decoded_texture_size(const void *data, size_t size);
 }
\ No newline at end of file
@@ -0,0 +1,236 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "upload_manager.hpp"
+#include "device.hpp"
+#include <algorithm>
+#include <string.h>
+
+namespace Vulkan
+{
+UploadManager::UploadManager(Device &device_)
+	: device(device_)
+{
+	// Offsets within blocks are assigned by the scheduler, the pool alignment is not used.
+	pool.init(&device, staging_block_size, 16, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, false);
+	pool.set_max_retained_blocks(8);
+	scheduler.set_block_size(staging_block_size);
+}
+
+UploadManager::~UploadManager()
+{
+	for (auto &inflight_batch : inflight)
+	{
+		inflight_batch.fence->wait();
+		for (auto &block : inflight_batch.blocks)
+			if (block.size == staging_block_size)
+				pool.recycle_block(block);
+	}
+	inflight.clear();
+	region_block.reset();
+	pool.reset();
+}
+
+void UploadManager::set_staging_block_size(VkDeviceSize size)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	VK_ASSERT(inflight.empty());
+	pool.reset();
+	region_block.reset();
+	region_offset = 0;
+	staging_block_size = size;
+	pool.init(&device, staging_block_size, 16, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, false);
+	scheduler.set_block_size(staging_block_size);
+}
+
+void UploadManager::set_frame_budget(VkDeviceSize bytes)
+{
+	std::lock_guard<std::mutex> holder{lock};
+	scheduler.set_frame_budget(bytes);
+}
+
+BufferHandle UploadManager::create_buffer(const BufferCreateInfo &info, const void *initial, uint64_t *ticket,
+                                          UploadMode mode)
+{
+	if (ticket)
+		*ticket = 0;
+
+	if (!initial || info.domain != BufferDomain::Device)
+		return device.create_buffer(info, initial);
+
+	auto buffer = device.create_buffer(info, nullptr);
+	if (!buffer)
+		return buffer;
+
+	// Integrated GPUs tend to expose device local memory as host visible. No need to stage anything.
+	void *ptr = device.map_host_buffer(*buffer, MEMORY_ACCESS_WRITE_BIT);
+	if (ptr)
+	{
+		memcpy(ptr, initial, info.size);
+		device.unmap_host_buffer(*buffer, MEMORY_ACCESS_WRITE_BIT);
+		return buffer;
+	}
+
+	PendingUpload upload;
+	upload.buffer = buffer;
+	upload.data.resize(info.size);
+	memcpy(upload.data.data(), initial, info.size);
+
+	std::lock_guard<std::mutex> holder{lock};
+	uint64_t new_ticket = scheduler.push(info.size, 16, mode == UploadMode::Required);
+	pending.push_back(std::move(upload));
+	if (ticket)
+		*ticket = new_ticket;
+	return buffer;
+}
+
+UploadManager::StagingRegion UploadManager::allocate_staging(VkDeviceSize size, VkDeviceSize alignment)
+{
+	BufferCreateInfo info = {};
+	info.domain = BufferDomain::Host;
+	info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+	if (size > staging_block_size)
+	{
+		info.size = size;
+		auto buffer = device.create_buffer(info, nullptr);
+		if (buffer)
+			device.set_name(*buffer, "upload-manager-staging-dedicated");
+		return { std::move(buffer), 0 };
+	}
+
+	std::lock_guard<std::mutex> holder{lock};
+	alignment = std::max<VkDeviceSize>(alignment, 1);
+	VkDeviceSize offset = (region_offset + alignment - 1) / alignment * alignment;
+
+	if (!region_block || offset + size > staging_block_size)
+	{
+		// The old block is released once every region in it is.
+		info.size = staging_block_size;
+		region_block = device.create_buffer(info, nullptr);
+		if (!region_block)
+			return {};
+		device.set_name(*region_block, "upload-manager-staging-block");
+		offset = 0;
+	}
+
+	region_offset = offset + size;
+	return { region_block, offset };
+}
+
+void UploadManager::recycle_completed_batches()
+{
+	size_t write_index = 0;
+	for (size_t i = 0, n = inflight.size(); i < n; i++)
+	{
+		auto &inflight_batch = inflight[i];
+		if (inflight_batch.fence->wait_timeout(0))
+		{
+			// Dedicated blocks for large uploads are not retained.
+			for (auto &block : inflight_batch.blocks)
+				if (block.size == staging_block_size)
+					pool.recycle_block(block);
+		}
+		else
+		{
+			if (write_index != i)
+				inflight[write_index] = std::move(inflight_batch);
+			write_index++;
+		}
+	}
+	inflight.resize(write_index);
+}
+
+void UploadManager::flush()
+{
+	std::lock_guard<std::mutex> holder{lock};
+	recycle_completed_batches();
+	if (scheduler.schedule(batch))
+		submit_batch();
+}
+
+void UploadManager::flush_required()
+{
+	std::lock_guard<std::mutex> holder{lock};
+	if (!scheduler.has_required_uploads())
+		return;
+
+	recycle_completed_batches();
+	if (scheduler.schedule_required(batch))
+		submit_batch();
+}
+
+void UploadManager::submit_batch()
+{
+	InflightBatch inflight_batch;
+	inflight_batch.blocks.reserve(batch.block_sizes.size());
+	for (auto size : batch.block_sizes)
+		inflight_batch.blocks.push_back(pool.request_block(size));
+
+	auto cmd = device.request_command_buffer(CommandBuffer::Type::AsyncTransfer);
+	cmd->begin_region("upload-manager-flush");
+
+	for (auto &copy : batch.copies)
+	{
+		auto &upload = pending.front();
+		auto &block = inflight_batch.blocks[copy.block];
+		memcpy(block.mapped + copy.offset, upload.data.data(), copy.size);
+		cmd->copy_buffer(*upload.buffer, 0, *block.cpu, copy.offset, copy.size);
+		pending.pop_front();
+	}
+
+	for (auto &block : inflight_batch.blocks)
+		device.unmap_host_buffer(*block.cpu, MEMORY_ACCESS_WRITE_BIT);
+
+	cmd->end_region();
+
+	Semaphore semaphores[2];
+	device.submit(cmd, &inflight_batch.fence, 2, semaphores);
+	semaphores[0]->set_internal_sync_object();
+	semaphores[1]->set_internal_sync_object();
+	device.add_wait_semaphore(CommandBuffer::Type::Generic, std::move(semaphores[0]),
+	                          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, true);
+	device.add_wait_semaphore(CommandBuffer::Type::AsyncCompute, std::move(semaphores[1]),
+	                          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, true);
+
+	inflight.push_back(std::move(inflight_batch));
+}
+
+bool UploadManager::is_submitted(uint64_t ticket) const
+{
+	std::lock_guard<std::mutex> holder{lock};
+	return scheduler.is_scheduled(ticket);
+}
+
+bool UploadManager::has_pending_uploads() const
+{
+	std::lock_guard<std::mutex> holder{lock};
+	return scheduler.get_pending_count() != 0;
+}
+
+VkDeviceSize UploadManager::get_pending_bytes() const
+{
+	std::lock_guard<std::mutex> holder{lock};
+	return scheduler.get_pending_bytes();
+}
+}
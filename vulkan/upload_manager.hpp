@@ -0,0 +1,123 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "buffer_pool.hpp"
+#include "buffer.hpp"
+#include "fence.hpp"
+#include "upload_scheduler.hpp"
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace Vulkan
+{
+class Device;
+
+// Streams initial buffer contents to the GPU in batches.
+// Device::create_buffer() with initial data allocates a staging buffer and submits a copy per buffer,
+// which adds up quickly when loading a scene with thousands of meshes.
+// Here, uploads are queued up, packed into large staging blocks and submitted in one
+// transfer queue command buffer per flush(), optionally throttled by a per-frame byte budget.
+class UploadManager
+{
+public:
+	explicit UploadManager(Device &device);
+	~UploadManager();
+
+	UploadManager(const UploadManager &) = delete;
+	void operator=(const UploadManager &) = delete;
+
+	void set_staging_block_size(VkDeviceSize size);
+	// 0 means everything which is pending is submitted on flush().
+	void set_frame_budget(VkDeviceSize bytes);
+
+	enum class UploadMode
+	{
+		// Throttled by the frame budget.
+		// The buffer must not be used by the GPU until its ticket has been submitted.
+		Deferred,
+		// Submitted by flush_required(), before any later graphics or compute work.
+		// Everything queued before it goes out as well, regardless of budget.
+		Required
+	};
+
+	// Buffers which end up in host visible memory are written immediately, and ticket is set to 0.
+	BufferHandle create_buffer(const BufferCreateInfo &info, const void *initial, uint64_t *ticket = nullptr,
+	                           UploadMode mode = UploadMode::Deferred);
+
+	// Host visible staging memory for uploads which are recorded by the caller, e.g. image initial data.
+	// Regions are carved linearly out of large blocks, and block memory is never handed out twice,
+	// so the region can be consumed by any later submission. Holding on to the buffer keeps the whole block alive.
+	struct StagingRegion
+	{
+		BufferHandle buffer;
+		VkDeviceSize offset;
+	};
+	StagingRegion allocate_staging(VkDeviceSize size, VkDeviceSize alignment);
+
+	// Records and submits copies for pending uploads, up to the frame budget.
+	// Graphics and compute queues wait for the copies to complete before their next submission.
+	// Must be called once per frame, since each call starts a new budget frame.
+	// The Device flushes its own upload manager in next_frame_context().
+	void flush();
+
+	// Submits pending uploads up to the last Required one, outside of the frame budget.
+	// The Device calls this on its own upload manager before graphics and compute submissions.
+	void flush_required();
+
+	bool is_submitted(uint64_t ticket) const;
+	bool has_pending_uploads() const;
+	VkDeviceSize get_pending_bytes() const;
+
+private:
+	Device &device;
+
+	struct PendingUpload
+	{
+		BufferHandle buffer;
+		std::vector<uint8_t> data;
+	};
+
+	struct InflightBatch
+	{
+		Fence fence;
+		std::vector<BufferBlock> blocks;
+	};
+
+	mutable std::mutex lock;
+	BufferPool pool;
+	UploadScheduler scheduler;
+	UploadScheduler::Batch batch;
+	std::deque<PendingUpload> pending;
+	std::vector<InflightBatch> inflight;
+	VkDeviceSize staging_block_size = 8 * 1024 * 1024;
+
+	BufferHandle region_block;
+	VkDeviceSize region_offset = 0;
+
+	void recycle_completed_batches();
+	void submit_batch();
+};
+}
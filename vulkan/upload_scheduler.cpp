@@ -0,0 +1,151 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "upload_scheduler.hpp"
+#include <algorithm>
+
+namespace Vulkan
+{
+void UploadScheduler::Batch::clear()
+{
+	copies.clear();
+	block_sizes.clear();
+	bytes = 0;
+}
+
+void UploadScheduler::set_block_size(uint64_t size)
+{
+	block_size = std::max<uint64_t>(size, 1);
+}
+
+void UploadScheduler::set_frame_budget(uint64_t bytes)
+{
+	frame_budget = bytes;
+}
+
+uint64_t UploadScheduler::push(uint64_t size, uint64_t alignment, bool required)
+{
+	pending.push_back({ size, std::max<uint64_t>(alignment, 1) });
+	pending_bytes += size;
+	if (required)
+		last_required = next_ticket;
+	return next_ticket++;
+}
+
+bool UploadScheduler::has_required_uploads() const
+{
+	return last_required > last_scheduled;
+}
+
+bool UploadScheduler::is_scheduled(uint64_t ticket) const
+{
+	return ticket <= last_scheduled;
+}
+
+uint64_t UploadScheduler::get_pending_bytes() const
+{
+	return pending_bytes;
+}
+
+size_t UploadScheduler::get_pending_count() const
+{
+	return pending.size();
+}
+
+bool UploadScheduler::schedule(Batch &batch)
+{
+	batch.clear();
+
+	uint64_t budget = 0;
+	if (frame_budget)
+		budget = frame_budget > frame_bytes ? frame_budget - frame_bytes : 0;
+
+	// Only let an upload overshoot the budget if nothing else went out this frame.
+	bool overshoot = frame_bytes == 0;
+	frame_bytes = 0;
+
+	if (frame_budget && budget == 0)
+		return false;
+
+	schedule_until(batch, UINT64_MAX, budget, overshoot);
+	return !batch.copies.empty();
+}
+
+bool UploadScheduler::schedule_required(Batch &batch)
+{
+	batch.clear();
+	if (!has_required_uploads())
+		return false;
+
+	schedule_until(batch, last_required, 0, true);
+	frame_bytes += batch.bytes;
+	return true;
+}
+
+void UploadScheduler::schedule_until(Batch &batch, uint64_t ticket, uint64_t budget, bool overshoot)
+{
+	uint32_t current_block = UINT32_MAX;
+	uint64_t current_offset = 0;
+
+	while (!pending.empty() && last_scheduled < ticket)
+	{
+		auto &upload = pending.front();
+		if (budget && (!batch.copies.empty() || !overshoot) && batch.bytes + upload.size > budget)
+			break;
+
+		Copy copy = {};
+		copy.ticket = last_scheduled + 1;
+		copy.size = upload.size;
+
+		uint64_t aligned_offset = (current_offset + upload.alignment - 1) / upload.alignment * upload.alignment;
+
+		if (upload.size > block_size)
+		{
+			// Dedicated block. Keep filling the current block afterwards.
+			copy.block = uint32_t(batch.block_sizes.size());
+			copy.offset = 0;
+			batch.block_sizes.push_back(upload.size);
+		}
+		else if (current_block != UINT32_MAX && aligned_offset + upload.size <= block_size)
+		{
+			copy.block = current_block;
+			copy.offset = aligned_offset;
+			current_offset = aligned_offset + upload.size;
+		}
+		else
+		{
+			current_block = uint32_t(batch.block_sizes.size());
+			batch.block_sizes.push_back(block_size);
+			copy.block = current_block;
+			copy.offset = 0;
+			current_offset = upload.size;
+		}
+
+		batch.copies.push_back(copy);
+		batch.bytes += upload.size;
+		pending_bytes -= upload.size;
+		last_scheduled++;
+		pending.pop_front();
+	}
+}
+}
@@ -0,0 +1,102 @@
+/* Copyright (c) 2017-2022 Hans-Kristian Arntzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <deque>
+
+namespace Vulkan
+{
+// Decides where pending uploads land in staging memory and which uploads go out in a given frame.
+// Uploads are packed back to back into fixed size blocks, and uploads which are larger than
+// a block get a dedicated block. Uploads are always scheduled in FIFO order,
+// so a ticket is submitted once every ticket before it is.
+// Does not touch any Vulkan objects, so it can be tested without a device.
+class UploadScheduler
+{
+public:
+	struct Copy
+	{
+		uint64_t ticket;
+		uint32_t block;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	struct Batch
+	{
+		std::vector<Copy> copies;
+		// Size of each staging block the copies in this batch refer to.
+		std::vector<uint64_t> block_sizes;
+		uint64_t bytes = 0;
+
+		void clear();
+	};
+
+	void set_block_size(uint64_t size);
+	// 0 means no budget. At least one upload is scheduled per frame,
+	// even if it exceeds the budget on its own, so large uploads cannot stall forever.
+	void set_frame_budget(uint64_t bytes);
+
+	// Returns a ticket which increases monotonically, starting at 1.
+	// Required uploads cannot be deferred by the budget, see schedule_required().
+	uint64_t push(uint64_t size, uint64_t alignment, bool required = false);
+
+	// Schedules one frame's worth of uploads, and starts a new frame for budget purposes.
+	// Bytes already scheduled by schedule_required() in this frame count towards the budget.
+	// Returns false if there was nothing to schedule.
+	bool schedule(Batch &batch);
+
+	// Schedules everything up to and including the last required upload, ignoring the budget.
+	// May be called any number of times within a frame. Returns false if there was nothing to schedule.
+	bool schedule_required(Batch &batch);
+	bool has_required_uploads() const;
+
+	bool is_scheduled(uint64_t ticket) const;
+	uint64_t get_pending_bytes() const;
+	size_t get_pending_count() const;
+
+private:
+	struct Pending
+	{
+		uint64_t size;
+		uint64_t alignment;
+	};
+
+	// Front belongs to ticket last_scheduled + 1.
+	std::deque<Pending> pending;
+	uint64_t pending_bytes = 0;
+	uint64_t last_scheduled = 0;
+	uint64_t next_ticket = 1;
+	uint64_t last_required = 0;
+	uint64_t frame_bytes = 0;
+
+	uint64_t block_size = 8 * 1024 * 1024;
+	uint64_t frame_budget = 0;
+
+	void schedule_until(Batch &batch, uint64_t ticket, uint64_t budget, bool overshoot);
+};
+}
@@ -53,6 +53,22 @@ WSI::WSI()
 		LOGI("Overriding VK_KHR_present_wait latency to %u frames.\n", present_frame_latency);
 	}
 
+	// GRANITE_VULKAN_FRAME_PACING=1 paces to the display refresh rate.
+	// GRANITE_VULKAN_FRAME_PACING_FPS optionally overrides the target frame rate.
+	env = getenv("GRANITE_VULKAN_FRAME_PACING");
+	if (env && strtoul(env, nullptr, 0) != 0)
+	{
+		double target_fps = 0.0;
+		if (const char *fps_env = getenv("GRANITE_VULKAN_FRAME_PACING_FPS"))
+			target_fps = strtod(fps_env, nullptr);
+
+		if (target_fps > 0.0)
+			LOGI("Enabling frame pacing, target %.3f fps.\n", target_fps);
+		else
+			LOGI("Enabling frame pacing, target display refresh rate.\n");
+		set_frame_pacing(true, target_fps > 0.0 ? target_fps : 0.0);
+	}
+
 	// Primaries are ST.2020 with D65 whitepoint as specified.
 	hdr_metadata.displayPrimaryRed = { 0.708f, 0.292f };
 	hdr_metadata.displayPrimaryGreen = { 0.170f, 0.797f };
@@ -108,6 +124,14 @@ double WSI::get_smooth_frame_time() const
 	return smooth_frame_time;
 }
 
+void WSI::set_frame_pacing(bool enable, double target_fps)
+{
+	frame_pacing = enable;
+	frame_pacer.set_target_frame_rate(target_fps);
+	frame_pacer.reset();
+	frame_pacer_in_frame = false;
+}
+
 bool WSI::init_from_existing_context(ContextHandle existing_context)
 {
 	VK_ASSERT(platform);
@@ -352,6 +376,9 @@ void WSI::tear_down_swapchain()
 	has_acquired_swapchain_index = false;
 	present_id = 0;
 	present_last_id = 0;
+	frame_pacer.reset();
+	frame_pacer_in_frame = false;
+	frame_pacer_observed_present_id = 0;
 }
 
 void WSI::deinit_surface_and_swapchain()
@@ -411,8 +438,49 @@ Semaphore WSI::consume_external_release_semaphore()
 
 //#define VULKAN_WSI_TIMING_DEBUG
 
+void WSI::wait_frame_pacing()
+{
+	// Wait for the latest present rather than an older one, so that we observe when it actually
+	// hit the display. The pacer needs that to find the vblank grid.
+	// If the last frame did not present, that present has already been observed,
+	// and a completion timestamp taken now would not line up with vblank.
+	auto wait_ts = device->write_calibrated_timestamp();
+	if (present_last_id != frame_pacer_observed_present_id)
+	{
+		VkResult wait_result = table->vkWaitForPresentKHR(context->get_device(), swapchain, present_last_id, UINT64_MAX);
+		if (wait_result == VK_SUCCESS)
+		{
+			frame_pacer.present_complete(Util::get_current_time_nsecs());
+			frame_pacer_observed_present_id = present_last_id;
+		}
+		else
+		{
+			LOGE("vkWaitForPresentKHR failed, vr %d.\n", wait_result);
+			frame_pacer.reset();
+		}
+	}
+
+	auto now = Util::get_current_time_nsecs();
+	auto start = frame_pacer.compute_frame_start_time(now);
+	if (start > now)
+		std::this_thread::sleep_for(std::chrono::nanoseconds(start - now));
+	device->register_time_interval("WSI", std::move(wait_ts),
+	                               device->write_calibrated_timestamp(), "wait_frame_pacing");
+
+	frame_pacer.begin_frame(Util::get_current_time_nsecs());
+	frame_pacer_in_frame = true;
+}
+
 void WSI::wait_swapchain_latency()
 {
+	if (frame_pacing && present_last_id &&
+	    device->get_device_features().present_wait_features.presentWait &&
+	    current_present_mode == PresentMode::SyncToVBlank)
+	{
+		wait_frame_pacing();
+		return;
+	}
+
 	if (device->get_device_features().present_wait_features.presentWait &&
 	    present_last_id > present_frame_latency &&
 	    current_present_mode == PresentMode::SyncToVBlank)
@@ -567,7 +635,15 @@ bool WSI::end_frame()
 	else
 	{
 		if (!device->swapchain_touched())
+		{
+			// Nothing to present, so the pacer cannot track this frame.
+			if (frame_pacer_in_frame)
+			{
+				frame_pacer.reset();
+				frame_pacer_in_frame = false;
+			}
 			return true;
+		}
 
 		has_acquired_swapchain_index = false;
 
@@ -621,6 +697,9 @@ bool WSI::end_frame()
 		auto present_start = Util::get_current_time_nsecs();
 #endif
 
+		if (frame_pacer_in_frame)
+			frame_pacer.end_frame(Util::get_current_time_nsecs());
+
 		auto present_ts = device->write_calibrated_timestamp();
 
 #if defined(ANDROID) && defined(HAVE_SWAPPY)
@@ -660,6 +739,11 @@ bool WSI::end_frame()
 			present_last_id = present_id;
 		}
 
+		// If the present did not go through, the pacer would pair up the wrong present with this frame.
+		if (frame_pacer_in_frame && present_last_id != present_id)
+			frame_pacer.reset();
+		frame_pacer_in_frame = false;
+
 		if (overall == VK_SUBOPTIMAL_KHR || result == VK_SUBOPTIMAL_KHR)
 		{
 #ifdef VULKAN_DEBUG
@@ -1389,6 +1473,9 @@ WSI::SwapchainError WSI::init_swapchain(unsigned width, unsigned height)
 	has_acquired_swapchain_index = false;
 	present_id = 0;
 	present_last_id = 0;
+	frame_pacer.reset();
+	frame_pacer_in_frame = false;
+	frame_pacer_observed_present_id = 0;
 
 	active_present_mode = info.presentMode;
 	present_mode_compat_group = std::move(surface_info.present_mode_compat_group);
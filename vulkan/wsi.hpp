@@ -26,6 +26,7 @@
 #include "semaphore_manager.hpp"
 #include "vulkan_headers.hpp"
 #include "timer.hpp"
+#include "frame_pacer.hpp"
 #include <vector>
 #include <thread>
 #include <chrono>
@@ -263,6 +264,21 @@ public:
 	double get_smooth_frame_time() const;
 	double get_smooth_elapsed_time() const;
 
+	// Defers the start of each frame so it completes just in time for its vblank, which minimizes input latency.
+	// Only takes effect with VK_KHR_present_wait and SyncToVBlank.
+	// Frames are not pipelined across vblanks while pacing, so CPU + GPU time must fit in the target interval.
+	// A target_fps of 0 paces to the display refresh rate.
+	void set_frame_pacing(bool enable, double target_fps = 0.0);
+	inline bool get_frame_pacing() const
+	{
+		return frame_pacing;
+	}
+
+	inline const FramePacer::Statistics &get_frame_pacing_statistics() const
+	{
+		return frame_pacer.get_statistics();
+	}
+
 private:
 	void update_framebuffer(unsigned width, unsigned height);
 
@@ -326,9 +342,16 @@ private:
 	uint64_t present_last_id = 0;
 	unsigned present_frame_latency = 0;
 
+	FramePacer frame_pacer;
+	bool frame_pacing = false;
+	bool frame_pacer_in_frame = false;
+	// Last present ID whose completion was fed to the pacer.
+	uint64_t frame_pacer_observed_present_id = 0;
+
 	void tear_down_swapchain();
 	void drain_swapchain(bool in_tear_down);
 	void wait_swapchain_latency();
+	void wait_frame_pacing();
 
 	VkHdrMetadataEXT hdr_metadata = { VK_STRUCTURE_TYPE_HDR_METADATA_EXT };
 